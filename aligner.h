@@ -16,6 +16,7 @@
 #include "assert_helpers.h"
 #include "ds.h"
 #include "ebwt.h"
+#include "ebwt_search_pigeonhole.h"
 #include "pat.h"
 #include "range.h"
 #include "range_chaser.h"
@@ -396,7 +397,8 @@ public:
 		int maxBts,
 		ChunkPool *pool,
 		int *btCnt = NULL,
-		AlignerMetrics *metrics = NULL) :
+		AlignerMetrics *metrics = NULL,
+		PigeonholeSearch *pigeon = NULL) :
 		Aligner(true, rangeMode),
 		doneFirst_(true),
 		firstIsFw_(true),
@@ -412,7 +414,8 @@ public:
 		maxBts_(maxBts),
 		pool_(pool),
 		btCnt_(btCnt),
-		metrics_(metrics)
+		metrics_(metrics),
+		pigeon_(pigeon)
 	{
 		assert(pool_   != NULL);
 		assert(sinkPt_ != NULL);
@@ -421,6 +424,7 @@ public:
 	}
 
 	virtual ~UnpairedAlignerV2() {
+		delete pigeon_;  pigeon_  = NULL;
 		delete driver_;  driver_  = NULL;
 		delete params_;  params_  = NULL;
 		delete rchase_;  rchase_  = NULL;
@@ -446,6 +450,20 @@ public:
 			sinkPt_->finishRead(*patsrc_, true, true);
 			return;
 		}
+		if(sinkPt_->replayCopy(*patsrc)) {
+			// Aligned a copy of this read already (--dedup)
+			this->done = true;
+			sinkPt_->finishRead(*patsrc_, true, true);
+			return;
+		}
+		if(pigeon_ != NULL && pigeon_->align(patsrc->bufa())) {
+			// Found the read's only alignment, or that it has
+			// none, without backtracking (--pigeonhole)
+			pigeon_->report(patsrc->bufa(), *params_);
+			this->done = true;
+			sinkPt_->finishRead(*patsrc_, true, true);
+			return;
+		}
 		driver_->setQuery(patsrc, NULL);
 		this->done = driver_->done;
 		doneFirst_ = false;
@@ -596,6 +614,9 @@ protected:
 	ChunkPool *pool_;
 	int *btCnt_;
 	AlignerMetrics *metrics_;
+
+	// Aligns reads without the driver when it can (--pigeonhole)
+	PigeonholeSearch *pigeon_;
 };
 
 /**
@@ -43,7 +43,8 @@ public:
 			bool rangeMode,
 			bool verbose,
 			bool quiet,
-			uint32_t seed) :
+			uint32_t seed,
+			bool pigeonhole = false) :
 			ebwtFw_(ebwtFw),
 			ebwtBw_(ebwtBw),
 			two_(two),
@@ -61,7 +62,8 @@ public:
 			strandFix_(strandFix),
 			rangeMode_(rangeMode),
 			verbose_(verbose),
-			quiet_(quiet)
+			quiet_(quiet),
+			pigeonhole_(pigeonhole)
 	{
 		assert(ebwtFw.isInMemory());
 		assert(ebwtBw != NULL);
@@ -214,10 +216,20 @@ public:
 		RangeChaser *rchase =
 			new RangeChaser(cacheLimit_, cacheFw_, cacheBw_);
 
+		// Try exact-part filtering before backtracking (--pigeonhole)
+		PigeonholeSearch *pigeon = NULL;
+		if(pigeonhole_ && !rangeMode_ &&
+		   PigeonholeSearch::usable(ebwtFw_, refs_))
+		{
+			pigeon = new PigeonholeSearch(
+				ebwtFw_, *refs_, two_ ? 2 : 3, doFw_, doRc_, maqPenalty_);
+		}
+
 		return new UnpairedAlignerV2<EbwtRangeSource>(
 			params, dr, rchase,
 			sink_, sinkPtFactory_, sinkPt, os_, refs_,
-			rangeMode_, verbose_, quiet_, INT_MAX, pool_, NULL, NULL);
+			rangeMode_, verbose_, quiet_, INT_MAX, pool_, NULL, NULL,
+			pigeon);
 	}
 
 private:
@@ -240,6 +252,7 @@ private:
 	const bool rangeMode_;
 	const bool verbose_;
 	const bool quiet_;
+	const bool pigeonhole_;
 };
 
 /**
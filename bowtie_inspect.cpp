@@ -386,7 +386,8 @@ void print_index_summary(
 		cout << "refs.numRefs()" << '\t' << refs.numRefs() << endl;
 		cout << "refs.numNonGapRefs()" << '\t' << refs.numNonGapRefs() << endl;
 	}
-	cout << "SA-Sample" << "\t1 in " << (1 << ebwt.eh().offRate()) << endl;
+	cout << "SA-Sample" << "\t1 in " << (1 << ebwt.eh().offRate())
+	     << (ebwt.textSampled() ? " ref offsets" : "") << endl;
 	cout << "FTab-Chars" << '\t' << ebwt.eh().ftabChars() << endl;
 	for(size_t i = 0; i < ebwt.nPat(); i++) {
 		cout << "Sequence-" << (i+1)
@@ -0,0 +1,222 @@
+/*
+ * ccnt.cpp
+ *
+ * Character-counting kernels for Ebwt sides; see ccnt.h.
+ */
+
+#include <stdint.h>
+#include "assert_helpers.h"
+#include "ccnt.h"
+
+#ifdef CCNT_X86_KERNELS
+#include <immintrin.h>
+#include "processor_support.h"
+
+// 32 bytes of 0xff followed by 32 bytes of 0x00; an unaligned load at
+// offset 32-n yields a mask selecting the first n bytes of a vector
+static const uint8_t prefixMaskTbl[64] __attribute__((aligned(64))) = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+__attribute__((target("avx2")))
+static inline __m256i prefixMask256(int nbytes) {
+	if(nbytes >= 32) return _mm256_set1_epi8((char)0xff);
+	return _mm256_loadu_si256((const __m256i*)(prefixMaskTbl + 32 - nbytes));
+}
+
+/**
+ * Per-byte population count via a nibble lookup table (AVX2 has no
+ * vector popcount instruction).
+ */
+__attribute__((target("avx2")))
+static inline __m256i popcnt8x32(__m256i v) {
+	const __m256i lut = _mm256_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i lo4 = _mm256_set1_epi8(0x0f);
+	__m256i lo = _mm256_and_si256(v, lo4);
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lo4);
+	return _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+	                       _mm256_shuffle_epi8(lut, hi));
+}
+
+/**
+ * Sum the bytes of v.
+ */
+__attribute__((target("avx2")))
+static inline TIndexOffU hsum8x32(__m256i v) {
+	__m256i s = _mm256_sad_epu8(v, _mm256_setzero_si256());
+	__m128i t = _mm_add_epi64(_mm256_castsi256_si128(s),
+	                          _mm256_extracti128_si256(s, 1));
+	t = _mm_add_epi64(t, _mm_unpackhi_epi64(t, t));
+	return (TIndexOffU)_mm_cvtsi128_si64(t);
+}
+
+/**
+ * AVX2 kernel: 128 characters per iteration.  Each byte of a match
+ * vector holds at most 4 set bits, so per-byte counts can be
+ * accumulated for a whole side (< 64 iterations) before reducing.
+ */
+__attribute__((target("avx2")))
+TIndexOffU occCountUpToAvx2(const uint8_t *side, int by, int c) {
+	const __m256i m1 = _mm256_set1_epi8(0x55);
+	const __m256i c0 = _mm256_set1_epi64x((long long)occCTable[c]);
+	__m256i acc = _mm256_setzero_si256();
+	for(int i = 0; i < by; i += 32) {
+		__m256i x0 = _mm256_xor_si256(
+			_mm256_loadu_si256((const __m256i*)(side + i)), c0);
+		__m256i x = _mm256_and_si256(
+			_mm256_and_si256(x0, _mm256_srli_epi64(x0, 1)), m1);
+		x = _mm256_and_si256(x, prefixMask256(by - i));
+		acc = _mm256_add_epi8(acc, popcnt8x32(x));
+	}
+	return hsum8x32(acc);
+}
+
+__attribute__((target("avx2")))
+void occCountUpToExAvx2(const uint8_t *side, int by, TIndexOffU *arrs) {
+	const __m256i m1 = _mm256_set1_epi8(0x55);
+	__m256i accLo = _mm256_setzero_si256();
+	__m256i accHi = _mm256_setzero_si256();
+	__m256i accT  = _mm256_setzero_si256();
+	for(int i = 0; i < by; i += 32) {
+		__m256i dw = _mm256_and_si256(
+			_mm256_loadu_si256((const __m256i*)(side + i)),
+			prefixMask256(by - i));
+		__m256i lo = _mm256_and_si256(dw, m1);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi64(dw, 1), m1);
+		accLo = _mm256_add_epi8(accLo, popcnt8x32(lo));
+		accHi = _mm256_add_epi8(accHi, popcnt8x32(hi));
+		accT  = _mm256_add_epi8(accT,  popcnt8x32(_mm256_and_si256(lo, hi)));
+	}
+	TIndexOffU nlo = hsum8x32(accLo);
+	TIndexOffU nhi = hsum8x32(accHi);
+	TIndexOffU nt  = hsum8x32(accT);
+	arrs[0] += ((TIndexOffU)by << 2) - nlo - nhi + nt;
+	arrs[1] += nlo - nt;
+	arrs[2] += nhi - nt;
+	arrs[3] += nt;
+}
+
+#define CCNT_AVX512_TARGET "avx512f,avx512bw,avx512vpopcntdq"
+
+// Some GCC versions warn spuriously about the _mm512_undefined_*()
+// placeholders used inside their own AVX-512 intrinsic headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+/**
+ * AVX-512 kernel: 256 characters per iteration.  Masked loads never
+ * fault on the masked-out bytes, so this kernel never reads past 'by'.
+ */
+__attribute__((target(CCNT_AVX512_TARGET)))
+TIndexOffU occCountUpToAvx512(const uint8_t *side, int by, int c) {
+	const __m512i m1 = _mm512_set1_epi8(0x55);
+	const __m512i c0 = _mm512_set1_epi64((long long)occCTable[c]);
+	__m512i acc = _mm512_setzero_si512();
+	for(int i = 0; i < by; i += 64) {
+		int rem = by - i;
+		__mmask64 k = (rem >= 64) ? ~0llu : ((1llu << rem) - 1);
+		__m512i x0 = _mm512_xor_si512(_mm512_maskz_loadu_epi8(k, side + i), c0);
+		__m512i x = _mm512_and_si512(
+			_mm512_and_si512(x0, _mm512_srli_epi64(x0, 1)), m1);
+		// Masked-out bytes were loaded as zeroes, which look like As
+		x = _mm512_maskz_mov_epi8(k, x);
+		acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+	}
+	return (TIndexOffU)_mm512_reduce_add_epi64(acc);
+}
+
+__attribute__((target(CCNT_AVX512_TARGET)))
+void occCountUpToExAvx512(const uint8_t *side, int by, TIndexOffU *arrs) {
+	const __m512i m1 = _mm512_set1_epi8(0x55);
+	__m512i accLo = _mm512_setzero_si512();
+	__m512i accHi = _mm512_setzero_si512();
+	__m512i accT  = _mm512_setzero_si512();
+	for(int i = 0; i < by; i += 64) {
+		int rem = by - i;
+		__mmask64 k = (rem >= 64) ? ~0llu : ((1llu << rem) - 1);
+		__m512i dw = _mm512_maskz_loadu_epi8(k, side + i);
+		__m512i lo = _mm512_and_si512(dw, m1);
+		__m512i hi = _mm512_and_si512(_mm512_srli_epi64(dw, 1), m1);
+		accLo = _mm512_add_epi64(accLo, _mm512_popcnt_epi64(lo));
+		accHi = _mm512_add_epi64(accHi, _mm512_popcnt_epi64(hi));
+		accT  = _mm512_add_epi64(accT,  _mm512_popcnt_epi64(_mm512_and_si512(lo, hi)));
+	}
+	TIndexOffU nlo = (TIndexOffU)_mm512_reduce_add_epi64(accLo);
+	TIndexOffU nhi = (TIndexOffU)_mm512_reduce_add_epi64(accHi);
+	TIndexOffU nt  = (TIndexOffU)_mm512_reduce_add_epi64(accT);
+	arrs[0] += ((TIndexOffU)by << 2) - nlo - nhi + nt;
+	arrs[1] += nlo - nt;
+	arrs[2] += nhi - nt;
+	arrs[3] += nt;
+}
+
+#pragma GCC diagnostic pop
+
+#else
+
+// Never picked without x86 support; only here to be linked against
+
+TIndexOffU occCountUpToAvx2(const uint8_t *side, int by, int c) {
+	return occCountUpToScalar<USE_POPCNT_GENERIC>(side, by, c);
+}
+
+void occCountUpToExAvx2(const uint8_t *side, int by, TIndexOffU *arrs) {
+	occCountUpToExScalar<USE_POPCNT_GENERIC>(side, by, arrs);
+}
+
+TIndexOffU occCountUpToAvx512(const uint8_t *side, int by, int c) {
+	return occCountUpToScalar<USE_POPCNT_GENERIC>(side, by, c);
+}
+
+void occCountUpToExAvx512(const uint8_t *side, int by, TIndexOffU *arrs) {
+	occCountUpToExScalar<USE_POPCNT_GENERIC>(side, by, arrs);
+}
+
+#endif /* CCNT_X86_KERNELS */
+
+/**
+ * CPU features are probed once per process; the choice among the
+ * kernels the CPU supports is then a function of the side shape.
+ */
+OccCountKernels selectOccCountKernels(uint32_t sideBwtSz, uint32_t sideSz) {
+	// Scalar kernels read whole 64-bit words
+	assert_eq(0, sideBwtSz & 7);
+#ifdef CCNT_X86_KERNELS
+	static ProcessorSupport ps;
+	static const bool popcnt = ps.POPCNTenabled();
+	static const bool avx2   = popcnt && ps.AVX2enabled();
+	static const bool avx512 = popcnt && ps.AVX512enabled();
+	if(avx512) {
+		OccCountKernels k = {
+			"AVX-512", OCC_KERNEL_AVX512,
+			occCountUpToAvx512, occCountUpToExAvx512 };
+		return k;
+	}
+	if(avx2 && ((sideBwtSz + 31) & ~31u) <= sideSz) {
+		OccCountKernels k = {
+			"AVX2", OCC_KERNEL_AVX2,
+			occCountUpToAvx2, occCountUpToExAvx2 };
+		return k;
+	}
+	if(popcnt) {
+		OccCountKernels k = {
+			"POPCNT", OCC_KERNEL_POPCNT,
+			occCountUpToScalar<USE_POPCNT_INSTRUCTION>,
+			occCountUpToExScalar<USE_POPCNT_INSTRUCTION> };
+		return k;
+	}
+#endif
+	OccCountKernels k = {
+		"generic", OCC_KERNEL_GENERIC,
+		occCountUpToScalar<USE_POPCNT_GENERIC>,
+		occCountUpToExScalar<USE_POPCNT_GENERIC> };
+	return k;
+}
@@ -0,0 +1,256 @@
+/*
+ * ccnt.h
+ *
+ * Kernels for counting occurrences of DNA characters within an Ebwt
+ * side.  These sit underneath Ebwt::countUpTo() and
+ * Ebwt::countUpToEx(), i.e. underneath every LF step.  Several
+ * implementations are provided (generic bit-bashing, POPCNT, AVX2 and
+ * AVX-512) and the fastest one the host CPU supports is picked once,
+ * when the Ebwt is opened, rather than being re-decided on every call.
+ *
+ * The search engines are compiled once per kernel (see OccKernel and
+ * EBWT_LF in ebwt.h), so the scalar kernels are inlined into their LF
+ * steps and the vector kernels are called directly.  The vector
+ * kernels are compiled for their own instruction sets and so can't be
+ * inlined into code that isn't.
+ */
+
+#ifndef CCNT_H_
+#define CCNT_H_
+
+#include <stdint.h>
+#include <string>
+#include "assert_helpers.h"
+#include "btypes.h"
+
+#if defined(POPCNT_CAPABILITY) && defined(__GNUC__) && defined(__x86_64__)
+#define CCNT_X86_KERNELS
+#endif
+
+/**
+ * Occurrence-counting kernels.  OCC_KERNEL_ANY means whichever one
+ * was picked at run time, called through OccCountKernels.
+ */
+enum OCC_KERNELS {
+	OCC_KERNEL_ANY = 0,
+	OCC_KERNEL_GENERIC,
+	OCC_KERNEL_POPCNT,
+	OCC_KERNEL_AVX2,
+	OCC_KERNEL_AVX512
+};
+
+/**
+ * Count occurrences of character c (0-3) in the first 'by' bytes of
+ * 'side'.  Bytes at and beyond 'by' may be read but are not counted.
+ */
+typedef TIndexOffU (*CountUpToFn)(const uint8_t *side, int by, int c);
+
+/**
+ * Add the number of occurrences of each of A, C, G and T in the first
+ * 'by' bytes of 'side' to arrs[0], arrs[1], arrs[2] and arrs[3].
+ */
+typedef void (*CountUpToExFn)(const uint8_t *side, int by, TIndexOffU *arrs);
+
+/**
+ * A matched pair of counting kernels plus a human-readable name for
+ * verbose output.
+ */
+struct OccCountKernels {
+	const char    *name;
+	int            kernel;  /// which of OCC_KERNELS
+	CountUpToFn    countUpTo;
+	CountUpToExFn  countUpToEx;
+};
+
+/**
+ * Return the fastest pair of kernels supported by this CPU that is
+ * safe to use with sides of the given shape.  Vector kernels read
+ * whole vectors, so they're only chosen when rounding the BWT portion
+ * of a side up to a vector boundary stays within the side.
+ */
+extern OccCountKernels selectOccCountKernels(uint32_t sideBwtSz, uint32_t sideSz);
+
+// Vector kernels; see ccnt.cpp
+extern TIndexOffU occCountUpToAvx2(const uint8_t *side, int by, int c);
+extern void occCountUpToExAvx2(const uint8_t *side, int by, TIndexOffU *arrs);
+extern TIndexOffU occCountUpToAvx512(const uint8_t *side, int by, int c);
+extern void occCountUpToExAvx512(const uint8_t *side, int by, TIndexOffU *arrs);
+
+static const uint64_t OCC_M1 = 0x5555555555555555llu;
+
+static const uint64_t occCTable[4] = {
+	0xffffffffffffffffllu,
+	0xaaaaaaaaaaaaaaaallu,
+	0x5555555555555555llu,
+	0x0000000000000000llu
+};
+
+// Use this standard bit-bashing population count
+struct USE_POPCNT_GENERIC {
+	inline static int pop64(uint64_t x) {
+		x = x - ((x >> 1) & 0x5555555555555555llu);
+		x = (x & 0x3333333333333333llu) + ((x >> 2) & 0x3333333333333333llu);
+		x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Fllu;
+		x = x + (x >> 8);
+		x = x + (x >> 16);
+		x = x + (x >> 32);
+		return x & 0x3F;
+	}
+};
+
+#ifdef CCNT_X86_KERNELS
+struct USE_POPCNT_INSTRUCTION {
+	inline static int pop64(uint64_t x) {
+		int64_t count;
+		asm ("popcntq %[x],%[count]\n": [count] "=&r" (count): [x] "r" (x));
+		return count;
+	}
+};
+#else
+typedef USE_POPCNT_GENERIC USE_POPCNT_INSTRUCTION;
+#endif
+
+/**
+ * Mask selecting the first 'nbytes' (0-7) bytes of a little-endian
+ * 64-bit word.
+ */
+static inline uint64_t occByteMask(int nbytes) {
+	assert_lt(nbytes, 8);
+	return (1llu << (nbytes << 3)) - 1;
+}
+
+/**
+ * Count occurrences of c in the 32 bit-pairs of dw.
+ */
+template<typename Operation>
+static inline TIndexOffU occCountInU64(int c, uint64_t dw) {
+	uint64_t x0 = dw ^ occCTable[c];
+	return Operation::pop64(x0 & (x0 >> 1) & OCC_M1);
+}
+
+/**
+ * Add the number of occurrences of each character in the 32 bit-pairs
+ * of dw to arrs[].  With lo = the low bit of every bit-pair and hi =
+ * the high bit, Ts are lo&hi, Gs are hi minus Ts, Cs are lo minus Ts
+ * and As are whatever is left over.
+ */
+template<typename Operation>
+static inline void occCountInU64Ex(uint64_t dw, TIndexOffU *arrs) {
+	uint64_t lo = dw & OCC_M1;
+	uint64_t hi = (dw >> 1) & OCC_M1;
+	TIndexOffU nlo = Operation::pop64(lo);
+	TIndexOffU nhi = Operation::pop64(hi);
+	TIndexOffU nt  = Operation::pop64(lo & hi);
+	arrs[0] += 32 - nlo - nhi + nt;
+	arrs[1] += nlo - nt;
+	arrs[2] += nhi - nt;
+	arrs[3] += nt;
+}
+
+/**
+ * Scalar kernel: count c 64 bits at a time.  The trailing partial word
+ * is masked rather than walked byte-by-byte through a LUT.  Note that
+ * the mask must be applied to the match flags, not to the BWT word,
+ * since zeroed bit-pairs would otherwise count as As.
+ */
+template<typename Operation>
+static inline TIndexOffU occCountUpToScalar(const uint8_t *side, int by, int c) {
+	const uint64_t c0 = occCTable[c];
+	TIndexOffU cCnt = 0;
+	int i = 0;
+	for(; i + 8 <= by; i += 8) {
+		uint64_t x0 = *(const uint64_t*)&side[i] ^ c0;
+		cCnt += Operation::pop64(x0 & (x0 >> 1) & OCC_M1);
+	}
+	if(i < by) {
+		uint64_t x0 = *(const uint64_t*)&side[i] ^ c0;
+		cCnt += Operation::pop64(x0 & (x0 >> 1) & OCC_M1 & occByteMask(by - i));
+	}
+	return cCnt;
+}
+
+/**
+ * Scalar kernel: count all four characters with three population
+ * counts per word, as in occCountInU64Ex().
+ */
+template<typename Operation>
+static inline void occCountUpToExScalar(const uint8_t *side, int by, TIndexOffU *arrs) {
+	TIndexOffU nlo = 0, nhi = 0, nt = 0;
+	int i = 0;
+	for(; i < by; i += 8) {
+		uint64_t dw = *(const uint64_t*)&side[i];
+		if(i + 8 > by) dw &= occByteMask(by - i);
+		uint64_t lo = dw & OCC_M1;
+		uint64_t hi = (dw >> 1) & OCC_M1;
+		nlo += Operation::pop64(lo);
+		nhi += Operation::pop64(hi);
+		nt  += Operation::pop64(lo & hi);
+	}
+	arrs[0] += ((TIndexOffU)by << 2) - nlo - nhi + nt;
+	arrs[1] += nlo - nt;
+	arrs[2] += nhi - nt;
+	arrs[3] += nt;
+}
+
+/**
+ * Kernel K (one of OCC_KERNELS) as a compile-time choice.  'Pop' is
+ * the population count to use for odd words alongside it.  The
+ * primary template is OCC_KERNEL_ANY and goes through the kernels
+ * picked at run time.
+ */
+template<int K>
+struct OccKernel {
+	typedef USE_POPCNT_GENERIC Pop;
+	static inline TIndexOffU countUpTo(const OccCountKernels& k, const uint8_t *side, int by, int c) {
+		return k.countUpTo(side, by, c);
+	}
+	static inline void countUpToEx(const OccCountKernels& k, const uint8_t *side, int by, TIndexOffU *arrs) {
+		k.countUpToEx(side, by, arrs);
+	}
+};
+
+template<>
+struct OccKernel<OCC_KERNEL_GENERIC> {
+	typedef USE_POPCNT_GENERIC Pop;
+	static inline TIndexOffU countUpTo(const OccCountKernels&, const uint8_t *side, int by, int c) {
+		return occCountUpToScalar<Pop>(side, by, c);
+	}
+	static inline void countUpToEx(const OccCountKernels&, const uint8_t *side, int by, TIndexOffU *arrs) {
+		occCountUpToExScalar<Pop>(side, by, arrs);
+	}
+};
+
+template<>
+struct OccKernel<OCC_KERNEL_POPCNT> {
+	typedef USE_POPCNT_INSTRUCTION Pop;
+	static inline TIndexOffU countUpTo(const OccCountKernels&, const uint8_t *side, int by, int c) {
+		return occCountUpToScalar<Pop>(side, by, c);
+	}
+	static inline void countUpToEx(const OccCountKernels&, const uint8_t *side, int by, TIndexOffU *arrs) {
+		occCountUpToExScalar<Pop>(side, by, arrs);
+	}
+};
+
+template<>
+struct OccKernel<OCC_KERNEL_AVX2> {
+	typedef USE_POPCNT_INSTRUCTION Pop;
+	static inline TIndexOffU countUpTo(const OccCountKernels&, const uint8_t *side, int by, int c) {
+		return occCountUpToAvx2(side, by, c);
+	}
+	static inline void countUpToEx(const OccCountKernels&, const uint8_t *side, int by, TIndexOffU *arrs) {
+		occCountUpToExAvx2(side, by, arrs);
+	}
+};
+
+template<>
+struct OccKernel<OCC_KERNEL_AVX512> {
+	typedef USE_POPCNT_INSTRUCTION Pop;
+	static inline TIndexOffU countUpTo(const OccCountKernels&, const uint8_t *side, int by, int c) {
+		return occCountUpToAvx512(side, by, c);
+	}
+	static inline void countUpToEx(const OccCountKernels&, const uint8_t *side, int by, TIndexOffU *arrs) {
+		occCountUpToExAvx512(side, by, arrs);
+	}
+};
+
+#endif /* CCNT_H_ */
@@ -1,9 +1,101 @@
 #include "cpu_numa_info.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
+
 /// Based on http://stackoverflow.com/questions/16862620/numa-get-current-node-core
 void get_cpu_and_node_(int& cpu, int& node) {
+#if defined(__x86_64__) || defined(__i386__)
 	unsigned long a,d,c;
 	__asm__ volatile("rdtscp" : "=a" (a), "=d" (d), "=c" (c));
 	node = (c & 0xFFF000)>>12;
 	cpu = c & 0xFFF;
+#else
+	node = cpu = 0;
+#endif
+}
+
+#ifdef __linux__
+/**
+ * Read the CPU list of the given node from sysfs, e.g. "0-7,16-23".
+ * Return an empty string if there is none.
+ */
+static std::string numa_node_cpulist(int node) {
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	FILE *f = fopen(path, "r");
+	if(f == NULL) return std::string();
+	char buf[4096];
+	std::string ret;
+	if(fgets(buf, sizeof(buf), f) != NULL) {
+		ret = buf;
+		while(!ret.empty() && (ret[ret.length()-1] == '\n' || ret[ret.length()-1] == ' ')) {
+			ret.erase(ret.length()-1);
+		}
+	}
+	fclose(f);
+	return ret;
+}
+#endif
+
+void numa_nodes_with_cpus(std::vector<int>& nodes) {
+	nodes.clear();
+#ifdef __linux__
+	DIR *dir = opendir("/sys/devices/system/node");
+	if(dir != NULL) {
+		struct dirent *ent;
+		while((ent = readdir(dir)) != NULL) {
+			const char *name = ent->d_name;
+			if(strncmp(name, "node", 4) != 0 || name[4] < '0' || name[4] > '9') {
+				continue;
+			}
+			int node = atoi(name + 4);
+			// Skip memory-only nodes; no worker could run there
+			if(numa_node_cpulist(node).empty()) continue;
+			size_t i = nodes.size();
+			nodes.push_back(node);
+			while(i > 0 && nodes[i-1] > node) {
+				nodes[i] = nodes[i-1];
+				nodes[--i] = node;
+			}
+		}
+		closedir(dir);
+	}
+#endif
+	if(nodes.empty()) nodes.push_back(0);
+}
+
+bool pin_thread_to_numa_node(int node) {
+#ifdef __linux__
+	std::string list = numa_node_cpulist(node);
+	if(list.empty()) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	const char *p = list.c_str();
+	while(*p != '\0') {
+		char *end;
+		long lo = strtol(p, &end, 10);
+		if(end == p) return false;
+		long hi = lo;
+		p = end;
+		if(*p == '-') {
+			hi = strtol(p + 1, &end, 10);
+			if(end == p + 1) return false;
+			p = end;
+		}
+		for(long c = lo; c <= hi && c < CPU_SETSIZE; c++) {
+			CPU_SET((int)c, &set);
+		}
+		if(*p == ',') p++;
+	}
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
 }
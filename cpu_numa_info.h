@@ -1,6 +1,22 @@
 #ifndef CPU_AND_NODE_H_
 #define CPU_AND_NODE_H_
 
+#include <vector>
+
 extern void get_cpu_and_node_(int& cpu, int& node);
 
+/**
+ * Fill 'nodes' with the ids of the NUMA nodes that have CPUs, in
+ * ascending order.  Where the topology can't be read (non-Linux
+ * hosts, or no sysfs), report a single node 0.
+ */
+extern void numa_nodes_with_cpus(std::vector<int>& nodes);
+
+/**
+ * Restrict the calling thread to the CPUs of NUMA node 'node', so that
+ * memory it touches first is allocated on that node.  Return false,
+ * leaving the thread's affinity unchanged, if that's not possible.
+ */
+extern bool pin_thread_to_numa_node(int node);
+
 #endif
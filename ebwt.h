@@ -23,9 +23,11 @@
 #include "bitpack.h"
 #include "bitset.h"
 #include "blockwise_sa.h"
+#include "ccnt.h"
 #include "ds.h"
 #include "endian_swap.h"
 #include "hit.h"
+#include "hugepages.h"
 #include "mm.h"
 #include "random_source.h"
 #include "ref_read.h"
@@ -37,10 +39,6 @@
 #include "timer.h"
 #include "word_io.h"
 
-#ifdef POPCNT_CAPABILITY
-    #include "processor_support.h"
-#endif
-
 using namespace std;
 
 #ifndef PREFETCH_LOCALITY
@@ -51,13 +49,6 @@ using namespace std;
 // From ccnt_lut.cpp, automatically generated by gen_lookup_tables.pl
 extern uint8_t cCntLUT_4[4][4][256];
 
-static const uint64_t c_table[4] = {
-	0xffffffffffffffffllu,
-	0xaaaaaaaaaaaaaaaallu,
-	0x5555555555555555llu,
-	0x0000000000000000llu
-};
-
 #ifndef VMSG_NL
 #define VMSG_NL(args...) \
 if(this->verbose()) { \
@@ -81,11 +72,94 @@ if(this->verbose()) { \
  */
 enum EBWT_FLAGS {
 	EBWT_COLOR = 2,     // true -> Ebwt is colorspace
-	EBWT_ENTIRE_REV = 4 // true -> reverse Ebwt is the whole
-	                    // concatenated string reversed, rather than
-	                    // each stretch reversed
+	EBWT_ENTIRE_REV = 4, // true -> reverse Ebwt is the whole
+	                     // concatenated string reversed, rather than
+	                     // each stretch reversed
+	EBWT_LINE_SIDES = 8, // true -> every side holds all four occ[]
+	                     // counts after its BWT chars (as in a
+	                     // bowtie2 index), so one LF step touches one
+	                     // side; ebwt[] starts on a 64-byte boundary
+	                     // in the primary file
+	EBWT_KFTAB = 16,     // true -> a sparse table of the BW ranges of
+	                     // all k-mers (12 <= k <= 16) that occur
+	                     // follows eftab[] in the primary file
+	EBWT_PAGED = 32,     // true -> every section starts on a page
+	                     // boundary and a table of section offsets
+	                     // follows the flags word in the header
+	EBWT_TEXT_SAMP = 64  // true -> offs[] samples the SA at text
+	                     // offsets that are multiples of 2^offRate,
+	                     // rather than at every 2^offRate'th row, and a
+	                     // bitvector marking the sampled rows follows
+	                     // offs[] in the secondary file
+};
+
+/**
+ * Sections of a paged index, in the order they appear in the table
+ * that follows the header.  Each table entry is the 64-bit byte offset
+ * of the section in its file, or 0 if the index has no such section.
+ */
+enum EBWT_SECTIONS {
+	EBWT_SEC_PLEN = 0, // nPat and plen[]      (primary file)
+	EBWT_SEC_RSTARTS,  // nFrag and rstarts[]  (primary file)
+	EBWT_SEC_EBWT,     // ebwt[]               (primary file)
+	EBWT_SEC_FCHR,     // zOff and fchr[]      (primary file)
+	EBWT_SEC_FTAB,     // ftab[]               (primary file)
+	EBWT_SEC_EFTAB,    // eftab[]              (primary file)
+	EBWT_SEC_KFTAB,    // kftab                (primary file)
+	EBWT_SEC_NAMES,    // reference names      (primary file)
+	EBWT_SEC_OFFS,     // offs[]               (secondary file)
+	EBWT_SEC_ISA,      // isa[]                (secondary file)
+	EBWT_SEC_SAMP,     // sampled-row bitvector (secondary file)
+	EBWT_NUM_SECS
 };
 
+/// Sections of a paged index are aligned to this many bytes
+static const uint64_t EBWT_PAGE_SZ = 4096;
+
+/// The sampled-row bitvector of a text-sampled index is made of
+/// 64-byte lines, each holding the number of sampled rows before the
+/// line in its first word followed by this many rows' worth of bits
+static const uint64_t EBWT_SAMP_LINE_ROWS = 7 * 64;
+
+/**
+ * Side layouts the LF-mapping routines can be compiled for.  Code
+ * instantiated for EBWT_LAYOUT_ANY checks the index's layout on every
+ * call; the search engines pick EBWT_LAYOUT_PAIRS or EBWT_LAYOUT_LINES
+ * once per search, so that check folds away in their inner loops.
+ */
+enum EBWT_LAYOUTS {
+	EBWT_LAYOUT_ANY = 0, // check EbwtParams::_isBt2Index at run time
+	EBWT_LAYOUT_PAIRS,   // bowtie1 pairs of forward/backward sides
+	EBWT_LAYOUT_LINES    // line sides, as in a bowtie2 index
+};
+
+/**
+ * The LF-mapping routines' template parameter L combines a side
+ * layout (EBWT_LAYOUTS) with an occurrence-counting kernel
+ * (OCC_KERNELS in ccnt.h).  0 is EBWT_LAYOUT_ANY with OCC_KERNEL_ANY.
+ */
+#define EBWT_LF(layout, kernel) ((layout) | ((kernel) << 2))
+#define EBWT_LF_LAYOUT(L) ((L) & 3)
+#define EBWT_LF_KERNEL(L) ((L) >> 2)
+
+/**
+ * Run CALL(L) for the L that matches the run-time LF variant 'v' (see
+ * Ebwt::lfVariant()).  CALL is a macro the caller defines around the
+ * call to its own template.
+ */
+#define EBWT_LF_DISPATCH(v, CALL) \
+	switch(v) { \
+		case EBWT_LF(EBWT_LAYOUT_PAIRS, OCC_KERNEL_GENERIC): CALL(EBWT_LF(EBWT_LAYOUT_PAIRS, OCC_KERNEL_GENERIC)); break; \
+		case EBWT_LF(EBWT_LAYOUT_PAIRS, OCC_KERNEL_POPCNT):  CALL(EBWT_LF(EBWT_LAYOUT_PAIRS, OCC_KERNEL_POPCNT)); break; \
+		case EBWT_LF(EBWT_LAYOUT_PAIRS, OCC_KERNEL_AVX2):    CALL(EBWT_LF(EBWT_LAYOUT_PAIRS, OCC_KERNEL_AVX2)); break; \
+		case EBWT_LF(EBWT_LAYOUT_PAIRS, OCC_KERNEL_AVX512):  CALL(EBWT_LF(EBWT_LAYOUT_PAIRS, OCC_KERNEL_AVX512)); break; \
+		case EBWT_LF(EBWT_LAYOUT_LINES, OCC_KERNEL_GENERIC): CALL(EBWT_LF(EBWT_LAYOUT_LINES, OCC_KERNEL_GENERIC)); break; \
+		case EBWT_LF(EBWT_LAYOUT_LINES, OCC_KERNEL_POPCNT):  CALL(EBWT_LF(EBWT_LAYOUT_LINES, OCC_KERNEL_POPCNT)); break; \
+		case EBWT_LF(EBWT_LAYOUT_LINES, OCC_KERNEL_AVX2):    CALL(EBWT_LF(EBWT_LAYOUT_LINES, OCC_KERNEL_AVX2)); break; \
+		case EBWT_LF(EBWT_LAYOUT_LINES, OCC_KERNEL_AVX512):  CALL(EBWT_LF(EBWT_LAYOUT_LINES, OCC_KERNEL_AVX512)); break; \
+		default: CALL(EBWT_LAYOUT_ANY); break; \
+	}
+
 extern string gLastIOErrMsg;
 
 inline bool is_read_err(int fdesc, ssize_t ret, size_t count){
@@ -213,6 +287,7 @@ public:
 	TIndexOffU ebwtTotSz() const     { return _ebwtTotSz; }
 	bool entireReverse() const     { return _entireReverse; }
 	bool isBt2Index() const { return _isBt2Index; }
+	int layout() const { return _isBt2Index ? EBWT_LAYOUT_LINES : EBWT_LAYOUT_PAIRS; }
 
 	/**
 	 * Set a new suffix-array sampling rate, which involves updating
@@ -319,6 +394,16 @@ public:
 	bool     _isBt2Index;
 };
 
+/**
+ * Return true iff the index's sides are line sides.  Known at compile
+ * time unless L's layout is EBWT_LAYOUT_ANY.
+ */
+template<int L>
+static inline bool lineSidesLayout(const EbwtParams& ep) {
+	return EBWT_LF_LAYOUT(L) == EBWT_LAYOUT_ANY ?
+		ep._isBt2Index : (EBWT_LF_LAYOUT(L) == EBWT_LAYOUT_LINES);
+}
+
 /**
  * Exception to throw when a file-realted error occurs.
  */
@@ -377,11 +462,29 @@ public:
 	    _fchr(NULL), \
 	    _ftab(NULL), \
 	    _eftab(NULL), \
+	    _kftabChars(0), \
+	    _kftabLen(0), \
+	    _kfShortLen(0), \
+	    _kfIdx(NULL), \
+	    _kfTops(NULL), \
+	    _kfKeys(NULL), \
+	    _kfShort(NULL), \
 	    _offs(NULL), \
+	    _offsPacked(NULL), \
+	    _offsBits(0), \
+	    _offsBitMask(0), \
 	    _isa(NULL), \
+	    _textSamp(false), \
+	    _sampBits(NULL), \
+	    _sampMem(NULL), \
 	    _ebwt(NULL), \
+	    _ebwtMem(NULL), \
 	    _useMm(false), \
 	    useShmem_(false), \
+	    hugePages_(false), \
+	    packOffs_(false), \
+	    loadTiming_(false), \
+	    _paged(false), \
 	    _refnames(), \
 	    mmFile1_(NULL), \
 	    mmFile2_(NULL)
@@ -411,18 +514,19 @@ public:
 	     bool startVerbose = false,
 	     bool passMemExc = false,
 	     bool sanityCheck = false,
-	     bool isBt2Index = false) :
+	     bool isBt2Index = false,
+	     bool hugePages = false,
+	     bool packOffs = false) :
 	     Ebwt_INITS
 	     Ebwt_STAT_INITS
 	{
 		assert(!useMm || !useShmem);
-#ifdef POPCNT_CAPABILITY
-        ProcessorSupport ps;
-        _usePOPCNTinstruction = ps.POPCNTenabled();
-#endif
 		_packed = false;
 		_useMm = useMm;
 		useShmem_ = useShmem;
+		hugePages_ = hugePages;
+		// Packing is done on load, into our own heap memory
+		packOffs_ = packOffs && !useMm && !useShmem && !currentlyBigEndian();
 		_in1Str = in + ".1." + gEbwt_ext;
 		_in2Str = in + ".2." + gEbwt_ext;
 		readIntoMemory(
@@ -432,6 +536,7 @@ public:
 			mmSweep,       // mmSweep
 			loadNames,     // loadNames
 			startVerbose); // startVerbose
+		initOccKernels(verbose || startVerbose);
 		// If the offRate has been overridden, reflect that in the
 		// _eh._offRate field
 		if(_overrideOffRate > _eh._offRate) {
@@ -477,7 +582,10 @@ public:
 	     bool verbose = false,
 	     bool passMemExc = false,
 	     bool sanityCheck = false,
-	     bool isBt2Index = false) :
+	     bool isBt2Index = false,
+	     int kftabChars = 0,
+	     bool paged = false,
+	     bool textSamp = false) :
 	     Ebwt_INITS
 	     Ebwt_STAT_INITS,
 	     _eh(joinedLen(szs),
@@ -490,10 +598,11 @@ public:
 	         isBt2Index)
 	{
 		_packed = packed;
-	 #ifdef POPCNT_CAPABILITY
-        ProcessorSupport ps;
-        _usePOPCNTinstruction = ps.POPCNTenabled();
-#endif
+		_kftabChars = kftabChars;
+		_paged = paged;
+		_textSamp = textSamp;
+		memset(_secOffs, 0, sizeof(_secOffs));
+		initOccKernels(verbose);
 		_in1Str = file + ".1." + gEbwt_ext;
 		_in2Str = file + ".2." + gEbwt_ext;
 		// Open output files
@@ -803,10 +912,18 @@ public:
 #else
 		assert_eq(this->_refnames.size(), this->_nPat);
 #endif
+		beginSection(out1, secOffsOut(), EBWT_SEC_NAMES);
 		for(TIndexOffU i = 0; i < this->_refnames.size(); i++) {
 			out1 << this->_refnames[i] << endl;
 		}
 		out1 << '\0';
+		if(_paged) {
+			// Now that every section's offset is known, fill in the table
+			ofstream::pos_type end = out1.tellp();
+			out1.seekp(sectionTableOff());
+			writeSectionTable(out1, _secOffs, this->toBe());
+			out1.seekp(end);
+		}
 		out1.flush(); out2.flush();
 		if(out1.fail() || out2.fail()) {
 			cerr << "An error occurred writing the index to disk.  Please check if the disk is full." << endl;
@@ -835,17 +952,23 @@ public:
 		if(!_useMm) {
 			// Delete everything that was allocated in read(false, ...)
 			if(_fchr    != NULL) delete[] _fchr;
-			if(_ftab    != NULL) delete[] _ftab;
+			if(_ftab    != NULL) freeBig(_ftab);
 			if(_eftab   != NULL) delete[] _eftab;
+			if(_kfIdx   != NULL) freeBig(_kfIdx);
+			if(_kfTops  != NULL) freeBig(_kfTops);
+			if(_kfKeys  != NULL) freeBig(_kfKeys);
+			if(_kfShort != NULL) delete[] _kfShort;
 			if(_offs != NULL && !useShmem_)
-				delete[] _offs;
+				freeBig(_offs);
 			else if(_offs != NULL && useShmem_)
 				FREE_SHARED(_offs);
+			if(_offsPacked != NULL) freeBig(_offsPacked);
+			if(_sampMem != NULL) freeBig(_sampMem);
 			if(_isa     != NULL) delete[] _isa;
 			if(_plen    != NULL) delete[] _plen;
 			if(_rstarts != NULL) delete[] _rstarts;
-			if(_ebwt != NULL && !useShmem_)
-				delete[] _ebwt;
+			if(_ebwtMem != NULL)
+				freeBig(_ebwtMem);
 			else if(_ebwt != NULL && useShmem_)
 				FREE_SHARED(_ebwt);
 		}
@@ -871,8 +994,82 @@ public:
 	TIndexOffU*   fchr() const         { return _fchr; }
 	TIndexOffU*   ftab() const         { return _ftab; }
 	TIndexOffU*   eftab() const        { return _eftab; }
+	int           kftabChars() const   { return _kftabChars; }
 	TIndexOffU*   offs() const         { return _offs; }
+
+	/**
+	 * Return the idx'th SA sample.  When offs[] is packed, the entry is
+	 * extracted with a single unaligned 64-bit load, a shift and a
+	 * mask; entries are at most 57 bits so they never straddle more
+	 * than 8 bytes.
+	 */
+	inline TIndexOffU offAt(TIndexOffU idx) const {
+		if(_offsPacked == NULL) return _offs[idx];
+		uint64_t bit = (uint64_t)idx * _offsBits;
+		uint64_t w;
+		memcpy(&w, _offsPacked + (bit >> 3), 8);
+		return (TIndexOffU)((w >> (bit & 7)) & _offsBitMask);
+	}
+
+	/**
+	 * Store the idx'th SA sample into the packed offs[].
+	 */
+	inline void setPackedOff(TIndexOffU idx, TIndexOffU off) {
+		assert(_offsPacked != NULL);
+		assert_eq(0, (uint64_t)off & ~_offsBitMask);
+		uint64_t bit = (uint64_t)idx * _offsBits;
+		uint64_t w;
+		memcpy(&w, _offsPacked + (bit >> 3), 8);
+		w &= ~(_offsBitMask << (bit & 7));
+		w |= ((uint64_t)off << (bit & 7));
+		memcpy(_offsPacked + (bit >> 3), &w, 8);
+	}
+
+	/// Number of 64-bit words in the sampled-row bitvector
+	static uint64_t sampBitsLen(TIndexOffU bwtLen) {
+		return ((bwtLen + EBWT_SAMP_LINE_ROWS - 1) / EBWT_SAMP_LINE_ROWS) << 3;
+	}
+
+	/**
+	 * If BW row 'row' has an SA sample, set 'idx' to its index in
+	 * offs[] and return true.  In a text-sampled index that means
+	 * testing the row's bit and ranking it within its line; otherwise
+	 * every 2^offRate'th row is sampled.
+	 */
+	inline bool sampledRow(TIndexOffU row, TIndexOffU& idx) const {
+		if(_sampBits == NULL) {
+			if((row & _eh._offMask) != row) return false;
+			idx = row >> _eh._offRate;
+			return true;
+		}
+		uint64_t line = row / EBWT_SAMP_LINE_ROWS;
+		uint64_t bit = row - line * EBWT_SAMP_LINE_ROWS;
+		const uint64_t *l = _sampBits + (line << 3);
+		const uint64_t *w = l + 1 + (bit >> 6);
+		if(((*w >> (bit & 63)) & 1) == 0) return false;
+		uint64_t rank = l[0] + __builtin_popcountll(*w & ((1llu << (bit & 63)) - 1));
+		for(const uint64_t *p = l + 1; p < w; p++) {
+			rank += __builtin_popcountll(*p);
+		}
+		idx = (TIndexOffU)rank;
+		return true;
+	}
+
+	/**
+	 * Prefetch the line of the sampled-row bitvector that a
+	 * sampledRow(row) a little later will look at.
+	 */
+	inline void prefetchSampled(TIndexOffU row) const {
+#ifndef NO_PREFETCH
+		if(_sampBits != NULL) {
+			__builtin_prefetch((const void *)(_sampBits + ((row / EBWT_SAMP_LINE_ROWS) << 3)),
+			                   0, PREFETCH_LOCALITY);
+		}
+#endif
+	}
+
 	TIndexOffU*   isa() const          { return _isa; } /* check */
+	bool          textSampled() const  { return _textSamp; }
 	TIndexOffU*   plen() const         { return _plen; }
 	TIndexOffU*   rstarts() const      { return _rstarts; }
 	uint8_t*    ebwt() const         { return _ebwt; }
@@ -881,9 +1078,26 @@ public:
 	bool        sanityCheck() const  { return _sanity; }
 	EList<string>& refnames()       { return _refnames; }
 	bool        fw() const           { return _fw; }
-#ifdef POPCNT_CAPABILITY
-    bool _usePOPCNTinstruction;
-#endif
+
+	/**
+	 * Pick the occurrence-counting kernels used by countUpTo() and
+	 * countUpToEx().  Done once, after the side geometry is known, so
+	 * that the LF hot path doesn't re-check CPU capabilities.
+	 */
+	void initOccKernels(bool verbose) {
+		_occ = selectOccCountKernels(_eh._sideBwtSz, _eh._sideSz);
+		if(verbose) {
+			cerr << "Using " << _occ.name << " occurrence-counting kernel" << endl;
+		}
+	}
+
+	/**
+	 * Return the LF variant (see EBWT_LF) matching this index's side
+	 * layout and the counting kernel picked for this CPU.
+	 */
+	int lfVariant() const {
+		return EBWT_LF(_eh.layout(), _occ.kernel);
+	}
 
 	/// Return true iff the Ebwt is currently in memory
 	bool isInMemory() const {
@@ -892,7 +1106,7 @@ public:
 			assert(_ftab != NULL);
 			assert(_eftab != NULL);
 			assert(_fchr != NULL);
-			assert(_offs != NULL);
+			assert(_offs != NULL || _offsPacked != NULL);
 			assert(_isa != NULL);
 			assert(_rstarts != NULL);
 			assert_neq(_zEbwtByteOff, OFF_MASK);
@@ -903,6 +1117,7 @@ public:
 			assert(_eftab == NULL);
 			assert(_fchr == NULL);
 			assert(_offs == NULL);
+			assert(_offsPacked == NULL);
 			assert(_rstarts == NULL);
 			assert_eq(_zEbwtByteOff, OFF_MASK);
 			assert_eq(_zEbwtBpOff, -1);
@@ -915,6 +1130,31 @@ public:
 		return !isInMemory();
 	}
 
+	/**
+	 * Return the number of bytes held by the big in-memory arrays:
+	 * ebwt[], ftab[], eftab[], the kftab, offs[], the sampled-row
+	 * bitvector and isa[].
+	 */
+	uint64_t bigArrayBytes() const {
+		assert(isInMemory());
+		uint64_t ret = _eh._ebwtTotSz;
+		ret += (uint64_t)(_eh._ftabLen + _eh._eftabLen) * OFF_SIZE;
+		if(_kftabChars > 0) {
+			ret += (uint64_t)(_kfShortLen + kftabIdxLen(_kftabChars) + _kftabLen) * OFF_SIZE;
+			ret += _kftabLen;
+		}
+		if(_offsPacked != NULL) {
+			ret += (((uint64_t)_eh._offsLen * _offsBits + 7) >> 3) + 8;
+		} else {
+			ret += _eh._offsSz;
+		}
+		if(_sampBits != NULL) {
+			ret += sampBitsLen(_eh._bwtLen) * 8;
+		}
+		ret += _eh._isaSz;
+		return ret;
+	}
+
 	/**
 	 * Load this Ebwt into memory by reading it in from the _in1 and
 	 * _in2 streams.
@@ -940,30 +1180,65 @@ public:
 		assert(isInMemory());
 		if(!_useMm) {
 			delete[] _fchr;
-			delete[] _ftab;
+			freeBig(_ftab);
 			delete[] _eftab;
-			if(!useShmem_) delete[] _offs;
+			if(_kfIdx != NULL) {
+				freeBig(_kfIdx);
+				freeBig(_kfTops);
+				freeBig(_kfKeys);
+				delete[] _kfShort;
+			}
+			if(!useShmem_) freeBig(_offs);
+			if(_offsPacked != NULL) freeBig(_offsPacked);
+			if(_sampMem != NULL) freeBig(_sampMem);
 			delete[] _isa;
 			// Keep plen; it's small and the client may want to query it
 			// even when the others are evicted.
 			//delete[] _plen;
 			delete[] _rstarts;
-			if(!useShmem_) delete[] _ebwt;
+			if(_ebwtMem != NULL) freeBig(_ebwtMem);
 		}
 		_fchr  = NULL;
 		_ftab  = NULL;
 		_eftab = NULL;
+		_kfIdx = NULL;
+		_kfTops = NULL;
+		_kfKeys = NULL;
+		_kfShort = NULL;
 		_offs  = NULL;
+		_offsPacked = NULL;
+		_sampBits = NULL;
+		_sampMem = NULL;
 		_isa   = NULL;
 		// Keep plen; it's small and the client may want to query it
 		// even when the others are evicted.
 		//_plen  = NULL;
 		_rstarts = NULL;
 		_ebwt    = NULL;
+		_ebwtMem = NULL;
 		_zEbwtByteOff = OFF_MASK;
 		_zEbwtBpOff = -1;
 	}
 
+	/**
+	 * Allocate one of the big, randomly-accessed arrays (ftab[],
+	 * offs[]), from huge pages if they were requested.
+	 */
+	template<typename T>
+	T* newBig(size_t n) const {
+		if(hugePages_) return reinterpret_cast<T*>(hugeAlloc(n * sizeof(T), true));
+		return new T[n];
+	}
+
+	/**
+	 * Free an array allocated with newBig() (or _ebwtMem).
+	 */
+	template<typename T>
+	void freeBig(T* p) const {
+		if(hugePages_) hugeFree(p);
+		else delete[] p;
+	}
+
 	/**
 	 * Non-static facade for static function ftabHi.
 	 */
@@ -1032,6 +1307,66 @@ public:
 		}
 	}
 
+	/// Return the number of kfIdx[] entries for a kftab over k-mers
+	static TIndexOffU kftabIdxLen(int kChars) {
+		return ((TIndexOffU)1 << (2 * (kChars - 4))) + 1;
+	}
+
+	/**
+	 * Set top and bot to the BW range of the given k-mer (rightmost
+	 * char in the least significant bit-pair); the range is empty if
+	 * the k-mer doesn't occur.  The k-mer's first k-4 characters pick
+	 * a bucket of at most a few hundred entries, which is binary-
+	 * searched on the last 4.
+	 */
+	void kftabRange(uint64_t kmer, TIndexOffU& top, TIndexOffU& bot) const {
+		assert_gt(_kftabChars, 0);
+		TIndexOffU pre = (TIndexOffU)(kmer >> 8);
+		uint8_t key = (uint8_t)(kmer & 0xff);
+		assert_lt(pre+1, kftabIdxLen(_kftabChars));
+		TIndexOffU lo = _kfIdx[pre], hi = _kfIdx[pre+1];
+		// Find the first entry in the bucket with this key; the k-mer's
+		// own entry comes before any short-suffix entry padded to it
+		while(lo < hi) {
+			TIndexOffU mid = lo + ((hi - lo) >> 1);
+			if(_kfKeys[mid] < key) lo = mid + 1;
+			else hi = mid;
+		}
+		top = bot = 0;
+		if(lo == _kfIdx[pre+1] || _kfKeys[lo] != key) return;
+		TIndexOffU e = lo;
+		for(TIndexOffU i = 0; i < _kfShortLen; i++) {
+			if(_kfShort[i] == e) return;
+		}
+		top = _kfTops[e];
+		bot = (e+1 < _kftabLen) ? _kfTops[e+1] : _eh._len+1;
+		assert_gt(bot, top);
+	}
+
+	/**
+	 * If there's a kftab and the rightmost k characters of the first
+	 * 'qlen' characters of 'qry' are N-free and within 'maxDepth' of
+	 * the right end, set top and bot to their range and return k.
+	 * Otherwise return 0, and the caller should fall back on the ftab.
+	 */
+	int kftabJump(const BTDnaString& qry,
+	              size_t qlen,
+	              size_t maxDepth,
+	              TIndexOffU& top,
+	              TIndexOffU& bot) const
+	{
+		if(_kftabChars == 0 || maxDepth < (size_t)_kftabChars) return 0;
+		assert_leq(maxDepth, qlen);
+		uint64_t kmer = 0;
+		for(size_t i = qlen - _kftabChars; i < qlen; i++) {
+			int c = (int)qry[i];
+			if(c == 4) return 0;
+			kmer = (kmer << 2) | (uint64_t)c;
+		}
+		kftabRange(kmer, top, bot);
+		return _kftabChars;
+	}
+
 	/**
 	 * When using read() to create an Ebwt, we have to set a couple of
 	 * additional fields in the Ebwt object that aren't part of the
@@ -1112,10 +1447,12 @@ public:
 			out << "non-NULL, [0] = " << _eftab[0] << endl;
 		}
 		out << "    offs: ";
-		if(_offs == NULL) {
+		if(_offs == NULL && _offsPacked == NULL) {
 			out << "NULL" << endl;
 		} else {
-			out << "non-NULL, [0] = " << _offs[0] << endl;
+			out << "non-NULL, [0] = " << offAt(0);
+			if(_offsPacked != NULL) out << " (" << _offsBits << " bits/entry)";
+			out << endl;
 		}
 	}
 
@@ -1127,9 +1464,188 @@ public:
 
 	// I/O
 	void readIntoMemory(int needEntireReverse, bool justHeader, EbwtParams *params, bool mmSweep, bool loadNames, bool startVerbose);
+
+	/**
+	 * What readSecondary() needs to know about the index being read,
+	 * taken from the primary stream's header, plus the thread reading
+	 * it, if any.  The thread is joined on destruction so that it
+	 * can't outlive an exception thrown while reading the primary.
+	 */
+	struct SecondaryRead {
+		SecondaryRead() : thread(NULL), failed(false) { }
+		~SecondaryRead() { join(); }
+
+		/// Wait for the reader thread, if there is one
+		void join() {
+			if(thread != NULL) {
+				thread->join();
+				delete thread;
+				thread = NULL;
+			}
+		}
+
+		Ebwt*      ebwt;
+		char*      mmFile;         // memory-mapped secondary file, if any
+		bool       switchEndian;
+		bool       startVerbose;
+		TIndexOffU len;
+		TIndexOffU offsLen;
+		uint64_t   offsSz;
+		TIndexOffU offRateDiff;
+		TIndexOffU offsLenSampled;
+		TIndexOffU isaLen;
+		TIndexOffU isaRateDiff;
+		TIndexOffU isaLenSampled;
+#if (__cplusplus >= 201103L)
+		std::thread*     thread;
+#else
+		tthread::thread* thread;
+#endif
+		bool       failed;         // set if the reader thread failed
+	};
+	void readSecondary(const SecondaryRead& r);
+
+	/**
+	 * Thin a text-sampled index's bitvector to match an offs[] that
+	 * was thinned on load: of the originally sampled rows, in order,
+	 * keep those whose bits are set in 'kept', then redo the lines'
+	 * counts.
+	 */
+	static void thinSampBits(uint64_t *bits, uint64_t len, const EList<uint64_t>& kept) {
+		uint64_t j = 0;   // index of the next sampled row among the originals
+		uint64_t cum = 0; // sampled rows kept so far
+		for(uint64_t i = 0; i < len; i += 8) {
+			bits[i] = cum;
+			for(int w = 1; w < 8; w++) {
+				uint64_t x = bits[i+w], y = 0;
+				while(x != 0) {
+					int b = __builtin_ctzll(x);
+					x &= x - 1;
+					if(((kept[j >> 6] >> (j & 63)) & 1) != 0) {
+						y |= (1llu << b);
+					}
+					j++;
+				}
+				bits[i+w] = y;
+				cum += __builtin_popcountll(y);
+			}
+		}
+	}
+	static void readSecondaryWorker(void *vp);
+
+	/// Report how long each section of the index takes to load
+	void setLoadTiming(bool t) { loadTiming_ = t; }
 	void writeFromMemory(bool justHeader, ostream& out1, ostream& out2) const;
 	void writeFromMemory(bool justHeader, const string& out1, const string& out2) const;
 
+	/// Pad 'out' with zeroes up to the next 64-byte boundary
+	static void padToLine(ostream& out) {
+		while(((uint64_t)out.tellp() & 63) != 0) out.put(0);
+	}
+
+	/**
+	 * In a paged index, pad 'out' with zeroes up to the next page
+	 * boundary and record that section 'sec' starts there.
+	 */
+	static void beginSection(ostream& out, uint64_t* secOffs, int sec) {
+		if(secOffs == NULL) return;
+		while(((uint64_t)out.tellp() & (EBWT_PAGE_SZ-1)) != 0) out.put(0);
+		secOffs[sec] = (uint64_t)out.tellp();
+	}
+
+	/// Section table to fill in as we write, or NULL if not paged
+	uint64_t* secOffsOut() { return _paged ? _secOffs : NULL; }
+
+	/**
+	 * Write a paged index's section table: the number of entries, then
+	 * each section's offset.  It goes right after the flags word, and
+	 * is written twice: zeroed with the header, then for real once
+	 * every section has been written.
+	 */
+	static void writeSectionTable(ostream& out, const uint64_t* secOffs, bool be) {
+		writeU<uint64_t>(out, (uint64_t)EBWT_NUM_SECS, be);
+		for(int i = 0; i < EBWT_NUM_SECS; i++) {
+			writeU<uint64_t>(out, secOffs[i], be);
+		}
+	}
+
+	/// Offset of the section table in the primary file
+	static uint64_t sectionTableOff() { return 4 + OFF_SIZE + 5*4; }
+
+	/**
+	 * In a paged index, move 'f' to the start of section 'sec' and
+	 * set 'bytesRead' to match; otherwise the section follows on from
+	 * wherever the previous one ended and there's nothing to do.
+	 */
+	void seekSection(FILE* f, int sec, uint64_t& bytesRead) const {
+		if(!_paged) return;
+		fseeko(f, (off_t)_secOffs[sec], SEEK_SET);
+		bytesRead = _secOffs[sec];
+	}
+
+	/**
+	 * Write a kftab to the primary stream: k, the number of entries
+	 * and of short-suffix entries, then the short-suffix entries,
+	 * kfIdx[], the entries' tops and finally their keys.
+	 */
+	static void writeKftab(ostream& out,
+	                       int kChars,
+	                       const TIndexOffU* shorts,
+	                       TIndexOffU nShort,
+	                       const TIndexOffU* idx,
+	                       const TIndexOffU* tops,
+	                       const uint8_t* keys,
+	                       TIndexOffU n,
+	                       bool be)
+	{
+		writeU<TIndexOffU>(out, (TIndexOffU)kChars, be);
+		writeU<TIndexOffU>(out, n, be);
+		writeU<TIndexOffU>(out, nShort, be);
+		for(TIndexOffU i = 0; i < nShort; i++)
+			writeU<TIndexOffU>(out, shorts[i], be);
+		TIndexOffU idxLen = kftabIdxLen(kChars);
+		for(TIndexOffU i = 0; i < idxLen; i++)
+			writeU<TIndexOffU>(out, idx[i], be);
+		for(TIndexOffU i = 0; i < n; i++)
+			writeU<TIndexOffU>(out, tops[i], be);
+		out.write((const char *)keys, n);
+	}
+
+	/**
+	 * Read an n-element kftab array from the primary stream, or point
+	 * it into the memory-mapped primary file.  'big' arrays come from
+	 * newBig().
+	 */
+	template<typename T>
+	T* readKftabArray(char *mmFile,
+	                  uint64_t& bytesRead,
+	                  TIndexOffU n,
+	                  bool switchEndian,
+	                  bool big) const
+	{
+		T* ret = NULL;
+		if(_useMm) {
+#ifdef BOWTIE_MM
+			ret = (T*)(mmFile + bytesRead);
+			fseeko(_in1, n*sizeof(T), SEEK_CUR);
+#endif
+		} else {
+			ret = big ? newBig<T>(n) : new T[n];
+			if(switchEndian && sizeof(T) > 1) {
+				for(TIndexOffU i = 0; i < n; i++)
+					ret[i] = readU<T>(_in1, switchEndian);
+			} else {
+				size_t r = MM_READ(_in1, (void *)ret, n*sizeof(T));
+				if(r != (size_t)(n*sizeof(T))) {
+					cerr << "Error reading kftab array: " << r << ", " << (n*sizeof(T)) << endl;
+					throw 1;
+				}
+			}
+		}
+		bytesRead += n*sizeof(T);
+		return ret;
+	}
+
 	// Sanity checking
 	void printRangeFw(uint32_t begin, uint32_t end) const;
 	void printRangeBw(uint32_t begin, uint32_t end) const;
@@ -1142,21 +1658,33 @@ public:
 	void joinedToTextOff(TIndexOffU qlen, TIndexOffU off, TIndexOffU& tidx, TIndexOffU& textoff, TIndexOffU& tlen) const;
 	inline bool report(const BTDnaString& query, BTString* quals, BTString* name, const EList<TIndexOffU>& mmui32, const EList<uint8_t>& refcs, size_t numMms, TIndexOffU off, TIndexOffU top, TIndexOffU bot, uint32_t qlen, int stratum, uint16_t cost, uint32_t patid, uint32_t seed, const EbwtSearchParams& params) const;
 	inline bool reportChaseOne(const BTDnaString& query, BTString* quals, BTString* name, const EList<TIndexOffU>& mmui32, const EList<uint8_t>& refcs, size_t numMms, TIndexOffU i, TIndexOffU top, TIndexOffU bot, uint32_t qlen, int stratum, uint16_t cost, uint32_t patid, uint32_t seed, const EbwtSearchParams& params, SideLocus *l = NULL) const;
+	inline uint64_t resolveRows(const TIndexOffU* rows, size_t n, TIndexOffU* offs) const;
+	template<int L> inline uint64_t resolveRows(const TIndexOffU* rows, size_t n, TIndexOffU* offs) const;
+	inline void prefetchOff(TIndexOffU idx) const;
+	template<int L> inline void resolvePrefetch(TIndexOffU row, SideLocus& l) const;
 	inline int rowL(const SideLocus& l) const;
-	inline TIndexOffU countUpTo(const SideLocus& l, int c) const;
-	inline void countUpToEx(const SideLocus& l, TIndexOffU* pairs) const;
-	inline TIndexOffU countFwSide(const SideLocus& l, int c) const;
-	inline void countFwSideEx(const SideLocus& l, TIndexOffU *pairs) const;
-	inline TIndexOffU countBwSide(const SideLocus& l, int c) const;
-	inline void countBwSideEx(const SideLocus& l, TIndexOffU *pairs) const;
-	inline TIndexOffU countBt2Side(const SideLocus& l, int c) const;
-	inline void countBt2SideEx(const SideLocus& l, TIndexOffU *pairs) const;
+	template<int L> inline TIndexOffU countUpTo(const SideLocus& l, int c) const;
+	template<int L> inline void countUpToEx(const SideLocus& l, TIndexOffU* pairs) const;
+	template<int L> inline TIndexOffU countFwSide(const SideLocus& l, int c) const;
+	template<int L> inline void countFwSideEx(const SideLocus& l, TIndexOffU *pairs) const;
+	template<int L> inline TIndexOffU countBwSide(const SideLocus& l, int c) const;
+	template<int L> inline void countBwSideEx(const SideLocus& l, TIndexOffU *pairs) const;
+	template<int L> inline TIndexOffU countBt2Side(const SideLocus& l, int c) const;
+	template<int L> inline void countBt2SideEx(const SideLocus& l, TIndexOffU *pairs) const;
 	inline TIndexOffU mapLF(const SideLocus& l ASSERT_ONLY(, bool overrideSanity = false)) const;
 	inline void mapLFEx(const SideLocus& l, TIndexOffU *pairs ASSERT_ONLY(, bool overrideSanity = false)) const;
 	inline void mapLFEx(const SideLocus& ltop, const SideLocus& lbot, TIndexOffU *tops, TIndexOffU *bots ASSERT_ONLY(, bool overrideSanity = false)) const;
 	inline TIndexOffU mapLF(const SideLocus& l, int c ASSERT_ONLY(, bool overrideSanity = false)) const;
 	inline TIndexOffU mapLF1(TIndexOffU row, const SideLocus& l, int c ASSERT_ONLY(, bool overrideSanity = false)) const;
 	inline int mapLF1(TIndexOffU& row, const SideLocus& l ASSERT_ONLY(, bool overrideSanity = false)) const;
+
+	// The same, compiled for LF variant L (see EBWT_LF)
+	template<int L> inline TIndexOffU mapLF(const SideLocus& l ASSERT_ONLY(, bool overrideSanity = false)) const;
+	template<int L> inline void mapLFEx(const SideLocus& l, TIndexOffU *pairs ASSERT_ONLY(, bool overrideSanity = false)) const;
+	template<int L> inline void mapLFEx(const SideLocus& ltop, const SideLocus& lbot, TIndexOffU *tops, TIndexOffU *bots ASSERT_ONLY(, bool overrideSanity = false)) const;
+	template<int L> inline TIndexOffU mapLF(const SideLocus& l, int c ASSERT_ONLY(, bool overrideSanity = false)) const;
+	template<int L> inline TIndexOffU mapLF1(TIndexOffU row, const SideLocus& l, int c ASSERT_ONLY(, bool overrideSanity = false)) const;
+	template<int L> inline int mapLF1(TIndexOffU& row, const SideLocus& l ASSERT_ONLY(, bool overrideSanity = false)) const;
 	/// Check that in-memory Ebwt is internally consistent with respect
 	/// to given EbwtParams; assert if not
 	bool inMemoryRepOk(const EbwtParams& eh) const {
@@ -1217,21 +1745,54 @@ public:
 	TIndexOffU*  _fchr;
 	TIndexOffU*  _ftab;
 	TIndexOffU*  _eftab; // "extended" entries for _ftab
+	// The kftab is a sparse, two-level stand-in for an ftab over
+	// _kftabChars characters, which would be too big to store densely.
+	// There's one entry per run of BW rows sharing a k-mer prefix,
+	// plus entries for the runs of rows whose suffixes are shorter
+	// than k; an entry's range ends where the next one's begins.  See
+	// kftabRange().
+	int          _kftabChars; // k, or 0 if there's no kftab
+	TIndexOffU   _kftabLen;   // # entries
+	TIndexOffU   _kfShortLen; // # entries for short suffixes
+	TIndexOffU*  _kfIdx;      // first entry for each (k-4)-mer prefix
+	TIndexOffU*  _kfTops;     // first row of each entry
+	uint8_t*     _kfKeys;     // last 4 chars of each entry's k-mer
+	TIndexOffU*  _kfShort;    // entries for short suffixes, ascending
 	// _offs may be extremely large.  E.g. for DNA w/ offRate=4 (one
 	// offset every 16 rows), the total size of _offs is the same as
 	// the total size of the input sequence
 	TIndexOffU*  _offs;
+	// Alternatively, offs[] packed into _offsBits bits per entry, just
+	// enough to hold offsets up to _len; see offAt()
+	uint8_t*     _offsPacked;
+	uint32_t     _offsBits;
+	uint64_t     _offsBitMask;
 	TIndexOffU*  _isa;
+	// In a text-sampled index, offs[] holds the SA elements that are
+	// multiples of 2^offRate, so no walk is longer than 2^offRate-1
+	// steps.  Which rows those are is recorded in _sampBits, one bit
+	// per row, in EBWT_SAMP_LINE_ROWS-row lines that start with a count
+	// of the set bits in earlier lines; see sampledRow()
+	bool         _textSamp;
+	uint64_t*    _sampBits;
+	uint64_t*    _sampMem;    // block _sampBits was carved from, if we allocated it
 	// _ebwt is the Extended Burrows-Wheeler Transform itself, and thus
 	// is at least as large as the input sequence.
 	uint8_t*   _ebwt;
+	uint8_t*   _ebwtMem;      /// block _ebwt was carved from, if we new[]ed it
 	bool       _useMm;        /// use memory-mapped files to hold the index
 	bool       useShmem_;     /// use shared memory to hold large parts of the index
+	bool       hugePages_;    /// back ebwt[], offs[] and ftab[] with huge pages
+	bool       packOffs_;     /// bit-pack offs[] as it's loaded
+	bool       loadTiming_;   /// report how long each section takes to load
+	bool       _paged;        /// sections are page-aligned; see EBWT_PAGED
+	uint64_t   _secOffs[EBWT_NUM_SECS]; /// section offsets, if _paged
 	EList<string> _refnames; /// names of the reference sequences
 	char *mmFile1_;
 	char *mmFile2_;
 	EbwtParams _eh;
 	bool _packed;
+	OccCountKernels _occ; // counting kernels chosen for this CPU
 
 	#ifdef BOWTIE_64BIT_INDEX
 	static const int      default_lineRate = 7;
@@ -1434,6 +1995,20 @@ struct SideLocus {
 	 * Init two SideLocus objects from a top/bot pair, using the result
 	 * from one call to initFromRow to possibly avoid a second call.
 	 */
+	static void initFromTopBot(TIndexOffU top,
+	                           TIndexOffU bot,
+	                           const EbwtParams& ep,
+	                           const uint8_t* ebwt,
+	                           SideLocus& ltop,
+	                           SideLocus& lbot)
+	{
+		initFromTopBot<EBWT_LAYOUT_ANY>(top, bot, ep, ebwt, ltop, lbot);
+	}
+
+	/**
+	 * Same as above, compiled for LF variant L (see EBWT_LF).
+	 */
+	template<int L>
 	static void initFromTopBot(TIndexOffU top,
 	                           TIndexOffU bot,
 	                           const EbwtParams& ep,
@@ -1444,20 +2019,22 @@ struct SideLocus {
 		const TIndexOffU sideBwtLen = ep._sideBwtLen;
 		const uint32_t sideBwtSz  = ep._sideBwtSz;
 		assert_gt(bot, top);
-		ltop.initFromRow(top, ep, ebwt);
+		ltop.initFromRow<L>(top, ep, ebwt);
 		TIndexOffU spread = bot - top;
 		if(ltop._charOff + spread < sideBwtLen) {
 			lbot._charOff = (uint32_t)(ltop._charOff + spread);
 			lbot._sideNum = ltop._sideNum;
 			lbot._sideByteOff = ltop._sideByteOff;
-			lbot._fw = ep._isBt2Index ? true : ltop._fw;
+			lbot._fw = lineSidesLayout<L>(ep) ? true : ltop._fw;
 			lbot._by = lbot._charOff >> 2;
 			assert_lt(lbot._by, (int)sideBwtSz);
-			if(!lbot._fw) lbot._by = sideBwtSz - lbot._by - 1;
 			lbot._bp = lbot._charOff & 3;
-			if(!lbot._fw) lbot._bp ^= 3;
+			if(!lbot._fw) {
+				lbot._by = sideBwtSz - lbot._by - 1;
+				lbot._bp ^= 3;
+			}
 		} else {
-			lbot.initFromRow(bot, ep, ebwt);
+			lbot.initFromRow<L>(bot, ep, ebwt);
 		}
 	}
 
@@ -1465,11 +2042,19 @@ struct SideLocus {
 	 * Calculate SideLocus based on a row and other relevant
 	 * information about the shape of the Ebwt.
 	 */
+	void initFromRow(TIndexOffU row, const EbwtParams& ep, const uint8_t* ebwt) {
+		initFromRow<EBWT_LAYOUT_ANY>(row, ep, ebwt);
+	}
+
+	/**
+	 * Same as above, compiled for LF variant L (see EBWT_LF).
+	 */
+	template<int L>
 	void initFromRow(TIndexOffU row, const EbwtParams& ep, const uint8_t* ebwt) {
 		const uint32_t sideSz     = ep._sideSz;
 		// Side length is hard-coded for now; this allows the compiler
 		// to do clever things to accelerate / and %.
-		if (ep._isBt2Index) {
+		if (lineSidesLayout<L>(ep)) {
 			_sideNum = row / (48*OFF_SIZE);
 			_charOff = row % (48*OFF_SIZE);
 		} else {
@@ -1485,7 +2070,7 @@ struct SideLocus {
 		                   PREFETCH_LOCALITY);
 #endif
 		// prefetch this side too
-		_fw = ep._isBt2Index ? true : ((_sideNum & 1) != 0); // odd-numbered sides are forward
+		_fw = lineSidesLayout<L>(ep) ? true : ((_sideNum & 1) != 0); // odd-numbered sides are forward
 		_by = _charOff >> 2; // byte within side
 		assert_lt(_by, (int)ep._sideBwtSz);
 		_bp = _charOff & 3;  // bit-pair within byte
@@ -1585,6 +2170,26 @@ void Ebwt::sanityCheckUpToSide(TIndexOff upToSide) const {
 	ASSERT_ONLY(TIndexOffU occ_save[] = {0, 0});
 	TIndexOffU cur = 0; // byte pointer
 	const EbwtParams& eh = this->_eh;
+	if(eh._isBt2Index) {
+		// Every side is a forward side ending in all four occ[] counts
+		// prior to the side
+		while(cur < (TIndexOffU)(upToSide * eh._sideSz)) {
+			assert_leq(cur + eh._sideSz, eh._ebwtTotLen);
+			ASSERT_ONLY(const TIndexOffU *acgt = reinterpret_cast<const TIndexOffU*>(&this->_ebwt[cur + eh._sideBwtSz]));
+			assert(acgt[0] == occ[0] || acgt[0] == occ[0]-1); // one 'a' is a skipped '$'
+			assert_eq(acgt[1], occ[1]);
+			assert_eq(acgt[2], occ[2]);
+			assert_eq(acgt[3], occ[3]);
+			for(uint32_t i = 0; i < eh._sideBwtSz; i++) {
+				uint8_t by = this->_ebwt[cur + i];
+				for(int j = 0; j < 4; j++) {
+					occ[unpack_2b_from_8b(by, j)]++;
+				}
+			}
+			cur += eh._sideSz;
+		}
+		return;
+	}
 	bool fw = false;
 	while(cur < (TIndexOffU)(upToSide * eh._sideSz)) {
 		assert_leq(cur + eh._sideSz, eh._ebwtTotLen);
@@ -1638,6 +2243,35 @@ void Ebwt::sanityCheckAll(int reverse) const {
 	}
 	assert_eq(this->ftabHi(eh._ftabLen-1), eh._bwtLen);
 
+	// Check that every k-mer in the kftab can be found again, and that
+	// its range nests inside the ftab range of its prefix
+	if(_kftabChars > 0) {
+		TIndexOffU idxLen = kftabIdxLen(_kftabChars);
+		TIndexOffU nShort = 0;
+		for(TIndexOffU p = 0; p+1 < idxLen; p++) {
+			assert_leq(this->_kfIdx[p], this->_kfIdx[p+1]);
+			for(TIndexOffU e = this->_kfIdx[p]; e < this->_kfIdx[p+1]; e++) {
+				if(e > 0) assert_gt(this->_kfTops[e], this->_kfTops[e-1]);
+				if(nShort < this->_kfShortLen && this->_kfShort[nShort] == e) {
+					nShort++;
+					continue;
+				}
+				uint64_t kmer = ((uint64_t)p << 8) | this->_kfKeys[e];
+				TIndexOffU top = 0, bot = 0;
+				kftabRange(kmer, top, bot);
+				assert_eq(this->_kfTops[e], top);
+#ifndef NDEBUG
+				if(eh._ftabChars <= _kftabChars) {
+					TIndexOffU ftabOff = (TIndexOffU)(kmer >> (2 * (_kftabChars - eh._ftabChars)));
+					assert_geq(top, this->ftabHi(ftabOff));
+					assert_leq(bot, this->ftabLo(ftabOff+1));
+				}
+#endif
+			}
+		}
+		assert_eq(nShort, this->_kfShortLen);
+	}
+
 	// Check offs
 	TIndexOff seenLen = (eh._bwtLen + 31) >> ((TIndexOffU)5);
 	TIndexOff *seen;
@@ -1650,9 +2284,9 @@ void Ebwt::sanityCheckAll(int reverse) const {
 	memset(seen, 0, OFF_SIZE * seenLen);
 	TIndexOffU offsLen = eh._offsLen;
 	for(TIndexOffU i = 0; i < offsLen; i++) {
-		assert_lt(this->_offs[i], eh._bwtLen);
-		TIndexOff w = this->_offs[i] >> 5;
-		TIndexOff r = this->_offs[i] & 31;
+		assert_lt(this->offAt(i), eh._bwtLen);
+		TIndexOff w = this->offAt(i) >> 5;
+		TIndexOff r = this->offAt(i) & 31;
 		assert_eq(0, (seen[w] >> r) & 1); // shouldn't have been seen before
 		seen[w] |= (1 << r);
 	}
@@ -1701,189 +2335,6 @@ inline int Ebwt::rowL(const SideLocus& l) const {
 #endif
 }
 
-/**
- * Inline-function version of the above.  This does not always seem to
- * be inlined
- */
-#if 0
-// Use gcc's intrinsic popcountll.  I don't recommend it because it
-// seems to be somewhat slower than the bit-bashing pop64 routine both
-// on an AMD server and on an Intel workstation.  On the other hand,
-// perhaps when the builtin is used GCC is smart enough to insert a
-// pop-count instruction on architectures that have one (e.g. Itanium).
-// For now, it's disabled.
-#define pop64(x) __builtin_popcountll(x)
-#elif 0
-__declspec naked int __stdcall pop64
-(uint64_t v)
-{
-static const uint64_t C55 = 0x5555555555555555ll;
-static const uint64_t C33 = 0x3333333333333333ll;
-static const uint64_t C0F = 0x0F0F0F0F0F0F0F0Fll;
-__asm {
-   MOVD      MM0, [ESP+4] ;v_low
-   PUNPCKLDQ MM0, [ESP+8] ;v
-   MOVQ      MM1, MM0     ;v
-   PSRLD     MM0, 1       ;v >> 1
-   PAND      MM0, [C55]   ;(v >> 1) & 0x55555555
-   PSUBD     MM1, MM0     ;w = v - ((v >> 1) & 0x55555555)
-   MOVQ      MM0, MM1     ;w
-   PSRLD     MM1, 2       ;w >> 2
-   PAND      MM0, [C33]   ;w & 0x33333333
-   PAND      MM1, [C33]   ;(w >> 2)  & 0x33333333
-   PADDD     MM0, MM1     ;x = (w & 0x33333333) +
-                          ; ((w >> 2) & 0x33333333)
-   MOVQ      MM1, MM0     ;x
-   PSRLD     MM0, 4       ;x >> 4
-   PADDD     MM0, MM1     ;x + (x >> 4)
-   PAND      MM0, [C0F]   ;y = (x + (x >> 4) & 0x0F0F0F0F)
-   PXOR      MM1, MM1     ;0
-   PSADBW    (MM0, MM1)   ;sum across all 8 bytes
-   MOVD      EAX, MM0     ;result in EAX per calling
-                          ; convention
-   EMMS                   ;clear MMX state
-   RET  8                 ;pop 8-byte argument off stack
-                          ; and return
-   }
-}
-#elif 0
-// Use a bytewise LUT version of popcount.  This is slower than the
-// bit-bashing pop64 routine both on an AMD server and on an Intel
-// workstation.  It seems to be about the same speed as the GCC builtin
-// on Intel, and a bit faster than it on AMD.  For now, it's disabled.
-const int popcntU8Table[256] = {
-    0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,
-    1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
-    1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
-    2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
-    1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
-    2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
-    2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
-    3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8
-};
-
-// Use this bytewise population count table
-inline static int pop64(uint64_t x) {
-	const unsigned char * p = (const unsigned char *) &x;
-	return popcntU8Table[p[0]] +
-	       popcntU8Table[p[1]] +
-	       popcntU8Table[p[2]] +
-	       popcntU8Table[p[3]] +
-	       popcntU8Table[p[4]] +
-	       popcntU8Table[p[5]] +
-	       popcntU8Table[p[6]] +
-	       popcntU8Table[p[7]];
-}
-#else
-#ifdef POPCNT_CAPABILITY   // wrapping of "struct"
-struct USE_POPCNT_GENERIC {
-#endif
-// Use this standard bit-bashing population count
-inline static int pop64(uint64_t x) {
-   x = x - ((x >> 1) & 0x5555555555555555llu);
-   x = (x & 0x3333333333333333llu) + ((x >> 2) & 0x3333333333333333llu);
-   x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Fllu;
-   x = x + (x >> 8);
-   x = x + (x >> 16);
-   x = x + (x >> 32);
-   return x & 0x3F;
-}
-#ifdef POPCNT_CAPABILITY  // wrapping a "struct"
-};
-#endif
-
-#ifdef POPCNT_CAPABILITY
-    struct USE_POPCNT_INSTRUCTION {
-        inline static int pop64(uint64_t x) {
-            int64_t count;
-            asm ("popcntq %[x],%[count]\n": [count] "=&r" (count): [x] "r" (x));
-            return count;
-        }
-    };
-#endif
-
-#endif
-
-/**
- * Tricky-bit-bashing bitpair counting for given two-bit value (0-3)
- * within a 64-bit argument.
- */
-#ifdef POPCNT_CAPABILITY
-template<typename Operation>
-#endif
-inline static int countInU64(int c, uint64_t dw) {
-	uint64_t c0 = c_table[c];
-	uint64_t x0 = dw ^ c0;
-	uint64_t x1 = (x0 >> 1);
-	uint64_t x2 = x1 & (0x5555555555555555llu);
-	uint64_t x3 = x0 & x2;
-#ifdef POPCNT_CAPABILITY
-    uint64_t tmp = Operation().pop64(x3);
-#else
-    uint64_t tmp = pop64(x3);
-#endif
-	return (int) tmp;
-}
-
-/**
- * Tricky-bit-bashing bitpair counting for given two-bit value (0-3)
- * within a 64-bit argument.
- *
- * Function gets 2.32% in profile
- */
-#ifdef POPCNT_CAPABILITY
-template<typename Operation>
-#endif
-inline static void countInU64Ex(uint64_t dw, TIndexOffU* arrs) {
-	uint64_t c0 = c_table[0];
-	uint64_t x0 = dw ^ c0;
-	uint64_t x1 = (x0 >> 1);
-	uint64_t x2 = x1 & (0x5555555555555555llu);
-	uint64_t x3 = x0 & x2;
-#ifdef POPCNT_CAPABILITY
-	uint64_t tmp = Operation().pop64(x3);
-#else
-	uint64_t tmp = pop64(x3);
-#endif
-	arrs[0] += (uint32_t) tmp;
-
-        c0 = c_table[1];
-        x0 = dw ^ c0;
-        x1 = (x0 >> 1);
-        x2 = x1 & (0x5555555555555555llu);
-        x3 = x0 & x2;
-#ifdef POPCNT_CAPABILITY
-        tmp = Operation().pop64(x3);
-#else
-        tmp = pop64(x3);
-#endif
-        arrs[1] += (uint32_t) tmp;
-
-        c0 = c_table[2];
-        x0 = dw ^ c0;
-        x1 = (x0 >> 1);
-        x2 = x1 & (0x5555555555555555llu);
-        x3 = x0 & x2;
-#ifdef POPCNT_CAPABILITY
-        tmp = Operation().pop64(x3);
-#else
-        tmp = pop64(x3);
-#endif
-        arrs[2] += (uint32_t) tmp;
-
-        c0 = c_table[3];
-        x0 = dw ^ c0;
-        x1 = (x0 >> 1);
-        x2 = x1 & (0x5555555555555555llu);
-        x3 = x0 & x2;
-#ifdef POPCNT_CAPABILITY
-        tmp = Operation().pop64(x3);
-#else
-        tmp = pop64(x3);
-#endif
-        arrs[3] += (uint32_t) tmp;
-}
-
 /**
  * Counts the number of occurrences of character 'c' in the given Ebwt
  * side up to (but not including) the given byte/bitpair (by/bp).
@@ -1893,134 +2344,62 @@ inline static void countInU64Ex(uint64_t dw, TIndexOffU* arrs) {
  *
  * Function gets 11.09% in profile
  */
+template<int L>
 inline TIndexOffU Ebwt::countUpTo(const SideLocus& l, int c) const {
-	// Count occurrences of c in each 64-bit (using bit trickery);
-	// Someday countInU64() and pop() functions should be
-	// vectorized/SSE-ized in case that helps.
-	TIndexOffU cCnt = 0;
+	typedef OccKernel<EBWT_LF_KERNEL(L)> K;
 	const uint8_t *side = l.side(this->_ebwt);
-	int i = 0;
-#if 1
-    #ifdef POPCNT_CAPABILITY
-    if ( _usePOPCNTinstruction) {
-        for(; i + 7 < l._by; i += 8) {
-            cCnt += countInU64<USE_POPCNT_INSTRUCTION>(c, *(uint64_t*)&side[i]);
-        }
-    }
-    else {
-        for(; i + 7 < l._by; i += 8) {
-            cCnt += countInU64<USE_POPCNT_GENERIC>(c, *(uint64_t*)&side[i]);
-        }
-    }
-    #else
-    for(; i + 7 < l._by; i += 8) {
-        cCnt += countInU64(c, *(uint64_t*)&side[i]);
-    }
-    #endif
-#else
-	for(; i + 2 < l._by; i += 2) {
-		cCnt += cCntLUT_16b_4[c][*(uint16_t*)&side[i]];
-	}
-#endif
 #ifdef SIXTY4_FORMAT
+	// Count occurrences of c in the whole words preceding <by,bp>
+	const int i = l._by & ~7;
+	TIndexOffU cCnt = K::countUpTo(_occ, side, i, c);
 	// Calculate number of bit pairs to shift off the end
 	const int bpShiftoff = 32 - (((l._by & 7) << 2) + l._bp);
 	if(bpShiftoff < 32) {
 		assert_lt(bpShiftoff, 32);
 		const uint64_t sw = (*(uint64_t*)&side[i]) << (bpShiftoff << 1);
-
-        #ifdef POPCNT_CAPABILITY
-        if (_usePOPCNTinstruction) {
-            cCnt += countInU64<USE_POPCNT_INSTRUCTION>(c, sw);
-        }
-        else {
-            cCnt += countInU64<USE_POPCNT_GENERIC>(c, sw);
-        }
-        #else
-		cCnt += countInU64(c, sw);
-        #endif
-
+		cCnt += occCountInU64<typename K::Pop>(c, sw);
 		if(c == 0) cCnt -= bpShiftoff; // we turned these into As
 	}
 #else
-	// Count occurences of c in the rest of the side (using LUT)
-	for(; i < l._by; i++) {
-		cCnt += cCntLUT_4[0][c][side[i]];
-	}
+	// Count occurrences of c in the whole bytes preceding <by,bp>
+	// using the kernel picked for this CPU when the index was opened
+	TIndexOffU cCnt = K::countUpTo(_occ, side, l._by, c);
 	// Count occurences of c in the rest of the byte
 	if(l._bp > 0) {
-		cCnt += cCntLUT_4[(int)l._bp][c][side[i]];
+		cCnt += cCntLUT_4[(int)l._bp][c][side[l._by]];
 	}
 #endif
 	return cCnt;
 }
 
 /**
- * Counts the number of occurrences of character 'c' in the given Ebwt
- * side up to (but not including) the given byte/bitpair (by/bp).
+ * Counts the number of occurrences of all four characters in the
+ * given Ebwt side up to (but not including) the given byte/bitpair
+ * (by/bp) and adds them to arrs[].
  */
+template<int L>
 inline void Ebwt::countUpToEx(const SideLocus& l, TIndexOffU* arrs) const {
-	int i = 0;
-	// Count occurrences of c in each 64-bit (using bit trickery);
-	// note: this seems does not seem to lend a significant boost to
-	// performance.  If you comment out this whole loop (which won't
-	// affect correctness - it will just cause the following loop to
-	// take up the slack) then runtime does not change noticeably.
-	// Someday the countInU64() and pop() functions should be
-	// vectorized/SSE-ized in case that helps.
+	typedef OccKernel<EBWT_LF_KERNEL(L)> K;
 	const uint8_t *side = l.side(this->_ebwt);
-
-#ifdef POPCNT_CAPABILITY
-    if (_usePOPCNTinstruction) {
-        for(; i+7 < l._by; i += 8) {
-            countInU64Ex<USE_POPCNT_INSTRUCTION>(*(uint64_t*)&side[i], arrs);
-        }
-    }
-    else {
-        for(; i+7 < l._by; i += 8) {
-            countInU64Ex<USE_POPCNT_GENERIC>(*(uint64_t*)&side[i], arrs);
-        }
-    }
-#else
-	for(; i+7 < l._by; i += 8) {
-		countInU64Ex(*(uint64_t*)&side[i], arrs);
-	}
-#endif
-
 #ifdef SIXTY4_FORMAT
+	const int i = l._by & ~7;
+	K::countUpToEx(_occ, side, i, arrs);
 	// Calculate number of bit pairs to shift off the end
 	const int bpShiftoff = 32 - (((l._by & 7) << 2) + l._bp);
 	assert_leq(bpShiftoff, 32);
 	if(bpShiftoff < 32) {
-		const uint64_t sw = (*(uint64_t*)&l.side(this->_ebwt)[i]) << (bpShiftoff << 1);
-
-#ifdef POPCNT_CAPABILITY
-        if (_usePOPCNTinstruction) {
-            countInU64Ex<USE_POPCNT_INSTRUCTION>(sw, arrs);
-        }
-        else{
-            countInU64Ex<USE_POPCNT_GENERIC>(sw, arrs);
-        }
-#else
-		countInU64Ex(sw, arrs);
-#endif
-
+		const uint64_t sw = (*(uint64_t*)&side[i]) << (bpShiftoff << 1);
+		occCountInU64Ex<typename K::Pop>(sw, arrs);
 		arrs[0] -= bpShiftoff;
 	}
 #else
-	// Count occurences of c in the rest of the side (using LUT)
-	for(; i < l._by; i++) {
-		arrs[0] += cCntLUT_4[0][0][side[i]];
-		arrs[1] += cCntLUT_4[0][1][side[i]];
-		arrs[2] += cCntLUT_4[0][2][side[i]];
-		arrs[3] += cCntLUT_4[0][3][side[i]];
-	}
-	// Count occurences of c in the rest of the byte
+	K::countUpToEx(_occ, side, l._by, arrs);
+	// Count occurences of each char in the rest of the byte
 	if(l._bp > 0) {
-		arrs[0] += cCntLUT_4[(int)l._bp][0][side[i]];
-		arrs[1] += cCntLUT_4[(int)l._bp][1][side[i]];
-		arrs[2] += cCntLUT_4[(int)l._bp][2][side[i]];
-		arrs[3] += cCntLUT_4[(int)l._bp][3][side[i]];
+		arrs[0] += cCntLUT_4[(int)l._bp][0][side[l._by]];
+		arrs[1] += cCntLUT_4[(int)l._bp][1][side[l._by]];
+		arrs[2] += cCntLUT_4[(int)l._bp][2][side[l._by]];
+		arrs[3] += cCntLUT_4[(int)l._bp][3][side[l._by]];
 	}
 #endif
 }
@@ -2030,6 +2409,7 @@ inline void Ebwt::countUpToEx(const SideLocus& l, TIndexOffU* arrs) const {
  * forward side to <by,bp> and add in the occ[] count up to the side
  * break just prior to the side.
  */
+template<int L>
 inline TIndexOffU Ebwt::countFwSide(const SideLocus& l, int c) const { /* check */
 	assert_lt(c, 4);
 	assert_geq(c, 0);
@@ -2038,7 +2418,7 @@ inline TIndexOffU Ebwt::countFwSide(const SideLocus& l, int c) const { /* check
 	assert_lt(l._bp, 4);
 	assert_geq(l._bp, 0);
 	const uint8_t *side = l.side(this->_ebwt);
-	TIndexOffU cCnt = countUpTo(l, c);
+	TIndexOffU cCnt = countUpTo<L>(l, c);
 	assert_leq(cCnt, this->_eh._sideBwtLen);
 	if(c == 0 && l._sideByteOff <= _zEbwtByteOff && l._sideByteOff + l._by >= _zEbwtByteOff) {
 		// Adjust for the fact that we represented $ with an 'A', but
@@ -2077,13 +2457,14 @@ inline TIndexOffU Ebwt::countFwSide(const SideLocus& l, int c) const { /* check
  * forward side to <by,bp> and add in the occ[] count up to the side
  * break just prior to the side.
  */
+template<int L>
 inline void Ebwt::countFwSideEx(const SideLocus& l, TIndexOffU* arrs) const
 {
 	assert_lt(l._by, (int)this->_eh._sideBwtSz);
 	assert_geq(l._by, 0);
 	assert_lt(l._bp, 4);
 	assert_geq(l._bp, 0);
-	countUpToEx(l, arrs);
+	countUpToEx<L>(l, arrs);
 #ifndef NDEBUG
 	assert_leq(arrs[0], this->_fchr[1]); // can't have jumped into next char's section
 	assert_leq(arrs[1], this->_fchr[2]); // can't have jumped into next char's section
@@ -2132,6 +2513,7 @@ inline void Ebwt::countFwSideEx(const SideLocus& l, TIndexOffU* arrs) const
  * (actual beginning) of the backward side, and subtract that from the
  * occ[] count up to the side break.
  */
+template<int L>
 inline TIndexOffU Ebwt::countBwSide(const SideLocus& l, int c) const {
 	assert_lt(c, 4);
 	assert_geq(c, 0);
@@ -2140,7 +2522,7 @@ inline TIndexOffU Ebwt::countBwSide(const SideLocus& l, int c) const {
 	assert_lt(l._bp, 4);
 	assert_geq(l._bp, 0);
 	const uint8_t *side = l.side(this->_ebwt);
-	TIndexOffU cCnt = countUpTo(l, c);
+	TIndexOffU cCnt = countUpTo<L>(l, c);
 	if(rowL(l) == c) cCnt++;
 	assert_leq(cCnt, this->_eh._sideBwtLen);
 	if(c == 0 && l._sideByteOff <= _zEbwtByteOff && l._sideByteOff + l._by >= _zEbwtByteOff) {
@@ -2180,13 +2562,14 @@ inline TIndexOffU Ebwt::countBwSide(const SideLocus& l, int c) const {
  * (actual beginning) of the backward side, and subtract that from the
  * occ[] count up to the side break.
  */
+template<int L>
 inline void Ebwt::countBwSideEx(const SideLocus& l, TIndexOffU* arrs) const {
 	assert_lt(l._by, (int)this->_eh._sideBwtSz);
 	assert_geq(l._by, 0);
 	assert_lt(l._bp, 4);
 	assert_geq(l._bp, 0);
 	const uint8_t *side = l.side(this->_ebwt);
-	countUpToEx(l, arrs);
+	countUpToEx<L>(l, arrs);
 	arrs[rowL(l)]++;
 	assert_leq(arrs[0], this->_eh._sideBwtLen);
 	assert_leq(arrs[1], this->_eh._sideBwtLen);
@@ -2236,12 +2619,13 @@ inline void Ebwt::countBwSideEx(const SideLocus& l, TIndexOffU* arrs) const {
 	assert_leq(x[2], this->fchr()[3]); \
 	assert_leq(x[3], this->fchr()[4])
 
+template<int L>
 inline TIndexOffU Ebwt::countBt2Side(const SideLocus& l, int c) const {
 	assert_range(0, 3, c);
 	assert_range(0, (int)this->_eh._sideBwtSz-1, (int)l._by);
 	assert_range(0, 3, (int)l._bp);
 	const uint8_t *side = l.side(this->ebwt());
-	TIndexOffU cCnt = countUpTo(l, c);
+	TIndexOffU cCnt = countUpTo<L>(l, c);
 	assert_leq(cCnt, this->_eh._sideBwtLen);
 	if(c == 0 && l._sideByteOff <= _zEbwtByteOff && l._sideByteOff + l._by >= _zEbwtByteOff) {
 		// Adjust for the fact that we represented $ with an 'A', but
@@ -2292,10 +2676,11 @@ inline TIndexOffU Ebwt::countBt2Side(const SideLocus& l, int c) const {
  *         Side ptr (result from SideLocus.side())
  *
  */
+template<int L>
 inline void Ebwt::countBt2SideEx(const SideLocus& l, TIndexOffU* arrs) const {
 	assert_range(0, (int)this->_eh._sideBwtSz-1, (int)l._by);
 	assert_range(0, 3, (int)l._bp);
-	countUpToEx(l, arrs);
+	countUpToEx<L>(l, arrs);
 	if(l._sideByteOff <= _zEbwtByteOff && l._sideByteOff + l._by >= _zEbwtByteOff) {
 		// Adjust for the fact that we represented $ with an 'A', but
 		// shouldn't count it as an 'A' here
@@ -2330,6 +2715,7 @@ inline void Ebwt::countBt2SideEx(const SideLocus& l, TIndexOffU* arrs) const {
  * Given top and bot loci, calculate counts of all four DNA chars up to
  * those loci.  Used for more advanced backtracking-search.
  */
+template<int L>
 inline void Ebwt::mapLFEx(const SideLocus& ltop,
                                 const SideLocus& lbot,
                                 TIndexOffU *tops,
@@ -2346,20 +2732,20 @@ inline void Ebwt::mapLFEx(const SideLocus& ltop,
 	assert_eq(0, tops[1]); assert_eq(0, bots[1]);
 	assert_eq(0, tops[2]); assert_eq(0, bots[2]);
 	assert_eq(0, tops[3]); assert_eq(0, bots[3]);
-	if(ltop._fw) {
+	if(lineSidesLayout<L>(_eh) || ltop._fw) {
 		 // Forward side
-		!_eh._isBt2Index ? countFwSideEx(ltop, tops)
-		                 : countBt2SideEx(ltop, tops);
+		!lineSidesLayout<L>(_eh) ? countFwSideEx<L>(ltop, tops)
+		                         : countBt2SideEx<L>(ltop, tops);
 	} else {
-		countBwSideEx(ltop, tops); // Backward side
+		countBwSideEx<L>(ltop, tops); // Backward side
 	}
 
-	if(lbot._fw) {
+	if(lineSidesLayout<L>(_eh) || lbot._fw) {
 		// Forward side
-		!_eh._isBt2Index ? countFwSideEx(lbot, bots)
-		                 : countBt2SideEx(lbot, bots);
+		!lineSidesLayout<L>(_eh) ? countFwSideEx<L>(lbot, bots)
+		                         : countBt2SideEx<L>(lbot, bots);
 	} else {
-		countBwSideEx(lbot, bots); // Backward side
+		countBwSideEx<L>(lbot, bots); // Backward side
 	}
 #ifndef NDEBUG
 	if(_sanity && !overrideSanity) {
@@ -2378,11 +2764,22 @@ inline void Ebwt::mapLFEx(const SideLocus& ltop,
 #endif
 }
 
+inline void Ebwt::mapLFEx(const SideLocus& ltop,
+                                const SideLocus& lbot,
+                                TIndexOffU *tops,
+                                TIndexOffU *bots
+                                ASSERT_ONLY(, bool overrideSanity)
+                                ) const
+{
+	mapLFEx<EBWT_LAYOUT_ANY>(ltop, lbot, tops, bots ASSERT_ONLY(, overrideSanity));
+}
+
 #ifndef NDEBUG
 /**
  * Given top and bot loci, calculate counts of all four DNA chars up to
  * those loci.  Used for more advanced backtracking-search.
  */
+template<int L>
 inline void Ebwt::mapLFEx(const SideLocus& l,
 		TIndexOffU *arrs
                                 ASSERT_ONLY(, bool overrideSanity)
@@ -2392,12 +2789,12 @@ inline void Ebwt::mapLFEx(const SideLocus& l,
 	assert_eq(0, arrs[1]);
 	assert_eq(0, arrs[2]);
 	assert_eq(0, arrs[3]);
-	if(l._fw) {
+	if(lineSidesLayout<L>(_eh) || l._fw) {
 		// Forward side
-		!_eh._isBt2Index ? countFwSideEx(l, arrs)
-		                 : countBt2SideEx(l, arrs);
+		!lineSidesLayout<L>(_eh) ? countFwSideEx<L>(l, arrs)
+		                         : countBt2SideEx<L>(l, arrs);
 	} else {
-		countBwSideEx(l, arrs); // Backward side
+		countBwSideEx<L>(l, arrs); // Backward side
 	}
 #ifndef NDEBUG
 	if(_sanity && !overrideSanity) {
@@ -2411,11 +2808,20 @@ inline void Ebwt::mapLFEx(const SideLocus& l,
 	}
 #endif
 }
+
+inline void Ebwt::mapLFEx(const SideLocus& l,
+		TIndexOffU *arrs
+                                ASSERT_ONLY(, bool overrideSanity)
+                                ) const
+{
+	mapLFEx<EBWT_LAYOUT_ANY>(l, arrs ASSERT_ONLY(, overrideSanity));
+}
 #endif
 
 /**
  * Given row i, return the row that the LF mapping maps i to.
  */
+template<int L>
 inline TIndexOffU Ebwt::mapLF(const SideLocus& l
                                   ASSERT_ONLY(, bool overrideSanity)
                                   ) const
@@ -2428,13 +2834,13 @@ inline TIndexOffU Ebwt::mapLF(const SideLocus& l
 	int c = rowL(l);
 	assert_lt(c, 4);
 	assert_geq(c, 0);
-	if(l._fw) {
+	if(lineSidesLayout<L>(_eh) || l._fw) {
 		// Forward side
-		ret = !_eh._isBt2Index ? countFwSide(l, c)
-		                       : countBt2Side(l, c);
+		ret = !lineSidesLayout<L>(_eh) ? countFwSide<L>(l, c)
+		                               : countBt2Side<L>(l, c);
 	}
 	else {
-		ret = countBwSide(l, c); // Backward side
+		ret = countBwSide<L>(l, c); // Backward side
 	}
 	assert_lt(ret, this->_eh._bwtLen);
 #ifndef NDEBUG
@@ -2450,10 +2856,18 @@ inline TIndexOffU Ebwt::mapLF(const SideLocus& l
 	return ret;
 }
 
+inline TIndexOffU Ebwt::mapLF(const SideLocus& l
+                                  ASSERT_ONLY(, bool overrideSanity)
+                                  ) const
+{
+	return mapLF<EBWT_LAYOUT_ANY>(l ASSERT_ONLY(, overrideSanity));
+}
+
 /**
  * Given row i and character c, return the row that the LF mapping maps
  * i to on character c.
  */
+template<int L>
 inline TIndexOffU Ebwt::mapLF(const SideLocus& l, int c
                                   ASSERT_ONLY(, bool overrideSanity)
                                   ) const
@@ -2464,13 +2878,13 @@ inline TIndexOffU Ebwt::mapLF(const SideLocus& l, int c
 	TIndexOffU ret;
 	assert_lt(c, 4);
 	assert_geq(c, 0);
-	if(l._fw) {
+	if(lineSidesLayout<L>(_eh) || l._fw) {
 		// Forward side
-		ret = !_eh._isBt2Index ? countFwSide(l, c)
-		                       : countBt2Side(l, c);
+		ret = !lineSidesLayout<L>(_eh) ? countFwSide<L>(l, c)
+		                               : countBt2Side<L>(l, c);
 	}
 	else {
-		ret = countBwSide(l, c); // Backward side
+		ret = countBwSide<L>(l, c); // Backward side
 	}
 	assert_lt(ret, this->_eh._bwtLen);
 #ifndef NDEBUG
@@ -2486,10 +2900,18 @@ inline TIndexOffU Ebwt::mapLF(const SideLocus& l, int c
 	return ret;
 }
 
+inline TIndexOffU Ebwt::mapLF(const SideLocus& l, int c
+                                  ASSERT_ONLY(, bool overrideSanity)
+                                  ) const
+{
+	return mapLF<EBWT_LAYOUT_ANY>(l, c ASSERT_ONLY(, overrideSanity));
+}
+
 /**
  * Given row i and character c, return the row that the LF mapping maps
  * i to on character c.
  */
+template<int L>
 inline TIndexOffU Ebwt::mapLF1(TIndexOffU row, const SideLocus& l, int c
                                    ASSERT_ONLY(, bool overrideSanity)
                                    ) const
@@ -2501,12 +2923,12 @@ inline TIndexOffU Ebwt::mapLF1(TIndexOffU row, const SideLocus& l, int c
 	TIndexOffU ret;
 	assert_lt(c, 4);
 	assert_geq(c, 0);
-	if(l._fw) {
+	if(lineSidesLayout<L>(_eh) || l._fw) {
 		// Forward side
-		ret = !_eh._isBt2Index ? countFwSide(l, c)
-		                       : countBt2Side(l, c);
+		ret = !lineSidesLayout<L>(_eh) ? countFwSide<L>(l, c)
+		                               : countBt2Side<L>(l, c);
 	} else {
-		ret = countBwSide(l, c); // Backward side
+		ret = countBwSide<L>(l, c); // Backward side
 	}
 	assert_lt(ret, this->_eh._bwtLen);
 #ifndef NDEBUG
@@ -2522,10 +2944,18 @@ inline TIndexOffU Ebwt::mapLF1(TIndexOffU row, const SideLocus& l, int c
 	return ret;
 }
 
+inline TIndexOffU Ebwt::mapLF1(TIndexOffU row, const SideLocus& l, int c
+                                   ASSERT_ONLY(, bool overrideSanity)
+                                   ) const
+{
+	return mapLF1<EBWT_LAYOUT_ANY>(row, l, c ASSERT_ONLY(, overrideSanity));
+}
+
 /**
  * Given row i and character c, return the row that the LF mapping maps
  * i to on character c.
  */
+template<int L>
 inline int Ebwt::mapLF1(TIndexOffU& row, const SideLocus& l
                               ASSERT_ONLY(, bool overrideSanity)
                               ) const
@@ -2537,12 +2967,12 @@ inline int Ebwt::mapLF1(TIndexOffU& row, const SideLocus& l
 	int c = rowL(l);
 	assert_lt(c, 4);
 	assert_geq(c, 0);
-	if(l._fw) {
+	if(lineSidesLayout<L>(_eh) || l._fw) {
 		// Forward side
-		row = !_eh._isBt2Index ? countFwSide(l, c)
-		                       : countBt2Side(l, c);
+		row = !lineSidesLayout<L>(_eh) ? countFwSide<L>(l, c)
+		                               : countBt2Side<L>(l, c);
 	} else {
-		row = countBwSide(l, c); // Backward side
+		row = countBwSide<L>(l, c); // Backward side
 	}
 	assert_lt(row, this->_eh._bwtLen);
 #ifndef NDEBUG
@@ -2558,6 +2988,13 @@ inline int Ebwt::mapLF1(TIndexOffU& row, const SideLocus& l
 	return c;
 }
 
+inline int Ebwt::mapLF1(TIndexOffU& row, const SideLocus& l
+                              ASSERT_ONLY(, bool overrideSanity)
+                              ) const
+{
+	return mapLF1<EBWT_LAYOUT_ANY>(row, l ASSERT_ONLY(, overrideSanity));
+}
+
 /**
  * Take an offset into the joined text and translate it into the
  * reference of the index it falls on, the offset into the reference,
@@ -2682,6 +3119,116 @@ inline bool Ebwt::report(const BTDnaString& query,
 
 #include "row_chaser.h"
 
+/**
+ * Prefetch the idx'th SA sample, for an offAt(idx) a little later.
+ */
+inline void Ebwt::prefetchOff(TIndexOffU idx) const {
+#ifndef NO_PREFETCH
+	if(_offsPacked == NULL) {
+		__builtin_prefetch((const void *)(_offs + idx), 0, PREFETCH_LOCALITY);
+	} else {
+		__builtin_prefetch((const void *)(_offsPacked + (((uint64_t)idx * _offsBits) >> 3)),
+		                   0, PREFETCH_LOCALITY);
+	}
+#endif
+}
+
+/**
+ * Prefetch what the next look at BW row 'row' by resolveRows() will
+ * need: the SA sample if the row is marked, or else the side for the
+ * next LF step, plus (in a text-sampled index, where telling whether
+ * a row is marked means looking it up) the row's bitvector line.
+ */
+template<int L>
+inline void Ebwt::resolvePrefetch(TIndexOffU row, SideLocus& l) const {
+	if(row == _zOff) return;
+	if(_sampBits == NULL) {
+		if((row & _eh._offMask) == row) {
+			prefetchOff(row >> _eh._offRate);
+			return;
+		}
+	} else {
+		prefetchSampled(row);
+	}
+	l.initFromRow<L>(row, this->_eh, this->_ebwt);
+}
+
+/**
+ * Resolve each of the n BWT rows in rows[] to its offset into the
+ * joined reference, writing it to offs[].  This is the same walk as
+ * RowChaser/reportChaseOne: LF-map left until reaching a marked row or
+ * the row for the 0th suffix.  Here up to RESOLVE_LANES walks are
+ * kept in flight at once and advanced one step per round, so the
+ * side (or SA sample) each walk needs next has been prefetched by the
+ * time the round comes back to it, rather than every step stalling on
+ * its own cache miss.  Returns the total number of LF steps taken.
+ */
+inline uint64_t Ebwt::resolveRows(const TIndexOffU* rows, size_t n, TIndexOffU* offs) const {
+	uint64_t steps = 0;
+#define RESOLVE_ROWS(L) steps = resolveRows<L>(rows, n, offs)
+	EBWT_LF_DISPATCH(lfVariant(), RESOLVE_ROWS);
+#undef RESOLVE_ROWS
+	return steps;
+}
+
+/**
+ * resolveRows() compiled for LF variant L.
+ */
+template<int L>
+inline uint64_t Ebwt::resolveRows(const TIndexOffU* rows, size_t n, TIndexOffU* offs) const {
+	const size_t RESOLVE_LANES = 16;
+	SideLocus  loc[RESOLVE_LANES];
+	TIndexOffU row[RESOLVE_LANES];
+	TIndexOffU jumps[RESOLVE_LANES];
+	size_t     dst[RESOLVE_LANES];
+	size_t next = 0;  // next element of rows[] to start walking
+	size_t nlanes = 0;
+	uint64_t steps = 0;
+	// Start a walk in lane k, prefetching whatever it needs first
+	#define RESOLVE_START(k) { \
+		row[k] = rows[next]; \
+		jumps[k] = 0; \
+		dst[k] = next++; \
+		resolvePrefetch<L>(row[k], loc[k]); \
+	}
+	while(nlanes < RESOLVE_LANES && next < n) {
+		RESOLVE_START(nlanes);
+		nlanes++;
+	}
+	while(nlanes > 0) {
+		for(size_t k = 0; k < nlanes; ) {
+			TIndexOffU r = row[k];
+			TIndexOffU idx = 0;
+			if(r == _zOff || sampledRow(r, idx)) {
+				// Walk finished; marked rows' samples were prefetched
+				offs[dst[k]] = (r == _zOff) ? jumps[k] : (offAt(idx) + jumps[k]);
+				steps += jumps[k];
+				assert_eq(RowChaser::toFlatRefOff(this, 1, rows[dst[k]]), offs[dst[k]]);
+				if(next < n) {
+					RESOLVE_START(k);
+				} else {
+					// Retire the lane; the last lane moves into slot k
+					nlanes--;
+					loc[k] = loc[nlanes];
+					row[k] = row[nlanes];
+					jumps[k] = jumps[nlanes];
+					dst[k] = dst[nlanes];
+					continue;
+				}
+			} else {
+				// One LF step; prefetch what the next step needs
+				r = mapLF<L>(loc[k]);
+				row[k] = r;
+				jumps[k]++;
+				resolvePrefetch<L>(r, loc[k]);
+			}
+			k++;
+		}
+	}
+	#undef RESOLVE_START
+	return steps;
+}
+
 /**
  * Report a result.  Involves walking backwards along the original
  * string by way of the LF-mapping until we reach a marked SA row or
@@ -2711,9 +3258,7 @@ inline bool Ebwt::reportChaseOne(const BTDnaString& query,
 	uint32_t jumps = 0;
 	ASSERT_ONLY(uint32_t origi = i);
 	SideLocus myl;
-	const TIndexOffU offMask = this->_eh._offMask;
-	const uint32_t offRate = this->_eh._offRate;
-	const TIndexOffU* offs = this->_offs;
+	TIndexOffU idx = 0;
 	// If the caller didn't give us a pre-calculated (and prefetched)
 	// locus, then we have to do that now
 	if(l == NULL) {
@@ -2723,7 +3268,7 @@ inline bool Ebwt::reportChaseOne(const BTDnaString& query,
 	assert(l != NULL);
 	assert(l->valid());
 	// Walk along until we reach the next marked row to the left
-	while(((i & offMask) != i) && i != _zOff) {
+	while(i != _zOff && !sampledRow(i, idx)) {
 		// Not a marked row; walk left one more char
 		TIndexOffU newi = mapLF(*l); // calc next row
 		assert_neq(newi, i);
@@ -2740,7 +3285,7 @@ inline bool Ebwt::reportChaseOne(const BTDnaString& query,
 		VMSG_NL("reportChaseOne found zoff off=" << off << " (jumps=" << jumps << ")");
 	} else {
 		// Normal marked row, calculate offset of row i
-		off = offs[i >> offRate] + jumps;
+		off = offAt(idx) + jumps;
 		VMSG_NL("reportChaseOne found off=" << off << " (jumps=" << jumps << ")");
 	}
 #ifndef NDEBUG
@@ -2840,9 +3385,7 @@ void Ebwt::readIntoMemory(
 	bool startVerbose)
 {
 	bool switchEndian; // dummy; caller doesn't care
-#ifdef BOWTIE_MM
 	char *mmFile[] = { NULL, NULL };
-#endif
 	if(_in1Str.length() > 0) {
 		if(_verbose || startVerbose) {
 			cerr << "  About to open input files: ";
@@ -2887,6 +3430,7 @@ void Ebwt::readIntoMemory(
 					cerr << "Error: Could not memory-map the index file " << names[i] << endl;
 					throw 1;
 				}
+				if(hugePages_) hugeAdvise(mmFile[i], sbuf.st_size);
 				if(mmSweep) {
 					int sum = 0;
 					for(off_t j = 0; j < sbuf.st_size; j += 1024) {
@@ -2970,7 +3514,29 @@ void Ebwt::readIntoMemory(
 			throw 1;
 		}
 	} else entireRev = true;
+	bool lineSides = (flags < 0 && (((-flags) & EBWT_LINE_SIDES) != 0));
+	if(lineSides) {
+		// Sides are laid out as in a bowtie2 index
+		_isBt2Index = true;
+	}
+	bool kftab = (flags < 0 && (((-flags) & EBWT_KFTAB) != 0));
 	bytesRead += 4;
+	_paged = (flags < 0 && (((-flags) & EBWT_PAGED) != 0));
+	_textSamp = (flags < 0 && (((-flags) & EBWT_TEXT_SAMP) != 0));
+	memset(_secOffs, 0, sizeof(_secOffs));
+	if(_paged) {
+		// Read the table of section offsets; sections we don't know
+		// about (from a newer bowtie-build) are ignored
+		uint64_t nsecs = readU<uint64_t>(_in1, switchEndian);
+		for(uint64_t i = 0; i < nsecs; i++) {
+			uint64_t off = readU<uint64_t>(_in1, switchEndian);
+			if(i < (uint64_t)EBWT_NUM_SECS) _secOffs[i] = off;
+		}
+		bytesRead += 8 + nsecs*8;
+		if(_verbose || startVerbose) {
+			cerr << "  Paged index; ebwt[] at byte " << _secOffs[EBWT_SEC_EBWT] << endl;
+		}
+	}
 
 	// Create a new EbwtParams from the entries read from primary stream
 	EbwtParams *eh;
@@ -3022,6 +3588,7 @@ void Ebwt::readIntoMemory(
 	}
 
 	// Read nPat from primary stream
+	seekSection(_in1, EBWT_SEC_PLEN, bytesRead);
 	this->_nPat = readI<TIndexOffU>(_in1, switchEndian);
 	bytesRead += OFF_SIZE;
 	if(this->_plen != NULL && !_useMm) {
@@ -3062,7 +3629,7 @@ void Ebwt::readIntoMemory(
 		}
 	}
 
-	bool shmemLeader;
+	SecondaryRead sec;
 
 	// TODO: I'm not consistent on what "header" means.  Here I'm using
 	// "header" to mean everything that would exist in memory if we
@@ -3070,6 +3637,32 @@ void Ebwt::readIntoMemory(
 	// (i.e. everything up to and including join()).
 	if(justHeader) goto done;
 
+	// The secondary stream holds offs[] and isa[], which depend only on
+	// the header.  If they're going into our own heap memory, read them
+	// on another thread while this one reads the rest of the primary
+	// stream.  Shared memory has its own leader/follower handshake and
+	// memory-mapping has nothing to read, so those stay serial.
+	sec.ebwt = this;
+	sec.mmFile = mmFile[1];
+	sec.switchEndian = switchEndian;
+	sec.startVerbose = startVerbose;
+	sec.len = len;
+	sec.offsLen = offsLen;
+	sec.offsSz = offsSz;
+	sec.offRateDiff = offRateDiff;
+	sec.offsLenSampled = offsLenSampled;
+	sec.isaLen = isaLen;
+	sec.isaRateDiff = isaRateDiff;
+	sec.isaLenSampled = isaLenSampled;
+	if(!_useMm && !useShmem_) {
+#if (__cplusplus >= 201103L)
+		sec.thread = new std::thread(readSecondaryWorker, (void*)&sec);
+#else
+		sec.thread = new tthread::thread(readSecondaryWorker, (void*)&sec);
+#endif
+	}
+
+	seekSection(_in1, EBWT_SEC_RSTARTS, bytesRead);
 	this->_nFrag = readU<TIndexOffU>(_in1, switchEndian);
 	bytesRead += OFF_SIZE;
 	if(_verbose || startVerbose) {
@@ -3102,6 +3695,14 @@ void Ebwt::readIntoMemory(
 		}
 	}
 
+	if(_paged) {
+		seekSection(_in1, EBWT_SEC_EBWT, bytesRead);
+	} else if(lineSides) {
+		// Skip the padding that puts ebwt[] on a 64-byte boundary
+		off_t pad = (64 - (ftello(_in1) & 63)) & 63;
+		fseeko(_in1, pad, SEEK_CUR);
+		bytesRead += pad;
+	}
 	if(_useMm) {
 #ifdef BOWTIE_MM
 		this->_ebwt = (uint8_t*)(mmFile[0] + bytesRead);
@@ -3109,6 +3710,8 @@ void Ebwt::readIntoMemory(
 		fseeko(_in1, eh->_ebwtTotLen, SEEK_CUR);
 #endif
 	} else {
+		string msg = "  Time reading ebwt[] from " + _in1Str + ": ";
+		Timer _t(cerr, msg.c_str(), loadTiming_);
 		// Allocate ebwt (big allocation)
 		if(_verbose || startVerbose) {
 			cerr << "Reading ebwt (" << eh->_ebwtTotLen << "): ";
@@ -3118,13 +3721,21 @@ void Ebwt::readIntoMemory(
 		if(useShmem_) {
 			shmemLeader = ALLOC_SHARED_U8(
 				(_in1Str + "[ebwt]"), eh->_ebwtTotLen, &this->_ebwt,
-				"ebwt[]", (_verbose || startVerbose));
+				"ebwt[]", (_verbose || startVerbose), hugePages_);
 			if(_verbose || startVerbose) {
 				cerr << "  shared-mem " << (shmemLeader ? "leader" : "follower") << endl;
 			}
 		} else {
 			try {
-				this->_ebwt = new uint8_t[eh->_ebwtTotLen];
+				// Over-allocate so that sides can start on cache-line
+				// boundaries
+				if(hugePages_) {
+					this->_ebwtMem = hugeAlloc(eh->_ebwtTotLen, true);
+					this->_ebwt = this->_ebwtMem;
+				} else {
+					this->_ebwtMem = new uint8_t[eh->_ebwtTotLen + 63];
+					this->_ebwt = this->_ebwtMem + ((64 - ((uintptr_t)this->_ebwtMem & 63)) & 63);
+				}
 			} catch(bad_alloc& e) {
 				cerr << "Out of memory allocating the ebwt[] array for the Bowtie index.  Please try" << endl
 				     << "again on a computer with more memory." << endl;
@@ -3152,10 +3763,12 @@ void Ebwt::readIntoMemory(
 			}
 			if(switchEndian) {
 				uint8_t *side = this->_ebwt;
+				const int ncums = eh->_isBt2Index ? 4 : 2;
 				for(size_t i = 0; i < eh->_numSides; i++) {
-					TIndexOffU *cums = reinterpret_cast<TIndexOffU*>(side + eh->_sideSz - 2*OFF_SIZE);
-					cums[0] = endianSwapU(cums[0]);
-					cums[1] = endianSwapU(cums[1]);
+					TIndexOffU *cums = reinterpret_cast<TIndexOffU*>(side + eh->_sideSz - ncums*OFF_SIZE);
+					for(int j = 0; j < ncums; j++) {
+						cums[j] = endianSwapU(cums[j]);
+					}
 					side += this->_eh._sideSz;
 				}
 			}
@@ -3168,11 +3781,14 @@ void Ebwt::readIntoMemory(
 	}
 
 	// Read zOff from primary stream
+	seekSection(_in1, EBWT_SEC_FCHR, bytesRead);
 	_zOff = readU<TIndexOffU>(_in1, switchEndian);
 	bytesRead += OFF_SIZE;
 	assert_lt(_zOff, len);
 
 	try {
+		string msg = "  Time reading fchr[], ftab[], eftab[] and kftab from " + _in1Str + ": ";
+		Timer _t(cerr, msg.c_str(), loadTiming_ && !_useMm);
 		// Read fchr from primary stream
 		if(_verbose || startVerbose) cerr << "Reading fchr (5)" << endl;
 		if(_useMm) {
@@ -3191,6 +3807,7 @@ void Ebwt::readIntoMemory(
 		}
 		assert_gt(this->_fchr[4], this->_fchr[0]);
 		// Read ftab from primary stream
+		seekSection(_in1, EBWT_SEC_FTAB, bytesRead);
 		if(_verbose || startVerbose) {
 			cerr << "Reading ftab (" << eh->_ftabLen << "): ";
 			logTime(cerr);
@@ -3202,7 +3819,7 @@ void Ebwt::readIntoMemory(
 			fseeko(_in1, eh->_ftabLen*OFF_SIZE, SEEK_CUR);
 #endif
 		} else {
-			this->_ftab = new TIndexOffU[eh->_ftabLen];
+			this->_ftab = newBig<TIndexOffU>(eh->_ftabLen);
 			if(switchEndian) {
 				for(TIndexOffU i = 0; i < eh->_ftabLen; i++)
 					this->_ftab[i] = readU<TIndexOffU>(_in1, switchEndian);
@@ -3215,6 +3832,7 @@ void Ebwt::readIntoMemory(
 			}
 		}
 		// Read etab from primary stream
+		seekSection(_in1, EBWT_SEC_EFTAB, bytesRead);
 		if(_verbose || startVerbose) {
 			cerr << "Reading eftab (" << eh->_eftabLen << "): ";
 			logTime(cerr);
@@ -3245,8 +3863,31 @@ void Ebwt::readIntoMemory(
 				assert_eq(0, this->_eftab[i]);
 			}
 		}
+		// Read kftab from primary stream
+		_kftabChars = 0;
+		if(kftab) {
+			seekSection(_in1, EBWT_SEC_KFTAB, bytesRead);
+			_kftabChars = (int)readU<TIndexOffU>(_in1, switchEndian);
+			_kftabLen   = readU<TIndexOffU>(_in1, switchEndian);
+			_kfShortLen = readU<TIndexOffU>(_in1, switchEndian);
+			bytesRead += 3*OFF_SIZE;
+			if(_kftabChars < 5 || _kftabChars > 16) {
+				cerr << "Error: bad k-mer length in kftab: " << _kftabChars << endl;
+				throw 1;
+			}
+			if(_verbose || startVerbose) {
+				cerr << "Reading kftab (" << _kftabLen << " entries for "
+				     << _kftabChars << "-mers): ";
+				logTime(cerr);
+			}
+			_kfShort = readKftabArray<TIndexOffU>(mmFile[0], bytesRead, _kfShortLen, switchEndian, false);
+			_kfIdx   = readKftabArray<TIndexOffU>(mmFile[0], bytesRead, kftabIdxLen(_kftabChars), switchEndian, true);
+			_kfTops  = readKftabArray<TIndexOffU>(mmFile[0], bytesRead, _kftabLen, switchEndian, true);
+			_kfKeys  = readKftabArray<uint8_t>(mmFile[0], bytesRead, _kftabLen, switchEndian, true);
+			assert_eq(_kftabLen, _kfIdx[kftabIdxLen(_kftabChars)-1]);
+		}
 	} catch(bad_alloc& e) {
-		cerr << "Out of memory allocating fchr[], ftab[] or eftab[] arrays for the Bowtie index." << endl
+		cerr << "Out of memory allocating fchr[], ftab[], eftab[] or kftab arrays for the Bowtie index." << endl
 		     << "Please try again on a computer with more memory." << endl;
 		throw 1;
 	}
@@ -3254,6 +3895,7 @@ void Ebwt::readIntoMemory(
 	// Read reference sequence names from primary index file (or not,
 	// if --refidx is specified)
 	if(loadNames) {
+		seekSection(_in1, EBWT_SEC_NAMES, bytesRead);
 		while(true) {
 			char c = '\0';
 			if(MM_READ(_in1, (void *)(&c), (size_t)1) != (size_t)1) break;
@@ -3270,177 +3912,345 @@ void Ebwt::readIntoMemory(
 		}
 	}
 
-	bytesRead = 4; // reset for secondary index file (already read 1-sentinel)
-
-	shmemLeader = true;
-	if(_verbose || startVerbose) {
-		cerr << "Reading offs (" << offsLenSampled << " 32-bit words): ";
-		logTime(cerr);
+	if(sec.thread != NULL) {
+		// Wait for offs[] and isa[]
+		sec.join();
+		if(sec.failed) throw 1;
+	} else {
+		readSecondary(sec);
 	}
-	if(!_useMm) {
-		if(!useShmem_) {
-			// Allocate offs_
-			try {
-				this->_offs = new TIndexOffU[offsLenSampled];
-			} catch(bad_alloc& e) {
-				cerr << "Out of memory allocating the offs[] array  for the Bowtie index." << endl
-					 << "Please try again on a computer with more memory." << endl;
-				throw 1;
-			}
-		} else {
-			shmemLeader = ALLOC_SHARED_U(
-				(_in2Str + "[offs]"), offsLenSampled*OFF_SIZE, &this->_offs,
-				"offs", (_verbose || startVerbose));
+
+	this->postReadInit(*eh); // Initialize fields of Ebwt not read from file
+	if(_verbose || startVerbose) print(cerr, *eh);
+	if(hugePages_) {
+		cerr << "Index " << _in1Str << ":" << endl
+		     << "  ebwt[] backed by " << pageBacking(this->_ebwt) << endl
+		     << "  ftab[] backed by " << pageBacking(this->_ftab) << endl;
+		if(this->_offs != NULL || this->_offsPacked != NULL) {
+			cerr << "  offs[] backed by " << pageBacking(
+				this->_offs != NULL ? (const void*)this->_offs : (const void*)this->_offsPacked) << endl;
 		}
 	}
 
-	if(_overrideOffRate < 32) {
-		if(shmemLeader) {
-			// Allocate offs (big allocation)
-			if(switchEndian || offRateDiff > 0) {
-				assert(!_useMm);
-				const TIndexOffU blockMaxSz = (2 * 1024 * 1024); // 2 MB block size
-				const TIndexOffU blockMaxSzU = (blockMaxSz >> (OFF_SIZE/4 +1)); // # U32s per block
-				char *buf = new char[blockMaxSz];
-				for(TIndexOffU i = 0; i < offsLen; i += blockMaxSzU) {
-					TIndexOffU block = min<TIndexOffU>(blockMaxSzU, offsLen - i);
-					size_t r = MM_READ(_in2, (void *)buf, block << (OFF_SIZE/4 + 1));
-					if(r != (size_t)(block << (OFF_SIZE/4 + 1))) {
-						cerr << "Error reading block of offs array: " << r << ", " << (block << (OFF_SIZE/4 + 1)) << endl
-						     << "Your index files may be corrupt; please try re-building or re-downloading." << endl
-						     << "A complete index consists of 6 files: XYZ.1.ebwt, XYZ.2.ebwt, XYZ.3.ebwt," << endl
-						     << "XYZ.4.ebwt, XYZ.rev.1.ebwt, and XYZ.rev.2.ebwt.  The XYZ.1.ebwt and " << endl
-						     << "XYZ.rev.1.ebwt files should have the same size, as should the XYZ.2.ebwt and" << endl
-						     << "XYZ.rev.2.ebwt files." << endl;
-						throw 1;
-					}
-					TIndexOffU idx = i >> offRateDiff;
-					for(TIndexOffU j = 0; j < block; j += (1 << offRateDiff)) {
-						assert_lt(idx, offsLenSampled);
-						this->_offs[idx] = ((TIndexOffU*)buf)[j];
-						if(switchEndian) {
-							this->_offs[idx] = endianSwapU(this->_offs[idx]);
+	// The fact that _ebwt and friends actually point to something
+	// (other than NULL) now signals to other member functions that the
+	// Ebwt is loaded into memory.
+
+  done: // Exit hatch for both justHeader and !justHeader
+
+	// Be kind
+	if(deleteEh) delete eh;
+	if (_in1 != NULL) rewind(_in1);
+	if (_in2 != NULL) rewind(_in2);
+}
+
+/**
+ * Read offs[] and isa[] from the secondary stream.  Called either from
+ * readIntoMemory() or, when both are going into our own heap memory,
+ * from a thread of their own while readIntoMemory() carries on with
+ * the primary stream.
+ */
+void Ebwt::readSecondary(const SecondaryRead& r) {
+	const bool switchEndian = r.switchEndian;
+	const bool startVerbose = r.startVerbose;
+	const TIndexOffU len = r.len;
+	const TIndexOffU offsLen = r.offsLen;
+	const uint64_t offsSz = r.offsSz;
+	const TIndexOffU offRateDiff = r.offRateDiff;
+	const TIndexOffU offsLenSampled = r.offsLenSampled;
+	const TIndexOffU isaLen = r.isaLen;
+	const TIndexOffU isaRateDiff = r.isaRateDiff;
+	const TIndexOffU isaLenSampled = r.isaLenSampled;
+	uint64_t bytesRead = 4; // already read 1-sentinel
+	bool shmemLeader = true;
+	// When a text-sampled index's offRate is overridden, which of the
+	// samples in the file were kept
+	EList<uint64_t> sampKept;
+
+	{
+		string msg = "  Time reading offs[] from " + _in2Str + ": ";
+		Timer _t(cerr, msg.c_str(), loadTiming_);
+		if(_verbose || startVerbose) {
+			cerr << "Reading offs (" << offsLenSampled << " 32-bit words): ";
+			logTime(cerr);
+		}
+		if(!_useMm) {
+			if(!useShmem_) {
+				// Allocate offs_
+				try {
+					if(packOffs_) {
+						// Just enough bits to represent offsets up to len,
+						// plus 8 bytes of slack for offAt()'s 64-bit loads
+						_offsBits = 1;
+						while(_offsBits < 57 && ((uint64_t)len >> _offsBits) != 0) _offsBits++;
+						_offsBitMask = (1llu << _offsBits) - 1;
+						uint64_t packedSz = (((uint64_t)offsLenSampled * _offsBits + 7) >> 3) + 8;
+						this->_offsPacked = newBig<uint8_t>(packedSz);
+						memset(this->_offsPacked, 0, packedSz);
+						if(_verbose || startVerbose) {
+							cerr << "  packing offs into " << _offsBits << " bits/entry ("
+							     << packedSz << " bytes instead of " << (offsLenSampled*OFF_SIZE) << ")" << endl;
 						}
-						idx++;
+					} else {
+						this->_offs = newBig<TIndexOffU>(offsLenSampled);
 					}
+				} catch(bad_alloc& e) {
+					cerr << "Out of memory allocating the offs[] array  for the Bowtie index." << endl
+						 << "Please try again on a computer with more memory." << endl;
+					throw 1;
 				}
-				delete[] buf;
 			} else {
-				if(_useMm) {
-#ifdef BOWTIE_MM
-					this->_offs = (TIndexOffU*)(mmFile[1] + bytesRead);
-					bytesRead += offsSz;
-					// Argument to lseek can be 64 bits if compiled with
-					// _FILE_OFFSET_BITS
-					fseeko(_in2, offsSz, SEEK_CUR);
-#endif
-				} else {
-					// If any of the high two bits are set
-					// Workaround for small-index mode where MM_READ may
-					// not be able to handle read amounts greater than 2^32
-					// bytes.
-					uint64_t bytesLeft = offsSz;
-					char *offs = (char *)this->offs();
-
-					while(bytesLeft > 0) {
-						size_t r = MM_READ(_in2, (void*)offs, bytesLeft);
-						if(MM_IS_IO_ERR(_in2,r,bytesLeft)) {
-							cerr << "Error reading block of _offs[] array: "
-							     << r << ", " << bytesLeft << gLastIOErrMsg << endl;
+				shmemLeader = ALLOC_SHARED_U(
+					(_in2Str + "[offs]"), offsLenSampled*OFF_SIZE, &this->_offs,
+					"offs", (_verbose || startVerbose), hugePages_);
+			}
+		}
+
+		if(_overrideOffRate < 32) {
+			seekSection(_in2, EBWT_SEC_OFFS, bytesRead);
+			if(shmemLeader) {
+				// Allocate offs (big allocation)
+				if(switchEndian || offRateDiff > 0 || packOffs_) {
+					assert(!_useMm);
+					const TIndexOffU blockMaxSz = (2 * 1024 * 1024); // 2 MB block size
+					const TIndexOffU blockMaxSzU = (blockMaxSz >> (OFF_SIZE/4 +1)); // # U32s per block
+					char *buf = new char[blockMaxSz];
+					TIndexOffU nkept = 0;
+					if(_textSamp && offRateDiff > 0) {
+						sampKept.resize((offsLen + 63) >> 6);
+						sampKept.fillZero();
+					}
+					for(TIndexOffU i = 0; i < offsLen; i += blockMaxSzU) {
+						TIndexOffU block = min<TIndexOffU>(blockMaxSzU, offsLen - i);
+						size_t r = MM_READ(_in2, (void *)buf, block << (OFF_SIZE/4 + 1));
+						if(r != (size_t)(block << (OFF_SIZE/4 + 1))) {
+							cerr << "Error reading block of offs array: " << r << ", " << (block << (OFF_SIZE/4 + 1)) << endl
+							     << "Your index files may be corrupt; please try re-building or re-downloading." << endl
+							     << "A complete index consists of 6 files: XYZ.1.ebwt, XYZ.2.ebwt, XYZ.3.ebwt," << endl
+							     << "XYZ.4.ebwt, XYZ.rev.1.ebwt, and XYZ.rev.2.ebwt.  The XYZ.1.ebwt and " << endl
+							     << "XYZ.rev.1.ebwt files should have the same size, as should the XYZ.2.ebwt and" << endl
+							     << "XYZ.rev.2.ebwt files." << endl;
 							throw 1;
 						}
-						offs += r;
-						bytesLeft -= r;
+						if(_textSamp && offRateDiff > 0) {
+							// Keep the samples at multiples of the new
+							// rate; the bitvector is thinned to match
+							// once it has been read
+							const TIndexOffU keepMask = ~(OFF_MASK << _overrideOffRate);
+							for(TIndexOffU j = 0; j < block; j++) {
+								TIndexOffU off = ((TIndexOffU*)buf)[j];
+								if(switchEndian) {
+									off = endianSwapU(off);
+								}
+								if((off & keepMask) != 0) continue;
+								assert_lt(nkept, offsLenSampled);
+								sampKept[(i + j) >> 6] |= (1llu << ((i + j) & 63));
+								if(packOffs_) {
+									setPackedOff(nkept, off);
+								} else {
+									this->_offs[nkept] = off;
+								}
+								nkept++;
+							}
+							continue;
+						}
+						TIndexOffU idx = i >> offRateDiff;
+						for(TIndexOffU j = 0; j < block; j += (1 << offRateDiff)) {
+							assert_lt(idx, offsLenSampled);
+							TIndexOffU off = ((TIndexOffU*)buf)[j];
+							if(switchEndian) {
+								off = endianSwapU(off);
+							}
+							if(packOffs_) {
+								setPackedOff(idx, off);
+							} else {
+								this->_offs[idx] = off;
+							}
+							idx++;
+						}
+					}
+					assert(!_textSamp || offRateDiff == 0 || nkept == offsLenSampled);
+					delete[] buf;
+				} else {
+					if(_useMm) {
+	#ifdef BOWTIE_MM
+						this->_offs = (TIndexOffU*)(r.mmFile + bytesRead);
+						bytesRead += offsSz;
+						// Argument to lseek can be 64 bits if compiled with
+						// _FILE_OFFSET_BITS
+						fseeko(_in2, offsSz, SEEK_CUR);
+	#endif
+					} else {
+						// If any of the high two bits are set
+						// Workaround for small-index mode where MM_READ may
+						// not be able to handle read amounts greater than 2^32
+						// bytes.
+						uint64_t bytesLeft = offsSz;
+						char *offs = (char *)this->offs();
+
+						while(bytesLeft > 0) {
+							size_t r = MM_READ(_in2, (void*)offs, bytesLeft);
+							if(MM_IS_IO_ERR(_in2,r,bytesLeft)) {
+								cerr << "Error reading block of _offs[] array: "
+								     << r << ", " << bytesLeft << gLastIOErrMsg << endl;
+								throw 1;
+							}
+							offs += r;
+							bytesLeft -= r;
+						}
 					}
 				}
-			}
 
-			{
-				ASSERT_ONLY(Bitset offsSeen(len+1));
-				for(TIndexOffU i = 0; i < offsLenSampled; i++) {
-					assert(!offsSeen.test(this->_offs[i]));
-					ASSERT_ONLY(offsSeen.set(this->_offs[i]));
-					assert_leq(this->_offs[i], len);
+				{
+					ASSERT_ONLY(Bitset offsSeen(len+1));
+					for(TIndexOffU i = 0; i < offsLenSampled; i++) {
+						assert(!offsSeen.test(this->offAt(i)));
+						ASSERT_ONLY(offsSeen.set(this->offAt(i)));
+						assert_leq(this->offAt(i), len);
+					}
 				}
-			}
 
-			if(useShmem_) NOTIFY_SHARED(this->_offs, offsLenSampled*OFF_SIZE);
-		} else {
-			// Not the shmem leader
-			fseeko(_in2, offsLenSampled*OFF_SIZE, SEEK_CUR);
-			if(useShmem_) WAIT_SHARED(this->_offs, offsLenSampled*OFF_SIZE);
+				if(useShmem_) NOTIFY_SHARED(this->_offs, offsLenSampled*OFF_SIZE);
+			} else {
+				// Not the shmem leader
+				fseeko(_in2, offsLenSampled*OFF_SIZE, SEEK_CUR);
+				if(useShmem_) WAIT_SHARED(this->_offs, offsLenSampled*OFF_SIZE);
+			}
 		}
 	}
 
-	// Allocate _isa[] (big allocation)
-	if(_verbose || startVerbose) {
-		cerr << "Reading isa (" << isaLenSampled << "): ";
-		logTime(cerr);
-	}
-	if(!_useMm) {
-		try {
-			this->_isa = new TIndexOffU[isaLenSampled];
-		} catch(bad_alloc& e) {
-			cerr << "Out of memory allocating the isa[] array  for the Bowtie index." << endl
-				 << "Please try again on a computer with more memory." << endl;
-			throw 1;
+	if(_textSamp && _overrideOffRate < 32) {
+		string msg = "  Time reading sampled-row bitvector from " + _in2Str + ": ";
+		Timer _t(cerr, msg.c_str(), loadTiming_);
+		const uint64_t sampLen = sampBitsLen(len + 1);
+		if(_verbose || startVerbose) {
+			cerr << "Reading sampled-row bitvector (" << sampLen << " 64-bit words): ";
+			logTime(cerr);
 		}
-	}
-	// Read _isa[]
-	if(switchEndian || isaRateDiff > 0) {
-		assert(!_useMm);
-		for(TIndexOffU i = 0; i < isaLen; i++) {
-			if((i & ~(OFF_MASK << isaRateDiff)) != 0) {
-				char tmp[OFF_SIZE];
-				size_t r = MM_READ(_in2, (void *)tmp, OFF_SIZE);
-				if(r != (size_t)OFF_SIZE) {
-					cerr << "Error reading a word of the _isa[] array: " << r << ", 4" << endl;
-					throw 1;
-				}
-			} else {
-				TIndexOffU idx = i >> isaRateDiff;
-				assert_lt(idx, isaLenSampled);
-				this->_isa[idx] = readU<TIndexOffU>(_in2, switchEndian);
-			}
+		if(_paged) {
+			seekSection(_in2, EBWT_SEC_SAMP, bytesRead);
+		} else {
+			// The bitvector starts on the next 64-byte boundary
+			bytesRead = (uint64_t)ftello(_in2);
+			uint64_t pad = (64 - (bytesRead & 63)) & 63;
+			fseeko(_in2, pad, SEEK_CUR);
+			bytesRead += pad;
 		}
-	} else {
 		if(_useMm) {
 #ifdef BOWTIE_MM
-			this->_isa = (TIndexOffU*)(mmFile[1] + bytesRead);
-			bytesRead += (isaLen << 2);
-			fseeko(_in2, (isaLen << 2), SEEK_CUR);
+			this->_sampBits = (uint64_t*)(r.mmFile + bytesRead);
+			fseeko(_in2, sampLen*8, SEEK_CUR);
 #endif
 		} else {
-			size_t r = MM_READ(_in2, (void *)this->_isa, isaLen*OFF_SIZE);
-			if(r != (size_t)(isaLen*OFF_SIZE)) {
-				cerr << "Error reading _isa[] array: " << r << ", " << (isaLen*OFF_SIZE) << endl;
+			try {
+				this->_sampMem = newBig<uint64_t>(sampLen + 8);
+			} catch(bad_alloc& e) {
+				cerr << "Out of memory allocating the sampled-row bitvector for the Bowtie index." << endl
+				     << "Please try again on a computer with more memory." << endl;
+				throw 1;
+			}
+			// Start every line on a cache line
+			this->_sampBits = (uint64_t*)(((uintptr_t)this->_sampMem + 63) & ~(uintptr_t)63);
+			size_t r = MM_READ(_in2, (void *)this->_sampBits, sampLen*8);
+			if(r != (size_t)(sampLen*8)) {
+				cerr << "Error reading sampled-row bitvector: " << r << ", " << (sampLen*8) << endl;
 				throw 1;
 			}
+			if(switchEndian) {
+				for(uint64_t i = 0; i < sampLen; i++) {
+					this->_sampBits[i] = endianSwapU64(this->_sampBits[i]);
+				}
+			}
+			if(!sampKept.empty()) {
+				thinSampBits(this->_sampBits, sampLen, sampKept);
+			}
+		}
+		bytesRead += sampLen*8;
+#ifndef NDEBUG
+		uint64_t nsamp = 0;
+		for(uint64_t i = 0; i < sampLen; i += 8) {
+			assert_eq(nsamp, this->_sampBits[i]);
+			for(int j = 1; j < 8; j++) {
+				nsamp += __builtin_popcountll(this->_sampBits[i+j]);
+			}
 		}
+		assert_eq(nsamp, offsLenSampled);
+#endif
 	}
 
 	{
-		ASSERT_ONLY(Bitset isasSeen(len+1));
-		for(TIndexOffU i = 0; i < isaLenSampled; i++) {
-			assert(!isasSeen.test(this->_isa[i]));
-			ASSERT_ONLY(isasSeen.set(this->_isa[i]));
-			assert_leq(this->_isa[i], len);
+		string msg = "  Time reading isa[] from " + _in2Str + ": ";
+		Timer _t(cerr, msg.c_str(), loadTiming_ && isaLenSampled > 0);
+		// Allocate _isa[] (big allocation)
+		if(_verbose || startVerbose) {
+			cerr << "Reading isa (" << isaLenSampled << "): ";
+			logTime(cerr);
+		}
+		if(!_useMm) {
+			try {
+				this->_isa = new TIndexOffU[isaLenSampled];
+			} catch(bad_alloc& e) {
+				cerr << "Out of memory allocating the isa[] array  for the Bowtie index." << endl
+					 << "Please try again on a computer with more memory." << endl;
+				throw 1;
+			}
+		}
+		// Read _isa[]
+		if(isaLen > 0) seekSection(_in2, EBWT_SEC_ISA, bytesRead);
+		if(switchEndian || isaRateDiff > 0) {
+			assert(!_useMm);
+			for(TIndexOffU i = 0; i < isaLen; i++) {
+				if((i & ~(OFF_MASK << isaRateDiff)) != 0) {
+					char tmp[OFF_SIZE];
+					size_t r = MM_READ(_in2, (void *)tmp, OFF_SIZE);
+					if(r != (size_t)OFF_SIZE) {
+						cerr << "Error reading a word of the _isa[] array: " << r << ", 4" << endl;
+						throw 1;
+					}
+				} else {
+					TIndexOffU idx = i >> isaRateDiff;
+					assert_lt(idx, isaLenSampled);
+					this->_isa[idx] = readU<TIndexOffU>(_in2, switchEndian);
+				}
+			}
+		} else {
+			if(_useMm) {
+	#ifdef BOWTIE_MM
+				this->_isa = (TIndexOffU*)(r.mmFile + bytesRead);
+				bytesRead += (isaLen << 2);
+				fseeko(_in2, (isaLen << 2), SEEK_CUR);
+	#endif
+			} else {
+				size_t r = MM_READ(_in2, (void *)this->_isa, isaLen*OFF_SIZE);
+				if(r != (size_t)(isaLen*OFF_SIZE)) {
+					cerr << "Error reading _isa[] array: " << r << ", " << (isaLen*OFF_SIZE) << endl;
+					throw 1;
+				}
+			}
 		}
-	}
-
-	this->postReadInit(*eh); // Initialize fields of Ebwt not read from file
-	if(_verbose || startVerbose) print(cerr, *eh);
-
-	// The fact that _ebwt and friends actually point to something
-	// (other than NULL) now signals to other member functions that the
-	// Ebwt is loaded into memory.
 
-  done: // Exit hatch for both justHeader and !justHeader
+		{
+			ASSERT_ONLY(Bitset isasSeen(len+1));
+			for(TIndexOffU i = 0; i < isaLenSampled; i++) {
+				assert(!isasSeen.test(this->_isa[i]));
+				ASSERT_ONLY(isasSeen.set(this->_isa[i]));
+				assert_leq(this->_isa[i], len);
+			}
+		}
+	}
+}
 
-	// Be kind
-	if(deleteEh) delete eh;
-	if (_in1 != NULL) rewind(_in1);
-	if (_in2 != NULL) rewind(_in2);
+/**
+ * Thread body for reading the secondary stream; failures are recorded
+ * in the SecondaryRead for readIntoMemory() to rethrow.
+ */
+void Ebwt::readSecondaryWorker(void *vp) {
+	SecondaryRead* r = (SecondaryRead*)vp;
+	try {
+		r->ebwt->readSecondary(*r);
+	} catch(...) {
+		r->failed = true;
+	}
 }
 
 /**
@@ -3472,38 +4282,66 @@ readEbwtRefnames(FILE* fin, EList<string>& refnames) {
 	// BTL: chunkRate is now deprecated
 	int32_t flags = readI<int32_t>(fin, switchEndian);
 	bool entireReverse = false;
+	bool lineSides = false;
+	bool kftab = false;
+	bool paged = false;
 	if(flags < 0) {
 		entireReverse = (((-flags) & EBWT_ENTIRE_REV) != 0);
-	}
+		lineSides = (((-flags) & EBWT_LINE_SIDES) != 0);
+		kftab = (((-flags) & EBWT_KFTAB) != 0);
+		paged = (((-flags) & EBWT_PAGED) != 0);
+	}
+
+	if(paged) {
+		// Names are at a known offset; no need to skip to them
+		uint64_t nsecs = readU<uint64_t>(fin, switchEndian);
+		uint64_t namesOff = 0;
+		for(uint64_t i = 0; i < nsecs; i++) {
+			uint64_t off = readU<uint64_t>(fin, switchEndian);
+			if(i == (uint64_t)EBWT_SEC_NAMES) namesOff = off;
+		}
+		fseeko(fin, (off_t)namesOff, SEEK_SET);
+	} else {
+		// Create a new EbwtParams from the entries read from primary stream
+		bool isBt2Index = lineSides;
+		if (gEbwt_ext == "bt2" || gEbwt_ext == "bt2") {
+			isBt2Index = true;
+		}
+		EbwtParams eh(len, lineRate, linesPerSide, offRate, -1, ftabChars, entireReverse, isBt2Index);
 
-	// Create a new EbwtParams from the entries read from primary stream
-	bool isBt2Index = false;
-	if (gEbwt_ext == "bt2" || gEbwt_ext == "bt2") {
-		isBt2Index = true;
-	}
-	EbwtParams eh(len, lineRate, linesPerSide, offRate, -1, ftabChars, entireReverse, isBt2Index);
+		TIndexOffU nPat = readI<TIndexOffU>(fin, switchEndian); // nPat
+		fseeko(fin, nPat*OFF_SIZE, SEEK_CUR);
 
-	TIndexOffU nPat = readI<TIndexOffU>(fin, switchEndian); // nPat
-	fseeko(fin, nPat*OFF_SIZE, SEEK_CUR);
+		// Skip rstarts
+		TIndexOffU nFrag = readU<TIndexOffU>(fin, switchEndian);
+		fseeko(fin, nFrag*OFF_SIZE*3, SEEK_CUR);
 
-	// Skip rstarts
-	TIndexOffU nFrag = readU<TIndexOffU>(fin, switchEndian);
-	fseeko(fin, nFrag*OFF_SIZE*3, SEEK_CUR);
+		// Skip ebwt, and the padding before it
+		if(lineSides) {
+			fseeko(fin, (64 - (ftello(fin) & 63)) & 63, SEEK_CUR);
+		}
+		fseeko(fin, eh._ebwtTotLen, SEEK_CUR);
 
-	// Skip ebwt
-	fseeko(fin, eh._ebwtTotLen, SEEK_CUR);
+		// Skip zOff from primary stream
+		readU<TIndexOffU>(fin, switchEndian);
 
-	// Skip zOff from primary stream
-	readU<TIndexOffU>(fin, switchEndian);
+		// Skip fchr
+		fseeko(fin, 5 * OFF_SIZE, SEEK_CUR);
 
-	// Skip fchr
-	fseeko(fin, 5 * OFF_SIZE, SEEK_CUR);
+		// Skip ftab
+		fseeko(fin, eh._ftabLen*OFF_SIZE, SEEK_CUR);
 
-	// Skip ftab
-	fseeko(fin, eh._ftabLen*OFF_SIZE, SEEK_CUR);
+		// Skip eftab
+		fseeko(fin, eh._eftabLen*OFF_SIZE, SEEK_CUR);
 
-	// Skip eftab
-	fseeko(fin, eh._eftabLen*OFF_SIZE, SEEK_CUR);
+		// Skip kftab
+		if(kftab) {
+			int kChars = (int)readU<TIndexOffU>(fin, switchEndian);
+			TIndexOffU kfLen = readU<TIndexOffU>(fin, switchEndian);
+			TIndexOffU kfShortLen = readU<TIndexOffU>(fin, switchEndian);
+			fseeko(fin, (kfShortLen + Ebwt::kftabIdxLen(kChars) + kfLen)*OFF_SIZE + kfLen, SEEK_CUR);
+		}
+	}
 
 	// Read reference sequence names from primary index file
 	while(true) {
@@ -3620,17 +4458,31 @@ void Ebwt::writeFromMemory(bool justHeader,
 	writeI<int32_t>(out1, eh._ftabChars,    be); // number of 2-bit chars used to address ftab
 	int32_t flags = 1;
 	if(eh._entireReverse) flags |= EBWT_ENTIRE_REV;
+	if(eh._isBt2Index)    flags |= EBWT_LINE_SIDES;
+	if(_kftabChars > 0)   flags |= EBWT_KFTAB;
+	if(_paged)            flags |= EBWT_PAGED;
+	if(_textSamp)         flags |= EBWT_TEXT_SAMP;
 	writeI<int32_t>(out1, -flags, be); // BTL: chunkRate is now deprecated
+	uint64_t secOffs[EBWT_NUM_SECS];
+	memset(secOffs, 0, sizeof(secOffs));
+	if(_paged) {
+		// Placeholder; filled in once the sections have been written
+		assert_eq(sectionTableOff(), (uint64_t)out1.tellp());
+		writeSectionTable(out1, secOffs, be);
+	}
 
 	if(!justHeader) {
 		assert(isInMemory());
+		uint64_t *secs = _paged ? secOffs : NULL;
 		// These Ebwt parameters are known after the inputs strings have
 		// been joined() but before they have been built().  These can
 		// written to the disk next and then discarded from memory.
+		beginSection(out1, secs, EBWT_SEC_PLEN);
 		writeU<TIndexOffU>(out1, this->_nPat,      be);
 		for(TIndexOffU i = 0; i < this->_nPat; i++)
 			writeU<TIndexOffU>(out1, this->_plen[i], be);
 		assert_geq(this->_nFrag, this->_nPat);
+		beginSection(out1, secs, EBWT_SEC_RSTARTS);
 		writeU<TIndexOffU>(out1, this->_nFrag, be);
 		for(TIndexOffU i = 0; i < this->_nFrag*3; i++)
 			writeU<TIndexOffU>(out1, this->_rstarts[i], be);
@@ -3640,12 +4492,24 @@ void Ebwt::writeFromMemory(bool justHeader,
 		// terribly large.  'ebwt' is written to the primary file and then
 		// discarded from memory as it is built; 'offs' is similarly
 		// written to the secondary file and discarded.
+		if(_paged) beginSection(out1, secs, EBWT_SEC_EBWT);
+		else if(eh._isBt2Index) padToLine(out1);
 		out1.write((const char *)this->ebwt(), eh._ebwtTotLen);
+		beginSection(out1, secs, EBWT_SEC_FCHR);
 		writeU<TIndexOffU>(out1, this->zOff(), be);
 		TIndexOffU offsLen = eh._offsLen;
+		beginSection(out2, secs, EBWT_SEC_OFFS);
 		for(TIndexOffU i = 0; i < offsLen; i++)
 			writeU<TIndexOffU>(out2, this->_offs[i], be);
+		if(_textSamp) {
+			if(_paged) beginSection(out2, secs, EBWT_SEC_SAMP);
+			else padToLine(out2);
+			uint64_t sampLen = sampBitsLen(eh._bwtLen);
+			for(uint64_t i = 0; i < sampLen; i++)
+				writeU<uint64_t>(out2, this->_sampBits[i], be);
+		}
 		uint32_t isaLen = eh._isaLen;
+		if(isaLen > 0) beginSection(out2, secs, EBWT_SEC_ISA);
 		for(TIndexOffU i = 0; i < isaLen; i++)
 			writeU<TIndexOffU>(out2, this->_isa[i], be);
 
@@ -3655,10 +4519,28 @@ void Ebwt::writeFromMemory(bool justHeader,
 		// from memory.
 		for(int i = 0; i < 5; i++)
 			writeU<TIndexOffU>(out1, this->_fchr[i], be);
+		beginSection(out1, secs, EBWT_SEC_FTAB);
 		for(TIndexOffU i = 0; i < eh._ftabLen; i++)
 			writeU<TIndexOffU>(out1, this->ftab()[i], be);
+		beginSection(out1, secs, EBWT_SEC_EFTAB);
 		for(TIndexOffU i = 0; i < eh._eftabLen; i++)
 			writeU<TIndexOffU>(out1, this->eftab()[i], be);
+		if(_kftabChars > 0) {
+			beginSection(out1, secs, EBWT_SEC_KFTAB);
+			writeKftab(out1, _kftabChars, _kfShort, _kfShortLen,
+			           _kfIdx, _kfTops, _kfKeys, _kftabLen, be);
+		}
+		beginSection(out1, secs, EBWT_SEC_NAMES);
+		for(TIndexOffU i = 0; i < this->_refnames.size(); i++) {
+			out1 << this->_refnames[i] << endl;
+		}
+		out1 << '\0';
+		if(_paged) {
+			ostream::pos_type end = out1.tellp();
+			out1.seekp(sectionTableOff());
+			writeSectionTable(out1, secOffs, be);
+			out1.seekp(end);
+		}
 	}
 }
 
@@ -3861,6 +4743,7 @@ void Ebwt::joinToDisk(
 	assert_gt(this->_nPat, 0);
 	assert_geq(this->_nFrag, this->_nPat);
 	this->_rstarts = NULL;
+	beginSection(out1, secOffsOut(), EBWT_SEC_PLEN);
 	writeU<TIndexOffU>(out1, this->_nPat, this->toBe());
 	assert_eq(plens.size(), this->_nPat);
 	// Allocate plen[]
@@ -3877,6 +4760,7 @@ void Ebwt::joinToDisk(
 		writeU<TIndexOffU>(out1, this->_plen[i], this->toBe());
 	}
 	// Write the number of fragments
+	beginSection(out1, secOffsOut(), EBWT_SEC_RSTARTS);
 	writeU<TIndexOffU>(out1, this->_nFrag, this->toBe());
 	TIndexOffU seqsRead = 0;
 	ASSERT_ONLY(TIndexOffU szsi = 0);
@@ -4008,6 +4892,8 @@ void Ebwt::buildToDisk(InorderBlockwiseSA<TStr>& sa,
 	TIndexOffU occ[4] = {0, 0, 0, 0};
 	// Save 'G' and 'T' occurrences between backward and forward buckets
 	TIndexOffU occSave[2] = {0, 0};
+	// Occurrences before the current side, for the line-sides layout
+	TIndexOffU occSide[4] = {0, 0, 0, 0};
 
 	// Record rows that should "absorb" adjacent rows in the ftab.
 	// The absorbed rows represent suffixes shorter than the ftabChars
@@ -4029,6 +4915,28 @@ void Ebwt::buildToDisk(InorderBlockwiseSA<TStr>& sa,
 	assert(ftab != NULL);
 	assert(absorbFtab != NULL);
 
+	// kftab entries, accumulated as the SA streams by and written out
+	// after eftab
+	const int kfChars = _kftabChars;
+	EList<TIndexOffU> kfTops;
+	EList<uint8_t>    kfKeys;
+	EList<TIndexOffU> kfShort;
+	TIndexOffU *kfIdx = NULL;
+	TIndexOffU kfNextPre = 0;   // next kfIdx[] element to fill in
+	uint64_t kfLastKey = 0;
+	bool kfLastShort = false;
+	if(kfChars > 0) {
+		try {
+			VMSG_NL("Allocating kftab index for " << kfChars << "-mers");
+			kfIdx = new TIndexOffU[kftabIdxLen(kfChars)];
+		} catch(bad_alloc &e) {
+			cerr << "Out of memory allocating kftab index "
+			     << "in Ebwt::buildToDisk() at " << __FILE__ << ":"
+			     << __LINE__ << endl;
+			throw e;
+		}
+	}
+
 	// Allocate the side buffer; holds a single side as its being
 	// constructed and then written to disk.  Reused across all sides.
 #ifdef SIXTY4_FORMAT
@@ -4068,19 +4976,38 @@ void Ebwt::buildToDisk(InorderBlockwiseSA<TStr>& sa,
 		assert(isaSample != NULL);
 	}
 
+	// In a text-sampled index, the bitvector marking the sampled rows
+	// is accumulated in the loop too, and written after it
+	uint64_t *sampBits = NULL;
+	uint64_t sampLen = 0;
+	TIndexOffU nsamp = 0;
+	if(_textSamp) {
+		sampLen = sampBitsLen(eh._bwtLen);
+		try {
+			sampBits = new uint64_t[sampLen];
+		} catch(bad_alloc &e) {
+			cerr << "Out of memory allocating sampBits[] in "
+			     << "Ebwt::buildToDisk() at " << __FILE__ << ":"
+			     << __LINE__ << endl;
+			throw e;
+		}
+		memset(sampBits, 0, sampLen * 8);
+	}
+
 	// Points to the base offset within ebwt for the side currently
 	// being written
 	TIndexOffU side = 0;
 	// Points to a byte offset from 'side' within ebwt[] where next
 	// char should be written
 #ifdef SIXTY4_FORMAT
-	TIndexOff sideCur = (eh._sideBwtSz >> 3) - 1;
+	TIndexOff sideCur = eh._isBt2Index ? 0 : (eh._sideBwtSz >> 3) - 1;
 #else
-	TIndexOff sideCur = eh._sideBwtSz - 1;
+	TIndexOff sideCur = eh._isBt2Index ? 0 : eh._sideBwtSz - 1;
 #endif
 
-	// Whether we're assembling a forward or a reverse bucket
-	bool fw = false;
+	// Whether we're assembling a forward or a reverse bucket.  In the
+	// line-sides layout every side is a forward side.
+	bool fw = eh._isBt2Index;
 
 	// Did we just finish writing a forward bucket?  (Must be true when
 	// we exit the loop.)
@@ -4096,6 +5023,9 @@ void Ebwt::buildToDisk(InorderBlockwiseSA<TStr>& sa,
 	                               // end)
 	// Iterate over packed bwt bytes
 	VMSG_NL("Entering Ebwt loop");
+	if(_paged) beginSection(out1, _secOffs, EBWT_SEC_EBWT);
+	else if(eh._isBt2Index) padToLine(out1);
+	beginSection(out2, secOffsOut(), EBWT_SEC_OFFS);
 	ASSERT_ONLY(TIndexOffU beforeEbwtOff = (uint32_t)out1.tellp());
 	while(side < ebwtTotSz) {
 		ASSERT_ONLY(wroteFwBucket = false);
@@ -4174,8 +5104,47 @@ void Ebwt::buildToDisk(InorderBlockwiseSA<TStr>& sa,
 					assert_lt(absorbCnt, 255);
 					absorbCnt++;
 				}
+				// Update kftab
+				if(kfChars > 0) {
+					// The key is the suffix's first kfChars characters,
+					// padded with Ts if it's shorter than that.  The end
+					// of the text sorts after every character, so keys
+					// never decrease as we walk the SA, and a padded
+					// short suffix sorts after any real k-mer with the
+					// same key.
+					TIndexOffU sufLen = len - saElt;
+					bool isShort = (sufLen < (TIndexOffU)kfChars);
+					uint64_t key = 0;
+					for(int i = 0; i < kfChars; i++) {
+						key <<= 2;
+						key |= ((TIndexOffU)i < sufLen) ? (unsigned char)(s[saElt+i]) : 3;
+					}
+					if(kfTops.empty() || key != kfLastKey || isShort != kfLastShort) {
+						// This row starts a new entry
+						assert(kfTops.empty() || key >= kfLastKey);
+						TIndexOffU e = (TIndexOffU)kfTops.size();
+						while(kfNextPre <= (TIndexOffU)(key >> 8)) {
+							kfIdx[kfNextPre++] = e;
+						}
+						if(isShort) kfShort.push_back(e);
+						kfTops.push_back(si);
+						kfKeys.push_back((uint8_t)(key & 0xff));
+						kfLastKey = key;
+						kfLastShort = isShort;
+					}
+				}
 				// Suffix array offset boundary? - update offset array
-				if((si & eh._offMask) == si) {
+				if(_textSamp) {
+					if((saElt & eh._offMask) == saElt) {
+						// Text offset boundary; mark the row
+						assert_lt(nsamp, eh._offsLen);
+						uint64_t line = si / EBWT_SAMP_LINE_ROWS;
+						uint64_t bit = si - line * EBWT_SAMP_LINE_ROWS;
+						sampBits[(line << 3) + 1 + (bit >> 6)] |= (1llu << (bit & 63));
+						nsamp++;
+						writeU<TIndexOffU>(out2, saElt, this->toBe());
+					}
+				} else if((si & eh._offMask) == si) {
 					assert_lt((si >> eh._offRate), eh._offsLen);
 					// Write offsets directly to the secondary output
 					// stream, thereby avoiding keeping them in memory
@@ -4234,6 +5203,22 @@ void Ebwt::buildToDisk(InorderBlockwiseSA<TStr>& sa,
 		{
 			// Forward side boundary
 			assert_eq(0, si % eh._sideBwtLen);
+			if(eh._isBt2Index) {
+				// Line-sides layout: the side ends with the counts of
+				// all four chars prior to the side
+				sideCur = 0;
+				ASSERT_ONLY(wroteFwBucket = true);
+				TIndexOffU *u32side = reinterpret_cast<TIndexOffU*>(ebwtSide);
+				side += sideSz;
+				assert_leq(side, eh._ebwtTotSz);
+				for(int i = 0; i < 4; i++) {
+					assert_leq(occSide[i], occ[i]);
+					u32side[(eh._sideBwtSz / OFF_SIZE) + i] = endianizeU<TIndexOffU>(occSide[i], this->toBe());
+					occSide[i] = occ[i];
+				}
+				out1.write((const char *)ebwtSide, sideSz);
+				continue;
+			}
 #ifdef SIXTY4_FORMAT
 			sideCur = (eh._sideBwtSz >> 3) - 1;
 #else
@@ -4296,6 +5281,7 @@ void Ebwt::buildToDisk(InorderBlockwiseSA<TStr>& sa,
 	//
 	// Write zOff to primary stream
 	//
+	beginSection(out1, secOffsOut(), EBWT_SEC_FCHR);
 	writeU<TIndexOffU>(out1, zOff, this->toBe());
 
 	//
@@ -4360,15 +5346,49 @@ void Ebwt::buildToDisk(InorderBlockwiseSA<TStr>& sa,
 	}
 	assert_eq(Ebwt::ftabHi(ftab, eftab, len, ftabLen, eftabLen, ftabLen-1), len+1);
 	// Write ftab to primary file
+	beginSection(out1, secOffsOut(), EBWT_SEC_FTAB);
 	for(TIndexOffU i = 0; i < ftabLen; i++) {
 		writeU<TIndexOffU>(out1, ftab[i], this->toBe());
 	}
 	// Write eftab to primary file
+	beginSection(out1, secOffsOut(), EBWT_SEC_EFTAB);
 	for(TIndexOffU i = 0; i < eftabLen; i++) {
 		writeU<TIndexOffU>(out1, eftab[i], this->toBe());
 	}
+	// Write kftab to primary file
+	if(kfChars > 0) {
+		TIndexOffU kfIdxLen = kftabIdxLen(kfChars);
+		while(kfNextPre < kfIdxLen) {
+			kfIdx[kfNextPre++] = (TIndexOffU)kfTops.size();
+		}
+		VMSG_NL("kftab has " << kfTops.size() << " entries for " << kfChars << "-mers");
+		beginSection(out1, secOffsOut(), EBWT_SEC_KFTAB);
+		writeKftab(out1, kfChars, kfShort.ptr(), (TIndexOffU)kfShort.size(),
+		           kfIdx, kfTops.ptr(), kfKeys.ptr(), (TIndexOffU)kfTops.size(),
+		           this->toBe());
+		delete[] kfIdx;
+	}
+	// Write sampled-row bitvector to secondary file
+	if(sampBits != NULL) {
+		assert_eq(nsamp, eh._offsLen);
+		uint64_t cum = 0;
+		for(uint64_t i = 0; i < sampLen; i += 8) {
+			sampBits[i] = cum;
+			for(int j = 1; j < 8; j++) {
+				cum += __builtin_popcountll(sampBits[i+j]);
+			}
+		}
+		assert_eq(cum, nsamp);
+		if(_paged) beginSection(out2, _secOffs, EBWT_SEC_SAMP);
+		else padToLine(out2);
+		for(uint64_t i = 0; i < sampLen; i++) {
+			writeU<uint64_t>(out2, sampBits[i], this->toBe());
+		}
+		delete[] sampBits;
+	}
 	// Write isa to primary file
 	if(isaSample != NULL) {
+		beginSection(out2, secOffsOut(), EBWT_SEC_ISA);
 		ASSERT_ONLY(Bitset sawISA(eh._len+1));
 		for(TIndexOffU i = 0; i < eh._isaLen; i++) {
 			TIndexOffU s = isaSample[i];
@@ -45,6 +45,10 @@ static bool autoMem;
 static bool packed;
 static bool writeRef;
 static bool justRef;
+static bool lineSides;
+static int kftabChars;
+static bool pagedIndex;
+static bool textSample;
 static int reverseType;
 static int nthreads;
 static string wrapper;
@@ -74,6 +78,10 @@ static void resetOptions() {
 	packed       = false; //
 	writeRef     = true;  // write compact reference to .3.ebwt/.4.ebwt
 	justRef      = false; // *just* write compact reference, don't index
+	lineSides    = false; // keep all 4 occ[] counts in every side
+	kftabChars   = 0;     // no sparse k-mer lookup table
+	pagedIndex   = false; // sections packed back to back
+	textSample   = false; // sample every 2^offRate'th SA row
 	reverseType  = REF_READ_REVERSE_EACH;
 	nthreads     = 1;
 	wrapper.clear();
@@ -91,7 +99,11 @@ enum {
 	ARG_USAGE,
 	ARG_NEW_REVERSE,
 	ARG_THREADS,
-	ARG_WRAPPER
+	ARG_WRAPPER,
+	ARG_LINE_SIDES,
+	ARG_KFTAB,
+	ARG_PAGED,
+	ARG_TEXT_SAMPLE
 };
 
 /**
@@ -130,6 +142,11 @@ static void printUsage(ostream& out) {
 	    << "    -t/--ftabchars <int>    # of chars consumed in initial lookup (default: 10)" << endl
 	    << "    --threads <int>         # of threads" << endl
 	    << "    --ntoa                  convert Ns in reference to As" << endl
+	    << "    --line-sides            one cache line per LF step (index ~17% larger)" << endl
+	    << "    --kftab <int>           add sparse lookup table for initial <int>-mers (12-16)" << endl
+	    << "    --paged                 page-align index sections for zero-copy --mm loading" << endl
+	    << "    --text-sample           sample SA at every 2^offRate'th ref offset, not row;" << endl
+	    << "                            bounds offset lookups at 2^offRate-1 steps" << endl
 	    //<< "    --big --little          endianness (default: little, this host: "
 	    //<< (currentlyBigEndian()? "big":"little") << ")" << endl
 	    << "    --seed <int>            seed for random number generator" << endl
@@ -177,6 +194,10 @@ static struct option long_options[] = {
 	{(char*)"usage",        no_argument,       0,            ARG_USAGE},
 	{(char*)"wrapper",      required_argument, 0,            ARG_WRAPPER},
 	{(char*)"new-reverse",  no_argument,       0,            ARG_NEW_REVERSE},
+	{(char*)"line-sides",   no_argument,       0,            ARG_LINE_SIDES},
+	{(char*)"kftab",        required_argument, 0,            ARG_KFTAB},
+	{(char*)"paged",        no_argument,       0,            ARG_PAGED},
+	{(char*)"text-sample",  no_argument,       0,            ARG_TEXT_SAMPLE},
 	{(char*)0, 0, 0, 0} // terminator
 };
 
@@ -270,6 +291,16 @@ static void parseOptions(int argc, const char **argv) {
 			        nthreads = parseNumber<int>(0, "--threads arg must be at least 1");
 		                break;
 			case ARG_NEW_REVERSE: reverseType = REF_READ_REVERSE; break;
+			case ARG_LINE_SIDES: lineSides = true; break;
+			case ARG_KFTAB:
+				kftabChars = parseNumber<int>(12, "--kftab arg must be at least 12");
+				if(kftabChars > 16) {
+					cerr << "--kftab arg must be at most 16" << endl;
+					throw 1;
+				}
+				break;
+			case ARG_PAGED: pagedIndex = true; break;
+			case ARG_TEXT_SAMPLE: textSample = true; break;
 			case 'a': autoMem = false; break;
 			case 'q': verbose = false; break;
 			case 's': sanityCheck = true; break;
@@ -443,7 +474,10 @@ static void driver(const string& infile,
 		  verbose,      // be talkative
 		  autoMem,      // pass exceptions up to the toplevel so that we can adjust memory settings automatically
 		  sanityCheck,  // verify results and internal consistency
-		  false);       // are we building a bt2 index?
+		  lineSides,    // lay sides out as in a bt2 index?
+		  kftabChars,   // k-mer length for sparse lookup table, or 0
+		  pagedIndex,   // page-align sections and write a section table?
+		  textSample);  // sample SA by text offset rather than by row?
 	// Note that the Ebwt is *not* resident in memory at this time.  To
 	// load it into memory, call ebwt.loadIntoMemory()
 	if(verbose) {
@@ -550,9 +584,13 @@ extern "C" {
 			cout << "Settings:" << endl
 				 << "  Output files: \"" << outfile << ".*." + gEbwt_ext + "\"" << endl
 				 << "  Line rate: " << lineRate << " (line is " << (1<<lineRate) << " bytes)" << endl
-				 << "  Lines per side: " << linesPerSide << " (side is " << ((1<<lineRate)*linesPerSide) << " bytes)" << endl
+				 << "  Lines per side: " << (lineSides ? 1 : linesPerSide) << " (side is " << ((1<<lineRate)*(lineSides ? 1 : linesPerSide)) << " bytes)" << endl
+				 << "  Side layout: " << (lineSides ? "line sides (all 4 occ[] counts per side)" : "side pairs") << endl
 				 << "  Offset rate: " << offRate << " (one in " << (1<<offRate) << ")" << endl
+				 << "  SA sampled by: " << (textSample ? "text offset" : "row") << endl
 				 << "  FTable chars: " << ftabChars << endl
+				 << "  KFTable chars: " << kftabChars << endl
+				 << "  Paged sections: " << (pagedIndex ? "yes" : "no") << endl
 				 << "  Strings: " << (packed? "packed" : "unpacked") << endl
 				 ;
 			if(bmax == OFF_MASK) {
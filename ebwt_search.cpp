@@ -23,9 +23,12 @@
 #include "alphabet.h"
 #include "assert_helpers.h"
 #include "bitset.h"
+#include "cpu_numa_info.h"
 #include "ds.h"
 #include "ebwt.h"
 #include "ebwt_search.h"
+#include "ebwt_search_batch.h"
+#include "ebwt_search_pigeonhole.h"
 #include "endian_swap.h"
 #include "formats.h"
 #include "hit.h"
@@ -104,8 +107,17 @@ static bool fileParallel;		// separate threads read separate input files in para
 static bool useShmem;			// use shared memory to hold the index
 static bool useMm;			// use memory-mapped files to hold the index
 static bool mmSweep;			// sweep through memory-mapped files immediately after mapping
+static bool hugePages;			// back the index with huge pages
+static bool packOffs;			// bit-pack the SA sample as it's loaded
+static bool numaReplicate;		// one copy of the index per NUMA node
+static bool dedupReads;			// align each distinct read once; replay for copies
+static bool dedupQuals;			// copies of reads must have the same quals too
+static bool pigeonhole;			// -v 2/3: filter with exact parts, verify against reference
+static bool mmsBound;			// -v 2: prune backtracking with a lower bound on mismatches
+static bool readerThread;		// read input ahead on a thread of its own
 static bool stateful;			// use stateful aligners
 static uint32_t prefetchWidth;		// number of reads to process in parallel w/ --stateful
+static uint32_t interleaveWidth;	// number of reads to search for exact hits in lockstep
 static uint32_t minInsert;		// minimum insert size (Maq = 0, SOAP = 400)
 static uint32_t maxInsert;		// maximum insert size (Maq = 250, SOAP = 600)
 static bool mate1fw;			// -1 mate aligns in fw orientation on fw strand
@@ -115,7 +127,9 @@ static uint32_t mixedThresh;		// threshold for when to switch to paired-end mixe
 static uint32_t mixedAttemptLim;	// number of attempts to make in "mixed mode" before giving up on orientation
 static bool dontReconcileMates;		// suppress pairwise all-versus-all way of resolving mates
 static uint32_t cacheLimit;		// ranges w/ size > limit will be cached
-static uint32_t cacheSize;		// # words per range cache
+static uint64_t cacheSize;		// bytes of shared range cache (fw and mirror together)
+static RangeCache *rangeCacheFw;	// resolved rows shared by all threads, forward index
+static RangeCache *rangeCacheBw;	// resolved rows shared by all threads, mirror index
 static int offBase;			// offsets are 0-based by default, but configurable
 static bool tryHard;			// set very high maxBts, mixedAttemptLim
 static uint32_t skipReads;		// # reads/read pairs to skip
@@ -123,9 +137,12 @@ static bool nofw;			// don't align fw orientation of read
 static bool norc;			// don't align rc orientation of read
 static bool strandFix;			// attempt to fix strand bias
 static bool stats;			// print performance stats
-static int chunkPoolMegabytes;		// max MB to dedicate to best-first search frames per thread
+static int chunkPoolMegabytes;		// MB of best-first search frames retained per thread
+static int chunkPoolMaxMegabytes;	// hard cap on MB of best-first search frames per thread (0 = none)
 static int chunkSz;			// size of single chunk disbursed by ChunkPool
 static bool chunkVerbose;		// have chunk allocator output status messages?
+static ChunkPoolStats chunkStats;	// best-first frame memory usage, all threads
+static MUTEX_T chunkStatsMutex;
 static bool useV1;
 static bool reportSe;
 static size_t fastaContLen;
@@ -147,6 +164,8 @@ static EList<string> qualities2;
 static string wrapper;			// Type of wrapper script
 bool gAllowMateContainment;
 bool noUnal;				// don't print unaligned reads
+int inflateThreads;			// threads for reading/decompressing gzipped reads
+bool mmReads;				// memory-map uncompressed read files
 string ebwtFile;			// read serialized Ebwt from this file
 MUTEX_T gLock;
 
@@ -207,8 +226,17 @@ static void resetOptions() {
 	useShmem		= false;	// use shared memory to hold the index
 	useMm			= false;	// use memory-mapped files to hold the index
 	mmSweep			= false;	// sweep through memory-mapped files immediately after mapping
+	hugePages		= false;	// back the index with huge pages
+	packOffs		= false;	// bit-pack the SA sample as it's loaded
+	numaReplicate		= false;	// one copy of the index per NUMA node
+	dedupReads		= false;	// align each distinct read once; replay for copies
+	dedupQuals		= false;	// copies of reads must have the same quals too
+	pigeonhole		= false;	// -v 2/3: filter with exact parts, verify against reference
+	mmsBound		= false;	// -v 2: prune backtracking with a lower bound on mismatches
+	readerThread		= false;	// true -> read input ahead on a thread of its own
 	stateful		= false;	// use stateful aligners
 	prefetchWidth		= 1;		// number of reads to process in parallel w/ --stateful
+	interleaveWidth		= 16;		// number of reads to search for exact hits in lockstep
 	minInsert		= 0;		// minimum insert size (Maq = 0, SOAP = 400)
 	maxInsert		= 250;		// maximum insert size (Maq = 250, SOAP = 600)
 	mate1fw			= true;		// -1 mate aligns in fw orientation on fw strand
@@ -218,7 +246,9 @@ static void resetOptions() {
 	mixedAttemptLim		= 100;		// number of attempts to make in "mixed mode" before giving up on orientation
 	dontReconcileMates	= true;		// suppress pairwise all-versus-all way of resolving mates
 	cacheLimit		= 5;		// ranges w/ size > limit will be cached
-	cacheSize		= 0;		// # words per range cache
+	cacheSize		= 0;		// bytes of shared range cache (fw and mirror together)
+	rangeCacheFw		= NULL;
+	rangeCacheBw		= NULL;
 	offBase			= 0;		// offsets are 0-based by default, but configurable
 	tryHard			= false;	// set very high maxBts, mixedAttemptLim
 	skipReads		= 0;		// # reads/read pairs to skip
@@ -226,7 +256,9 @@ static void resetOptions() {
 	norc			= false;	// don't align rc orientation of read
 	strandFix		= true;		// attempt to fix strand bias
 	stats			= false;	// print performance stats
-	chunkPoolMegabytes	= 64;		// max MB to dedicate to best-first search frames per thread
+	chunkPoolMegabytes	= 64;		// MB of best-first search frames retained per thread
+	chunkPoolMaxMegabytes	= 1024;		// hard cap on MB of best-first search frames per thread (0 = none)
+	chunkStats.reset();
 	chunkSz			= 256;		// size of single chunk disbursed by ChunkPool (in KB)
 	chunkVerbose		= false;	// have chunk allocator output status messages?
 	useV1			= true;
@@ -250,6 +282,8 @@ static void resetOptions() {
 	wrapper.clear();
 	gAllowMateContainment	= false;	// true -> alignments where one mate lies inside the other are valid
 	noUnal			= false;	// true -> do not report unaligned reads
+	inflateThreads		= 0;		// 0 -> decompress under the input lock
+	mmReads			= false;	// true -> memory-map uncompressed read files
 }
 
 // mating constraints
@@ -283,8 +317,18 @@ enum {
 	ARG_SHMEM,
 	ARG_MM,
 	ARG_MMSWEEP,
+	ARG_HUGE_PAGES,
+	ARG_PACK_OFFS,
+	ARG_NUMA_REPLICATE,
+	ARG_DEDUP,
+	ARG_PIGEONHOLE,
+	ARG_MMS_BOUND,
+	ARG_INFLATE_THREADS,
+	ARG_READER_THREAD,
+	ARG_MM_READS,
 	ARG_STATEFUL,
 	ARG_PREFETCH_WIDTH,
+	ARG_INTERLEAVE_WIDTH,
 	ARG_FF,
 	ARG_FR,
 	ARG_RF,
@@ -301,6 +345,7 @@ enum {
 	ARG_PHRED64,
 	ARG_PHRED33,
 	ARG_CHUNKMBS,
+	ARG_CHUNKMBS_MAX,
 	ARG_CHUNKSZ,
 	ARG_CHUNKVERBOSE,
 	ARG_STRATA,
@@ -377,6 +422,7 @@ static struct option long_options[] = {
 {(char*)"partition",                         required_argument,  0,                    ARG_PARTITION},
 {(char*)"stateful",                          no_argument,        0,                    ARG_STATEFUL},
 {(char*)"prewidth",                          required_argument,  0,                    ARG_PREFETCH_WIDTH},
+{(char*)"interleave",                        required_argument,  0,                    ARG_INTERLEAVE_WIDTH},
 {(char*)"ff",                                no_argument,        0,                    ARG_FF},
 {(char*)"fr",                                no_argument,        0,                    ARG_FR},
 {(char*)"rf",                                no_argument,        0,                    ARG_RF},
@@ -397,11 +443,21 @@ static struct option long_options[] = {
 {(char*)"phred64-quals",                     no_argument,        0,                    ARG_PHRED64},
 {(char*)"solexa1.3-quals",                   no_argument,        0,                    ARG_PHRED64},
 {(char*)"chunkmbs",                          required_argument,  0,                    ARG_CHUNKMBS},
+{(char*)"chunkmbs-max",                      required_argument,  0,                    ARG_CHUNKMBS_MAX},
 {(char*)"chunksz",                           required_argument,  0,                    ARG_CHUNKSZ},
 {(char*)"chunkverbose",                      no_argument,        0,                    ARG_CHUNKVERBOSE},
 {(char*)"mm",                                no_argument,        0,                    ARG_MM},
 {(char*)"shmem",                             no_argument,        0,                    ARG_SHMEM},
 {(char*)"mmsweep",                           no_argument,        0,                    ARG_MMSWEEP},
+{(char*)"huge-pages",                        no_argument,        0,                    ARG_HUGE_PAGES},
+{(char*)"packed-offs",                       no_argument,        0,                    ARG_PACK_OFFS},
+{(char*)"numa-replicate",                    no_argument,        0,                    ARG_NUMA_REPLICATE},
+{(char*)"dedup",                             no_argument,        0,                    ARG_DEDUP},
+{(char*)"pigeonhole",                        no_argument,        0,                    ARG_PIGEONHOLE},
+{(char*)"mms-bound",                         no_argument,        0,                    ARG_MMS_BOUND},
+{(char*)"inflate-threads",                   required_argument,  0,                    ARG_INFLATE_THREADS},
+{(char*)"reader-thread",                     no_argument,        0,                    ARG_READER_THREAD},
+{(char*)"mm-reads",                          no_argument,        0,                    ARG_MM_READS},
 {(char*)"pev2",                              no_argument,        0,                    ARG_PEV2},
 {(char*)"reportse",                          no_argument,        0,                    ARG_REPORTSE},
 {(char*)"hadoopout",                         no_argument,        0,                    ARG_HADOOPOUT},
@@ -490,7 +546,9 @@ static void printUsage(ostream& out) {
 	    << "  --maxbts <int>     max # backtracks for -n 2/3 (default: 125, 800 for --best)" << endl
 	    << "  --pairtries <int>  max # attempts to find mate for anchor hit (default: 100)" << endl
 	    << "  -y/--tryhard       try hard to find valid alignments, at the expense of speed" << endl
-	    << "  --chunkmbs <int>   max megabytes of RAM for best-first search frames (def: 64)" << endl
+	    << "  --chunkmbs <int>   MB of RAM kept for best-first search frames (def: 64)" << endl
+	    << "  --chunkmbs-max <int> MB best-first frames may grow to; 0 = no cap (def: 1024)" << endl
+	    << "  --cachesz <int>    MB for offsets shared across threads; 0 = off (def: 0)" << endl
 	    << " --reads-per-batch   # of reads to read from input file at once (default: 16)" << endl
 	    << "Reporting:" << endl
 	    << "  -k <int>           report up to <int> good alignments per read (default: 1)" << endl
@@ -519,11 +577,22 @@ static void printUsage(ostream& out) {
 	    << "Performance:" << endl
 	    << "  -o/--offrate <int> override offrate of index; must be >= index's offrate" << endl
 	    << "  -p/--threads <int> number of alignment threads to launch (default: 1)" << endl
+	    << "  --packed-offs      store SA sample in ceil(log2(ref len)) bits per entry" << endl
+	    << "  --numa-replicate   copy index to each NUMA node; pin threads to nodes" << endl
+	    << "  --dedup            align identical unpaired reads once; replay for copies" << endl
+	    << "  --pigeonhole       -v 2/3: find exact parts and check vs. ref; no backtracking" << endl
+	    << "  --mms-bound        -v 2: prune backtracking w/ lower bound on # mismatches" << endl
+	    << "  --inflate-threads <int> # threads to read/decompress gzipped reads (def: 0)" << endl
+	    << "  --reader-thread    parse input ahead on a thread of its own" << endl
 #ifdef BOWTIE_MM
 	    << "  --mm               use memory-mapped I/O for index; many 'bowtie's can share" << endl
+	    << "  --mm-reads         use memory-mapped I/O for uncompressed read files" << endl
 #endif
 #ifdef BOWTIE_SHARED_MEM
 	    << "  --shmem            use shared mem for index; many 'bowtie's can share" << endl
+#endif
+#ifdef BOWTIE_MM
+	    << "  --huge-pages       back index with huge pages where available" << endl
 #endif
 	    << "Other:" << endl
 	    << "  --seed <int>       seed for random number generator" << endl
@@ -678,6 +747,28 @@ static void parseOptions(int argc, const char **argv) {
 #endif
 			}
 			case ARG_MMSWEEP: mmSweep = true; break;
+			case ARG_HUGE_PAGES: hugePages = true; break;
+			case ARG_PACK_OFFS: packOffs = true; break;
+			case ARG_NUMA_REPLICATE: numaReplicate = true; break;
+			case ARG_DEDUP: dedupReads = true; break;
+			case ARG_PIGEONHOLE: pigeonhole = true; break;
+			case ARG_MMS_BOUND: mmsBound = true; break;
+			case ARG_INFLATE_THREADS:
+				inflateThreads = parseInt(0, "--inflate-threads arg must be at least 0");
+				break;
+			case ARG_READER_THREAD: readerThread = true; break;
+			case ARG_MM_READS: {
+#ifdef BOWTIE_MM
+				mmReads = true;
+				break;
+#else
+				cerr << "Memory-mapped I/O mode is disabled because bowtie was not compiled with" << endl
+				     << "BOWTIE_MM defined.  Memory-mapped I/O is not supported under Windows.  If you" << endl
+				     << "would like to use memory-mapped I/O on a platform that supports it, please" << endl
+				     << "refrain from specifying BOWTIE_MM=0 when compiling Bowtie." << endl;
+				throw 1;
+#endif
+			}
 			case ARG_HADOOPOUT: hadoopOut = true; break;
 			case ARG_AL: dumpAlBase = optarg; break;
 			case ARG_UN: dumpUnalBase = optarg; break;
@@ -694,6 +785,9 @@ static void parseOptions(int argc, const char **argv) {
 			case ARG_PREFETCH_WIDTH:
 				prefetchWidth = parseInt(1, "--prewidth must be at least 1");
 				break;
+			case ARG_INTERLEAVE_WIDTH:
+				interleaveWidth = parseInt(1, "--interleave must be at least 1");
+				break;
 			case 'B':
 				offBase = parseInt(-999999, "-B/--offbase cannot be a large negative number");
 				break;
@@ -733,7 +827,7 @@ static void parseOptions(int argc, const char **argv) {
 				cacheLimit = (uint32_t)parseInt(1, "--cachelim arg must be at least 1");
 				break;
 			case ARG_CACHE_SZ:
-				cacheSize = (uint32_t)parseInt(1, "--cachesz arg must be at least 1");
+				cacheSize = (uint64_t)parseInt(0, "--cachesz arg must be at least 0");
 				cacheSize *= (1024 * 1024); // convert from MB to B
 				break;
 			case ARG_NO_RECONCILE:
@@ -770,6 +864,7 @@ static void parseOptions(int argc, const char **argv) {
 			case 'a': allHits = true; break;
 			case 'y': tryHard = true; break;
 			case ARG_CHUNKMBS: chunkPoolMegabytes = parseInt(1, "--chunkmbs arg must be at least 1"); break;
+			case ARG_CHUNKMBS_MAX: chunkPoolMaxMegabytes = parseInt(0, "--chunkmbs-max arg must be at least 0"); break;
 			case ARG_CHUNKSZ: chunkSz = parseInt(1, "--chunksz arg must be at least 1"); break;
 			case ARG_CHUNKVERBOSE: chunkVerbose = true; break;
 			case ARG_BETTER: stateful = true; better = true; break;
@@ -898,6 +993,30 @@ static void parseOptions(int argc, const char **argv) {
 		cerr << "Warning: --shmem overrides --mm..." << endl;
 		useMm = false;
 	}
+	if(packOffs && (useShmem || useMm)) {
+		if(!quiet) {
+			cerr << "Warning: --packed-offs has no effect with --mm or --shmem" << endl;
+		}
+		packOffs = false;
+	}
+	if(pigeonhole && (maqLike || mismatches < 2 || rangeMode)) {
+		if(!quiet) {
+			cerr << "Warning: --pigeonhole has no effect except with -v 2 or -v 3" << endl;
+		}
+		pigeonhole = false;
+	}
+	if(mmsBound && (maqLike || mismatches != 2 || stateful || rangeMode)) {
+		if(!quiet) {
+			cerr << "Warning: --mms-bound has no effect except with -v 2 without --best" << endl;
+		}
+		mmsBound = false;
+	}
+	if(numaReplicate && (useShmem || useMm)) {
+		if(!quiet) {
+			cerr << "Warning: --numa-replicate has no effect with --mm or --shmem" << endl;
+		}
+		numaReplicate = false;
+	}
 	if(!mateFwSet) {
 		// Set nucleotide space default (--fr)
 		mate1fw = true;
@@ -930,7 +1049,9 @@ static const char *argv0 = NULL;
 
 /// Macro for getting the next read, possibly aborting depending on
 /// whether the result is empty or the patid exceeds the limit, and
-/// marshaling the read into convenient variables.
+/// marshaling the read into convenient variables.  A read that's a
+/// copy of one this thread already aligned (--dedup) gets the earlier
+/// read's alignments replayed and is skipped.
 #define GET_READ(p)					\
 	if(get_read_ret.second) break;			\
 	get_read_ret = p->nextReadPair();		\
@@ -958,7 +1079,8 @@ static const char *argv0 = NULL;
 	BTString& name   = p->bufa().name;		\
 	name.length();					\
 	uint32_t      patid  = (uint32_t)p->rdid();	\
-	params.setPatId(patid);
+	params.setPatId(patid);				\
+	if(sink->replayCopy(*p)) continue;
 
 #define WORKER_EXIT()				\
 	patsrcFact->destroy(patsrc);		\
@@ -967,6 +1089,49 @@ static const char *argv0 = NULL;
 	delete sinkFact;			\
 	return;
 
+/**
+ * Make sure 'exb' holds the exact-match ranges for the read currently
+ * in patsrc's buffer.  If it doesn't, find them along with those of up
+ * to interleaveWidth-1 of the reads that follow it in the same input
+ * batch, stepping through all of them in lockstep so that their BWT
+ * cache misses overlap.  If rcHalf is true, reverse-complement strands
+ * are only searched far enough to get their half ranges.  Returns the
+ * read's index within 'exb'.
+ */
+static int exactBatchFor(
+	PatternSourcePerThread& patsrc,
+	const Ebwt& ebwt,
+	ExactSearchBatch& exb,
+	bool fw,
+	bool rc,
+	bool rcHalf = false)
+{
+	int i = exb.find(patsrc.rdid());
+	if(i >= 0) {
+		return i;
+	}
+	size_t n = patsrc.lookahead(interleaveWidth);
+	exb.reset(ebwt);
+	for(size_t j = 0; j < n; j++) {
+		if(!patsrc.aheadReady(j) || patsrc.aheadRdid(j) >= qUpto) {
+			continue;
+		}
+		exb.add(patsrc.aheadRdid(j), patsrc.aheadBufa(j), fw, rc, rcHalf);
+	}
+	exb.search();
+	i = exb.find(patsrc.rdid());
+	if(i < 0) {
+		// The current read didn't make it into the batch; search it
+		// on its own
+		exb.reset(ebwt);
+		exb.add(patsrc.rdid(), patsrc.bufa(), fw, rc, rcHalf);
+		exb.search();
+		i = exb.find(patsrc.rdid());
+	}
+	assert_eq(0, i);
+	return i;
+}
+
 #ifdef CHUD_PROFILING
 #define CHUD_START() chudStartRemotePerfMonitor("Bowtie");
 #define CHUD_STOP()  chudStopRemotePerfMonitor();
@@ -980,11 +1145,38 @@ static const char *argv0 = NULL;
 static PatternSourcePerThreadFactory*
 createPatsrcFactory(PatternComposer& _patsrc, int tid, uint32_t max_buf) {
 	PatternSourcePerThreadFactory *patsrcFact;
-	patsrcFact = new PatternSourcePerThreadFactory(_patsrc, max_buf, skipReads, seed);
+	// With --dedup, a read's pseudo-random seed must only depend on
+	// what makes it a copy of another, so that replaying the copy's
+	// alignments gives the same result as aligning it afresh
+	patsrcFact = new PatternSourcePerThreadFactory(
+		_patsrc, max_buf, skipReads, seed,
+		!dedupReads || dedupQuals, // seed with quals
+		!dedupReads);              // seed with name
 	assert(patsrcFact != NULL);
 	return patsrcFact;
 }
 
+/**
+ * Fold a worker thread's ChunkPool statistics into the global ones.
+ */
+static void mergeChunkStats(ChunkPool& pool) {
+	ThreadSafe ts(&chunkStatsMutex);
+	chunkStats.merge(pool.stats());
+}
+
+/**
+ * Print best-first frame memory usage gathered across all threads.
+ */
+static void printChunkStats(ostream& os) {
+	if(chunkStats.reads == 0) return;
+	os << "Best-first frame memory: peak "
+	   << ((chunkStats.peakBytes + (1 << 20) - 1) >> 20) << " MB for one read; "
+	   << chunkStats.grownReads << " of " << chunkStats.reads
+	   << " reads grew past --chunkmbs (" << chunkStats.slabAllocs
+	   << " slabs allocated); " << chunkStats.exhaustedReads
+	   << " reads hit --chunkmbs-max" << endl;
+}
+
 /**
  * Allocate a HitSinkPerThreadFactory on the heap according to the
  * global params and return a pointer to it.
@@ -1020,6 +1212,265 @@ createSinkFactory(HitSink& _sink, size_t threadId) {
 	return sink;
 }
 
+/**
+ * With --numa-replicate, every NUMA node with CPUs gets its own heap
+ * copy of each loaded index, and every worker is pinned to a node and
+ * searches that node's copy, so LF steps stay off the interconnect.
+ * Slot 0 of numaFw/numaBw is the Ebwt the search driver loaded itself
+ * (from a thread pinned to the first node); the other slots are copies
+ * loaded by threads pinned to the other nodes, so that first-touch
+ * places their pages there.
+ */
+static std::vector<int> numaNodes; // ids of nodes used; empty if not replicating
+static EList<Ebwt*> numaFw;        // per-node forward index
+static EList<Ebwt*> numaBw;        // per-node mirror index
+
+struct NumaLoad {
+	const Ebwt* primary;
+	int node;
+	Ebwt* copy;
+};
+
+/**
+ * Load a copy of the primary Ebwt from a thread pinned to the given
+ * node.  On failure, leave 'copy' NULL.
+ */
+static void numaLoadWorker(void *vp) {
+	NumaLoad* l = (NumaLoad*)vp;
+	pin_thread_to_numa_node(l->node);
+	bool fw = l->primary->fw();
+	try {
+		l->copy = new Ebwt(
+			fw ? adjustedEbwtFileBase : (adjustedEbwtFileBase + ".rev"),
+			-1,      // don't care about entireReverse
+			fw,      // index is for the forward direction?
+			/* overriding: */ offRate,
+			/* overriding: */ isaRate,
+			false,   // memory-mapped files aren't replicated
+			false,   // nor is shared memory
+			false,   // mmSweep
+			!noRefNames, // load names?
+			false,   // copies stay quiet
+			false,   // ditto
+			false /*passMemExc*/,
+			false,   // sanity-check only the primary
+			gEbwt_ext == "bt2" || gEbwt_ext == "bt2l",
+			hugePages, // back index with huge pages
+			packOffs); // bit-pack SA sample
+		l->copy->loadIntoMemory(-1, !noRefNames, false);
+	} catch(...) {
+		if(l->copy != NULL) {
+			delete l->copy;
+			l->copy = NULL;
+		}
+	}
+}
+
+/**
+ * Give every NUMA node in numaNodes its own in-memory copy of 'ebwt',
+ * which the caller has already loaded, and report what it cost.  A
+ * node whose copy can't be loaded shares the primary instead.
+ */
+static void numaReplicateIndex(Ebwt& ebwt) {
+	if(numaNodes.size() <= 1) return;
+	assert(ebwt.isInMemory());
+	EList<Ebwt*>& reps = ebwt.fw() ? numaFw : numaBw;
+	assert(reps.empty());
+	Timer _t(cerr, ebwt.fw() ? "Time replicating forward index: " :
+	                           "Time replicating mirror index: ", timing);
+	EList<NumaLoad> loads;
+	loads.resize(numaNodes.size());
+#if (__cplusplus >= 201103L)
+	EList<std::thread*> threads;
+#else
+	EList<tthread::thread*> threads;
+#endif
+	for(size_t i = 1; i < numaNodes.size(); i++) {
+		loads[i].primary = &ebwt;
+		loads[i].node = numaNodes[i];
+		loads[i].copy = NULL;
+#if (__cplusplus >= 201103L)
+		threads.push_back(new std::thread(numaLoadWorker, (void*)&loads[i]));
+#else
+		threads.push_back(new tthread::thread(numaLoadWorker, (void*)&loads[i]));
+#endif
+	}
+	for(size_t i = 0; i < threads.size(); i++) {
+		threads[i]->join();
+		delete threads[i];
+	}
+	reps.push_back(&ebwt);
+	size_t ncopies = 0;
+	for(size_t i = 1; i < numaNodes.size(); i++) {
+		if(loads[i].copy == NULL) {
+			cerr << "Warning: could not load a copy of the index on NUMA node "
+			     << numaNodes[i] << "; its threads will use node "
+			     << numaNodes[0] << "'s copy" << endl;
+			reps.push_back(&ebwt);
+		} else {
+			reps.push_back(loads[i].copy);
+			ncopies++;
+		}
+	}
+	if(!quiet) {
+		uint64_t bytes = ebwt.bigArrayBytes();
+		cerr << "NUMA replication: " << (ebwt.fw() ? "forward" : "mirror")
+		     << " index on " << (ncopies+1) << " nodes, "
+		     << ((bytes + (1 << 19)) >> 20) << " MB per node ("
+		     << (((bytes * ncopies) + (1 << 19)) >> 20) << " MB extra)" << endl;
+	}
+}
+
+/**
+ * Free the index copies made by numaReplicateIndex().
+ */
+static void numaRelease() {
+	for(size_t i = 1; i < numaFw.size(); i++) {
+		if(numaFw[i] != numaFw[0]) delete numaFw[i];
+	}
+	for(size_t i = 1; i < numaBw.size(); i++) {
+		if(numaBw[i] != numaBw[0]) delete numaBw[i];
+	}
+	numaFw.clear();
+	numaBw.clear();
+}
+
+/**
+ * Pin worker 'tid' to its NUMA node and return the node's slot, or
+ * return 0 if we're not replicating.
+ */
+static int numaWorkerSlot(int tid) {
+	if(numaNodes.size() <= 1) return 0;
+	int slot = tid % (int)numaNodes.size();
+	pin_thread_to_numa_node(numaNodes[slot]);
+	return slot;
+}
+
+/**
+ * Return the copy of 'ebwt' local to the given NUMA slot.
+ */
+static Ebwt& numaLocal(Ebwt& ebwt, int slot) {
+	const EList<Ebwt*>& reps = ebwt.fw() ? numaFw : numaBw;
+	if(reps.empty()) return ebwt;
+	assert_lt((size_t)slot, reps.size());
+	assert(reps[0] == &ebwt);
+	return *reps[slot];
+}
+
+/**
+ * Loads the bit-pair reference (the .3/.4 files), if paired-end
+ * search needs it, on a thread of its own, so that it overlaps with
+ * loading the index.
+ */
+class ReferenceLoader {
+public:
+	explicit ReferenceLoader(EList<BTRefString>& os) :
+		os_(os), refs_(NULL), required_(false), thread_(NULL)
+	{
+		bool pair = mates1.size() > 0 || mates12.size() > 0;
+		required_ = pair && mixedThresh < 0xffffffff;
+		if(required_ || pigeonhole) {
+#if (__cplusplus >= 201103L)
+			thread_ = new std::thread(loadWorker, (void*)this);
+#else
+			thread_ = new tthread::thread(loadWorker, (void*)this);
+#endif
+		}
+	}
+
+	~ReferenceLoader() { join(); }
+
+	/**
+	 * Wait for the reference and return it, or NULL if this run
+	 * doesn't need it.  --pigeonhole can do without it, so failing to
+	 * load it only for that is not an error.  The caller takes
+	 * ownership.
+	 */
+	BitPairReference* wait() {
+		if(thread_ == NULL) return NULL;
+		join();
+		if(refs_ == NULL || !refs_->loaded()) {
+			if(required_) throw 1;
+			if(!quiet) {
+				cerr << "Warning: --pigeonhole disabled; could not load the reference sequence" << endl;
+			}
+			delete refs_;
+			refs_ = NULL;
+		}
+		return refs_;
+	}
+
+private:
+
+	void join() {
+		if(thread_ != NULL) {
+			thread_->join();
+			delete thread_;
+			thread_ = NULL;
+		}
+	}
+
+	static void loadWorker(void *vp) {
+		ReferenceLoader* l = (ReferenceLoader*)vp;
+		Timer _t(cerr, "Time loading reference: ", timing);
+		try {
+			l->refs_ = new BitPairReference(adjustedEbwtFileBase, sanityCheck, NULL, &l->os_, false, true, useMm, useShmem, mmSweep, verbose, startVerbose, hugePages);
+		} catch(...) {
+			l->refs_ = NULL;
+		}
+	}
+
+	EList<BTRefString>& os_;
+	BitPairReference*   refs_;
+	bool                required_; // paired-end mate rescue needs it
+#if (__cplusplus >= 201103L)
+	std::thread*        thread_;
+#else
+	tthread::thread*    thread_;
+#endif
+};
+
+struct MirrorLoad {
+	Ebwt* ebwt;
+	bool failed;
+};
+
+static void mirrorLoadWorker(void *vp) {
+	MirrorLoad* l = (MirrorLoad*)vp;
+	try {
+		Timer _t(cerr, "Time loading mirror index: ", timing);
+		l->ebwt->loadIntoMemory(-1, !noRefNames, startVerbose);
+	} catch(...) {
+		l->failed = true;
+	}
+}
+
+/**
+ * Load the forward and mirror indexes into memory, the mirror on a
+ * thread of its own so that the two loads overlap.
+ */
+static void loadIndexPair(Ebwt& ebwtFw, Ebwt& ebwtBw) {
+	assert(!ebwtFw.isInMemory());
+	assert(!ebwtBw.isInMemory());
+	MirrorLoad bw;
+	bw.ebwt = &ebwtBw;
+	bw.failed = false;
+#if (__cplusplus >= 201103L)
+	std::thread t(mirrorLoadWorker, (void*)&bw);
+#else
+	tthread::thread t(mirrorLoadWorker, (void*)&bw);
+#endif
+	try {
+		Timer _t(cerr, "Time loading forward index: ", timing);
+		ebwtFw.loadIntoMemory(-1, !noRefNames, startVerbose);
+	} catch(...) {
+		t.join();
+		throw;
+	}
+	t.join();
+	if(bw.failed) throw 1;
+}
+
 void increment_thread_counter() {
 #if (__cplusplus >= 201103)
 	thread_counter.fetch_add(1);
@@ -1139,7 +1590,8 @@ static void exactSearchWorker(void *vp) {
 	}
 	PatternComposer&	_patsrc = *exactSearch_patsrc;
 	HitSink&		_sink   = *exactSearch_sink;
-	Ebwt&			ebwt    = *exactSearch_ebwt;
+	const int numaSlot = numaWorkerSlot(tid);
+	Ebwt&			ebwt    = numaLocal(*exactSearch_ebwt, numaSlot);
 	EList<BTRefString >&	os	= *exactSearch_os;
 
 	// Per-thread initialization
@@ -1164,6 +1616,7 @@ static void exactSearchWorker(void *vp) {
 	        verbose,        // verbose
 	        &os,
 	        false);         // considerQuals
+	ExactSearchBatch exb;
 	pair<bool, bool> get_read_ret = make_pair(false, false);
 	bool skipped = false;
 #ifdef PER_THREAD_TIMING
@@ -1232,7 +1685,8 @@ static void exactSearchWorkerStateful(void *vp) {
 	}
 	PatternComposer&	_patsrc = *exactSearch_patsrc;
 	HitSink&		_sink   = *exactSearch_sink;
-	Ebwt&			ebwt    = *exactSearch_ebwt;
+	const int numaSlot = numaWorkerSlot(tid);
+	Ebwt&			ebwt    = numaLocal(*exactSearch_ebwt, numaSlot);
 	EList<BTRefString >&	os	= *exactSearch_os;
 	BitPairReference*	refs    = exactSearch_refs;
 
@@ -1240,15 +1694,16 @@ static void exactSearchWorkerStateful(void *vp) {
 	PatternSourcePerThreadFactory* patsrcFact = createPatsrcFactory(_patsrc, tid, readsPerBatch);
 	HitSinkPerThreadFactory* sinkFact = createSinkFactory(_sink, tid);
 
-	ChunkPool *pool = new ChunkPool(chunkSz * 1024, chunkPoolMegabytes * 1024 * 1024, chunkVerbose);
+	ChunkPool *pool = new ChunkPool(chunkSz * 1024, chunkPoolMegabytes * 1024 * 1024, chunkVerbose,
+	                                (uint64_t)chunkPoolMaxMegabytes * 1024 * 1024);
 	UnpairedExactAlignerV1Factory alSEfact(
 			ebwt,
 			!nofw,
 			!norc,
 			_sink,
 			*sinkFact,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			rangeCacheFw,
+			rangeCacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -1275,8 +1730,8 @@ static void exactSearchWorkerStateful(void *vp) {
 			mhits,       // for symCeiling
 			mixedThresh,
 			mixedAttemptLim,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			rangeCacheFw,
+			rangeCacheBw,
 			cacheLimit,
 			pool,
 			refs, os,
@@ -1306,6 +1761,7 @@ static void exactSearchWorkerStateful(void *vp) {
 
 	delete patsrcFact;
 	delete sinkFact;
+	mergeChunkStats(*pool);
 	delete pool;
 #if (__cplusplus >= 201103L)
 	p->done->fetch_add(1);
@@ -1341,20 +1797,16 @@ static void exactSearch(PatternComposer& _patsrc,
 	exactSearch_os     = &os;
 
 	assert(!ebwt.isInMemory());
+	ReferenceLoader refLoad(os);
 	{
 		// Load the rest of (vast majority of) the backward Ebwt into
 		// memory
 		Timer _t(cerr, "Time loading forward index: ", timing);
 		ebwt.loadIntoMemory(-1, !noRefNames, startVerbose);
 	}
+	numaReplicateIndex(ebwt);
 
-	BitPairReference *refs = NULL;
-	bool pair = mates1.size() > 0 || mates12.size() > 0;
-	if((pair && mixedThresh < 0xffffffff)) {
-		Timer _t(cerr, "Time loading reference: ", timing);
-		refs = new BitPairReference(adjustedEbwtFileBase, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
-		if(!refs->loaded()) throw 1;
-	}
+	BitPairReference *refs = refLoad.wait();
 	exactSearch_refs   = refs;
 	int tids[max(nthreads, thread_ceiling)];
 #if (__cplusplus >= 201103L)
@@ -1518,15 +1970,17 @@ static void mismatchSearchWorkerFullStateful(void *vp) {
 	}
 	PatternComposer&	_patsrc = *mismatchSearch_patsrc;
 	HitSink&		_sink   = *mismatchSearch_sink;
-	Ebwt&			ebwtFw  = *mismatchSearch_ebwtFw;
-	Ebwt&			ebwtBw  = *mismatchSearch_ebwtBw;
+	const int numaSlot = numaWorkerSlot(tid);
+	Ebwt&			ebwtFw  = numaLocal(*mismatchSearch_ebwtFw, numaSlot);
+	Ebwt&			ebwtBw  = numaLocal(*mismatchSearch_ebwtBw, numaSlot);
 	EList<BTRefString >& os      = *mismatchSearch_os;
 	BitPairReference*	refs    = mismatchSearch_refs;
 
 	// Global initialization
 	PatternSourcePerThreadFactory* patsrcFact = createPatsrcFactory(_patsrc, tid, readsPerBatch);
 	HitSinkPerThreadFactory* sinkFact = createSinkFactory(_sink, tid);
-	ChunkPool *pool = new ChunkPool(chunkSz * 1024, chunkPoolMegabytes * 1024 * 1024, chunkVerbose);
+	ChunkPool *pool = new ChunkPool(chunkSz * 1024, chunkPoolMegabytes * 1024 * 1024, chunkVerbose,
+	                                (uint64_t)chunkPoolMaxMegabytes * 1024 * 1024);
 
 	Unpaired1mmAlignerV1Factory alSEfact(
 			ebwtFw,
@@ -1535,8 +1989,8 @@ static void mismatchSearchWorkerFullStateful(void *vp) {
 			!norc,
 			_sink,
 			*sinkFact,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			rangeCacheFw,
+			rangeCacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -1564,8 +2018,8 @@ static void mismatchSearchWorkerFullStateful(void *vp) {
 			mhits,     // for symCeiling
 			mixedThresh,
 			mixedAttemptLim,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			rangeCacheFw,
+			rangeCacheBw,
 			cacheLimit,
 			pool,
 			refs, os,
@@ -1598,6 +2052,7 @@ static void mismatchSearchWorkerFullStateful(void *vp) {
 
 	delete patsrcFact;
 	delete sinkFact;
+	mergeChunkStats(*pool);
 	delete pool;
 	return;
 }
@@ -1615,8 +2070,9 @@ static void mismatchSearchWorkerFull(void *vp){
 	}
 	PatternComposer&	_patsrc = *mismatchSearch_patsrc;
 	HitSink&		_sink   = *mismatchSearch_sink;
-	Ebwt&			ebwtFw  = *mismatchSearch_ebwtFw;
-	Ebwt&			ebwtBw  = *mismatchSearch_ebwtBw;
+	const int numaSlot = numaWorkerSlot(tid);
+	Ebwt&			ebwtFw  = numaLocal(*mismatchSearch_ebwtFw, numaSlot);
+	Ebwt&			ebwtBw  = numaLocal(*mismatchSearch_ebwtBw, numaSlot);
 	EList<BTRefString >& os      = *mismatchSearch_os;
 
 	// Per-thread initialization
@@ -1641,6 +2097,7 @@ static void mismatchSearchWorkerFull(void *vp){
 	        verbose,        // verbose
 	        &os,
 	        false);         // considerQuals
+	ExactSearchBatch exb;
 	bool skipped = false;
 	pair<bool, bool> get_read_ret = make_pair(false, false);
 #ifdef PER_THREAD_TIMING
@@ -1714,26 +2171,12 @@ static void mismatchSearchFull(PatternComposer& _patsrc,
 	mismatchSearch_hitMask      = NULL;
 	mismatchSearch_os           = &os;
 
-	assert(!ebwtFw.isInMemory());
-	assert(!ebwtBw.isInMemory());
-	{
-		// Load the other half of the index into memory
-		Timer _t(cerr, "Time loading forward index: ", timing);
-		ebwtFw.loadIntoMemory(-1, !noRefNames, startVerbose);
-	}
-	{
-		// Load the other half of the index into memory
-		Timer _t(cerr, "Time loading mirror index: ", timing);
-		ebwtBw.loadIntoMemory(-1, !noRefNames, startVerbose);
-	}
+	ReferenceLoader refLoad(os);
+	loadIndexPair(ebwtFw, ebwtBw);
+	numaReplicateIndex(ebwtFw);
+	numaReplicateIndex(ebwtBw);
 	// Create range caches, which are shared among all aligners
-	BitPairReference *refs = NULL;
-	bool pair = mates1.size() > 0 || mates12.size() > 0;
-	if(pair && mixedThresh < 0xffffffff) {
-		Timer _t(cerr, "Time loading reference: ", timing);
-		refs = new BitPairReference(adjustedEbwtFileBase, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
-		if(!refs->loaded()) throw 1;
-	}
+	BitPairReference *refs = refLoad.wait();
 	mismatchSearch_refs = refs;
 
 	int tids[max(nthreads, thread_ceiling)];
@@ -1964,8 +2407,9 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 	}
 	PatternComposer&	_patsrc = *twoOrThreeMismatchSearch_patsrc;
 	HitSink&		_sink   = *twoOrThreeMismatchSearch_sink;
-	Ebwt&			ebwtFw  = *twoOrThreeMismatchSearch_ebwtFw;
-	Ebwt&			ebwtBw  = *twoOrThreeMismatchSearch_ebwtBw;
+	const int numaSlot = numaWorkerSlot(tid);
+	Ebwt&			ebwtFw  = numaLocal(*twoOrThreeMismatchSearch_ebwtFw, numaSlot);
+	Ebwt&			ebwtBw  = numaLocal(*twoOrThreeMismatchSearch_ebwtBw, numaSlot);
 	EList<BTRefString >& os      = *twoOrThreeMismatchSearch_os;
 	BitPairReference*	refs    = twoOrThreeMismatchSearch_refs;
 	static bool		two     = twoOrThreeMismatchSearch_two;
@@ -1974,7 +2418,8 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 	PatternSourcePerThreadFactory* patsrcFact = createPatsrcFactory(_patsrc, tid, readsPerBatch);
 	HitSinkPerThreadFactory* sinkFact = createSinkFactory(_sink, tid);
 
-	ChunkPool *pool = new ChunkPool(chunkSz * 1024, chunkPoolMegabytes * 1024 * 1024, chunkVerbose);
+	ChunkPool *pool = new ChunkPool(chunkSz * 1024, chunkPoolMegabytes * 1024 * 1024, chunkVerbose,
+	                                (uint64_t)chunkPoolMaxMegabytes * 1024 * 1024);
 	Unpaired23mmAlignerV1Factory alSEfact(
 			ebwtFw,
 			&ebwtBw,
@@ -1983,8 +2428,8 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 			!norc,
 			_sink,
 			*sinkFact,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			rangeCacheFw,
+			rangeCacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -1995,7 +2440,8 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 			rangeMode,
 			verbose,
 			quiet,
-			seed);
+			seed,
+			pigeonhole);
 	Paired23mmAlignerV1Factory alPEfact(
 			ebwtFw,
 			&ebwtBw,
@@ -2013,8 +2459,8 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 			mhits,       // for symCeiling
 			mixedThresh,
 			mixedAttemptLim,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			rangeCacheFw,
+			rangeCacheBw,
 			cacheLimit,
 			pool,
 			refs, os,
@@ -2047,6 +2493,7 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 
 	delete patsrcFact;
 	delete sinkFact;
+	mergeChunkStats(*pool);
 	delete pool;
 	return;
 }
@@ -2077,8 +2524,9 @@ static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
 	        os,          /* reference sequences */
 	        true,        /* read is forward */
 	        true);       /* index is forward */
-	Ebwt& ebwtFw = *twoOrThreeMismatchSearch_ebwtFw;
-	Ebwt& ebwtBw = *twoOrThreeMismatchSearch_ebwtBw;
+	const int numaSlot = numaWorkerSlot(tid);
+	Ebwt& ebwtFw = numaLocal(*twoOrThreeMismatchSearch_ebwtFw, numaSlot);
+	Ebwt& ebwtBw = numaLocal(*twoOrThreeMismatchSearch_ebwtBw, numaSlot);
 	GreedyDFSRangeSource btr1(
 	        &ebwtFw, params,
 	        0xffffffff,     // qualThresh
@@ -2132,6 +2580,24 @@ static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
 	        &os,
 	        false,          // considerQuals
 	        true);          // halfAndHalf
+	if(mmsBound) {
+		// Let each backtracker use the other index to bound how many
+		// mismatches the rest of the read needs, and prune accordingly
+		btr1.setBoundEbwts(&ebwtFw, &ebwtBw);
+		bt2.setBoundEbwts(&ebwtFw, &ebwtBw);
+		bt3.setBoundEbwts(&ebwtFw, &ebwtBw);
+		bthh3.setBoundEbwts(&ebwtFw, &ebwtBw);
+	}
+	ExactSearchBatch exb;
+	// With --pigeonhole, reads with at most one alignment whose parts
+	// don't have too many exact matches are aligned without
+	// backtracking.  Mismatch qualities are Maq-rounded, as the
+	// backtrackers above do.
+	BitPairReference* refs = twoOrThreeMismatchSearch_refs;
+	PigeonholeSearch* pigeon = NULL;
+	if(pigeonhole && PigeonholeSearch::usable(ebwtFw, refs)) {
+		pigeon = new PigeonholeSearch(ebwtFw, *refs, two ? 2 : 3, !nofw, !norc, true);
+	}
 	bool skipped = false;
 	pair<bool, bool> get_read_ret = make_pair(false, false);
 #ifdef PER_THREAD_TIMING
@@ -2168,6 +2634,10 @@ static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
 			uint32_t s = plen;
 			uint32_t s3 = s >> 1; // length of 3' half of seed
 			uint32_t s5 = (s >> 1) + (s & 1); // length of 5' half of seed
+			if(pigeon != NULL && pigeon->align(patsrc->bufa())) {
+				pigeon->report(patsrc->bufa(), params);
+				continue;
+			}
 			#define DONEMASK_SET(p)
 			#include "search_23mm_phase1.c"
 			#include "search_23mm_phase2.c"
@@ -2186,6 +2656,7 @@ static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
 		std::cout << ss.str();
 	}
 #endif
+	delete pigeon;
 #if (__cplusplus >= 201103L)
 	p->done->fetch_add(1);
 #endif
@@ -2202,26 +2673,12 @@ static void twoOrThreeMismatchSearchFull(
 		bool two = true)                /// true -> 2, false -> 3
 {
 	// Global initialization
-	assert(!ebwtFw.isInMemory());
-	assert(!ebwtBw.isInMemory());
-	{
-		// Load the other half of the index into memory
-		Timer _t(cerr, "Time loading forward index: ", timing);
-		ebwtFw.loadIntoMemory(-1, !noRefNames, startVerbose);
-	}
-	{
-		// Load the other half of the index into memory
-		Timer _t(cerr, "Time loading mirror index: ", timing);
-		ebwtBw.loadIntoMemory(-1, !noRefNames, startVerbose);
-	}
+	ReferenceLoader refLoad(os);
+	loadIndexPair(ebwtFw, ebwtBw);
+	numaReplicateIndex(ebwtFw);
+	numaReplicateIndex(ebwtBw);
 	// Create range caches, which are shared among all aligners
-	BitPairReference *refs = NULL;
-	bool pair = mates1.size() > 0 || mates12.size() > 0;
-	if(pair && mixedThresh < 0xffffffff) {
-		Timer _t(cerr, "Time loading reference: ", timing);
-		refs = new BitPairReference(adjustedEbwtFileBase, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
-		if(!refs->loaded()) throw 1;
-	}
+	BitPairReference *refs = refLoad.wait();
 	twoOrThreeMismatchSearch_refs     = refs;
 	twoOrThreeMismatchSearch_patsrc   = &_patsrc;
 	twoOrThreeMismatchSearch_sink     = &_sink;
@@ -2399,8 +2856,9 @@ static void seededQualSearchWorkerFull(void *vp) {
 	        os,          /* reference sequences */
 	        true,        /* read is forward */
 	        true);       /* index is forward */
-	Ebwt& ebwtFw = *seededQualSearch_ebwtFw;
-	Ebwt& ebwtBw = *seededQualSearch_ebwtBw;
+	const int numaSlot = numaWorkerSlot(tid);
+	Ebwt& ebwtFw = numaLocal(*seededQualSearch_ebwtFw, numaSlot);
+	Ebwt& ebwtBw = numaLocal(*seededQualSearch_ebwtBw, numaSlot);
 	PartialAlignmentManager * pamRc = NULL;
 	PartialAlignmentManager * pamFw = NULL;
 	if(seedMms > 0) {
@@ -2618,8 +3076,9 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 	}
 	PatternComposer&	_patsrc    = *seededQualSearch_patsrc;
 	HitSink&                _sink      = *seededQualSearch_sink;
-	Ebwt&			ebwtFw     = *seededQualSearch_ebwtFw;
-	Ebwt&			ebwtBw     = *seededQualSearch_ebwtBw;
+	const int numaSlot = numaWorkerSlot(tid);
+	Ebwt&			ebwtFw     = numaLocal(*seededQualSearch_ebwtFw, numaSlot);
+	Ebwt&			ebwtBw     = numaLocal(*seededQualSearch_ebwtBw, numaSlot);
 	EList<BTRefString >& os         = *seededQualSearch_os;
 	int                     qualCutoff = seededQualSearch_qualCutoff;
 	BitPairReference*       refs       = seededQualSearch_refs;
@@ -2627,7 +3086,8 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 	// Global initialization
 	PatternSourcePerThreadFactory* patsrcFact = createPatsrcFactory(_patsrc, tid, readsPerBatch);
 	HitSinkPerThreadFactory* sinkFact = createSinkFactory(_sink, tid);
-	ChunkPool *pool = new ChunkPool(chunkSz * 1024, chunkPoolMegabytes * 1024 * 1024, chunkVerbose);
+	ChunkPool *pool = new ChunkPool(chunkSz * 1024, chunkPoolMegabytes * 1024 * 1024, chunkVerbose,
+	                                (uint64_t)chunkPoolMaxMegabytes * 1024 * 1024);
 
 	AlignerMetrics *metrics = NULL;
 	if(stats) {
@@ -2644,8 +3104,8 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 			maxBts,
 			_sink,
 			*sinkFact,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			rangeCacheFw,
+			rangeCacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -2678,8 +3138,8 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 			mhits,       // for symCeiling
 			mixedThresh,
 			mixedAttemptLim,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			rangeCacheFw,
+			rangeCacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -2717,6 +3177,7 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 
 	delete patsrcFact;
 	delete sinkFact;
+	mergeChunkStats(*pool);
 	delete pool;
 	return;
 }
@@ -2760,15 +3221,7 @@ static void seededQualCutoffSearchFull(
 	seededQualSearch_pamRc    = NULL;
 	seededQualSearch_qualCutoff = qualCutoff;
 
-	// Create range caches, which are shared among all aligners
-	BitPairReference *refs = NULL;
-	bool pair = mates1.size() > 0 || mates12.size() > 0;
-	if(pair && mixedThresh < 0xffffffff) {
-		Timer _t(cerr, "Time loading reference: ", timing);
-		refs = new BitPairReference(adjustedEbwtFileBase, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
-		if(!refs->loaded()) throw 1;
-	}
-	seededQualSearch_refs = refs;
+	ReferenceLoader refLoad(os);
 
 	int tids[max(nthreads, thread_ceiling)];
 #if (__cplusplus >= 201103L)
@@ -2784,13 +3237,12 @@ static void seededQualCutoffSearchFull(
 	all_threads_done = 0;
 #endif
 
-	SWITCH_TO_FW_INDEX();
-	assert(!ebwtBw.isInMemory());
-	{
-		// Load the other half of the index into memory
-		Timer _t(cerr, "Time loading mirror index: ", timing);
-		ebwtBw.loadIntoMemory(-1, !noRefNames, startVerbose);
-	}
+	loadIndexPair(ebwtFw, ebwtBw);
+	numaReplicateIndex(ebwtFw);
+	numaReplicateIndex(ebwtBw);
+	// Create range caches, which are shared among all aligners
+	BitPairReference *refs = refLoad.wait();
+	seededQualSearch_refs = refs;
 	CHUD_START();
 	{
 		// Phase 1: Consider cases 1R and 2R
@@ -3000,6 +3452,10 @@ static void driver(const char * type,
 	// stateful mode
 	bool paired = mates1.size() > 0 || mates12.size() > 0;
 	if(paired) stateful = true;
+	// Qualities affect alignment in -n mode, and the stateful aligners
+	// (-v 3, --best, -M, paired runs) may weigh them too, so copies of
+	// reads must have matching qualities there
+	dedupQuals = dedupReads && (maqLike || stateful);
 
 	// Create list of pattern sources for paired reads appearing
 	// interleaved in a single file
@@ -3102,6 +3558,11 @@ static void driver(const char * type,
 	} else {
 		patsrc = new DualPatternComposer(patsrcs_a, patsrcs_b);
 	}
+	if(readerThread) {
+		// Enough batches in flight that every search thread can have
+		// one waiting for it while it works on another
+		patsrc = new ReadAheadPatternComposer(patsrc, readsPerBatch, 2 * nthreads + 2);
+	}
 
 	// Open hit output file
 	if(verbose || startVerbose) {
@@ -3113,6 +3574,23 @@ static void driver(const char * type,
 	} else {
 		fout = new OutFileBuf();
 	}
+	// Decide which NUMA nodes get a copy of the index, and make sure
+	// the copy we load ourselves lands on the first of them
+	numaNodes.clear();
+	if(numaReplicate) {
+		numa_nodes_with_cpus(numaNodes);
+		if(numaNodes.size() <= 1) {
+			if(!quiet) {
+				cerr << "Warning: --numa-replicate has no effect on a host with one NUMA node" << endl;
+			}
+			numaNodes.clear();
+		} else if(!pin_thread_to_numa_node(numaNodes[0])) {
+			if(!quiet) {
+				cerr << "Warning: could not pin threads to NUMA nodes; ignoring --numa-replicate" << endl;
+			}
+			numaNodes.clear();
+		}
+	}
 	// Initialize Ebwt object and read in header
 	if(verbose || startVerbose) {
 		cerr << "About to initialize fw Ebwt: "; logTime(cerr, true);
@@ -3130,7 +3608,10 @@ static void driver(const char * type,
 	                startVerbose, // talkative during initialization
 	                false /*passMemExc*/,
 	                sanityCheck,
-	                isBt2Index);
+	                isBt2Index,
+	                hugePages, // back index with huge pages
+	                packOffs); // bit-pack SA sample
+	ebwt.setLoadTiming(timing);
 	Ebwt* ebwtBw = NULL;
 	// We need the mirror index if mismatches are allowed
 	if(mismatches > 0 || maqLike) {
@@ -3151,7 +3632,10 @@ static void driver(const char * type,
 			startVerbose, // talkative during initialization
 			false /*passMemExc*/,
 			sanityCheck,
-	        isBt2Index);
+	        isBt2Index,
+			hugePages, // back index with huge pages
+			packOffs); // bit-pack SA sample
+		ebwtBw->setLoadTiming(timing);
 	}
 	if(!os.empty()) {
 		for(size_t i = 0; i < os.size(); i++) {
@@ -3237,6 +3721,15 @@ static void driver(const char * type,
 			cerr << "Invalid output type: " << outType << endl;
 			throw 1;
 		}
+		sink->setDedup(dedupReads, dedupQuals);
+		if(cacheSize > 0) {
+			// Rows of repetitive ranges resolved by any thread are
+			// shared with all the others; split the budget between
+			// the forward and mirror indexes
+			uint64_t sz = (ebwtBw != NULL) ? (cacheSize >> 1) : cacheSize;
+			rangeCacheFw = new RangeCache(sz);
+			if(ebwtBw != NULL) rangeCacheBw = new RangeCache(sz);
+		}
 		if(verbose || startVerbose) {
 			cerr << "Dispatching to search driver: "; logTime(cerr, true);
 		}
@@ -3266,7 +3759,9 @@ static void driver(const char * type,
 			// we're only loading half of the index anyway
 			exactSearch(*patsrc, *sink, ebwt, os);
 		}
-		// Evict any loaded indexes from memory
+		// Free per-node copies, then evict any loaded indexes from
+		// memory
+		numaRelease();
 		if(ebwt.isInMemory()) {
 			ebwt.evictFromMemory();
 		}
@@ -3274,6 +3769,20 @@ static void driver(const char * type,
 			delete ebwtBw;
 		}
 		sink->finish(hadoopOut); // end the hits section of the hit file
+		if(stats || chunkVerbose) printChunkStats(cerr);
+		if(rangeCacheFw != NULL) {
+			if(stats) rangeCacheFw->printStats(cerr, "Forward-index");
+			delete rangeCacheFw;
+			rangeCacheFw = NULL;
+		}
+		if(rangeCacheBw != NULL) {
+			if(stats) rangeCacheBw->printStats(cerr, "Mirror-index");
+			delete rangeCacheBw;
+			rangeCacheBw = NULL;
+		}
+		// The reader thread, if any, uses the PatternSources until
+		// the composer is deleted
+		delete patsrc;
 		for(size_t i = 0; i < patsrcs_a.size(); i++) {
 			assert(patsrcs_a[i] != NULL);
 			delete patsrcs_a[i];
@@ -3288,7 +3797,6 @@ static void driver(const char * type,
 				delete patsrcs_ab[i];
 			}
 		}
-		delete patsrc;
 		delete sink;
 		if(fout != NULL) delete fout;
 	}
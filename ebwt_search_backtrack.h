@@ -57,6 +57,10 @@ public:
 		_mms(),
 		_refcs(),
 		_chars(NULL),
+		_bndFw(NULL),
+		_bndBw(NULL),
+		_minMms(NULL),
+		_minMmsValid(false),
 		_reportPartials(reportPartials),
 		_reportExacts(reportExacts),
 		_reportRanges(reportRanges),
@@ -82,6 +86,7 @@ public:
 		if(_pairs != NULL) delete[] _pairs;
 		if(_elims != NULL) delete[] _elims;
 		if(_chars != NULL) delete[] _chars;
+		if(_minMms != NULL) delete[] _minMms;
 	}
 
 	/**
@@ -112,6 +117,9 @@ public:
 				// Resize _chars
 				if(_chars != NULL) { delete[] _chars; }
 				_chars = new char[_qlen];
+				// Resize _minMms
+				if(_minMms != NULL) { delete[] _minMms; }
+				_minMms = new uint32_t[_qlen];
 				assert(_pairs != NULL && _elims != NULL && _chars != NULL);
 			} catch(std::bad_alloc& e) {
 				ThreadSafe _ts(&gLock);
@@ -128,6 +136,7 @@ public:
 		}
 		_mms.clear();
 		_refcs.clear();
+		_minMmsValid = false;
 		assert_geq(_qual->length(), _qlen);
 		if(_verbose) {
 			cout << "setQuery(_qry=" << (*_qry) << ", _qual=" << (*_qual) << ")" << endl;
@@ -202,6 +211,21 @@ public:
 	 */
 	void setEbwt(const Ebwt* ebwt) {
 		_ebwt = ebwt;
+		_minMmsValid = false;
+	}
+
+	/**
+	 * Give the backtracker both the forward index and its mirror so
+	 * that, whichever of them it is searching, it can use the other
+	 * to bound the number of mismatches the rest of the query needs
+	 * (see calcMinMms()) and prune branches that can't finish within
+	 * their mismatch budget (--mms-bound).  The indexes needn't be
+	 * loaded yet.
+	 */
+	void setBoundEbwts(const Ebwt* ebwtFw, const Ebwt* ebwtBw) {
+		_bndFw = ebwtFw;
+		_bndBw = ebwtBw;
+		_minMmsValid = false;
 	}
 
 	/**
@@ -217,6 +241,7 @@ public:
 	void setQlen(uint32_t qlen) {
 		assert(_qry != NULL);
 		_qlen = min<uint32_t>((uint32_t)_qry->length(), qlen);
+		_minMmsValid = false;
 	}
 
 	/// Return the maximum number of allowed backtracks in a given call
@@ -251,11 +276,18 @@ public:
 		// m = depth beyond which ftab must not extend or else we might
 		// miss some legitimate paths
 		uint32_t m = min<uint32_t>(_unrevOff, (uint32_t)_qlen);
-		if(nsInFtab == 0 && m >= (uint32_t)ftabChars) {
+		// Jump as many characters as we can in one lookup: kftab
+		// first, then ftab
+		TIndexOffU top = 0, bot = 0;
+		int jump = ebwt.kftabJump(*_qry, _qlen, m, top, bot);
+		if(jump == 0 && nsInFtab == 0 && m >= (uint32_t)ftabChars) {
 			uint32_t ftabOff = calcFtabOff();
-			TIndexOffU top = ebwt.ftabHi(ftabOff);
-			TIndexOffU bot = ebwt.ftabLo(ftabOff+1);
-			if(_qlen == (TIndexOffU)ftabChars && bot > top) {
+			top = ebwt.ftabHi(ftabOff);
+			bot = ebwt.ftabLo(ftabOff+1);
+			jump = ftabChars;
+		}
+		if(jump > 0) {
+			if(_qlen == (TIndexOffU)jump && bot > top) {
 				// We have a match!
 				if(_reportPartials > 0) {
 					// Oops - we're trying to find seedlings, so we've
@@ -271,7 +303,7 @@ public:
 				}
 			} else if (bot > top) {
 				// We have an arrow pair from which we can backtrack
-				ret = backtrack(ftabChars, // depth
+				ret = backtrack(jump,      // depth
 				                top,       // top
 				                bot,       // bot
 				                ham,
@@ -296,6 +328,61 @@ public:
 		return ret;
 	}
 
+	/**
+	 * Report the exact alignments in a range that was already found
+	 * for the current query, e.g. by an ExactSearchBatch.  Reports the
+	 * same alignments, in the same order, as backtrack() would with
+	 * the whole query unrevisitable.  bot <= top means there are no
+	 * exact alignments.
+	 *
+	 * Return true iff the HitSink has indicated that we're done with
+	 * this read.
+	 */
+	bool reportExactRange(TIndexOffU top, TIndexOffU bot) {
+		assert_gt(_qry->length(), 0);
+		bool ret = false;
+		if(bot > top) {
+			_ihits = _params.sink().retainedHits().size();
+			ret = reportAlignment(0, top, bot, 0);
+		}
+		if(finalize()) ret = true;
+		return ret;
+	}
+
+	/**
+	 * Like backtrack(), but start from a range already found for the
+	 * rightmost 'depth' characters of the current query, e.g. by an
+	 * ExactSearchBatch, rather than matching them again.  'depth' must
+	 * not exceed the unrevisitable region, so the characters skipped
+	 * are ones backtrack() would have matched exactly anyway.  bot <=
+	 * top means the characters have no exact matches, so neither can
+	 * the query.
+	 *
+	 * Return true iff the HitSink has indicated that we're done with
+	 * this read.
+	 */
+	bool backtrackFromRange(uint32_t depth,
+	                        TIndexOffU top,
+	                        TIndexOffU bot,
+	                        uint32_t ham = 0)
+	{
+		assert_gt(_qry->length(), 0);
+		assert_eq(_qlen, _qry->length());
+		assert_gt(depth, 0);
+		assert_lt(depth, _qlen);
+		assert_leq(depth, _unrevOff);
+		int nsInSeed = 0; int nsInFtab = 0;
+		if(!tallyNs(nsInSeed, nsInFtab)) {
+			return false;
+		}
+		bool ret = false;
+		if(bot > top) {
+			ret = backtrack(depth, top, bot, ham, nsInFtab > 0);
+		}
+		if(finalize()) ret = true;
+		return ret;
+	}
+
 	/**
 	 * If there are any buffered results that have yet to be committed,
 	 * commit them.  This happens when looking for partial alignments.
@@ -342,8 +429,14 @@ public:
 		// Initiate the recursive, randomized quality-aware backtracker
 		// with a stack depth of 0 (no backtracks so far)
 		_bailedOnBacktracks = false;
-		bool done = backtrack(0, depth, _unrevOff, _1revOff, _2revOff, _3revOff,
-		                      top, bot, iham, iham, _pairs, _elims, disableFtab);
+		bool done;
+		// Pick the backtracker compiled for this index's side layout
+		// and counting kernel
+#define BACKTRACK(L) done = backtrack<L>( \
+				0, depth, _unrevOff, _1revOff, _2revOff, _3revOff, \
+				top, bot, iham, iham, _pairs, _elims, disableFtab)
+		EBWT_LF_DISPATCH(_ebwt->lfVariant(), BACKTRACK);
+#undef BACKTRACK
 
 		_totNumBts += _numBts;
 		_numBts = 0;
@@ -359,7 +452,9 @@ public:
 	 * backtracking opportunities, the function will call itself
 	 * recursively and return the result.  As soon as there is a
 	 * mismatch and no backtracking opportunities, false is returned.
+	 * Compiled separately for each LF variant L (see EBWT_LF).
 	 */
+	template<int L>
 	bool backtrack(uint32_t  stackDepth, // depth of the recursion stack; = # mismatches so far
 	               uint32_t  depth,    // next depth where a post-pair needs to be calculated
 	               uint32_t  unrevOff, // depths < unrevOff are unrevisitable
@@ -422,7 +517,7 @@ public:
 			lbot = _preLbot;
 			_precalcedSideLocus = false;
 		} else if(top != 0 || bot != 0) {
-			SideLocus::initFromTopBot(top, bot, ebwt._eh, ebwt._ebwt, ltop, lbot);
+			SideLocus::initFromTopBot<L>(top, bot, ebwt._eh, ebwt._ebwt, ltop, lbot);
 		}
 		// Check whether we've exceeded any backtracking limit
 		if(_halfAndHalf) {
@@ -451,6 +546,15 @@ public:
 		// ranges; all alternative ranges with this quality are
 		// eligible
 		uint8_t lowAltQual = 0xff;
+		// Most mismatches this frame can still add, if we're bounding
+		// the mismatches the rest of the query needs; 0xffffffff if
+		// not.  Ranges are reported without weeding out alignments
+		// that straddle stretches, which the bound doesn't cover.
+		// Pruned branches never yield a hit, but they would have drawn
+		// from _rand, so pruning changes which of several valid hits
+		// is found first, though not which hits are valid.
+		const uint32_t budget = (_bndFw == NULL || _reportRanges) ? 0xffffffff :
+			mmBudget(unrevOff, oneRevOff, twoRevOff, threeRevOff);
 		uint32_t d = depth;
 		uint32_t cur = (uint32_t)_qlen - d - 1; // current offset into _qry
 		while(cur < _qlen) {
@@ -485,6 +589,15 @@ public:
 				(d >= unrevOff) &&
 			    (!_considerQuals ||
 			     (ham + mmPenalty(_maqPenalty, q) <= _qualThresh));
+			// A mismatch here is futile if the rest of the query needs
+			// more mismatches than would be left afterwards
+			bool curIsFutile = false;
+			if(curIsAlternative && budget != 0xffffffff && cur > 0 &&
+			   1 + minMms(cur-1) > budget)
+			{
+				curIsAlternative = false;
+				curIsFutile = true;
+			}
 			if(curIsAlternative) {
 				if(_considerQuals) {
 					// Is it the best alternative?
@@ -545,7 +658,7 @@ public:
 				// Clear pairs
 				memset(&pairs[d*8], 0, 8 * OFF_SIZE);
 				// Calculate next quartet of ranges
-				ebwt.mapLFEx(ltop, lbot, &pairs[d*8], &pairs[(d*8)+4]);
+				ebwt.mapLFEx<L>(ltop, lbot, &pairs[d*8], &pairs[(d*8)+4]);
 				// Update top and bot
 				if(c < 4) {
 					top = pairTop(pairs, d, c); bot = pairBot(pairs, d, c);
@@ -558,22 +671,33 @@ public:
 				// bookkeeping for the entire quartet, just do c
 				if(c < 4) {
 					if(top+1 == bot) {
-						bot = top = ebwt.mapLF1(top, ltop, c);
+						bot = top = ebwt.mapLF1<L>(top, ltop, c);
 						if(bot != OFF_MASK) bot++;
 					} else {
-						top = ebwt.mapLF(ltop, c); bot = ebwt.mapLF(lbot, c);
+						top = ebwt.mapLF<L>(ltop, c); bot = ebwt.mapLF<L>(lbot, c);
 						assert_geq(bot, top);
 					}
 				}
 			}
+			if(top < bot && budget != 0xffffffff && cur > 0 &&
+			   d >= unrevOff && minMms(cur-1) > budget)
+			{
+				// Matching here can't lead anywhere; the rest of the
+				// query needs more mismatches than we have left
+				top = bot;
+			}
 			if(top != bot) {
 				// Calculate loci from row indices; do it now so that
 				// those prefetches are fired off as soon as possible.
 				// This eventually calls SideLocus.initfromRow().
-				SideLocus::initFromTopBot(top, bot, ebwt._eh, ebwt._ebwt, ltop, lbot);
+				SideLocus::initFromTopBot<L>(top, bot, ebwt._eh, ebwt._ebwt, ltop, lbot);
 			}
 			// Update the elim array
 			eliminate(elims, d, c);
+			if(curIsFutile) {
+				// Rule out every backtrack target at this position
+				elims[d] = 15;
+			}
 
 			if(curIsAlternative) {
 				// Given the just-calculated range quartet, update
@@ -834,7 +958,7 @@ public:
 				}
 				// This is the earliest that we know what the next top/
 				// bot combo is going to be
-				SideLocus::initFromTopBot(bttop, btbot,
+				SideLocus::initFromTopBot<L>(bttop, btbot,
 				                          ebwt._eh, ebwt._ebwt,
 				                          _preLtop, _preLbot);
 				icur = (uint32_t)(_qlen - i - 1); // current offset into _qry
@@ -937,7 +1061,7 @@ public:
 					} else {
 						assert(!_precalcedSideLocus);
 						assert_leq(iham, _qualThresh);
-						ret = backtrack(stackDepth+1,
+						ret = backtrack<L>(stackDepth+1,
 						                ebwt._eh._ftabChars,
 						                btUnrevOff,  // new unrevisitable boundary
 						                btOneRevOff, // new 1-revisitable boundary
@@ -956,7 +1080,7 @@ public:
 					_precalcedSideLocus = true;
 					assert_leq(iham, _qualThresh);
 					// Continue from selected alternative range
-					ret = backtrack(stackDepth+1,// added 1 mismatch to alignment
+					ret = backtrack<L>(stackDepth+1,// added 1 mismatch to alignment
 					                (uint32_t)i+1, // start from next position after
 					                btUnrevOff,  // new unrevisitable boundary
 					                btOneRevOff, // new 1-revisitable boundary
@@ -1299,6 +1423,81 @@ protected:
 		return pairBot(pairs, d, c) - pairTop(pairs, d, c);
 	}
 
+	/**
+	 * Return the most mismatches a backtracking frame with the given
+	 * revisitability boundaries can still add.  Each backtrack folds
+	 * one boundary below _qlen into the next, so that's how many
+	 * there are.  A frame with depths beyond the 3-revisitable region
+	 * isn't bounded this way; return 0xffffffff.
+	 */
+	uint32_t mmBudget(uint32_t unrevOff,
+	                  uint32_t oneRevOff,
+	                  uint32_t twoRevOff,
+	                  uint32_t threeRevOff) const
+	{
+		if(threeRevOff < _qlen) return 0xffffffff;
+		return (unrevOff  < _qlen ? 1 : 0) +
+		       (oneRevOff < _qlen ? 1 : 0) +
+		       (twoRevOff < _qlen ? 1 : 0);
+	}
+
+	/**
+	 * Fill in _minMms, BWA's D array: _minMms[i] is a lower bound on
+	 * the number of mismatches in any alignment of _qry[0..i].  Scan
+	 * the query left to right, extending a substring one character at
+	 * a time in the mirror of the index we're searching (i.e.
+	 * searching its reverse against the reversed text).  Each time the
+	 * substring runs out of occurrences (or hits an N), it must
+	 * contain a mismatch; count it and start a new substring at the
+	 * next character.
+	 *
+	 * Whether the mirror reverses the whole joined text or each
+	 * stretch separately, every alignment that doesn't straddle two
+	 * stretches (and those are thrown out anyway) is reversed in the
+	 * mirror, so the bound holds for all alignments we could report.
+	 */
+	void calcMinMms() {
+		assert(_bndFw != NULL && _bndBw != NULL);
+		assert(_minMms != NULL);
+		const Ebwt& ebwt = (_ebwt == _bndFw) ? *_bndBw : *_bndFw;
+		assert_neq(&ebwt, _ebwt);
+		uint32_t z = 0;
+		TIndexOffU top = 0, bot = 0;
+		for(size_t i = 0; i < _qlen; i++) {
+			int c = (int)(*_qry)[i];
+			if(c == 4) {
+				z++;
+				top = bot = 0;
+			} else if(top == 0 && bot == 0) {
+				top = ebwt._fchr[c];
+				bot = ebwt._fchr[c+1];
+			} else {
+				SideLocus ltop, lbot;
+				SideLocus::initFromTopBot(top, bot, ebwt._eh, ebwt._ebwt, ltop, lbot);
+				top = ebwt.mapLF(ltop, c);
+				bot = ebwt.mapLF(lbot, c);
+			}
+			if(c < 4 && bot <= top) {
+				z++;
+				top = bot = 0;
+			}
+			_minMms[i] = z;
+		}
+		_minMmsValid = true;
+	}
+
+	/**
+	 * Return the lower bound on the number of mismatches in
+	 * _qry[0..i], computing the bounds for the query if necessary.
+	 * They're computed lazily because many searches end before
+	 * reaching a depth where the bound could be used.
+	 */
+	uint32_t minMms(size_t i) {
+		assert_lt(i, _qlen);
+		if(!_minMmsValid) calcMinMms();
+		return _minMms[i];
+	}
+
 	/**
 	 * Tally how many Ns occur in the seed region and in the ftab-
 	 * jumpable region of the read.  Check whether the mismatches
@@ -1536,29 +1735,41 @@ protected:
 		TIndexOffU spread = bot - top;
 		// Pick a random spot in the range to begin report
 		TIndexOffU r = top + (_rand.nextU<TIndexOffU>() % spread);
-		for(TIndexOffU i = 0; i < spread; i++) {
-			TIndexOffU ri = r + i;
-			if(ri >= bot) ri -= spread;
-			// reportChaseOne takes the _mms[] list in terms of
-			// their indices into the query string; not in terms
-			// of their offset from the 3' or 5' end.
-			assert_geq(cost, (uint32_t)(stratum << 14));
-			if(_ebwt->reportChaseOne((*_qry), _qual, _name,
-			                         _mms, _refcs,
-			                         stackDepth, ri, top, bot,
-			                         (uint32_t)_qlen, stratum, cost, _patid,
-			                         _seed, _params))
-			{
-				// Return value of true means that we can stop
-				return true;
+		// Rows are resolved in batches whose walks are interleaved by
+		// resolveRows().  Batches start at one row and double, so a
+		// read that stops after its first alignment or two doesn't pay
+		// for resolving the rest of a wide range.
+		TIndexOffU batch = 1;
+		for(TIndexOffU i = 0; i < spread; i += batch, batch = min<TIndexOffU>(batch << 1, 64)) {
+			TIndexOffU nb = min<TIndexOffU>(batch, spread - i);
+			_chaseRows.resize(nb);
+			_chaseOffs.resize(nb);
+			for(TIndexOffU j = 0; j < nb; j++) {
+				_chaseRows[j] = top + (r - top + i + j) % spread;
+			}
+			_ebwt->resolveRows(_chaseRows.ptr(), nb, _chaseOffs.ptr());
+			for(TIndexOffU j = 0; j < nb; j++) {
+				// report takes the _mms[] list in terms of their
+				// indices into the query string; not in terms of
+				// their offset from the 3' or 5' end.
+				assert_geq(cost, (uint32_t)(stratum << 14));
+				if(_ebwt->report((*_qry), _qual, _name,
+				                 _mms, _refcs,
+				                 stackDepth, _chaseOffs[j], top, bot,
+				                 (uint32_t)_qlen, stratum, cost, _patid,
+				                 _seed, _params))
+				{
+					// Return value of true means that we can stop
+					return true;
+				}
+				// Return value of false means that we should continue
+				// searching.  This could happen if we the call to
+				// report() reported a hit, but the user asked for
+				// multiple hits and we haven't reached the ceiling
+				// yet.  This might also happen if the call to report()
+				// didn't report a hit because the alignment was
+				// spurious (i.e. overlapped some padding).
 			}
-			// Return value of false means that we should continue
-			// searching.  This could happen if we the call to
-			// reportChaseOne() reported a hit, but the user asked for
-			// multiple hits and we haven't reached the ceiling yet.
-			// This might also happen if the call to reportChaseOne()
-			// didn't report a hit because the alignment was spurious
-			// (i.e. overlapped some padding).
 		}
 		// All range elements were examined and we should keep going
 		return false;
@@ -1718,7 +1929,17 @@ protected:
 	EList<uint8_t> _refcs;  // array for holding mismatches
 	// Entries in _mms[] are in terms of offset into
 	// _qry - not in terms of offset from 3' or 5' end
+	EList<TIndexOffU> _chaseRows; // batch of rows for resolveRows()
+	EList<TIndexOffU> _chaseOffs; // their joined-reference offsets
 	char               *_chars;  // characters selected so far
+	// Forward index and mirror used to compute _minMms; NULL if the
+	// lower bound isn't in use
+	const Ebwt*         _bndFw;
+	const Ebwt*         _bndBw;
+	// _minMms[i] = lower bound on # mismatches in _qry[0..i]; only
+	// meaningful once calcMinMms() has set _minMmsValid
+	uint32_t           *_minMms;
+	bool                _minMmsValid;
 	// If > 0, report partial alignments up to this many mismatches
 	uint32_t            _reportPartials;
 	/// Do not report alignments with stratum < this limit
@@ -1968,14 +2189,24 @@ public:
 		bool ftabSkipsToEnd = (qlen_ == (uint32_t)ftabChars);
 		bool skipInvalidExact = (!reportExacts_ && ftabSkipsToEnd);
 
+		// Jump as many characters as we can in one lookup: kftab
+		// first, then ftab
+		TIndexOffU top = 0, bot = 0;
+		int jump = 0;
+		if(reportExacts_ || qlen_ != (uint32_t)ebwt.kftabChars()) {
+			jump = ebwt.kftabJump(*qry_, qlen_, m, top, bot);
+		}
 		// If it's OK to use the ftab...
-		if(nsInFtab == 0 && m >= (uint32_t)ftabChars && !skipInvalidExact) {
+		if(jump == 0 && nsInFtab == 0 && m >= (uint32_t)ftabChars && !skipInvalidExact) {
 			// Use the ftab to jump 'ftabChars' chars into the read
 			// from the right
 			uint32_t ftabOff = calcFtabOff();
-			TIndexOffU top = ebwt.ftabHi(ftabOff);
-			TIndexOffU bot = ebwt.ftabLo(ftabOff+1);
-			if(qlen_ == (uint32_t)ftabChars && bot > top) {
+			top = ebwt.ftabHi(ftabOff);
+			bot = ebwt.ftabLo(ftabOff+1);
+			jump = ftabChars;
+		}
+		if(jump > 0) {
+			if(qlen_ == (uint32_t)jump && bot > top) {
 				// We found a range with 0 mismatches immediately.  Set
 				// fields to indicate we found a range.
 				assert(reportExacts_);
@@ -2007,7 +2238,7 @@ public:
 				if(!b->init(
 				        pm.rpool, pm.epool, pm.bpool.lastId(), (uint32_t)qlen_,
 				        offRev0_, offRev1_, offRev2_, offRev3_,
-				        0, ftabChars, icost, iham, top, bot,
+				        0, jump, icost, iham, top, bot,
 				        ebwt._eh, ebwt._ebwt))
 				{
 					// Negative result from b->init() indicates we ran
@@ -2058,6 +2289,18 @@ public:
 	 */
 	virtual void
 	advanceBranch(int until, uint16_t minCost, PathManager& pm) {
+		// Pick the loop compiled for this index's side layout and
+		// counting kernel
+#define ADVANCE_BRANCH(L) advanceBranch<L>(until, minCost, pm)
+		EBWT_LF_DISPATCH(ebwt_->lfVariant(), ADVANCE_BRANCH);
+#undef ADVANCE_BRANCH
+	}
+
+	/**
+	 * advanceBranch() compiled for LF variant L (see EBWT_LF).
+	 */
+	template<int L>
+	void advanceBranch(int until, uint16_t minCost, PathManager& pm) {
 		assert(curEbwt_ != NULL);
 
 		// Let this->foundRange = false; we'll set it to true iff this call
@@ -2189,18 +2432,18 @@ public:
 					rs->bots[3]               = 0;
 					if(br->lbot_.valid()) {
 						if(metrics_ != NULL) metrics_->curBwtOps_++;
-						ebwt.mapLFEx(br->ltop_, br->lbot_, (TIndexOffU*)rs->tops, (TIndexOffU*)rs->bots);
+						ebwt.mapLFEx<L>(br->ltop_, br->lbot_, (TIndexOffU*)rs->tops, (TIndexOffU*)rs->bots);
 					} else {
 #ifndef NDEBUG
 						TIndexOffU tmptops[] = {0, 0, 0, 0};
 						TIndexOffU tmpbots[] = {0, 0, 0, 0};
 						SideLocus ltop, lbot;
-						ltop.initFromRow(otop, ebwt_->_eh, ebwt_->_ebwt);
-						lbot.initFromRow(obot, ebwt_->_eh, ebwt_->_ebwt);
-						ebwt.mapLFEx(ltop, lbot, tmptops, tmpbots);
+						ltop.initFromRow<L>(otop, ebwt_->_eh, ebwt_->_ebwt);
+						lbot.initFromRow<L>(obot, ebwt_->_eh, ebwt_->_ebwt);
+						ebwt.mapLFEx<L>(ltop, lbot, tmptops, tmpbots);
 #endif
 						if(metrics_ != NULL) metrics_->curBwtOps_++;
-						int cc = ebwt.mapLF1((TIndexOffU&)otop, br->ltop_);
+						int cc = ebwt.mapLF1<L>((TIndexOffU&)otop, br->ltop_);
 						br->top_ = otop;
 						assert(cc == -1 || (cc >= 0 && cc < 4));
 						if(cc >= 0) {
@@ -2238,14 +2481,14 @@ public:
 					if(c < 4) {
 						if(br->top_ + 1 == br->bot_) {
 							if(metrics_ != NULL) metrics_->curBwtOps_++;
-							br->bot_ = br->top_ = ebwt.mapLF1(br->top_, br->ltop_, c);
+							br->bot_ = br->top_ = ebwt.mapLF1<L>(br->top_, br->ltop_, c);
 							if(br->bot_ != OFF_MASK) br->bot_++;
 						} else {
 							if(metrics_ != NULL) metrics_->curBwtOps_++;
-							br->top_ = ebwt.mapLF(br->ltop_, c);
+							br->top_ = ebwt.mapLF<L>(br->ltop_, c);
 							assert(br->lbot_.valid());
 							if(metrics_ != NULL) metrics_->curBwtOps_++;
-							br->bot_ = ebwt.mapLF(br->lbot_, c);
+							br->bot_ = ebwt.mapLF<L>(br->lbot_, c);
 						}
 					}
 				} else {
@@ -2336,9 +2579,9 @@ public:
 		bail:
 			// Make sure the front element of the priority queue is
 			// extendable (i.e. not curtailed) and then prep it.
-			if(!pm.splitAndPrep(rand_, (uint32_t)qlen_, qualLim_, depth3_,
-			                    qualOrder_,
-			                    ebwt_->_eh, ebwt_->_ebwt, ebwt_->_fw))
+			if(!pm.splitAndPrep<L>(rand_, (uint32_t)qlen_, qualLim_, depth3_,
+			                       qualOrder_,
+			                       ebwt_->_eh, ebwt_->_ebwt, ebwt_->_fw))
 			{
 				pm.reset(0);
 				assert(pm.empty());
@@ -0,0 +1,546 @@
+/*
+ * ebwt_search_batch.h
+ *
+ * Exact-match backward search over several reads at once.  Searching
+ * one read at a time means every LF step waits on a cache miss into
+ * the BWT; for genomes much larger than the last-level cache that miss
+ * almost always goes to DRAM.  ExactSearchBatch instead keeps a window
+ * of queries in flight and advances each by one LF step per round.
+ * The SideLocus for a query's next step is computed (and its side
+ * prefetched) as soon as its current step finishes, so by the time
+ * the round comes back around to it, the side is hopefully in cache.
+ *
+ * Queries are also sorted by their reversed sequences, i.e. in the
+ * order backward search consumes them, so that queries sharing their
+ * rightmost characters end up next to each other.  Where a query
+ * shares more than its initial ftab jump with one sorted before it, it
+ * waits for that query to get past the shared characters and starts
+ * from its range, so the shared suffix is matched once for the whole
+ * batch, as in a walk down a trie of the batch's reversed queries.
+ * Deep, duplicate-rich data (amplicons, small RNAs) shares a lot.
+ *
+ * Along the way the batch records the range each query had when it
+ * had consumed one half of itself (either half, for odd lengths).  The
+ * 1- and 2/3-mismatch searches keep one half of the read unrevisitable
+ * when backtracking in the forward index, so those ranges let them
+ * start backtracking at the half boundary instead of matching the same
+ * characters a second time.  Queries that others share with also
+ * record their ranges at every depth, which is where the sharers get
+ * theirs (half ranges included) from.
+ */
+
+#ifndef EBWT_SEARCH_BATCH_H_
+#define EBWT_SEARCH_BATCH_H_
+
+#include <algorithm>
+#include <stdint.h>
+
+#include "btypes.h"
+#include "ds.h"
+#include "ebwt.h"
+#include "read.h"
+#include "sstring.h"
+
+/**
+ * Finds the BW range for the exact matches of each strand of a batch
+ * of reads.  The ranges are the same ones GreedyDFSRangeSource would
+ * arrive at with the whole read unrevisitable, so they can be handed
+ * to GreedyDFSRangeSource::reportExactRange() to produce exactly the
+ * same alignments as GreedyDFSRangeSource::backtrack().
+ */
+class ExactSearchBatch {
+
+	/// A query (one strand of one read) in flight
+	struct Query {
+		const BTDnaString* qry;
+		uint32_t   end;   // search leftward from just before qry[end]
+		uint32_t   nfrom; // qry[nfrom, end) must be N-free
+		TIndexOffU top;
+		TIndexOffU bot;
+		uint32_t   depth; // # characters consumed from the right
+		uint32_t   stop;  // stop after consuming this many characters
+		uint32_t   jump;  // depth the kftab/ftab/fchr lookup gets to
+		TIndexOffU ftabOff;
+		SideLocus  ltop;
+		SideLocus  lbot;
+		// Ranges at the half boundaries; [0] after len>>1 characters,
+		// [1] after len - (len>>1)
+		uint32_t   halfDepth[2];
+		TIndexOffU halfTop[2];
+		TIndexOffU halfBot[2];
+		bool       halfSet[2];
+		int        parent;  // query to take the shared range from, or -1
+		uint32_t   share;   // # rightmost characters shared with parent
+		bool       keepPath; // record range at every depth in _path
+		uint64_t   suffix;  // rightmost 32 characters, rightmost on top
+		size_t     pathOff; // where this query's ranges start in _path
+		uint32_t   pathLo;  // shallowest depth with a range in _path
+	};
+
+	/**
+	 * Orders queries by their reversed sequences.  Mostly settled by
+	 * comparing the packed rightmost 32 characters.
+	 */
+	struct SuffixLess {
+		explicit SuffixLess(const EList<Query>& qs) : qs_(qs) { }
+		bool operator()(uint32_t a, uint32_t b) const {
+			if(qs_[a].suffix != qs_[b].suffix) {
+				return qs_[a].suffix < qs_[b].suffix;
+			}
+			const BTDnaString& x = *qs_[a].qry;
+			const BTDnaString& y = *qs_[b].qry;
+			const size_t xlen = qs_[a].end, ylen = qs_[b].end;
+			const size_t len = std::min(xlen, ylen);
+			for(size_t j = 1; j <= len; j++) {
+				if((int)x[xlen-j] != (int)y[ylen-j]) {
+					return (int)x[xlen-j] < (int)y[ylen-j];
+				}
+			}
+			if(xlen != ylen) return xlen < ylen;
+			return a < b;
+		}
+		const EList<Query>& qs_;
+	};
+
+public:
+
+	ExactSearchBatch() : _ebwt(NULL) { }
+
+	/**
+	 * Forget all reads, in preparation for a new batch against 'ebwt'.
+	 */
+	void reset(const Ebwt& ebwt) {
+		_ebwt = &ebwt;
+		_rdids.clear();
+		_qs.clear();
+		_active.clear();
+		_waiting.clear();
+	}
+
+	/**
+	 * Add a read to the batch.  The read's sequences must stay put
+	 * until search() returns.  Strands that are not requested get
+	 * empty ranges.  If rcHalf is true, the reverse-complement strand
+	 * is only searched as far as its longer half; only halfRange() is
+	 * meaningful for it afterwards.
+	 */
+	void add(TReadId rdid, const Read& r, bool fw, bool rc, bool rcHalf = false) {
+		_rdids.push_back(rdid);
+		addQuery(fw ? &r.patFw : NULL, false);
+		addQuery(rc ? &r.patRc : NULL, rcHalf);
+	}
+
+	/**
+	 * Add a query for the 'len' characters of 'qry' ending just before
+	 * qry[end], and return its index for range().  Used for searching
+	 * pieces of reads; don't mix with add() in one batch.
+	 */
+	size_t addPart(const BTDnaString& qry, uint32_t end, uint32_t len) {
+		assert_gt(len, 0);
+		assert_leq(len, end);
+		assert_leq(end, qry.length());
+		addQuery(&qry, false);
+		Query& q = _qs.back();
+		q.end = end;
+		q.nfrom = end - len;
+		q.stop = len;
+		// Parts have no halves to record
+		q.halfDepth[0] = q.halfDepth[1] = 0;
+		return _qs.size() - 1;
+	}
+
+	/**
+	 * Find exact-match ranges for every query in the batch.
+	 */
+	void search() {
+		assert(_ebwt != NULL);
+		// Pick the search compiled for this index's side layout and
+		// counting kernel
+#define SEARCH(L) search<L>()
+		EBWT_LF_DISPATCH(_ebwt->lfVariant(), SEARCH);
+#undef SEARCH
+	}
+
+	/**
+	 * search() compiled for LF variant L (see EBWT_LF).
+	 */
+	template<int L>
+	void search() {
+		assert(_ebwt != NULL);
+		const Ebwt& ebwt = *_ebwt;
+		const int ftabChars = ebwt._eh._ftabChars;
+		const int kftabChars = ebwt.kftabChars();
+		// First pass: rule out queries with Ns and work out how far
+		// each query's initial lookup takes it
+		_order.clear();
+		for(size_t i = 0; i < _qs.size(); i++) {
+			Query& q = _qs[i];
+			if(q.qry == NULL) continue;
+			const BTDnaString& qry = *q.qry;
+			const size_t qlen = q.end;
+			bool hasN = (qlen == q.nfrom);
+			uint64_t suffix = 0;
+			for(size_t j = 1; j <= qlen - q.nfrom && !hasN; j++) {
+				const int c = (int)qry[qlen - j];
+				hasN = (c == 4);
+				if(j <= 32) suffix |= ((uint64_t)(c & 3) << (64 - 2*j));
+			}
+			if(hasN) {
+				// An N can't be matched exactly
+				q.qry = NULL;
+				continue;
+			}
+			if(kftabChars > 0 && q.stop >= (uint32_t)kftabChars) {
+				q.jump = kftabChars;
+			} else if(q.stop >= (uint32_t)ftabChars) {
+				q.jump = ftabChars;
+			} else {
+				q.jump = 1;
+			}
+			q.suffix = suffix;
+			_order.push_back((uint32_t)i);
+		}
+		findParents();
+		// Fire off prefetches for the ftab entries that queries with
+		// nothing to share are about to look at
+		for(size_t i = 0; i < _order.size(); i++) {
+			Query& q = _qs[_order[i]];
+			if(q.parent >= 0 || q.jump != (uint32_t)ftabChars ||
+			   (kftabChars > 0 && q.stop >= (uint32_t)kftabChars))
+			{
+				continue;
+			}
+			const BTDnaString& qry = *q.qry;
+			const size_t qlen = q.end;
+			// Rightmost char gets least significant bit-pair
+			TIndexOffU ftabOff = (TIndexOffU)qry[qlen - ftabChars];
+			for(int j = ftabChars - 1; j > 0; j--) {
+				ftabOff <<= 2;
+				ftabOff |= (TIndexOffU)qry[qlen - j];
+			}
+			assert_lt(ftabOff, ebwt._eh._ftabLen-1);
+			q.ftabOff = ftabOff;
+#ifndef NO_PREFETCH
+			__builtin_prefetch((const void *)(ebwt._ftab + ftabOff),
+			                   0 /* prepare for read */,
+			                   PREFETCH_LOCALITY);
+#endif
+		}
+		// Second pass: get the initial range for each query from the
+		// kftab or ftab (or the fchr, for queries shorter than both) and
+		// compute the loci for its first LF step.  Queries sharing
+		// with an earlier one wait for it instead.
+		_active.clear();
+		_waiting.clear();
+		for(size_t i = 0; i < _order.size(); i++) {
+			Query& q = _qs[_order[i]];
+			if(q.parent >= 0) {
+				_waiting.push_back(_order[i]);
+				continue;
+			}
+			const uint32_t qlen = q.end;
+			if(kftabChars > 0 && q.stop >= (uint32_t)kftabChars) {
+				q.depth = ebwt.kftabJump(*q.qry, qlen, q.stop, q.top, q.bot);
+				assert_eq((uint32_t)kftabChars, q.depth);
+			} else if(q.stop >= (uint32_t)ftabChars) {
+				q.top = ebwt.ftabHi(q.ftabOff);
+				q.bot = ebwt.ftabLo(q.ftabOff+1);
+				q.depth = ftabChars;
+			} else {
+				int c = (int)(*q.qry)[qlen-1];
+				q.top = ebwt._fchr[c];
+				q.bot = ebwt._fchr[c+1];
+				q.depth = 1;
+			}
+			assert_eq(q.jump, q.depth);
+			q.pathLo = q.depth;
+			if(!advanceLoci<L>(q)) continue;
+			_active.push_back(_order[i]);
+		}
+		// Round-robin over the queries still in flight, one LF step
+		// each per round, until they've all matched or run dry
+		while(!_active.empty() || !_waiting.empty()) {
+			size_t nact = 0;
+			for(size_t i = 0; i < _active.size(); i++) {
+				Query& q = _qs[_active[i]];
+				const uint32_t qlen = q.end;
+				assert_lt(q.depth, qlen);
+				int c = (int)(*q.qry)[qlen - q.depth - 1];
+				assert_lt(c, 4);
+				if(q.top+1 == q.bot) {
+					q.bot = q.top = ebwt.mapLF1<L>(q.top, q.ltop, c);
+					if(q.bot != OFF_MASK) q.bot++;
+				} else {
+					q.top = ebwt.mapLF<L>(q.ltop, c);
+					q.bot = ebwt.mapLF<L>(q.lbot, c);
+				}
+				assert_geq(q.bot, q.top);
+				q.depth++;
+				if(advanceLoci<L>(q)) {
+					_active[nact++] = _active[i];
+				}
+			}
+			_active.resize(nact);
+			// Start the waiting queries whose parents have got past
+			// the shared characters (or run dry before then)
+			size_t nwait = 0;
+			for(size_t i = 0; i < _waiting.size(); i++) {
+				Query& q = _qs[_waiting[i]];
+				const Query& p = _qs[q.parent];
+				if(p.depth < q.share && p.qry != NULL) {
+					_waiting[nwait++] = _waiting[i];
+					continue;
+				}
+				inherit(q, p);
+				if(advanceLoci<L>(q)) {
+					_active.push_back(_waiting[i]);
+				}
+			}
+			_waiting.resize(nwait);
+		}
+	}
+
+	/// Return the number of reads in the batch
+	size_t size() const {
+		return _rdids.size();
+	}
+
+	/**
+	 * Return the index of the read with the given id, or -1 if it
+	 * isn't part of this batch.  Reads are added in id order.
+	 */
+	int find(TReadId rdid) const {
+		if(_rdids.empty() || rdid < _rdids[0]) return -1;
+		size_t i = (size_t)(rdid - _rdids[0]);
+		if(i < _rdids.size() && _rdids[i] == rdid) return (int)i;
+		for(i = 0; i < _rdids.size(); i++) {
+			if(_rdids[i] == rdid) return (int)i;
+		}
+		return -1;
+	}
+
+	/// Return top of the exact-match range for read i, given strand
+	TIndexOffU top(size_t i, bool fw) const {
+		const Query& q = _qs[2*i + (fw ? 0 : 1)];
+		assert(q.qry == NULL || q.stop == q.qry->length());
+		return q.qry == NULL ? 0 : q.top;
+	}
+
+	/// Return bot of the exact-match range for read i, given strand
+	TIndexOffU bot(size_t i, bool fw) const {
+		const Query& q = _qs[2*i + (fw ? 0 : 1)];
+		assert(q.qry == NULL || q.stop == q.qry->length());
+		return q.qry == NULL ? 0 : q.bot;
+	}
+
+	/**
+	 * Get the exact-match range of query qi, as returned by addPart().
+	 * The range is empty if the query has an N or no matches.
+	 */
+	void range(size_t qi, TIndexOffU& top, TIndexOffU& bot) const {
+		const Query& q = _qs[qi];
+		assert(q.qry == NULL || q.depth == q.stop);
+		top = (q.qry == NULL ? 0 : q.top);
+		bot = (q.qry == NULL ? 0 : q.bot);
+	}
+
+	/**
+	 * Get the range for the rightmost 'depth' characters of the given
+	 * strand of read i, where 'depth' is the length of one of the
+	 * read's halves.  Returns false if the range isn't known, e.g.
+	 * because the strand wasn't searched, because it has an N, or
+	 * because the ftab jumped over 'depth'.  An empty range (top ==
+	 * bot) means the half has no exact matches.
+	 */
+	bool halfRange(size_t i, bool fw, uint32_t depth,
+	               TIndexOffU& top, TIndexOffU& bot) const
+	{
+		const Query& q = _qs[2*i + (fw ? 0 : 1)];
+		for(int k = 0; k < 2; k++) {
+			if(q.halfDepth[k] != depth) continue;
+			if(q.halfSet[k]) {
+				top = q.halfTop[k];
+				bot = q.halfBot[k];
+				return true;
+			}
+			if(q.depth > 0 && q.depth <= depth && q.bot <= q.top) {
+				// Ran dry before getting that far
+				top = bot = 0;
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+
+	void addQuery(const BTDnaString* qry, bool half) {
+		_qs.expand();
+		Query& q = _qs.back();
+		q.qry = qry;
+		q.nfrom = 0;
+		q.top = q.bot = 0;
+		q.depth = 0;
+		q.ftabOff = 0;
+		const uint32_t qlen = (qry == NULL ? 0 : (uint32_t)qry->length());
+		q.end = qlen;
+		q.halfDepth[0] = qlen >> 1;
+		q.halfDepth[1] = qlen - q.halfDepth[0];
+		q.stop = half ? q.halfDepth[1] : qlen;
+		q.halfSet[0] = q.halfSet[1] = false;
+		q.halfTop[0] = q.halfTop[1] = 0;
+		q.halfBot[0] = q.halfBot[1] = 0;
+		q.jump = 0;
+		q.parent = -1;
+		q.share = 0;
+		q.keepPath = false;
+		q.suffix = 0;
+		q.pathOff = 0;
+		q.pathLo = 0;
+	}
+
+	/**
+	 * Sort the live queries by their reversed sequences and, for each
+	 * that shares more rightmost characters with an earlier one than
+	 * its own initial lookup would get it, pick the query to take the
+	 * shared range from.  That's the nearest earlier query that shares
+	 * at least as much and doesn't itself start below the shared depth.
+	 * Then make room in _path for the queries that were picked.
+	 */
+	void findParents() {
+		_path.clear();
+		if(_order.size() < 2) return;
+		std::sort(_order.ptr(), _order.ptr() + _order.size(), SuffixLess(_qs));
+		// _lcs[j] = # rightmost characters _order[j] shares with
+		// _order[j-1], as far as both are searched
+		_lcs.resize(_order.size());
+		_lcs[0] = 0;
+		for(size_t j = 1; j < _order.size(); j++) {
+			const Query& a = _qs[_order[j-1]];
+			Query& b = _qs[_order[j]];
+			const BTDnaString& x = *a.qry;
+			const BTDnaString& y = *b.qry;
+			const uint32_t xlen = a.end;
+			const uint32_t ylen = b.end;
+			const uint32_t lim = std::min(a.stop, b.stop);
+			uint32_t s = 32;
+			if(a.suffix != b.suffix) {
+				// Leading zero bit pairs of the xor = shared characters
+				s = (uint32_t)__builtin_clzll(a.suffix ^ b.suffix) >> 1;
+			}
+			s = std::min(s, lim);
+			while(s < lim && (int)x[xlen-s-1] == (int)y[ylen-s-1]) s++;
+			_lcs[j] = s;
+			if(s <= b.jump) continue; // initial lookup gets as far
+			for(size_t k = j; k > 0; k--) {
+				if(_lcs[k] < s) break;
+				const Query& c = _qs[_order[k-1]];
+				const uint32_t start = (c.parent >= 0 ? c.share : c.jump);
+				if(start <= s) {
+					b.parent = (int)_order[k-1];
+					b.share = s;
+					_qs[b.parent].keepPath = true;
+					break;
+				}
+			}
+		}
+		size_t pathSz = 0;
+		for(size_t j = 0; j < _order.size(); j++) {
+			Query& q = _qs[_order[j]];
+			if(!q.keepPath) continue;
+			q.pathOff = pathSz;
+			pathSz += 2 * (q.stop + 1);
+		}
+		_path.resize(pathSz);
+	}
+
+	/**
+	 * Give q the ranges parent p had for the characters they share, or
+	 * p's empty range if p ran dry before matching all of them.
+	 */
+	void inherit(Query& q, const Query& p) {
+		assert(p.keepPath);
+		assert(p.depth >= q.share || p.qry == NULL);
+		const uint32_t d = std::min(q.share, p.depth);
+		assert_geq(d, p.pathLo);
+		const TIndexOffU* ppath = _path.ptr() + p.pathOff;
+		for(int k = 0; k < 2; k++) {
+			const uint32_t hd = q.halfDepth[k];
+			if(hd >= p.pathLo && hd <= d) {
+				q.halfTop[k] = ppath[2*hd];
+				q.halfBot[k] = ppath[2*hd + 1];
+				q.halfSet[k] = true;
+			}
+		}
+		if(q.keepPath) {
+			for(uint32_t j = p.pathLo; j <= d; j++) {
+				_path[q.pathOff + 2*j]     = ppath[2*j];
+				_path[q.pathOff + 2*j + 1] = ppath[2*j + 1];
+			}
+		}
+		q.pathLo = p.pathLo;
+		q.top = ppath[2*d];
+		q.bot = ppath[2*d + 1];
+		q.depth = d;
+		assert(d == q.share || q.bot <= q.top);
+	}
+
+	/**
+	 * Having just updated q's range, record it if need be and decide
+	 * whether it needs more LF steps.  If so, compute the loci for the next step, which also
+	 * prefetches the relevant side(s), and return true.  If not,
+	 * leave the final range in place (NULL-ing out the query if the
+	 * range is empty) and return false.
+	 */
+	template<int L>
+	bool advanceLoci(Query& q) {
+		assert_leq(q.depth, q.stop);
+		for(int k = 0; k < 2; k++) {
+			if(q.depth == q.halfDepth[k]) {
+				q.halfTop[k] = q.top;
+				q.halfBot[k] = q.bot;
+				q.halfSet[k] = true;
+			}
+		}
+		if(q.keepPath) {
+			_path[q.pathOff + 2*q.depth]     = q.top;
+			_path[q.pathOff + 2*q.depth + 1] = q.bot;
+		}
+		if(q.bot <= q.top) {
+			q.qry = NULL; // no exact matches
+			return false;
+		}
+		if(q.depth == q.stop) {
+			return false; // matched as much of the query as was asked
+		}
+		const Ebwt& ebwt = *_ebwt;
+		SideLocus::initFromTopBot<L>(q.top, q.bot, ebwt._eh, ebwt._ebwt, q.ltop, q.lbot);
+#ifndef NO_PREFETCH
+		if(!lineSidesLayout<L>(ebwt._eh)) {
+			// The occ[] counts for a side live partly in the other
+			// side of its pair; get that one on its way too
+			const uint32_t sideSz = ebwt._eh._sideSz;
+			__builtin_prefetch((const void *)(ebwt._ebwt + (q.ltop._sideNum ^ 1) * sideSz),
+			                   0 /* prepare for read */,
+			                   PREFETCH_LOCALITY);
+			if(q.lbot._sideNum != q.ltop._sideNum) {
+				__builtin_prefetch((const void *)(ebwt._ebwt + (q.lbot._sideNum ^ 1) * sideSz),
+				                   0 /* prepare for read */,
+				                   PREFETCH_LOCALITY);
+			}
+		}
+#endif
+		return true;
+	}
+
+	const Ebwt*       _ebwt;
+	EList<TReadId>    _rdids;  // ids of reads in the batch
+	EList<Query>      _qs;     // 2 per read: fw then rc; or parts
+	EList<uint32_t>   _active; // indexes into _qs still in flight
+	EList<uint32_t>   _waiting; // indexes into _qs waiting on a parent
+	EList<uint32_t>   _order;  // live indexes into _qs, sorted by SuffixLess
+	EList<uint32_t>   _lcs;    // shared suffix lengths along _order
+	EList<TIndexOffU> _path;   // (top, bot) at each depth, for parents
+};
+
+#endif /* EBWT_SEARCH_BATCH_H_ */
@@ -0,0 +1,452 @@
+/*
+ * ebwt_search_pigeonhole.h
+ *
+ * Pigeonhole filtering for the -v 2 and -v 3 searches.  If a read is
+ * split into v+1 parts, any alignment with at most v mismatches
+ * matches at least one of the parts exactly.  So instead of
+ * backtracking through the index, PigeonholeSearch finds the exact
+ * matches of every part of both strands (interleaved, through
+ * ExactSearchBatch), resolves them to reference offsets, and checks
+ * each distinct candidate position against the bit-packed reference,
+ * comparing 32 characters per XOR.
+ *
+ * Backtracking cost grows steeply with read length and mismatch
+ * budget, while the filter's cost is mostly the candidates it has to
+ * resolve.  Reads whose parts have many exact matches (i.e., short
+ * reads and repeats) would make the filter the slower of the two, so
+ * align() refuses those and the caller backtracks as usual.
+ *
+ * Every alignment the backtracker can report is found, with the same
+ * stratum, cost and count of other instances (the "oms" of a range).
+ * Which of several alignments the backtracker reports first, though,
+ * depends on the pseudo-random choices it makes among partial ranges
+ * as it goes, and reproducing those would mean retracing its search.
+ * So align() only answers for reads with no alignment (where
+ * backtracking has to exhaust the search) or exactly one, whose output
+ * doesn't depend on those choices in any reporting mode, and leaves
+ * the rest to the backtracker too.
+ */
+
+#ifndef EBWT_SEARCH_PIGEONHOLE_H_
+#define EBWT_SEARCH_PIGEONHOLE_H_
+
+#include <algorithm>
+#include <stdint.h>
+
+#include "btypes.h"
+#include "ds.h"
+#include "ebwt.h"
+#include "ebwt_search_batch.h"
+#include "hit.h"
+#include "qual.h"
+#include "read.h"
+#include "reference.h"
+#include "sstring.h"
+
+/**
+ * Finds all the alignments with up to 2 or 3 mismatches of one read at
+ * a time, using pigeonhole filtering and verification against the
+ * reference.
+ */
+class PigeonholeSearch {
+
+	/// # candidates verify() checks per pass
+	static const size_t VERIFY_LANES = 4;
+
+	/// One part of one strand of the read
+	struct Part {
+		bool       fw;
+		uint32_t   off; // offset of the part's leftmost character
+		size_t     qi;  // index of the part's query in the batch
+	};
+
+	/// A row being resolved to a joined-text offset
+	struct Chase {
+		TIndexOffU row;
+		TIndexOffU jumps;
+		uint32_t   part;
+		SideLocus  l;
+	};
+
+	/// A candidate position that verified
+	struct Match {
+		TIndexOffU off;      // joined offset of the leftmost character
+		uint64_t   key;      // mismatches; equal keys, equal ref strings
+		uint16_t   cost;
+		bool       fw;
+		bool       straddles; // overlaps a boundary between fragments
+		uint32_t   nmm;
+		uint32_t   mms[3];   // mismatched offsets into the strand
+		uint8_t    refcs[3]; // reference characters there
+		TIndexOffU tidx;
+		TIndexOffU textoff;
+		TIndexOffU tlen;
+		uint32_t   oms;
+	};
+
+	/// Orders matches by strand, then by mismatches
+	struct KeyLess {
+		bool operator()(const Match& a, const Match& b) const {
+			if(a.fw != b.fw) return a.fw;
+			return a.key < b.key;
+		}
+	};
+
+public:
+
+	/**
+	 * 'mms' is the number of mismatches allowed (2 or 3) and fw/rc say
+	 * which strands to align; 'maqPenalty' says whether mismatch
+	 * qualities are rounded as in Maq when costing alignments, as the
+	 * backtracker being replaced does.  A read is refused if its parts
+	 * have more than 'maxCands' exact matches in all; by default that's
+	 * 64 for -v 2 and 256 for -v 3, where backtracking costs more.
+	 */
+	PigeonholeSearch(const Ebwt& ebwt,
+	                 const BitPairReference& refs,
+	                 int mms,
+	                 bool fw,
+	                 bool rc,
+	                 bool maqPenalty,
+	                 uint32_t maxCands = 0) :
+		_ebwt(ebwt),
+		_refs(refs),
+		_mms(mms),
+		_fw(fw),
+		_rc(rc),
+		_maqPenalty(maqPenalty),
+		_maxCands(maxCands != 0 ? maxCands : (mms < 3 ? 64 : 256))
+	{
+		assert_geq(mms, 1);
+		assert_leq(mms, 3);
+		assert_eq(ebwt._eh._len, refs.joinedLen());
+	}
+
+	/**
+	 * Return true iff pigeonhole filtering can stand in for
+	 * backtracking against this index: the reference sequence has to
+	 * be there and has to be the text the index was built from.
+	 */
+	static bool usable(const Ebwt& ebwt, const BitPairReference* refs) {
+		return refs != NULL && refs->loaded() &&
+		       refs->joinedLen() == ebwt._eh._len;
+	}
+
+	/**
+	 * Find the alignment of r, if it has one.  Returns false, having
+	 * found nothing, if that would mean checking too many candidates
+	 * or if r has more than one alignment; the caller should
+	 * backtrack instead.
+	 */
+	bool align(const Read& r) {
+		_matches.clear();
+		const uint32_t len = (uint32_t)r.length();
+		const uint32_t nparts = (uint32_t)_mms + 1;
+		if(len < 4 * nparts) return false;
+		_exb.reset(_ebwt);
+		_parts.clear();
+		for(int s = 0; s < 2; s++) {
+			if(!(s == 0 ? _fw : _rc)) continue;
+			const BTDnaString& qry = (s == 0 ? r.patFw : r.patRc);
+			for(uint32_t p = 0; p < nparts; p++) {
+				const uint32_t lo = (uint32_t)((uint64_t)len * p / nparts);
+				const uint32_t hi = (uint32_t)((uint64_t)len * (p+1) / nparts);
+				_parts.expand();
+				_parts.back().fw = (s == 0);
+				_parts.back().off = lo;
+				_parts.back().qi = _exb.addPart(qry, hi, hi - lo);
+			}
+		}
+		_exb.search();
+		TIndexOffU ncands = 0;
+		for(size_t i = 0; i < _parts.size(); i++) {
+			TIndexOffU top = 0, bot = 0;
+			_exb.range(_parts[i].qi, top, bot);
+			ncands += (bot - top);
+			if(ncands > _maxCands) return false;
+		}
+		_cands[0].clear();
+		_cands[1].clear();
+		if(ncands == 0) return true;
+#define RESOLVE(L) resolve<L>(len)
+		EBWT_LF_DISPATCH(_ebwt.lfVariant(), RESOLVE);
+#undef RESOLVE
+		for(int s = 0; s < 2; s++) {
+			EList<TIndexOffU>& cands = _cands[s];
+			if(cands.empty()) continue;
+			// A position with fewer than v mismatches matches more
+			// than one part exactly; check it once
+			std::sort(cands.ptr(), cands.ptr() + cands.size());
+			const TIndexOffU* end = std::unique(cands.ptr(), cands.ptr() + cands.size());
+			cands.resize(end - cands.ptr());
+			verify(r, s == 0, len);
+		}
+		finish(r, len);
+		if(_matches.size() > 1) {
+			_matches.clear();
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Report the alignment found by the last call to align(), if any,
+	 * telling the sink whenever a stratum is done with.  Returns true
+	 * iff the sink doesn't want any more alignments.
+	 */
+	bool report(Read& r, EbwtSearchParams& params) {
+		HitSinkPerThread& sink = params.sink();
+		const uint32_t len = (uint32_t)r.length();
+		uint32_t stratum = 0;
+		for(size_t i = 0; i < _matches.size(); i++) {
+			const Match& m = _matches[i];
+			while(stratum < m.nmm) {
+				if(sink.finishedWithStratum((int)stratum)) return true;
+				stratum++;
+			}
+			_mmsList.clear();
+			_refcsList.clear();
+			for(uint32_t j = 0; j < m.nmm; j++) {
+				_mmsList.push_back(m.mms[j]);
+				_refcsList.push_back("ACGT"[m.refcs[j]]);
+			}
+			params.setFw(m.fw);
+			if(params.reportHit(
+				m.fw ? r.patFw : r.patRc,   // read sequence
+				m.fw ? &r.qual : &r.qualRev, // read quality values
+				&r.name,                    // read name
+				true,                       // index is forward
+				_mmsList,                   // mismatch positions
+				_refcsList,                 // reference characters for mms
+				m.nmm,                      // # mismatches
+				make_pair(m.tidx, m.textoff), // position
+				make_pair<TIndexOffU,TIndexOffU>(0, 0), // (bogus) mate position
+				true,                       // (bogus) mate orientation
+				0,                          // (bogus) mate length
+				make_pair<TIndexOffU,TIndexOffU>(0, 0), // (bogus) arrows
+				m.tlen,                     // textlen
+				len,                        // qlen
+				(int)m.nmm,                 // alignment stratum
+				m.cost,                     // cost, including qual penalty
+				m.oms,                      // # other hits
+				(uint32_t)r.rdid,           // pattern id
+				r.seed,                     // pseudo-random seed
+				0))                         // mate (0 = unpaired)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+
+	/**
+	 * Resolve every row in every part's range to the joined offset of
+	 * the read position it implies, one LF step per row per round so
+	 * that the rows' cache misses overlap.
+	 */
+	template<int L>
+	void resolve(uint32_t len) {
+		const Ebwt& ebwt = _ebwt;
+		const EbwtParams& eh = ebwt._eh;
+		TIndexOffU idx = 0;
+		_chases.clear();
+		for(size_t i = 0; i < _parts.size(); i++) {
+			TIndexOffU top = 0, bot = 0;
+			_exb.range(_parts[i].qi, top, bot);
+			for(TIndexOffU row = top; row < bot; row++) {
+				if(row == ebwt._zOff) {
+					addCandidate((uint32_t)i, 0, len);
+				} else if(ebwt.sampledRow(row, idx)) {
+					addCandidate((uint32_t)i, ebwt.offAt(idx), len);
+				} else {
+					_chases.expand();
+					Chase& c = _chases.back();
+					c.row = row;
+					c.jumps = 0;
+					c.part = (uint32_t)i;
+					c.l.initFromRow<L>(row, eh, ebwt._ebwt);
+					ebwt.prefetchSampled(row);
+				}
+			}
+		}
+		size_t nact = _chases.size();
+		while(nact > 0) {
+			size_t n = 0;
+			for(size_t i = 0; i < nact; i++) {
+				Chase& c = _chases[i];
+				c.row = ebwt.mapLF<L>(c.l);
+				c.jumps++;
+				if(c.row == ebwt._zOff) {
+					addCandidate(c.part, c.jumps, len);
+				} else if(ebwt.sampledRow(c.row, idx)) {
+					addCandidate(c.part, ebwt.offAt(idx) + c.jumps, len);
+				} else {
+					c.l.initFromRow<L>(c.row, eh, ebwt._ebwt);
+					ebwt.prefetchSampled(c.row);
+					if(n != i) _chases[n] = c;
+					n++;
+				}
+			}
+			nact = n;
+		}
+	}
+
+	/**
+	 * Note that part i matches at joined offset 'off', unless that puts
+	 * the read off either end of the joined text.
+	 */
+	void addCandidate(uint32_t i, TIndexOffU off, uint32_t len) {
+		const Part& p = _parts[i];
+		if(off < p.off) return;
+		off -= p.off;
+		if(off + len > _refs.joinedLen()) return;
+		_cands[p.fw ? 0 : 1].push_back(off);
+	}
+
+	/**
+	 * Check each of the strand's candidates against the reference and
+	 * keep the ones with few enough mismatches.  Ns in the read always
+	 * mismatch.  Candidates are checked VERIFY_LANES at a time.
+	 */
+	void verify(const Read& r, bool fw, uint32_t len) {
+		const BTDnaString& qry = (fw ? r.patFw : r.patRc);
+		const uint32_t nw = (len + 31) >> 5;
+		_qw.resize(nw);
+		_nw.resize(nw);
+		_qw.fillZero();
+		_nw.fillZero();
+		for(uint32_t i = 0; i < len; i++) {
+			const int c = (int)qry[i];
+			const int sh = (int)(i & 31) << 1;
+			if(c == 4) {
+				_nw[i >> 5] |= (1llu << sh);
+			} else {
+				_qw[i >> 5] |= ((uint64_t)c << sh);
+			}
+		}
+		const uint64_t lastMask = ((len & 31) == 0) ?
+			0x5555555555555555llu : ((1llu << ((len & 31) << 1)) - 1) & 0x5555555555555555llu;
+		const EList<TIndexOffU>& cands = _cands[fw ? 0 : 1];
+		const uint32_t mms = (uint32_t)_mms;
+		for(size_t ci = 0; ci < cands.size(); ci += VERIFY_LANES) {
+			const size_t left = cands.size() - ci;
+			const size_t nl = (left < VERIFY_LANES ? left : VERIFY_LANES);
+			// Count the mismatches of several candidates per pass, a
+			// word of each at a time, so that their reference loads
+			// and population counts don't wait on one another.  Lanes
+			// drop out as they exceed the budget.
+			uint32_t nmm[VERIFY_LANES];
+			uint32_t live = (1u << nl) - 1;
+			for(size_t l = 0; l < VERIFY_LANES; l++) nmm[l] = 0;
+			for(uint32_t w = 0; w < nw && live != 0; w++) {
+				const uint64_t mask = (w == nw-1) ? lastMask : 0x5555555555555555llu;
+				for(size_t l = 0; l < VERIFY_LANES; l++) {
+					if((live & (1u << l)) == 0) continue;
+					const uint64_t x = _refs.getJoinedWord(cands[ci + l] + (w << 5)) ^ _qw[w];
+					// One bit per character that differs
+					const uint64_t d = (((x | (x >> 1)) & 0x5555555555555555llu) | _nw[w]) & mask;
+					nmm[l] += (uint32_t)__builtin_popcountll(d);
+					if(nmm[l] > mms) live &= ~(1u << l);
+				}
+			}
+			for(size_t l = 0; l < nl; l++) {
+				if((live & (1u << l)) != 0) {
+					addMatch(cands[ci + l], fw, nw, lastMask, len);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Record the match at joined offset 'off', which verify() found to
+	 * have few enough mismatches, noting where they are.
+	 */
+	void addMatch(TIndexOffU off, bool fw, uint32_t nw, uint64_t lastMask, uint32_t len) {
+		Match m;
+		uint32_t nmm = 0;
+		for(uint32_t w = 0; w < nw; w++) {
+			const uint64_t rw = _refs.getJoinedWord(off + (w << 5));
+			const uint64_t x = rw ^ _qw[w];
+			uint64_t d = ((x | (x >> 1)) & 0x5555555555555555llu) | _nw[w];
+			if(w == nw-1) d &= lastMask;
+			while(d != 0) {
+				const int b = __builtin_ctzll(d);
+				d &= (d - 1);
+				assert_lt(nmm, (uint32_t)_mms);
+				m.mms[nmm] = (w << 5) + (b >> 1);
+				m.refcs[nmm] = (uint8_t)((rw >> b) & 3);
+				nmm++;
+			}
+		}
+		m.off = off;
+		m.fw = fw;
+		m.nmm = nmm;
+		m.key = nmm;
+		for(uint32_t j = 0; j < nmm; j++) {
+			m.key = (m.key << 20) | (m.mms[j] << 2) | m.refcs[j];
+		}
+		_ebwt.joinedToTextOff(len, off, m.tidx, m.textoff, m.tlen);
+		m.straddles = (m.tidx == OFF_MASK);
+		_matches.push_back(m);
+	}
+
+	/**
+	 * Work out each match's count of other instances the way the
+	 * backtracker would get it from the size of its range: as the
+	 * number of other places, including ones that straddle fragments,
+	 * where the same reference string occurs.  Then drop the
+	 * straddlers and cost the rest.
+	 */
+	void finish(const Read& r, uint32_t len) {
+		if(_matches.empty()) return;
+		std::sort(_matches.ptr(), _matches.ptr() + _matches.size(), KeyLess());
+		for(size_t i = 0; i < _matches.size(); ) {
+			size_t j = i+1;
+			while(j < _matches.size() && _matches[j].fw == _matches[i].fw &&
+			      _matches[j].key == _matches[i].key)
+			{
+				j++;
+			}
+			for(size_t k = i; k < j; k++) {
+				_matches[k].oms = (uint32_t)(j - i - 1);
+			}
+			i = j;
+		}
+		size_t n = 0;
+		for(size_t i = 0; i < _matches.size(); i++) {
+			Match& m = _matches[i];
+			if(m.straddles) continue;
+			const BTString& qual = (m.fw ? r.qual : r.qualRev);
+			uint16_t ham = 0;
+			for(uint32_t j = 0; j < m.nmm; j++) {
+				assert_lt(m.mms[j], len);
+				ham += mmPenalty(_maqPenalty, phredCharToPhredQual(qual[m.mms[j]]));
+			}
+			m.cost = (uint16_t)((m.nmm << 14) | ham);
+			if(n != i) _matches[n] = m;
+			n++;
+		}
+		_matches.resize(n);
+	}
+
+	const Ebwt&             _ebwt;
+	const BitPairReference& _refs;
+	const int               _mms;
+	const bool              _fw;
+	const bool              _rc;
+	const bool              _maqPenalty;
+	const uint32_t          _maxCands;
+	ExactSearchBatch        _exb;
+	EList<Part>             _parts;
+	EList<Chase>            _chases;
+	EList<TIndexOffU>       _cands[2]; // candidate offsets, fw and rc
+	EList<uint64_t>         _qw;    // strand being verified, 2 bits/char
+	EList<uint64_t>         _nw;    // 1 bit per N in it
+	EList<Match>            _matches;
+	EList<TIndexOffU>       _mmsList;
+	EList<uint8_t>          _refcsList;
+};
+
+#endif /* EBWT_SEARCH_PIGEONHOLE_H_ */
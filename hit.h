@@ -164,7 +164,9 @@ public:
 		perThreadBufSize_(perThreadBufSize),
 		ptNumAligned_(NULL),
 		reorder_(reorder),
-		next_batch_to_flush_(0)
+		next_batch_to_flush_(0),
+		dedup_(false),
+		dedupQuals_(false)
 	{
 		size_t nelt = 5 * nthreads_;
 		ptNumAligned_ = new uint64_t[nelt];
@@ -372,6 +374,23 @@ public:
 		return dumpAlignFlag_ || dumpUnalignFlag_ || dumpMaxedFlag_;
 	}
 
+	/**
+	 * Have per-thread sinks created from now on align each distinct
+	 * unpaired read once and replay the result for its copies
+	 * (--dedup).  If keyQuals is true, reads are only copies of each
+	 * other if their qualities match too.
+	 */
+	void setDedup(bool dedup, bool keyQuals) {
+		dedup_ = dedup;
+		dedupQuals_ = keyQuals;
+	}
+
+	/// Return true iff per-thread sinks should replay copies of reads
+	bool dedup() const { return dedup_; }
+
+	/// Return true iff copies of reads must have the same qualities
+	bool dedupQuals() const { return dedupQuals_; }
+
 	/**
 	 * Dump an aligned read to all of the appropriate output streams.
 	 * Be careful to synchronize correctly - there may be multiple
@@ -388,7 +407,7 @@ public:
 					dumpAl_ = openOf(dumpAlBase_, 0, "");
 					assert(dumpAl_ != NULL);
 				}
-				*dumpAl_ << p.bufa().readOrigBuf;
+				p.bufa().writeOrig(*dumpAl_);
 			}
 		} else {
 			// Dump paired-end read to an aligned-read file (or pair of
@@ -401,8 +420,8 @@ public:
 					assert(dumpAl_1_ != NULL);
 					assert(dumpAl_2_ != NULL);
 				}
-				*dumpAl_1_ << p.bufa().readOrigBuf;
-				*dumpAl_2_ << p.bufb().readOrigBuf;
+				p.bufa().writeOrig(*dumpAl_1_);
+				p.bufb().writeOrig(*dumpAl_2_);
 			}
 		}
 	}
@@ -423,7 +442,7 @@ public:
 					dumpUnal_ = openOf(dumpUnalBase_, 0, "");
 					assert(dumpUnal_ != NULL);
 				}
-				*dumpUnal_ << p.bufa().readOrigBuf;
+				p.bufa().writeOrig(*dumpUnal_);
 			}
 		} else {
 			// Dump paired-end read to an unaligned-read file (or pair
@@ -438,8 +457,8 @@ public:
 					assert(dumpUnal_1_ != NULL);
 					assert(dumpUnal_2_ != NULL);
 				}
-				*dumpUnal_1_ << p.bufa().readOrigBuf;
-				*dumpUnal_2_ << p.bufb().readOrigBuf;
+				p.bufa().writeOrig(*dumpUnal_1_);
+				p.bufb().writeOrig(*dumpUnal_2_);
 			}
 		}
 	}
@@ -463,7 +482,7 @@ public:
 					dumpMax_ = openOf(dumpMaxBase_, 0, "");
 					assert(dumpMax_ != NULL);
 				}
-				*dumpMax_ << p.bufa().readOrigBuf.toZBuf();
+				p.bufa().writeOrig(*dumpMax_);
 			}
 		} else {
 			// Dump paired-end read to a maxed-out-read file (or pair
@@ -476,8 +495,8 @@ public:
 					assert(dumpMax_1_ != NULL);
 					assert(dumpMax_2_ != NULL);
 				}
-				*dumpMax_1_ << p.bufa().readOrigBuf;
-				*dumpMax_2_ << p.bufb().readOrigBuf;
+				p.bufa().writeOrig(*dumpMax_1_);
+				p.bufb().writeOrig(*dumpMax_2_);
 			}
 		}
 	}
@@ -699,6 +718,156 @@ protected:
 	volatile uint64_t *ptNumMaxed_;
 
 	bool quiet_;  /// true -> don't print alignment stats at the end
+
+	bool dedup_;      /// true -> replay alignments for copies of reads
+	bool dedupQuals_; /// true -> copies must have the same qualities
+};
+
+/**
+ * Remembers the outcome of aligning each distinct unpaired read a
+ * search thread has seen, so that later copies of the same read can
+ * reuse it instead of being aligned again (--dedup).  A read's key is
+ * its sequence, plus its qualities if keyQuals is set; the caller is
+ * responsible for making sure nothing else about a read (in
+ * particular its pseudo-random seed) influences how it aligns.
+ *
+ * Keys are looked up in an open-addressed hash table.  The cache is
+ * bounded both in reads and in stored hits; when either bound is
+ * reached it's simply emptied, which is enough to catch the heavily
+ * duplicated sequences this is aimed at.  Entries' storage is reused
+ * after that, so a thread stops allocating once the cache has filled
+ * up the first time.
+ */
+class ReadCopyCache {
+public:
+
+	/// Outcome of aligning a read: finishReadImpl()'s return value and
+	/// the hits that were buffered for reporting
+	struct Entry {
+		// Most reads have few hits; don't let the list start out with
+		// room for EList's default of 128
+		Entry() : hash(0), ret(0), hits((size_t)1) { }
+		uint64_t    hash;
+		std::string key;
+		uint32_t    ret;
+		EList<Hit>  hits;
+	};
+
+	explicit ReadCopyCache(
+		bool keyQuals,
+		size_t maxReads = 32 * 1024,
+		size_t maxHits = 128 * 1024) :
+		keyQuals_(keyQuals),
+		maxReads_(maxReads),
+		maxHits_(maxHits),
+		nents_(0),
+		nhits_(0),
+		hash_(0)
+	{
+		assert_gt(maxReads_, 0);
+		// Keep the table at most half full
+		size_t tsz = 1;
+		while(tsz < 2 * maxReads_) tsz <<= 1;
+		table_.resize(tsz);
+		table_.fillZero();
+		mask_ = tsz - 1;
+	}
+
+	/**
+	 * Return the entry for an earlier copy of r, or NULL if there is
+	 * none or r isn't eligible.
+	 */
+	const Entry* find(const Read& r) {
+		if(!eligible(r)) return NULL;
+		setKey(r);
+		size_t slot = lookup();
+		return table_[slot] == 0 ? NULL : &entries_[table_[slot] - 1];
+	}
+
+	/**
+	 * Remember the outcome of aligning r.
+	 */
+	void add(const Read& r, uint32_t ret, const EList<Hit>& hits) {
+		if(!eligible(r) || hits.size() > maxHits_) return;
+		if(nents_ >= maxReads_ || nhits_ + hits.size() > maxHits_) {
+			table_.fillZero();
+			nents_ = nhits_ = 0;
+		}
+		setKey(r);
+		size_t slot = lookup();
+		Entry* e = NULL;
+		if(table_[slot] == 0) {
+			if(nents_ == entries_.size()) entries_.expand();
+			table_[slot] = (uint32_t)(++nents_);
+			e = &entries_[nents_ - 1];
+		} else {
+			// An earlier copy is there already; replace it
+			e = &entries_[table_[slot] - 1];
+			nhits_ -= e->hits.size();
+		}
+		e->hash = hash_;
+		e->key = key_;
+		e->ret = ret;
+		e->hits = hits;
+		nhits_ += hits.size();
+	}
+
+private:
+
+	/**
+	 * Mates are aligned together and so aren't cached on their own.
+	 * Reads shorter than 4 characters are cheap, and some of the
+	 * search routines warn about each one, so they're left alone too.
+	 */
+	static bool eligible(const Read& r) {
+		return r.mate == 0 && r.length() >= 4;
+	}
+
+	/// Put r's bases (and qualities, if they're keyed on) in key_, and
+	/// its hash in hash_
+	void setKey(const Read& r) {
+		const size_t len = r.length();
+		key_.clear();
+		for(size_t i = 0; i < len; i++) {
+			key_.push_back((char)r.patFw[i]);
+		}
+		if(keyQuals_) {
+			for(size_t i = 0; i < len; i++) {
+				key_.push_back(r.qual[i]);
+			}
+		}
+		// FNV-1a
+		hash_ = 14695981039346656037llu;
+		for(size_t i = 0; i < key_.length(); i++) {
+			hash_ ^= (uint8_t)key_[i];
+			hash_ *= 1099511628211llu;
+		}
+	}
+
+	/**
+	 * Return the table slot that holds key_'s entry, or the empty slot
+	 * where it would go.
+	 */
+	size_t lookup() const {
+		size_t slot = (size_t)(hash_ ^ (hash_ >> 32)) & mask_;
+		while(table_[slot] != 0) {
+			const Entry& e = entries_[table_[slot] - 1];
+			if(e.hash == hash_ && e.key == key_) break;
+			slot = (slot + 1) & mask_;
+		}
+		return slot;
+	}
+
+	bool        keyQuals_; // qualities are part of the key
+	size_t      maxReads_; // empty the cache when it has this many reads
+	size_t      maxHits_;  // ... or this many hits
+	size_t      nents_;    // # entries in use
+	size_t      nhits_;    // # hits stored over all entries
+	size_t      mask_;     // table_.size() - 1
+	std::string key_;      // scratch key
+	uint64_t    hash_;     // hash of key_
+	EList<uint32_t> table_;   // 1 + index into entries_; 0 = empty
+	EList<Entry>    entries_; // entries; first nents_ are in use
 };
 
 /**
@@ -722,12 +891,17 @@ public:
 		_max(max),
 		_n(n),
 		defaultMapq_(defaultMapq),
-		threadId_(threadId)
+		threadId_(threadId),
+		copies_(sink.dedup() ? new ReadCopyCache(sink.dedupQuals()) : NULL),
+		replayed_(false),
+		replayedRet_(0)
 	{
 		assert_gt(_n, 0);
 	}
 
-	virtual ~HitSinkPerThread() { }
+	virtual ~HitSinkPerThread() {
+		delete copies_;
+	}
 
 	/// Return the vector of retained hits
 	EList<Hit>& retainedHits()   { return _hits; }
@@ -736,6 +910,12 @@ public:
 	virtual uint32_t finishRead(PatternSourcePerThread& p, bool report, bool dump) {
 		uint32_t ret = finishReadImpl();
 		_bestRemainingStratum = 0;
+		if(replayed_) {
+			ret = replayedRet_;
+			replayed_ = false;
+		} else if(copies_ != NULL && report && dump) {
+			copies_->add(p.bufa(), ret, _bufferedHits);
+		}
 		if(!report) {
 			_bufferedHits.clear();
 			return 0;
@@ -783,6 +963,33 @@ public:
 
 	virtual uint32_t finishReadImpl() = 0;
 
+	/**
+	 * If copies of reads are being replayed (--dedup) and this thread
+	 * has already aligned a copy of the current read, buffer that
+	 * copy's hits, altered to describe the current read, so that the
+	 * next call to finishRead() reports them as though the current
+	 * read had been aligned.  Returns true iff so, in which case the
+	 * caller should skip aligning the read.
+	 */
+	bool replayCopy(PatternSourcePerThread& p) {
+		if(copies_ == NULL) return false;
+		const Read& r = p.bufa();
+		const ReadCopyCache::Entry* e = copies_->find(r);
+		if(e == NULL) return false;
+		assert(_bufferedHits.empty());
+		for(size_t i = 0; i < e->hits.size(); i++) {
+			_bufferedHits.push_back(e->hits[i]);
+			Hit& h = _bufferedHits.back();
+			h.patId = (uint32_t)p.rdid();
+			h.patName = r.name;
+			h.quals = h.fw ? r.qual : r.qualRev;
+			h.seed = r.seed;
+		}
+		replayed_ = true;
+		replayedRet_ = e->ret;
+		return true;
+	}
+
 	/**
 	 * Add a hit to the internal buffer.  Not yet reporting the hits.
 	 */
@@ -906,6 +1113,9 @@ protected:
 	uint32_t _n;   /// report at most _n hits
 	int defaultMapq_;
 	size_t threadId_;
+	ReadCopyCache* copies_; /// alignments of earlier reads, for --dedup
+	bool replayed_;         /// buffered hits were replayed by replayCopy()
+	uint32_t replayedRet_;  /// finishReadImpl() result to go with them
 };
 
 /**
@@ -0,0 +1,176 @@
+/*
+ * hugepages.cpp
+ *
+ * Huge-page allocation helpers; see hugepages.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <sstream>
+#include "assert_helpers.h"
+#include "hugepages.h"
+
+#ifdef BOWTIE_MM
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+static const size_t HUGE_2M = (size_t)1 << 21;
+static const size_t HUGE_1G = (size_t)1 << 30;
+
+// Bookkeeping stored in the 64 bytes just before the pointer handed
+// out by hugeAlloc(); keeps the returned pointer 64-byte aligned
+struct HugeHeader {
+	uint8_t *base;   // start of the underlying block
+	size_t   mapLen; // length of the mapping, or 0 if base came from new[]
+};
+
+static const size_t HUGE_HDR = 64;
+
+static inline size_t roundUp(size_t x, size_t to) {
+	return (x + to - 1) & ~(to - 1);
+}
+
+static uint8_t* finishAlloc(uint8_t *base, uint8_t *start, size_t mapLen) {
+	HugeHeader *h = reinterpret_cast<HugeHeader*>(start);
+	h->base = base;
+	h->mapLen = mapLen;
+	return start + HUGE_HDR;
+}
+
+#ifdef BOWTIE_MM
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/**
+ * Try an explicit huge-page mapping of the given page size.  Return
+ * NULL if none are available (none reserved, not Linux, etc.).
+ */
+static uint8_t* tryHugetlb(size_t len, size_t pageSz, int log2PageSz) {
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+	size_t mapLen = roundUp(len + HUGE_HDR, pageSz);
+	void *p = mmap(NULL, mapLen, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+	               (log2PageSz << MAP_HUGE_SHIFT), -1, 0);
+	if(p == MAP_FAILED) return NULL;
+	return finishAlloc((uint8_t*)p, (uint8_t*)p, mapLen);
+#else
+	return NULL;
+#endif
+}
+
+/**
+ * Map anonymous memory aligned to a 2 MB boundary so that the kernel
+ * can use transparent huge pages for it, and ask it to.
+ */
+static uint8_t* tryThp(size_t len) {
+	size_t mapLen = roundUp(len + HUGE_HDR, HUGE_2M);
+	size_t slop = HUGE_2M;
+	void *p = mmap(NULL, mapLen + slop, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED) return NULL;
+	uint8_t *raw = (uint8_t*)p;
+	uint8_t *aligned = (uint8_t*)roundUp((uintptr_t)raw, HUGE_2M);
+	// Trim the unaligned head and the unused tail
+	if(aligned > raw) munmap(raw, aligned - raw);
+	size_t tail = (raw + mapLen + slop) - (aligned + mapLen);
+	if(tail > 0) munmap(aligned + mapLen, tail);
+	hugeAdvise(aligned, mapLen);
+	return finishAlloc(aligned, aligned, mapLen);
+}
+
+#endif /* BOWTIE_MM */
+
+uint8_t* hugeAlloc(size_t len, bool huge) {
+#ifdef BOWTIE_MM
+	if(huge) {
+		uint8_t *ret = NULL;
+		// Only go for 1 GB pages if rounding up wastes < 1/8 of them
+		size_t len1g = roundUp(len + HUGE_HDR, HUGE_1G);
+		if(len1g - len < len1g / 8) {
+			ret = tryHugetlb(len, HUGE_1G, 30);
+		}
+		if(ret == NULL) ret = tryHugetlb(len, HUGE_2M, 21);
+		if(ret == NULL) ret = tryThp(len);
+		if(ret != NULL) return ret;
+	}
+#else
+	(void)huge;
+#endif
+	uint8_t *base = new uint8_t[len + HUGE_HDR + 63];
+	uint8_t *start = (uint8_t*)roundUp((uintptr_t)base, 64);
+	return finishAlloc(base, start, 0);
+}
+
+void hugeFree(void *p) {
+	if(p == NULL) return;
+	HugeHeader *h = reinterpret_cast<HugeHeader*>((uint8_t*)p - HUGE_HDR);
+#ifdef BOWTIE_MM
+	if(h->mapLen > 0) {
+		munmap(h->base, h->mapLen);
+		return;
+	}
+#endif
+	delete[] h->base;
+}
+
+bool hugeAdvise(void *p, size_t len) {
+#if defined(BOWTIE_MM) && defined(MADV_HUGEPAGE)
+	// madvise() wants a page-aligned start
+	uintptr_t start = (uintptr_t)p & ~(uintptr_t)4095;
+	return madvise((void*)start, len + ((uintptr_t)p - start), MADV_HUGEPAGE) == 0;
+#else
+	(void)p; (void)len;
+	return false;
+#endif
+}
+
+/**
+ * Parse "Name:   1234 kB" from an smaps line, returning -1 if the line
+ * isn't for the named field.
+ */
+static long smapsField(const char *line, const char *name) {
+	size_t nlen = strlen(name);
+	if(strncmp(line, name, nlen) != 0 || line[nlen] != ':') return -1;
+	return atol(line + nlen + 1);
+}
+
+string pageBacking(const void *p) {
+	FILE *f = fopen("/proc/self/smaps", "r");
+	if(f == NULL) return "unknown pages";
+	char line[512];
+	bool inVma = false;
+	long kps = -1, rss = 0, thp = 0;
+	while(fgets(line, sizeof(line), f) != NULL) {
+		unsigned long lo, hi;
+		if(sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+			// Header line for a new VMA
+			if(inVma) break; // past the VMA we wanted
+			inVma = ((uintptr_t)p >= lo && (uintptr_t)p < hi);
+			continue;
+		}
+		if(!inVma) continue;
+		long v;
+		if((v = smapsField(line, "KernelPageSize")) >= 0) kps = v;
+		else if((v = smapsField(line, "Rss")) >= 0) rss = v;
+		else if((v = smapsField(line, "AnonHugePages")) > 0) thp += v;
+		else if((v = smapsField(line, "ShmemPmdMapped")) > 0) thp += v;
+		else if((v = smapsField(line, "FilePmdMapped")) > 0) thp += v;
+	}
+	fclose(f);
+	if(kps < 0) return "unknown pages";
+	ostringstream os;
+	if(kps > 4) {
+		os << kps << " kB hugetlb pages";
+	} else if(thp > 0) {
+		os << "transparent huge pages (" << thp << " of " << rss << " kB resident)";
+	} else {
+		os << kps << " kB pages";
+	}
+	return os.str();
+}
@@ -0,0 +1,45 @@
+/*
+ * hugepages.h
+ *
+ * Helpers for backing the big, randomly-accessed index arrays (ebwt[],
+ * offs[], ftab[] and the bit-pair reference) with huge pages.  With
+ * 4 kB pages, a multi-gigabyte index needs far more TLB entries than
+ * the hardware has, so most LF steps pay for a page walk on top of the
+ * cache miss.  Everything here degrades gracefully: if huge pages
+ * can't be had, regular pages are used instead.
+ */
+
+#ifndef HUGEPAGES_H_
+#define HUGEPAGES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * Allocate 'len' bytes for a big index array.  If 'huge' is set, try
+ * explicit (hugetlbfs) 1 GB and 2 MB pages, then transparent huge
+ * pages, then regular pages.  The result is 64-byte aligned and must
+ * be released with hugeFree().  Throws bad_alloc on failure.
+ */
+extern uint8_t* hugeAlloc(size_t len, bool huge);
+
+/**
+ * Free memory obtained from hugeAlloc().
+ */
+extern void hugeFree(void *p);
+
+/**
+ * Ask the kernel to back an existing mapping (e.g. a memory-mapped
+ * index file) with transparent huge pages.  Return true iff the
+ * request was accepted; whether it's honored depends on the kernel.
+ */
+extern bool hugeAdvise(void *p, size_t len);
+
+/**
+ * Return a short description of the pages backing the mapping that
+ * contains 'p', e.g. "2048 kB hugetlb pages", for verbose output.
+ */
+extern std::string pageBacking(const void *p);
+
+#endif /* HUGEPAGES_H_ */
@@ -0,0 +1,447 @@
+/*
+ * inflate_stream.cpp
+ *
+ * Threaded decompression of gzipped read files; see inflate_stream.h.
+ */
+
+#include <errno.h>
+#include <iostream>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#include "assert_helpers.h"
+#include "inflate_stream.h"
+
+using namespace std;
+
+static inline uint32_t le16(const unsigned char *b) {
+	return (uint32_t)b[0] | ((uint32_t)b[1] << 8);
+}
+
+static inline uint32_t le32(const unsigned char *b) {
+	return le16(b) | (le16(b + 2) << 16);
+}
+
+InflateStream::InflateStream(int fd, int nhelpers) :
+	fd_(fd),
+	stop_(false),
+	ring_(NULL),
+	nring_(0),
+	nextIn_(0),
+	nextJob_(0),
+	nextOut_(0),
+	holding_(false),
+	inPos_(0),
+	inEnd_(0),
+	inEof_(false),
+	reader_(NULL)
+{
+	assert_geq(nhelpers, 0);
+	// Enough slots that every helper can work on one chunk while the
+	// caller drains another and the reader fills a third
+	nring_ = 2 * (size_t)nhelpers + 3;
+	ring_ = new Chunk[nring_];
+	for(size_t i = 0; i < nring_; i++) {
+		ring_[i].state = CHUNK_FREE;
+		ring_[i].outLen = 0;
+	}
+	inBuf_.resizeNoCopy(IN_SZ);
+#if (__cplusplus >= 201103L)
+	reader_ = new std::thread(readerWorker, (void*)this);
+	for(int i = 0; i < nhelpers; i++) {
+		helpers_.push_back(new std::thread(helperWorker, (void*)this));
+	}
+#else
+	reader_ = new tthread::thread(readerWorker, (void*)this);
+	for(int i = 0; i < nhelpers; i++) {
+		helpers_.push_back(new tthread::thread(helperWorker, (void*)this));
+	}
+#endif
+}
+
+InflateStream::~InflateStream() {
+	{
+		COND_LOCK_T<COND_MUTEX_T> l(mutex_);
+		stop_ = true;
+		cond_.notify_all();
+	}
+	reader_->join();
+	delete reader_;
+	for(size_t i = 0; i < helpers_.size(); i++) {
+		helpers_[i]->join();
+		delete helpers_[i];
+	}
+	delete[] ring_;
+	close(fd_);
+}
+
+/**
+ * Point 'buf' at the next piece of decompressed input, which stays
+ * valid until the next call.  Returns its length, 0 at the end of the
+ * input, or -1 if the input couldn't be decompressed.
+ */
+int64_t InflateStream::next(const char*& buf) {
+	COND_LOCK_T<COND_MUTEX_T> l(mutex_);
+	while(true) {
+		if(holding_) {
+			// Done with the last chunk; give its slot back
+			ring_[nextOut_ % nring_].state = CHUNK_FREE;
+			nextOut_++;
+			holding_ = false;
+			cond_.notify_all();
+		}
+		Chunk& c = ring_[nextOut_ % nring_];
+		while(nextOut_ == nextIn_ || (c.state != CHUNK_READY &&
+		      c.state != CHUNK_END && c.state != CHUNK_ERROR))
+		{
+			cond_.wait(mutex_);
+		}
+		if(c.state == CHUNK_END) {
+			return 0;
+		} else if(c.state == CHUNK_ERROR) {
+			if(!err_.empty()) {
+				cerr << "Warning: " << err_
+				     << "; ignoring the rest of the read file" << endl;
+				err_.clear();
+			}
+			return -1;
+		}
+		holding_ = true;
+		if(c.outLen > 0) {
+			buf = c.out.ptr();
+			return (int64_t)c.outLen;
+		}
+	}
+}
+
+void InflateStream::readerWorker(void *vp) {
+	((InflateStream*)vp)->readLoop();
+}
+
+void InflateStream::helperWorker(void *vp) {
+	((InflateStream*)vp)->helpLoop();
+}
+
+/**
+ * Walk the input a gzip member at a time, queueing runs of BGZF blocks
+ * for the helpers and inflating everything else here.
+ */
+void InflateStream::readLoop() {
+	z_stream zs, bz;
+	memset(&zs, 0, sizeof(zs));
+	memset(&bz, 0, sizeof(bz));
+	if(inflateInit2(&zs, 15 + 16) != Z_OK || inflateInit2(&bz, -15) != Z_OK) {
+		fail("could not initialize zlib");
+		return;
+	}
+	bool ok = true, first = true;
+	while(ok) {
+		fillIn(18);
+		size_t avail = inEnd_ - inPos_;
+		const unsigned char *b = (const unsigned char*)inBuf_.ptr() + inPos_;
+		if(avail < 2 || b[0] != 0x1f || b[1] != 0x8b) {
+			// Like gzread, pass input that isn't gzipped through
+			// untouched and ignore non-gzip data after the last member
+			if(first && avail > 0) {
+				ok = passThrough();
+			}
+			break;
+		}
+		first = false;
+		size_t bsz = bgzfBlockSize();
+		if(bsz == 0) {
+			// An ordinary gzip member; its end can only be found by
+			// inflating it
+			ok = inflateMember(zs);
+			continue;
+		}
+		// Gather a run of BGZF blocks into one chunk
+		Chunk *c = claim();
+		if(c == NULL) {
+			ok = false;
+			break;
+		}
+		c->in.clear();
+		c->blocks.clear();
+		c->outLen = 0;
+		while(bsz > 0 && c->outLen < CHUNK_SZ) {
+			if(!fillIn(bsz)) {
+				fail("read file ends in the middle of a BGZF block");
+				ok = false;
+				break;
+			}
+			b = (const unsigned char*)inBuf_.ptr() + inPos_;
+			uint32_t isize = le32(b + bsz - 4);
+			if(isize > 65536) {
+				fail("BGZF block is too large");
+				ok = false;
+				break;
+			}
+			c->blocks.push_back(c->in.size());
+			size_t off = c->in.size();
+			c->in.resize(off + bsz);
+			memcpy(c->in.ptr() + off, b, bsz);
+			c->outLen += isize;
+			inPos_ += bsz;
+			fillIn(18);
+			bsz = bgzfBlockSize();
+		}
+		if(!ok) break;
+		if(helpers_.empty()) {
+			if(!inflateBlocks(*c, bz)) {
+				fail("could not decompress BGZF block");
+				ok = false;
+				break;
+			}
+			publish(c, CHUNK_READY);
+		} else {
+			publish(c, CHUNK_PENDING);
+		}
+	}
+	inflateEnd(&zs);
+	inflateEnd(&bz);
+	if(ok) {
+		Chunk *c = claim();
+		if(c != NULL) publish(c, CHUNK_END);
+	}
+}
+
+/**
+ * Inflate queued runs of BGZF blocks until the stream is closed.
+ */
+void InflateStream::helpLoop() {
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	bool init = inflateInit2(&zs, -15) == Z_OK;
+	while(true) {
+		Chunk *c = NULL;
+		{
+			COND_LOCK_T<COND_MUTEX_T> l(mutex_);
+			while(!stop_ && nextJob_ == nextIn_) {
+				cond_.wait(mutex_);
+			}
+			if(stop_) break;
+			if(nextJob_ < nextOut_) {
+				nextJob_ = nextOut_;
+				continue;
+			}
+			c = &ring_[nextJob_++ % nring_];
+			if(c->state != CHUNK_PENDING) continue;
+			c->state = CHUNK_BUSY;
+		}
+		bool ok = init && inflateBlocks(*c, zs);
+		COND_LOCK_T<COND_MUTEX_T> l(mutex_);
+		if(ok) {
+			c->state = CHUNK_READY;
+		} else {
+			c->state = CHUNK_ERROR;
+			err_ = "could not decompress BGZF block";
+		}
+		cond_.notify_all();
+	}
+	if(init) inflateEnd(&zs);
+}
+
+/**
+ * Return true once the caller has closed the stream.
+ */
+bool InflateStream::stopped() {
+	COND_LOCK_T<COND_MUTEX_T> l(mutex_);
+	return stop_;
+}
+
+/**
+ * Read from fd_ until at least 'need' unconsumed bytes are buffered
+ * or the input runs out.  Returns true iff there are 'need' bytes.
+ */
+bool InflateStream::fillIn(size_t need) {
+	assert_leq(need, IN_SZ);
+	if(inEnd_ - inPos_ >= need) return true;
+	if(inPos_ + need > IN_SZ) {
+		// Slide the unconsumed tail to the front
+		memmove(inBuf_.ptr(), inBuf_.ptr() + inPos_, inEnd_ - inPos_);
+		inEnd_ -= inPos_;
+		inPos_ = 0;
+	}
+	while(inEnd_ - inPos_ < need && !inEof_) {
+#ifndef _WIN32
+		// Don't block for good on a pipe, so that closing the stream
+		// early can't hang
+		struct pollfd pfd;
+		pfd.fd = fd_;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if(poll(&pfd, 1, 100) == 0) {
+			if(stopped()) return false;
+			continue;
+		}
+#endif
+		ssize_t n = read(fd_, inBuf_.ptr() + inEnd_, IN_SZ - inEnd_);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) {
+			inEof_ = true;
+			break;
+		}
+		inEnd_ += (size_t)n;
+	}
+	return inEnd_ - inPos_ >= need;
+}
+
+/**
+ * If the buffered input starts with a BGZF block, return its total
+ * size, otherwise 0.
+ */
+size_t InflateStream::bgzfBlockSize() {
+	if(inEnd_ - inPos_ < 12) return 0;
+	const unsigned char *b = (const unsigned char*)inBuf_.ptr() + inPos_;
+	// BGZF members have the FEXTRA flag and nothing else
+	if(b[0] != 0x1f || b[1] != 0x8b || b[2] != 8 || b[3] != 4) return 0;
+	size_t xlen = le16(b + 10);
+	if(!fillIn(12 + xlen)) return 0;
+	b = (const unsigned char*)inBuf_.ptr() + inPos_;
+	for(size_t p = 12; p + 4 <= 12 + xlen; ) {
+		size_t slen = le16(b + p + 2);
+		if(b[p] == 'B' && b[p+1] == 'C' && slen == 2 && p + 6 <= 12 + xlen) {
+			size_t bsz = le16(b + p + 4) + 1;
+			return (bsz >= 12 + xlen + 8) ? bsz : 0;
+		}
+		p += 4 + slen;
+	}
+	return 0;
+}
+
+/**
+ * Inflate one ordinary gzip member into as many chunks as it takes.
+ */
+bool InflateStream::inflateMember(z_stream& zs) {
+	inflateReset(&zs);
+	Chunk *c = claim();
+	if(c == NULL) return false;
+	c->out.resizeNoCopy(CHUNK_SZ);
+	c->outLen = 0;
+	while(true) {
+		if(inPos_ == inEnd_ && !fillIn(1)) {
+			if(c->outLen > 0) publish(c, CHUNK_READY);
+			if(!stopped()) fail("read file ends in the middle of a gzip member");
+			return false;
+		}
+		zs.next_in = (Bytef*)inBuf_.ptr() + inPos_;
+		zs.avail_in = (uInt)(inEnd_ - inPos_);
+		zs.next_out = (Bytef*)c->out.ptr() + c->outLen;
+		zs.avail_out = (uInt)(CHUNK_SZ - c->outLen);
+		int ret = inflate(&zs, Z_NO_FLUSH);
+		inPos_ = inEnd_ - zs.avail_in;
+		c->outLen = CHUNK_SZ - zs.avail_out;
+		if(ret == Z_STREAM_END) {
+			publish(c, CHUNK_READY);
+			return true;
+		} else if(ret != Z_OK && ret != Z_BUF_ERROR) {
+			if(c->outLen > 0) publish(c, CHUNK_READY);
+			fail(string("could not decompress read file: ") +
+			     (zs.msg != NULL ? zs.msg : "corrupt gzip data"));
+			return false;
+		}
+		if(c->outLen == CHUNK_SZ) {
+			publish(c, CHUNK_READY);
+			if((c = claim()) == NULL) return false;
+			c->out.resizeNoCopy(CHUNK_SZ);
+			c->outLen = 0;
+		}
+	}
+}
+
+/**
+ * Hand the rest of the input over as is.
+ */
+bool InflateStream::passThrough() {
+	while(true) {
+		Chunk *c = claim();
+		if(c == NULL) return false;
+		c->out.resizeNoCopy(CHUNK_SZ);
+		c->outLen = 0;
+		while(c->outLen < CHUNK_SZ) {
+			if(inPos_ == inEnd_ && !fillIn(1)) break;
+			size_t len = min<size_t>(inEnd_ - inPos_, CHUNK_SZ - c->outLen);
+			memcpy(c->out.ptr() + c->outLen, inBuf_.ptr() + inPos_, len);
+			inPos_ += len;
+			c->outLen += len;
+		}
+		bool more = c->outLen == CHUNK_SZ;
+		publish(c, CHUNK_READY);
+		if(!more) return !stopped();
+	}
+}
+
+/**
+ * Wait for the slot after the last one published to be free, and
+ * return it.  Returns NULL if the stream was closed meanwhile.
+ */
+InflateStream::Chunk* InflateStream::claim() {
+	COND_LOCK_T<COND_MUTEX_T> l(mutex_);
+	while(!stop_ && nextIn_ - nextOut_ >= nring_) {
+		cond_.wait(mutex_);
+	}
+	if(stop_) return NULL;
+	return &ring_[nextIn_ % nring_];
+}
+
+/**
+ * Hand the claimed slot 'c' on in the given state.
+ */
+void InflateStream::publish(Chunk *c, int state) {
+	COND_LOCK_T<COND_MUTEX_T> l(mutex_);
+	assert(c == &ring_[nextIn_ % nring_]);
+	c->state = state;
+	nextIn_++;
+	cond_.notify_all();
+}
+
+/**
+ * Inflate every BGZF block of 'c' into c.out, checking sizes and
+ * CRCs.  c.outLen already holds the total decompressed size.
+ */
+bool InflateStream::inflateBlocks(Chunk& c, z_stream& zs) {
+	c.out.resizeNoCopy(c.outLen);
+	size_t off = 0;
+	for(size_t i = 0; i < c.blocks.size(); i++) {
+		size_t start = c.blocks[i];
+		size_t end = (i + 1 < c.blocks.size()) ? c.blocks[i+1] : c.in.size();
+		const unsigned char *b = (const unsigned char*)c.in.ptr() + start;
+		size_t bsz = end - start;
+		size_t hdr = 12 + le16(b + 10);
+		uint32_t crc = le32(b + bsz - 8);
+		uint32_t isize = le32(b + bsz - 4);
+		if(off + isize > c.outLen) return false;
+		unsigned char empty;
+		Bytef *out = (isize > 0) ? (Bytef*)c.out.ptr() + off : &empty;
+		inflateReset(&zs);
+		zs.next_in = (Bytef*)b + hdr;
+		zs.avail_in = (uInt)(bsz - hdr - 8);
+		zs.next_out = out;
+		zs.avail_out = isize;
+		if(inflate(&zs, Z_FINISH) != Z_STREAM_END || zs.avail_out != 0) {
+			return false;
+		}
+		if(crc32(crc32(0L, Z_NULL, 0), out, isize) != crc) {
+			return false;
+		}
+		off += isize;
+	}
+	return off == c.outLen;
+}
+
+/**
+ * Queue an error for the caller; the reader thread stops after this.
+ */
+void InflateStream::fail(const string& msg) {
+	Chunk *c = claim();
+	if(c == NULL) return;
+	{
+		COND_LOCK_T<COND_MUTEX_T> l(mutex_);
+		err_ = msg;
+	}
+	publish(c, CHUNK_ERROR);
+}
@@ -0,0 +1,119 @@
+/*
+ * inflate_stream.h
+ *
+ * Decompression of gzipped read files off the input lock.  A reader
+ * thread pulls compressed data from the file and walks it one gzip
+ * member at a time.  Members that are BGZF blocks (as written by
+ * bgzip and samtools) are independent and carry their own sizes, so
+ * runs of them are handed to helper threads and inflated in parallel;
+ * any other member, and input that isn't gzipped at all, is handled
+ * by the reader thread itself.  Either way the decompressed data comes
+ * back to the caller in file order.
+ */
+
+#ifndef INFLATE_STREAM_H_
+#define INFLATE_STREAM_H_
+
+#include <stdint.h>
+#include <string>
+#include <zlib.h>
+
+#include "ds.h"
+#include "threading.h"
+
+#if (__cplusplus >= 201103L)
+#include <thread>
+#else
+#include "tinythread.h"
+#endif
+
+class InflateStream {
+
+public:
+
+	/**
+	 * Start decompressing the file open on descriptor 'fd', which the
+	 * stream takes ownership of.  BGZF blocks are inflated by
+	 * 'nhelpers' helper threads, or by the reader thread if that's 0.
+	 */
+	InflateStream(int fd, int nhelpers);
+
+	~InflateStream();
+
+	/**
+	 * Point 'buf' at the next piece of decompressed input, which stays
+	 * valid until the next call.  Returns its length, 0 at the end of
+	 * the input, or -1 if the input couldn't be decompressed.
+	 */
+	int64_t next(const char*& buf);
+
+protected:
+
+	enum {
+		CHUNK_FREE = 0,  // slot is free for the reader
+		CHUNK_PENDING,   // holds BGZF blocks waiting for a helper
+		CHUNK_BUSY,      // a helper is inflating it
+		CHUNK_READY,     // holds decompressed data
+		CHUNK_END,       // marks the end of the input
+		CHUNK_ERROR      // marks a decompression error
+	};
+
+	/**
+	 * One slot of the ring of chunks passed from the reader thread to
+	 * the caller.  'in' and 'blocks' are only used for BGZF chunks.
+	 */
+	struct Chunk {
+		int state;
+		EList<char> in;      /// compressed BGZF blocks, back to back
+		EList<size_t> blocks; /// offset of each block in 'in'
+		EList<char> out;     /// decompressed data
+		size_t outLen;       /// number of valid bytes in 'out'
+	};
+
+	static const size_t CHUNK_SZ = 1024 * 1024; /// target decompressed size of a chunk
+	static const size_t IN_SZ = 1024 * 1024;    /// size of the reader's input buffer
+
+	static void readerWorker(void *vp);
+	static void helperWorker(void *vp);
+
+	void readLoop();
+	void helpLoop();
+
+	bool stopped();
+	bool fillIn(size_t need);
+	size_t bgzfBlockSize();
+	bool inflateMember(z_stream& zs);
+	bool passThrough();
+	Chunk* claim();
+	void publish(Chunk *c, int state);
+	bool inflateBlocks(Chunk& c, z_stream& zs);
+	void fail(const std::string& msg);
+
+	int fd_;                /// compressed input
+	bool stop_;             /// set when the caller is done with the stream
+	Chunk *ring_;           /// chunks in flight
+	size_t nring_;          /// number of slots in ring_
+	uint64_t nextIn_;       /// sequence number of the next chunk the reader fills
+	uint64_t nextJob_;      /// sequence number of the next chunk a helper looks at
+	uint64_t nextOut_;      /// sequence number of the next chunk handed out
+	bool holding_;          /// caller is still reading chunk nextOut_
+	std::string err_;       /// description of a decompression error
+	COND_MUTEX_T mutex_;
+	COND_VAR_T cond_;
+
+	// Reader thread's input buffer
+	EList<char> inBuf_;
+	size_t inPos_;          /// first unconsumed byte of inBuf_
+	size_t inEnd_;          /// number of valid bytes in inBuf_
+	bool inEof_;            /// nothing more to read from fd_
+
+#if (__cplusplus >= 201103L)
+	std::thread *reader_;
+	EList<std::thread*> helpers_;
+#else
+	tthread::thread *reader_;
+	EList<tthread::thread*> helpers_;
+#endif
+};
+
+#endif /* INFLATE_STREAM_H_ */
@@ -0,0 +1,177 @@
+/*
+ * input_block.h
+ *
+ * Reference-counted blocks of read input, and the slices of them that
+ * light-parsed reads keep instead of copies of their records.
+ */
+
+#ifndef INPUT_BLOCK_H_
+#define INPUT_BLOCK_H_
+
+#include <atomic>
+#include <stddef.h>
+#ifdef BOWTIE_MM
+#include <sys/mman.h>
+#endif
+
+class InputMap;
+
+/**
+ * A block of input read by a CFilePatternSource.  The light parser
+ * holds a reference to the block its cursor is in, and every Read
+ * whose raw record lies in the block holds one more.
+ *
+ * A block the source reads into itself also has a reference from the
+ * source's block pool.  A block whose only reference is the pool's can
+ * be refilled; once the pool lets go of it too, the last reader to
+ * release it frees it.  A block that is a window of a mapped file
+ * (--mm-reads) tells the mapping when its last reference goes.
+ */
+struct InputBlock {
+
+	InputBlock(size_t sz) :
+		data(new char[sz]), buf(data), len(0), refs(1), map(NULL) { }
+
+	InputBlock(InputMap *map_, const char *buf_, size_t len_) :
+		data(NULL), buf(buf_), len(len_), refs(1), map(map_) { }
+
+	~InputBlock() { delete[] data; }
+
+	void ref() { refs.fetch_add(1, std::memory_order_relaxed); }
+
+	inline void release();
+
+	/**
+	 * Return true iff nothing but the pool refers to the block.
+	 */
+	bool idle() const {
+		return refs.load(std::memory_order_acquire) == 1;
+	}
+
+	char            *data; /// buffer we own and read into, if any
+	const char      *buf;  /// the input
+	size_t           len;  /// number of valid bytes in buf
+	std::atomic<int> refs;
+	InputMap        *map;  /// mapping buf is a window of, if any
+};
+
+/**
+ * A read file mapped into memory for --mm-reads, handed to the light
+ * parser a window at a time.  Reads slice their records straight out
+ * of the windows.  A window's pages go back to the kernel once the
+ * parser has moved past it and no read refers to it any more, and the
+ * file is unmapped once that's true of every window and the source has
+ * closed it, so the mapping outlives every batch that points into it.
+ *
+ * A record that runs from one window into the next stays a slice of
+ * the first.  If the second is released first, reading its pages again
+ * just faults them back in from the file.
+ */
+class InputMap {
+
+public:
+
+	InputMap(const char *base, size_t len, size_t winSz) :
+		base_(base), len_(len), off_(0), winSz_(winSz), live_(1) { }
+
+	/**
+	 * Return the next window, with a reference for the caller, or NULL
+	 * if the whole file has been handed out.
+	 */
+	InputBlock* next() {
+		if(off_ >= len_) {
+			return NULL;
+		}
+		size_t n = len_ - off_;
+		if(n > winSz_) n = winSz_;
+		live_.fetch_add(1, std::memory_order_relaxed);
+		InputBlock *w = new InputBlock(this, base_ + off_, n);
+		off_ += n;
+		return w;
+	}
+
+	/**
+	 * The last reference to window 'w' is gone.
+	 */
+	void windowDone(InputBlock *w) {
+#ifdef BOWTIE_MM
+		madvise((void *)w->buf, w->len, MADV_DONTNEED);
+#endif
+		delete w;
+		unref();
+	}
+
+	/**
+	 * The source is done with the file.
+	 */
+	void close() { unref(); }
+
+private:
+
+	void unref() {
+		if(live_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+#ifdef BOWTIE_MM
+			munmap((void *)base_, len_);
+#endif
+			delete this;
+		}
+	}
+
+	const char *base_;
+	size_t len_;
+	size_t off_;             /// offset of the next window
+	size_t winSz_;
+	std::atomic<size_t> live_; /// windows not yet done, plus 1 until close()
+};
+
+void InputBlock::release() {
+	if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		if(map != NULL) {
+			map->windowDone(this);
+		} else {
+			delete this;
+		}
+	}
+}
+
+/**
+ * A Read's raw record, as a stretch of an InputBlock.  Holds a
+ * reference to the block for as long as the slice is set.
+ */
+struct InputSlice {
+
+	InputSlice() : blk(NULL), buf(NULL), len(0) { }
+
+	InputSlice(const InputSlice& o) : blk(o.blk), buf(o.buf), len(o.len) {
+		if(blk != NULL) blk->ref();
+	}
+
+	InputSlice& operator=(const InputSlice& o) {
+		if(o.blk != NULL) o.blk->ref();
+		clear();
+		blk = o.blk; buf = o.buf; len = o.len;
+		return *this;
+	}
+
+	~InputSlice() { clear(); }
+
+	/**
+	 * Point at 'len' bytes at 'buf' in block 'blk', taking over one
+	 * reference the caller holds to 'blk'.
+	 */
+	void set(InputBlock *blk_, const char *buf_, size_t len_) {
+		clear();
+		blk = blk_; buf = buf_; len = len_;
+	}
+
+	void clear() {
+		if(blk != NULL) blk->release();
+		blk = NULL; buf = NULL; len = 0;
+	}
+
+	InputBlock *blk;
+	const char *buf;
+	size_t      len;
+};
+
+#endif /* INPUT_BLOCK_H_ */
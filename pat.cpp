@@ -1,9 +1,13 @@
+#include <chrono>
 #include <cmath>
 #include <inttypes.h>
 #include <iostream>
 #include <string>
 #include <stdexcept>
 #include <string.h>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "assert_helpers.h"
 #include "filebuf.h"
@@ -16,13 +20,16 @@ using namespace std;
 /**
  * Calculate a per-read random seed based on a combination of
  * the read data (incl. sequence, name, quals) and the global
- * seed in '_randSeed'.
+ * seed in '_randSeed'.  The quals and/or name are left out if
+ * useQual and/or useName are false.
  */
 static uint32_t genRandSeed(
 	const BTDnaString& qry,
 	const BTString& qual,
 	const BTString& name,
-	uint32_t seed)
+	uint32_t seed,
+	bool useQual = true,
+	bool useName = true)
 {
 	// Calculate a per-read random seed based on a combination of
 	// the read data (incl. sequence, name, quals) and the global
@@ -38,7 +45,7 @@ static uint32_t genRandSeed(
 	}
 	// Throw all the quality values for the read into the random
 	// seed
-	for(size_t i = 0; i < qlen; i++) {
+	for(size_t i = 0; i < qlen && useQual; i++) {
 		int p = (int)qual[i];
 		assert_leq(p, 255);
 		size_t off = ((i & 3) << 3);
@@ -46,7 +53,7 @@ static uint32_t genRandSeed(
 	}
 	// Throw all the characters in the read name into the random
 	// seed
-	size_t namelen = name.length();
+	size_t namelen = useName ? name.length() : 0;
 	for(size_t i = 0; i < namelen; i++) {
 		int p = (int)name[i];
 		assert_leq(p, 255);
@@ -65,7 +72,7 @@ void PatternSourcePerThread::finalize(Read& ra) {
 	ra.mate = 0;
 	ra.constructRevComps();
 	ra.constructReverses();
-	ra.seed = genRandSeed(ra.patFw, ra.qual, ra.name, seed_);
+	ra.seed = genRandSeed(ra.patFw, ra.qual, ra.name, seed_, seedQuals_, seedName_);
 }
 
 /**
@@ -78,13 +85,13 @@ void PatternSourcePerThread::finalizePair(Read& ra, Read& rb) {
 	ra.constructRevComps();
 	ra.constructReverses();
 	ra.fixMateName(1);
-	ra.seed = genRandSeed(ra.patFw, ra.qual, ra.name, seed_);
+	ra.seed = genRandSeed(ra.patFw, ra.qual, ra.name, seed_, seedQuals_, seedName_);
 
 	rb.mate = 2;
 	rb.constructRevComps();
 	rb.constructReverses();
 	rb.fixMateName(2);
-	rb.seed = genRandSeed(rb.patFw, rb.qual, rb.name, seed_);
+	rb.seed = genRandSeed(rb.patFw, rb.qual, rb.name, seed_, seedQuals_, seedName_);
 }
 
 /**
@@ -108,11 +115,19 @@ pair<bool, bool> PatternSourcePerThread::nextReadPair() {
 		assert_gt(buf_.cur_buf_, 0);
 	}
 	bool this_is_last = buf_.cur_buf_ == last_batch_size_-1;
+	if(buf_.cur_buf_ < ahead_end_) {
+		// lookahead() already got to this one
+		switch(ahead_[buf_.cur_buf_]) {
+			case AHEAD_OK: return make_pair(true, this_is_last ? last_batch_ : false);
+			case AHEAD_FAILED: return make_pair(false, false);
+			default: return make_pair(false, this_is_last ? last_batch_ : false);
+		}
+	}
 	if(buf_.rdid() < skip_) {
 		return make_pair(false, this_is_last ? last_batch_ : false);
 	}
 	// Parse read/pair
-	assert(!buf_.read_a().readOrigBuf.empty());
+	assert(!buf_.read_a().origEmpty());
 	assert(buf_.read_a().empty());
 	if(!parse(buf_.read_a(), buf_.read_b())) {
 		return make_pair(false, false);
@@ -126,6 +141,45 @@ pair<bool, bool> PatternSourcePerThread::nextReadPair() {
 	return make_pair(true, this_is_last ? last_batch_ : false);
 }
 
+/**
+ * Parse and finalize up to n-1 of the reads following the current one
+ * in the current batch.  Doesn't look past the end of the batch.
+ * Returns the number of reads, counting the current one, whose status
+ * is now known.
+ */
+size_t PatternSourcePerThread::lookahead(size_t n) {
+	const size_t cur = buf_.cur_buf_;
+	assert_lt(cur, buf_.bufa_.size());
+	size_t end = min<size_t>(cur + n, last_batch_size_);
+	end = min<size_t>(end, buf_.bufa_.size());
+	if(end <= cur) {
+		return 1;
+	}
+	for(size_t i = max<size_t>(cur + 1, ahead_end_); i < end; i++) {
+		Read& ra = buf_.bufa_[i];
+		Read& rb = buf_.bufb_[i];
+		TReadId rdid = buf_.rdid() - cur + i;
+		if(rdid < skip_) {
+			ahead_[i] = AHEAD_SKIPPED;
+			continue;
+		}
+		assert(!ra.origEmpty());
+		assert(ra.empty());
+		if(!composer_.parse(ra, rb, rdid)) {
+			ahead_[i] = AHEAD_FAILED;
+			continue;
+		}
+		if(rb.parsed) {
+			finalizePair(ra, rb);
+		} else {
+			finalize(ra);
+		}
+		ahead_[i] = AHEAD_OK;
+	}
+	ahead_end_ = max<size_t>(ahead_end_, end);
+	return end - cur;
+}
+
 /**
  * The main member function for dispensing pairs of reads or
  * singleton reads.  Returns true iff ra and rb contain a new
@@ -220,6 +274,148 @@ pair<bool, int> DualPatternComposer::nextBatch(PerThreadReadBuf& pt) {
 	return make_pair(true, 0);
 }
 
+/**
+ * Wait a little for another thread to catch up: yield for the first
+ * few rounds, then sleep briefly so as not to burn a core waiting on
+ * slow input.
+ */
+static inline void readAheadBackoff(int& spins) {
+	if(++spins < 64) {
+		std::this_thread::yield();
+	} else {
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+}
+
+ReadAheadPatternComposer::ReadAheadPatternComposer(
+	PatternComposer* composer,
+	size_t max_buf,
+	size_t nslots) :
+	PatternComposer(),
+	composer_(composer),
+	endRdid_(0),
+	reader_(NULL)
+{
+	assert(composer_ != NULL);
+	assert_gt(nslots, 0);
+	for(size_t i = 0; i < nslots; i++) {
+		slots_.push_back(new Slot(max_buf));
+	}
+	start();
+}
+
+ReadAheadPatternComposer::~ReadAheadPatternComposer() {
+	stop();
+	for(size_t i = 0; i < slots_.size(); i++) {
+		delete slots_[i];
+	}
+	delete composer_;
+}
+
+void ReadAheadPatternComposer::reset() {
+	stop();
+	composer_->reset();
+	start();
+}
+
+/**
+ * Empty the ring and launch the reader thread.
+ */
+void ReadAheadPatternComposer::start() {
+	for(size_t i = 0; i < slots_.size(); i++) {
+		slots_[i]->seq.store(i, std::memory_order_relaxed);
+		slots_[i]->failed = false;
+	}
+	head_.store(0, std::memory_order_relaxed);
+	end_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+	stop_.store(false, std::memory_order_relaxed);
+#if (__cplusplus >= 201103L)
+	reader_ = new std::thread(readerWorker, (void*)this);
+#else
+	reader_ = new tthread::thread(readerWorker, (void*)this);
+#endif
+}
+
+/**
+ * Tell the reader thread to quit and wait for it.
+ */
+void ReadAheadPatternComposer::stop() {
+	if(reader_ == NULL) return;
+	stop_.store(true, std::memory_order_release);
+	reader_->join();
+	delete reader_;
+	reader_ = NULL;
+}
+
+void ReadAheadPatternComposer::readerWorker(void *vp) {
+	((ReadAheadPatternComposer*)vp)->readLoop();
+}
+
+/**
+ * Fill the ring in order until the wrapped composer runs dry.
+ */
+void ReadAheadPatternComposer::readLoop() {
+	const uint64_t nslots = slots_.size();
+	for(uint64_t s = 0; ; s++) {
+		Slot& sl = *slots_[s % nslots];
+		// Wait for the search threads to be done with the batch the
+		// slot held in the previous round
+		int spins = 0;
+		while(sl.seq.load(std::memory_order_acquire) != s) {
+			if(stop_.load(std::memory_order_acquire)) return;
+			readAheadBackoff(spins);
+		}
+		sl.buf.reset();
+		bool last;
+		try {
+			sl.res = composer_->nextBatch(sl.buf);
+			last = sl.res.first && sl.res.second == 0;
+		} catch(int) {
+			// The error message has been printed; the search thread
+			// that claims this slot rethrows
+			sl.failed = true;
+			last = true;
+		}
+		sl.seq.store(s + 1, std::memory_order_release);
+		if(last) {
+			endRdid_ = sl.buf.rdid_;
+			end_.store(s + 1, std::memory_order_release);
+			return;
+		}
+	}
+}
+
+/**
+ * Hand the next batch read ahead to the calling search thread by
+ * swapping buffers with it.
+ */
+pair<bool, int> ReadAheadPatternComposer::nextBatch(PerThreadReadBuf& pt) {
+	const uint64_t nslots = slots_.size();
+	uint64_t k = head_.fetch_add(1, std::memory_order_relaxed);
+	Slot& sl = *slots_[k % nslots];
+	int spins = 0;
+	while(sl.seq.load(std::memory_order_acquire) != k + 1) {
+		if(k >= end_.load(std::memory_order_acquire)) {
+			// Input ran out before this batch
+			pt.rdid_ = endRdid_;
+			return make_pair(true, 0);
+		}
+		readAheadBackoff(spins);
+	}
+	if(sl.failed) {
+		throw 1;
+	}
+	assert_eq(pt.max_buf_, sl.buf.max_buf_);
+	EList<Read> tmp;
+	tmp.xfer(pt.bufa_); pt.bufa_.xfer(sl.buf.bufa_); sl.buf.bufa_.xfer(tmp);
+	tmp.xfer(pt.bufb_); pt.bufb_.xfer(sl.buf.bufb_); sl.buf.bufb_.xfer(tmp);
+	pt.rdid_ = sl.buf.rdid_;
+	pair<bool, int> res = sl.res;
+	// Give the slot back to the reader for the next round
+	sl.seq.store(k + nslots, std::memory_order_release);
+	return res;
+}
+
 /**
  * Fill Read with the sequence, quality and name for the next
  * read in the list of read files.  This function gets called by
@@ -278,10 +474,18 @@ pair<bool, int> CFilePatternSource::nextBatch(
 void CFilePatternSource::open() {
 	if(is_open_) {
 		is_open_ = false;
-		if (compressed_) {
+		if(inflate_ != NULL) {
+			delete inflate_;
+			inflate_ = NULL;
+		} else if (compressed_) {
 			gzclose(zfp_);
 			zfp_ = NULL;
 		}
+		else if (map_ != NULL) {
+			// Unmapped once reads are done with it
+			map_->close();
+			map_ = NULL;
+		}
 		else if (fp_ != stdin) {
 			fclose(fp_);
 			fp_ = NULL;
@@ -291,23 +495,49 @@ void CFilePatternSource::open() {
 			qfp_ = NULL;
 		}
 	}
+	if(curBlk_ != NULL) {
+		curBlk_->release();
+		curBlk_ = NULL;
+	}
+	blk_ = NULL;
+	blkCur_ = blkEnd_ = 0;
 	while(filecur_ < infiles_.size()) {
 		// Open read
 		if(infiles_[filecur_] == "-") {
 			compressed_ = true;
 			int fn = dup(fileno(stdin));
-			zfp_ = gzdopen(fn, "rb");
+			if(inflateThreads > 0) {
+				inflate_ = new InflateStream(fn, inflateThreads - 1);
+			} else {
+				zfp_ = gzdopen(fn, "rb");
+			}
 		}
 		else {
 			compressed_ = false;
 			if (is_gzipped_file(infiles_[filecur_])) {
 				compressed_ = true;
-				zfp_ = gzopen(infiles_[filecur_].c_str(), "rb");
+				if(inflateThreads > 0) {
+					// Decompress on a reader thread (plus helpers for
+					// BGZF) instead of under the input lock
+					int fn = ::open(infiles_[filecur_].c_str(), O_RDONLY);
+					if(fn >= 0) {
+						inflate_ = new InflateStream(fn, inflateThreads - 1);
+					}
+				} else {
+					zfp_ = gzopen(infiles_[filecur_].c_str(), "rb");
+				}
+			}
+#ifdef BOWTIE_MM
+			else if (mmReads && openMapped(infiles_[filecur_])) {
+				// Reads are sliced straight out of the mapping
 			}
+#endif
 			else {
 				fp_ = fopen(infiles_[filecur_].c_str(), "rb");
 			}
-			if ((compressed_ && zfp_ == NULL) || (!compressed_ && fp_ == NULL)) {
+			if ((compressed_ && zfp_ == NULL && inflate_ == NULL) ||
+			    (!compressed_ && fp_ == NULL && map_ == NULL))
+			{
 				if(!errs_[filecur_]) {
 					cerr << "Warning: Could not open read file \""
 					     << infiles_[filecur_] << "\" for reading; skipping..."
@@ -319,7 +549,10 @@ void CFilePatternSource::open() {
 			}
 		}
 		is_open_ = true;
-		if (compressed_) {
+		if (inflate_ != NULL || map_ != NULL) {
+			// InflateStream or the mapping does the buffering
+		}
+		else if (compressed_) {
 #if ZLIB_VERNUM < 0x1235
 			cerr << "Warning: gzbuffer added in zlib v1.2.3.5. Unable to change "
 			        "buffer size from default of 8192." << endl;
@@ -351,6 +584,113 @@ void CFilePatternSource::open() {
 	throw 1;
 }
 
+/**
+ * Move on to the next block of the current file.  A record the light
+ * parser is in the middle of comes along: if none of it has been seen
+ * yet it just starts in the new block, and if the new block is the
+ * next window of a mapping it carries on into it.  Otherwise the part
+ * seen so far is copied into the read's buffer, and so will the rest
+ * be.
+ */
+bool CFilePatternSource::fillBlock() {
+	InputBlock *next = NULL;
+	const char *nb = NULL;
+	int64_t n;
+	if(inflate_ != NULL) {
+		// Decompressed on other threads; use their buffer as is.  It's
+		// recycled by the next call, so records are copied out of it
+		n = inflate_->next(nb);
+	}
+	else if(map_ != NULL) {
+		// --mm-reads: the block is the next window of the mapping
+		next = map_->next();
+		n = (next != NULL) ? (int64_t)next->len : 0;
+		nb = (next != NULL) ? next->buf : NULL;
+	}
+	else {
+		next = freeBlock();
+		n = compressed_ ?
+			(int64_t)gzread(zfp_, next->data, BLOCK_SZ) :
+			(int64_t)fread(next->data, 1, BLOCK_SZ, fp_);
+		next->len = n > 0 ? (size_t)n : 0;
+		nb = next->buf;
+	}
+	if(n <= 0) {
+		if(next != NULL) next->release();
+		return false;
+	}
+	if(rec_ != NULL) {
+		const char *end = blk_ + blkEnd_;
+		if(recPtr_ == end && rec_->readOrigBuf.empty()) {
+			if(recBlk_ != NULL) recBlk_->release();
+			recBlk_ = next;
+			if(recBlk_ != NULL) recBlk_->ref();
+			recCopy_ = (recBlk_ == NULL);
+			recPtr_ = nb;
+		} else if(!recCopy_ && nb == end) {
+			// Mapped file; the record stays a slice of the window it
+			// started in
+			assert(next != NULL && next->map != NULL);
+		} else {
+			rec_->readOrigBuf.append(recPtr_, (size_t)(end - recPtr_));
+			recCopy_ = true;
+			recPtr_ = nb;
+		}
+	}
+	if(curBlk_ != NULL) curBlk_->release();
+	curBlk_ = next;
+	blk_ = nb;
+	blkCur_ = 0;
+	blkEnd_ = (size_t)n;
+	return true;
+}
+
+/**
+ * Return a pooled block that nothing else refers to, adding one to the
+ * pool if they're all in use, with a reference for the caller.  Blocks
+ * only stay busy until the reads sliced from them are reset, so the
+ * pool stays at a few blocks per batch in flight.
+ */
+InputBlock* CFilePatternSource::freeBlock() {
+	for(size_t i = 0; i < pool_.size(); i++) {
+		if(pool_[i]->idle()) {
+			pool_[i]->ref();
+			return pool_[i];
+		}
+	}
+	InputBlock *b = new InputBlock(BLOCK_SZ);
+	pool_.push_back(b);
+	b->ref();
+	return b;
+}
+
+#ifdef BOWTIE_MM
+/**
+ * Memory-map uncompressed read file 'fn' for --mm-reads.  Returns
+ * false, leaving the file to be read with stdio, if it isn't a
+ * non-empty regular file or can't be mapped.
+ */
+bool CFilePatternSource::openMapped(const string& fn) {
+	int fd = ::open(fn.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return false;
+	}
+	struct stat sbuf;
+	if(fstat(fd, &sbuf) != 0 || !S_ISREG(sbuf.st_mode) || sbuf.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void *p = mmap((void *)0, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED) {
+		return false;
+	}
+	madvise(p, sbuf.st_size, MADV_SEQUENTIAL);
+	map_ = new InputMap((const char *)p, (size_t)sbuf.st_size, MM_BLOCK_SZ);
+	return true;
+}
+#endif
+
 /**
  * Constructor for vector pattern source, used when the user has
  * specified the input strings on the command line using the -c
@@ -440,10 +780,11 @@ bool VectorPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 	// Light parser (nextBatchFromFile) puts unparsed data
 	// into Read& r, even when the read is paired.
 	assert(ra.empty());
-	assert(!ra.readOrigBuf.empty()); // raw data for read/pair is here
+	assert(!ra.origEmpty()); // raw data for read/pair is here
 	int c = '\t';
 	size_t cur = 0;
-	const size_t buflen = ra.readOrigBuf.length();
+	const char *raw = ra.origBuf();
+	const size_t buflen = ra.origLen();
 
 	// Loop over the two ends
 	for(int endi = 0; endi < 2 && c == '\t'; endi++) {
@@ -453,10 +794,10 @@ bool VectorPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 		// (b) this is tab6
 		if(endi < 1 || paired_) {
 			// Parse read name
-			c = ra.readOrigBuf[cur++];
+			c = raw[cur++];
 			while(c != '\t' && cur < buflen) {
 				r.name.append(c);
-				c = ra.readOrigBuf[cur++];
+				c = raw[cur++];
 			}
 			assert_eq('\t', c);
 			if(cur >= buflen) {
@@ -470,7 +811,7 @@ bool VectorPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 
 		// Parse sequence
 		assert(r.patFw.empty());
-		c = ra.readOrigBuf[cur++];
+		c = raw[cur++];
 		int nchar = 0;
 		while(c != '\t' && cur < buflen) {
 			if(isalpha(c)) {
@@ -480,7 +821,7 @@ bool VectorPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 					r.patFw.append(asc2dna[c]); // ascii to int
 				}
 			}
-			c = ra.readOrigBuf[cur++];
+			c = raw[cur++];
 		}
 		assert_eq('\t', c);
 		if(cur >= buflen) {
@@ -493,7 +834,7 @@ bool VectorPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 
 		// Parse qualities
 		assert(r.qual.empty());
-		c = ra.readOrigBuf[cur++];
+		c = raw[cur++];
 		int nqual = 0;
 		while(c != '\t' && c != '\n' && c != '\r') {
 			if(c == ' ') {
@@ -505,7 +846,7 @@ bool VectorPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 				r.qual.append(cadd);
 			}
 			if(cur >= buflen) break;
-			c = ra.readOrigBuf[cur++];
+			c = raw[cur++];
 		}
 		if(nchar > nqual) {
 			tooFewQualities(r.name);
@@ -519,7 +860,7 @@ bool VectorPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 		assert_eq(r.patFw.length(), r.qual.length());
 	}
 	ra.parsed = true;
-	if(!rb.parsed && rb.readOrigBuf.length() > 0) {
+	if(!rb.parsed && !rb.origEmpty()) {
 		return parse(rb, ra, rdid);
 	}
 	return true;
@@ -550,20 +891,16 @@ pair<bool, int> FastaPatternSource::nextBatchFromFile(
 		first_ = false;
 	}
 	bool done = false;
-	// Read until we run out of input or until we've filled the buffer
+	// Read until we run out of input or until we've filled the buffer.
+	// Each record runs from the '>' already consumed to the next one.
 	for(; readi < pt.max_buf_ && !done; readi++) {
-		readbuf[readi].readOrigBuf.append('>');
-		while(true) {
-			c = getc_wrapper();
-			if(c < 0 || c == '>') {
-				done = c < 0;
-				break;
-			}
-			readbuf[readi].readOrigBuf.append(c);
-		}
+		beginRecord(readbuf[readi], 1);
+		c = skipUntil('>');
+		done = c < 0;
+		endRecord(done ? 0 : 1);
 	}
 	// Immediate EOF case
-	if(done && readbuf[readi-1].readOrigBuf.length() == 1) {
+	if(done && readbuf[readi-1].origLen() == 1) {
 		readi--;
 	}
 	return make_pair(done, readi);
@@ -576,19 +913,20 @@ bool FastaPatternSource::parse(Read& r, Read& rb, TReadId rdid) const {
 	// We assume the light parser has put the raw data for the separate ends
 	// into separate Read objects.  That doesn't have to be the case, but
 	// that's how we've chosen to do it for FastqPatternSource
-	assert(!r.readOrigBuf.empty());
+	assert(!r.origEmpty());
 	assert(r.empty());
 	int c = -1;
 	size_t cur = 1;
-	const size_t buflen = r.readOrigBuf.length();
+	const char *raw = r.origBuf();
+	const size_t buflen = r.origLen();
 
 	// Parse read name
 	assert(r.name.empty());
 	while(cur < buflen) {
-		c = r.readOrigBuf[cur++];
+		c = raw[cur++];
 		if(c == '\n' || c == '\r') {
 			do {
-				c = r.readOrigBuf[cur++];
+				c = raw[cur++];
 			} while((c == '\n' || c == '\r') && cur < buflen);
 			break;
 		}
@@ -614,7 +952,7 @@ bool FastaPatternSource::parse(Read& r, Read& rb, TReadId rdid) const {
 			}
 		}
 		assert_lt(cur, buflen);
-		c = r.readOrigBuf[cur++];
+		c = raw[cur++];
 	}
 	// record amt trimmed from 5' end due to --trim5
 	r.trimmed5 = (int)(nchar - r.patFw.length());
@@ -632,7 +970,7 @@ bool FastaPatternSource::parse(Read& r, Read& rb, TReadId rdid) const {
 		r.name.install(cbuf);
 	}
 	r.parsed = true;
-	if(!rb.parsed && rb.readOrigBuf.length() > 0) {
+	if(!rb.parsed && !rb.origEmpty()) {
 		return parse(rb, r, rdid);
 	}
 	return true;
@@ -742,17 +1080,18 @@ bool FastaContinuousPatternSource::parse(
 	// into Read& r, even when the read is paired.
 	assert(ra.empty());
 	assert(rb.empty());
-	assert(!ra.readOrigBuf.empty()); // raw data for read/pair is here
-	assert(rb.readOrigBuf.empty());
+	assert(!ra.origEmpty()); // raw data for read/pair is here
+	assert(rb.origEmpty());
 	int c = '\t';
 	size_t cur = 0;
-	const size_t buflen = ra.readOrigBuf.length();
+	const char *raw = ra.origBuf();
+	const size_t buflen = ra.origLen();
 
 	// Parse read name
-	c = ra.readOrigBuf[cur++];
+	c = raw[cur++];
 	while(c != '\t' && cur < buflen) {
 		ra.name.append(c);
-		c = ra.readOrigBuf[cur++];
+		c = raw[cur++];
 	}
 	assert_eq('\t', c);
 	if(cur >= buflen) {
@@ -763,7 +1102,7 @@ bool FastaContinuousPatternSource::parse(
 	assert(ra.patFw.empty());
 	int nchar = 0;
 	while(cur < buflen) {
-		c = ra.readOrigBuf[cur++];
+		c = raw[cur++];
 		if(isalpha(c)) {
 			assert_in(toupper(c), "ACGTN");
 			if(nchar++ >= this->trim5_) {
@@ -790,9 +1129,10 @@ bool FastaContinuousPatternSource::parse(
 /**
  * "Light" parser.  This is inside the critical section, so the key is to do
  * just enough parsing so that another function downstream (finalize()) can do
- * the rest of the parsing.  Really this function's only job is to stick every
- * for lines worth of the input file into a buffer (r.readOrigBuf).  finalize()
- * then parses the contents of r.readOrigBuf later.
+ * the rest of the parsing.  Really this function's only job is to find where
+ * every four lines of the input file start and end, leaving each read a slice
+ * of the input block they lie in (r.orig).  parse() then parses the slice
+ * later.
  */
 pair<bool, int> FastqPatternSource::nextBatchFromFile(
 	PerThreadReadBuf& pt,
@@ -801,6 +1141,7 @@ pair<bool, int> FastqPatternSource::nextBatchFromFile(
 {
 	int c = 0;
 	EList<Read>* readBuf = batch_a ? &pt.bufa_ : &pt.bufb_;
+	size_t back = 0; // whether the first record's '@' is already consumed
 	if(first_) {
 		c = getc_wrapper();
 		while(c == '\r' || c == '\n') {
@@ -811,23 +1152,29 @@ pair<bool, int> FastqPatternSource::nextBatchFromFile(
 			throw 1;
 		}
 		first_ = false;
-		(*readBuf)[readi].readOrigBuf.append('@');
+		back = 1;
 	}
 	bool done = false, aborted = false;
 	// Read until we run out of input or until we've filled the buffer
 	while (readi < pt.max_buf_ && !done) {
-		Read::TBuf& buf = (*readBuf)[readi].readOrigBuf;
-		assert(readi == 0 || (*readBuf)[readi].readOrigBuf.length() == 0);
+		Read& r = (*readBuf)[readi];
+		assert(readi == 0 || r.origEmpty());
+		beginRecord(r, back);
+		back = 0;
+		bool eofNewline = false;
 		int newlines = 4;
 		while(newlines) {
-			c = getc_wrapper();
+			// Skip through the next newline
+			c = skipUntil('\n');
 			done = c < 0;
-			if(c == '\n' || (done && newlines == 1)) {
-				// Saw newline, or EOF that we're
-				// interpreting as final newline
+			if(c == '\n') {
+				newlines--;
+			} else if(newlines == 1) {
+				// EOF that we're interpreting as final newline
 				newlines--;
 				c = '\n';
-			} else if(done) {
+				eofNewline = true;
+			} else {
 				if (newlines == 4) {
 					newlines = 0;
 				} else {
@@ -835,7 +1182,11 @@ pair<bool, int> FastqPatternSource::nextBatchFromFile(
 				}
 				break;
 			}
-			buf.append(c);
+		}
+		endRecord();
+		if(eofNewline) {
+			r.origToBuf();
+			r.readOrigBuf.append('\n');
 		}
 		if (c > 0) {
 			if (interleaved_) {
@@ -863,21 +1214,22 @@ bool FastqPatternSource::parse(Read &r, Read& rb, TReadId rdid) const {
 	// We assume the light parser has put the raw data for the separate ends
 	// into separate Read objects.  That doesn't have to be the case, but
 	// that's how we've chosen to do it for FastqPatternSource
-	assert(!r.readOrigBuf.empty());
+	assert(!r.origEmpty());
 	assert(r.empty());
 	int c;
 	size_t cur = 1;
-	const size_t buflen = r.readOrigBuf.length();
+	const char *raw = r.origBuf();
+	const size_t buflen = r.origLen();
 
 	// Parse read name
 	assert(r.name.empty());
 	while(true) {
 		assert_lt(cur, buflen);
-		c = r.readOrigBuf[cur++];
+		c = raw[cur++];
 		if(c == '\n' || c == '\r') {
 			do {
-				c = r.readOrigBuf[cur++];
-			} while(c == '\n' || c == '\r');
+				c = raw[cur++];
+			} while((c == '\n' || c == '\r') && cur < buflen);
 			break;
 		}
 		r.name.append(c);
@@ -897,7 +1249,7 @@ bool FastqPatternSource::parse(Read &r, Read& rb, TReadId rdid) const {
 			}
 		}
 		assert_lt(cur, buflen);
-		c = r.readOrigBuf[cur++];
+		c = raw[cur++];
 	}
 	// record amt trimmed from 5' end due to --trim5
 	r.trimmed5 = (int)(nchar - r.patFw.length());
@@ -907,10 +1259,10 @@ bool FastqPatternSource::parse(Read &r, Read& rb, TReadId rdid) const {
 	assert_eq('+', c);
 	do {
 		assert_lt(cur, buflen);
-		c = r.readOrigBuf[cur++];
-	} while(c != '\n' && c != '\r');
+		c = raw[cur++];
+	} while(c != '\n' && c != '\r' && cur < buflen);
 	while(cur < buflen && (c == '\n' || c == '\r')) {
-		c = r.readOrigBuf[cur++];
+		c = raw[cur++];
 	}
 
 	assert(r.qual.empty());
@@ -920,12 +1272,12 @@ bool FastqPatternSource::parse(Read &r, Read& rb, TReadId rdid) const {
 		while(c != '\t' && c != '\n' && c != '\r') {
 			cur_int *= 10;
 			cur_int += (int)(c - '0');
-			c = r.readOrigBuf[cur++];
+			c = raw[cur++];
 			if(c == ' ' || c == '\t' || c == '\n' || c == '\r') {
 				char cadd = intToPhred33(cur_int, solQuals_);
 				cur_int = 0;
 				if (c == ' ')
-					c = r.readOrigBuf[cur++];
+					c = raw[cur++];
 				assert_geq(cadd, 33);
 				if(++nqual > this->trim5_) {
 					r.qual.append(cadd);
@@ -938,7 +1290,7 @@ bool FastqPatternSource::parse(Read &r, Read& rb, TReadId rdid) const {
 			r.qual.append(c);
 		}
 		while(cur < buflen) {
-			c = r.readOrigBuf[cur++];
+			c = raw[cur++];
 			if (c == ' ') {
 				wrongQualityFormat(r.name);
 				return false;
@@ -968,7 +1320,7 @@ bool FastqPatternSource::parse(Read &r, Read& rb, TReadId rdid) const {
 		r.name.install(cbuf);
 	}
 	r.parsed = true;
-	if(!rb.parsed && rb.readOrigBuf.length() > 0) {
+	if(!rb.parsed && !rb.origEmpty()) {
 		return parse(rb, r, rdid);
 	}
 	return true;
@@ -990,20 +1342,23 @@ pair<bool, int> TabbedPatternSource::nextBatchFromFile(
 	// Read until we run out of input or until we've filled the buffer
 	for(; readi < pt.max_buf_ && c >= 0; readi++) {
 		readbuf[readi].readOrigBuf.clear();
-		while(c >= 0 && c != '\n' && c != '\r') {
-			readbuf[readi].readOrigBuf.append(c);
-			c = getc_wrapper();
+		if(c >= 0 && c != '\n' && c != '\r') {
+			// The record is the line plus a "\n" or "\n\r" ending
+			// it, but not a lone '\r'
+			beginRecord(readbuf[readi], 1);
+			c = skipLine();
+			size_t back = 0;
+			if (c == '\n') {
+				c = getc_wrapper();
+				if (c != '\r') {
+					ungetc_wrapper(c);
+					c = '\n'; // reset to last seen char
+				}
+			} else if (c == '\r') {
+				back = 1;
+			}
+			endRecord(back);
 		}
-                if (c == '\n') {
-			readbuf[readi].readOrigBuf.append(c);
-			c = getc_wrapper();
-			if (c == '\r')
-				readbuf[readi].readOrigBuf.append(c);
-                        else {
-				ungetc_wrapper(c);
-				c = '\n'; // reset to last seen char
-                        }
-                }
                 while(c >= 0 && (c == '\n' || c == '\r') && readi < pt.max_buf_ - 1) {
 			c = getc_wrapper();
 		}
@@ -1019,11 +1374,12 @@ bool TabbedPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 	// into Read& r, even when the read is paired.
 	assert(ra.empty());
 	assert(rb.empty());
-	assert(!ra.readOrigBuf.empty()); // raw data for read/pair is here
-	assert(rb.readOrigBuf.empty());
+	assert(!ra.origEmpty()); // raw data for read/pair is here
+	assert(rb.origEmpty());
 	int c = '\t';
 	size_t cur = 0;
-	const size_t buflen = ra.readOrigBuf.length();
+	const char *raw = ra.origBuf();
+	const size_t buflen = ra.origLen();
 	bool paired = false;
 
 	// Loop over the two ends
@@ -1034,10 +1390,10 @@ bool TabbedPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 		// (b) this is tab6
 		if(endi < 1 || secondName_) {
 			// Parse read name
-			c = ra.readOrigBuf[cur++];
+			c = raw[cur++];
 			while(c != '\t' && cur < buflen) {
 				r.name.append(c);
-				c = ra.readOrigBuf[cur++];
+				c = raw[cur++];
 			}
 			assert_eq('\t', c);
 			if(cur >= buflen) {
@@ -1053,7 +1409,7 @@ bool TabbedPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 
 		// Parse sequence
 		assert(r.patFw.empty());
-		c = ra.readOrigBuf[cur++];
+		c = raw[cur++];
 		int nchar = 0;
 		while(c != '\t' && cur < buflen) {
 			if(isalpha(c)) {
@@ -1063,7 +1419,7 @@ bool TabbedPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 					r.patFw.append(asc2dna[c]);
 				}
 			}
-			c = ra.readOrigBuf[cur++];
+			c = raw[cur++];
 		}
 		assert_eq('\t', c);
 		if(cur >= buflen) {
@@ -1076,14 +1432,14 @@ bool TabbedPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 
 		// Parse qualities
 		assert(r.qual.empty());
-		c = ra.readOrigBuf[cur++];
+		c = raw[cur++];
 		int nqual = 0;
 		if (intQuals_) {
 			int cur_int = 0;
 			while(c != '\t' && c != '\n' && c != '\r' && cur < buflen) {
 				cur_int *= 10;
 				cur_int += (int)(c - '0');
-				c = ra.readOrigBuf[cur++];
+				c = raw[cur++];
 				if(c == ' ' || c == '\t' || c == '\n' || c == '\r') {
 					char cadd = intToPhred33(cur_int, solQuals_);
 					cur_int = 0;
@@ -1104,7 +1460,7 @@ bool TabbedPatternSource::parse(Read& ra, Read& rb, TReadId rdid) const {
 					r.qual.append(cadd);
 				}
 				if(cur >= buflen) break;
-				c = ra.readOrigBuf[cur++];
+				c = raw[cur++];
 			}
 		}
 		if(nchar > nqual) {
@@ -1142,22 +1498,25 @@ pair<bool, int> RawPatternSource::nextBatchFromFile(
 		while(c >= 0 && (c == '\n' || c == '\r')) {
 			c = getc_wrapper();
 		}
-		while(c >= 0 && (c != '\n' && c != '\r')) {
-			readbuf[readi].readOrigBuf.append(c);
-			c = getc_wrapper();
-		}
-                if (c == '\n') {
-			readbuf[readi].readOrigBuf.append(c);
-			c = getc_wrapper();
-			if (c == '\r')
-				readbuf[readi].readOrigBuf.append(c);
-			else {
-				ungetc_wrapper(c);
-				c = '\n'; // reset to last character seen
+		if(c >= 0 && (c != '\n' && c != '\r')) {
+			// As for tabbed input, the record is the line plus a
+			// "\n" or "\n\r" ending it, but not a lone '\r'
+			beginRecord(readbuf[readi], 1);
+			c = skipLine();
+			size_t back = 0;
+			if (c == '\n') {
+				c = getc_wrapper();
+				if (c != '\r') {
+					ungetc_wrapper(c);
+					c = '\n'; // reset to last character seen
+				}
+			} else if (c == '\r') {
+				back = 1;
 			}
-                }
+			endRecord(back);
+		}
         }
-	while (readi > 0 && readbuf[readi-1].readOrigBuf.length() == 0)
+	while (readi > 0 && readbuf[readi-1].origEmpty())
 		readi--;
 	return make_pair(c < 0, readi);
 }
@@ -1167,19 +1526,20 @@ pair<bool, int> RawPatternSource::nextBatchFromFile(
  */
 bool RawPatternSource::parse(Read& r, Read& rb, TReadId rdid) const {
 	assert(r.empty());
-	assert(!r.readOrigBuf.empty());
+	assert(!r.origEmpty());
 	size_t cur = 0;
-	const size_t buflen = r.readOrigBuf.length();
+	const char *raw = r.origBuf();
+	const size_t buflen = r.origLen();
 
 	// Parse sequence
 	assert(r.patFw.empty());
 	int nchar = 0;
-	int c = r.readOrigBuf[cur++];
+	int c = raw[cur++];
 
 
 	cur--;
 	while(cur < buflen) {
-		c = r.readOrigBuf[cur++];
+		c = raw[cur++];
 		if(isalpha(c)) {
 			assert_in(toupper(c), "ACGTN");
 			if(nchar++ >= this->trim5_) {
@@ -1206,7 +1566,7 @@ bool RawPatternSource::parse(Read& r, Read& rb, TReadId rdid) const {
 		r.qual.append('I');
 	}
 	r.parsed = true;
-	if(!rb.parsed && !rb.readOrigBuf.empty()) {
+	if(!rb.parsed && !rb.origEmpty()) {
 		return parse(rb, r, rdid);
 	}
 	return true;
@@ -11,12 +11,18 @@
 #include <cstring>
 #include <ctype.h>
 #include <fstream>
+#ifdef BOWTIE_MM
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "alphabet.h"
 #include "assert_helpers.h"
 #include "ds.h"
 #include "ds.h"
 #include "filebuf.h"
+#include "inflate_stream.h"
+#include "input_block.h"
 #include "qual.h"
 #include "random_source.h"
 #include "read.h"
@@ -324,7 +330,17 @@ public:
 		qfp_(NULL),
 		zfp_(NULL),
 		is_open_(false),
-		first_(true)
+		first_(true),
+		blk_(NULL),
+		blkCur_(0),
+		blkEnd_(0),
+		curBlk_(NULL),
+		rec_(NULL),
+		recBlk_(NULL),
+		recPtr_(NULL),
+		recCopy_(false),
+		inflate_(NULL),
+		map_(NULL)
 	{
 		qinfiles_.clear();
 		if(qinfiles != NULL) qinfiles_ = *qinfiles;
@@ -343,11 +359,27 @@ public:
 	}
 
 	virtual ~CFilePatternSource() {
+		if(curBlk_ != NULL) {
+			curBlk_->release();
+			curBlk_ = NULL;
+		}
+		// Blocks still referred to by reads go when those reads do
+		for(size_t i = 0; i < pool_.size(); i++) {
+			pool_[i]->release();
+		}
 		if(is_open_) {
-			if (compressed_) {
+			if(inflate_ != NULL) {
+				delete inflate_;
+				inflate_ = NULL;
+			} else if (compressed_) {
 				gzclose(zfp_);
 				zfp_ = NULL;
 			}
+			else if (map_ != NULL) {
+				// Unmapped once reads are done with it
+				map_->close();
+				map_ = NULL;
+			}
 			else if (fp_ != stdin) {
 				fclose(fp_);
 				fp_ = NULL;
@@ -407,12 +439,123 @@ protected:
 	 */
 	void open();
 
+#ifdef BOWTIE_MM
+	bool openMapped(const string& fn);
+#endif
+
+	/**
+	 * Move on to the next block of the current file.  Returns false if
+	 * there was nothing left to read.
+	 */
+	bool fillBlock();
+
+	/**
+	 * Return a pooled block that nothing else refers to, adding one to
+	 * the pool if they're all in use, with a reference for the caller.
+	 */
+	InputBlock* freeBlock();
+
+	/**
+	 * Start a record for 'r' at the cursor, or 'back' bytes before it.
+	 * The record is found in place and handed to 'r' as a slice of the
+	 * block by endRecord(); only when it runs off the end of the block
+	 * is it copied into r.readOrigBuf.
+	 */
+	void beginRecord(Read& r, size_t back = 0) {
+		assert(rec_ == NULL);
+		assert_leq(back, blkCur_);
+		rec_ = &r;
+		recBlk_ = curBlk_;
+		if(recBlk_ != NULL) recBlk_->ref();
+		recPtr_ = blk_ + blkCur_ - back;
+		recCopy_ = (recBlk_ == NULL);
+	}
+
+	/**
+	 * End the current record at the cursor, or 'back' bytes before it.
+	 */
+	void endRecord(size_t back = 0) {
+		assert(rec_ != NULL);
+		assert_leq(back, blkCur_);
+		const char *end = blk_ + blkCur_ - back;
+		assert(end >= recPtr_);
+		if(recCopy_) {
+			rec_->readOrigBuf.append(recPtr_, (size_t)(end - recPtr_));
+			if(recBlk_ != NULL) recBlk_->release();
+		} else {
+			rec_->orig.set(recBlk_, recPtr_, (size_t)(end - recPtr_));
+		}
+		rec_ = NULL;
+		recBlk_ = NULL;
+	}
+
 	int getc_wrapper() {
-		return compressed_ ? gzgetc(zfp_) : getc_unlocked(fp_);
+		if(blkCur_ == blkEnd_ && !fillBlock()) {
+			return EOF;
+		}
+		return (unsigned char)blk_[blkCur_++];
 	}
 
+	/**
+	 * Push back the character just returned by getc_wrapper().
+	 */
 	int ungetc_wrapper(int c) {
-		return compressed_ ? gzungetc(c, zfp_) : ungetc(c, fp_);
+		if(c < 0) {
+			return c;
+		}
+		assert_gt(blkCur_, 0);
+		assert_eq(c, (unsigned char)blk_[blkCur_-1]);
+		blkCur_--;
+		return c;
+	}
+
+	/**
+	 * Advance the cursor past the next occurrence of 'delim'.  Whole
+	 * runs are found with memchr rather than a character at a time.
+	 * Returns 'delim', or EOF if the input ran out first.
+	 */
+	int skipUntil(int delim) {
+		while(true) {
+			if(blkCur_ == blkEnd_ && !fillBlock()) {
+				return EOF;
+			}
+			const char *b = blk_ + blkCur_;
+			const char *e = (const char *)memchr(b, delim, blkEnd_ - blkCur_);
+			if(e == NULL) {
+				blkCur_ = blkEnd_;
+				continue;
+			}
+			blkCur_ += (size_t)(e - b) + 1;
+			return delim;
+		}
+	}
+
+	/**
+	 * Advance the cursor past the next '\n' or '\r'.  Returns the
+	 * terminator, or EOF if the input ran out first.
+	 */
+	int skipLine() {
+		while(true) {
+			if(blkCur_ == blkEnd_ && !fillBlock()) {
+				return EOF;
+			}
+			const char *b = blk_ + blkCur_;
+			size_t avail = blkEnd_ - blkCur_;
+			const char *e = (const char *)memchr(b, '\n', avail);
+			size_t len = (e == NULL) ? avail : (size_t)(e - b);
+			// Carriage returns are rare; only look for one in the
+			// stretch before the newline
+			const char *r = (const char *)memchr(b, '\r', len);
+			if(r != NULL) {
+				e = r;
+				len = (size_t)(r - b);
+			}
+			blkCur_ += len;
+			if(e == NULL) {
+				continue;
+			}
+			return (unsigned char)blk_[blkCur_++];
+		}
 	}
 
 	bool is_gzipped_file(const std::string& filename) {
@@ -444,6 +587,19 @@ protected:
 	char buf_[64*1024]; /// file buffer for sequences
 	char qbuf_[64*1024]; /// file buffer for qualities
     bool compressed_;
+	static const size_t BLOCK_SZ = 256*1024;
+	const char *blk_;    /// block of input being light-parsed
+	size_t blkCur_;      /// next unconsumed byte of blk_
+	size_t blkEnd_;      /// number of valid bytes in blk_
+	EList<InputBlock*> pool_; /// blocks we read the file into ourselves
+	InputBlock *curBlk_; /// block blk_ is in, if pooled or mapped
+	Read *rec_;          /// read whose record is being light-parsed
+	InputBlock *recBlk_; /// block the record started in, if pooled or mapped
+	const char *recPtr_; /// start of the part of the record in blk_
+	bool recCopy_;       /// record is being copied into rec_->readOrigBuf
+	InflateStream *inflate_; /// decompresses the current file, if --inflate-threads
+	static const size_t MM_BLOCK_SZ = 4*1024*1024;
+	InputMap *map_;      /// current file mapped into memory, if --mm-reads
 
 private:
 
@@ -706,9 +862,10 @@ protected:
 	/**
 	 * "Light" parser.  This is inside the critical section, so the key is to do
 	 * just enough parsing so that another function downstream (finalize()) can do
-	 * the rest of the parsing.  Really this function's only job is to stick every
-	 * for lines worth of the input file into a buffer (r.readOrigBuf).  finalize()
-	 * then parses the contents of r.readOrigBuf later.
+	 * the rest of the parsing.  Really this function's only job is to find where
+	 * every four lines of the input file start and end, leaving each read a slice
+	 * of the input block they lie in (r.orig).  parse() then parses the slice
+	 * later.
 	 */
 	virtual pair<bool, int> nextBatchFromFile(
 		PerThreadReadBuf& pt,
@@ -941,6 +1098,77 @@ protected:
 	EList<PatternSource*> srcb_; /// PatternSources for 2nd mates
 };
 
+/**
+ * Wraps another PatternComposer and light-parses its batches ahead of
+ * time on a dedicated reader thread, so that search threads don't
+ * take turns doing file I/O under the input lock.  Batches are passed
+ * on through a bounded lock-free ring: every slot carries a sequence
+ * number saying whether it's waiting for the reader (seq == s) or for
+ * a search thread (seq == s+1) in round s, and search threads claim
+ * batches by incrementing a shared counter.  There's one reader, so
+ * batches enter the ring in input order and keep the read ids (and
+ * hence --reorder batch ids) they'd have had without the ring.
+ */
+class ReadAheadPatternComposer : public PatternComposer {
+
+public:
+
+	/**
+	 * Take ownership of 'composer' and start reading batches of up to
+	 * 'max_buf' reads from it into a ring of 'nslots' batches.
+	 */
+	ReadAheadPatternComposer(
+		PatternComposer* composer,
+		size_t max_buf,
+		size_t nslots);
+
+	virtual ~ReadAheadPatternComposer();
+
+	/**
+	 * Stop the reader, rewind the wrapped composer and start over.
+	 */
+	virtual void reset();
+
+	/**
+	 * Hand the next batch read ahead to the calling search thread.
+	 */
+	pair<bool, int> nextBatch(PerThreadReadBuf& pt);
+
+	/**
+	 * Make appropriate call into the format layer to parse individual read.
+	 */
+	virtual bool parse(Read& ra, Read& rb, TReadId rdid) {
+		return composer_->parse(ra, rb, rdid);
+	}
+
+protected:
+
+	struct Slot {
+		Slot(size_t max_buf) : buf(max_buf), res(make_pair(true, 0)), failed(false) { }
+		std::atomic<uint64_t> seq; /// round this slot is in; see above
+		PerThreadReadBuf buf;      /// the batch
+		pair<bool, int> res;       /// what the wrapped nextBatch() returned
+		bool failed;               /// wrapped nextBatch() threw
+	};
+
+	static void readerWorker(void *vp);
+	void readLoop();
+	void start();
+	void stop();
+
+	PatternComposer *composer_;   /// wrapped composer
+	EList<Slot*> slots_;          /// the ring
+	std::atomic<uint64_t> head_;  /// next batch a search thread claims
+	std::atomic<uint64_t> end_;   /// one past the last batch, once known
+	TReadId endRdid_;             /// read id just past the input; set before end_
+	std::atomic<bool> stop_;      /// tells the reader to quit
+#if (__cplusplus >= 201103L)
+	std::thread *reader_;
+#else
+	tthread::thread *reader_;
+#endif
+};
+
 /**
  * Encapsulates a single thread's interaction with the PatternSource.
  * Most notably, this class holds the buffers into which the
@@ -956,14 +1184,20 @@ public:
 		PatternComposer& composer,
 		uint32_t max_buf,
 		uint32_t skip,
-		uint32_t seed) :
+		uint32_t seed,
+		bool seedQuals = true,
+		bool seedName = true) :
 		composer_(composer),
 		buf_(max_buf),
 		last_batch_(false),
 		last_batch_size_(0),
 		skip_(skip),
 		seed_(seed),
-		batch_id_(0) { }
+		seedQuals_(seedQuals),
+		seedName_(seedName),
+		batch_id_(0),
+		ahead_end_(0),
+		ahead_((size_t)max_buf) { ahead_.resize(max_buf); }
 
 	/**
 	 * Get the next paired or unpaired read from the wrapped
@@ -983,6 +1217,31 @@ public:
 
 	size_t batch_id() const { return batch_id_; }
 
+	/**
+	 * Parse and finalize up to n-1 of the reads that follow the
+	 * current one in the current batch, so that the caller can work on
+	 * several reads at once.  Returns the number of reads, counting
+	 * the current one, that can now be examined with aheadReady(),
+	 * aheadRdid() and aheadBufa().  nextReadPair() will dish out the
+	 * parsed-ahead reads later without parsing them again.
+	 */
+	size_t lookahead(size_t n);
+
+	/**
+	 * Return true iff the i-th read from the current one was
+	 * successfully parsed, either by nextReadPair() (i = 0) or by
+	 * lookahead().
+	 */
+	bool aheadReady(size_t i) const {
+		return i == 0 || ahead_[buf_.cur_buf_ + i] == AHEAD_OK;
+	}
+
+	/// Return read id of the i-th read from the current one
+	TReadId aheadRdid(size_t i) const { return buf_.rdid() + i; }
+
+	/// Return mate 1 of the i-th read from the current one
+	Read& aheadBufa(size_t i) { return buf_.bufa_[buf_.cur_buf_ + i]; }
+
 	/**
 	 * Return true iff the read currently in the buffer is a
 	 * paired-end read.
@@ -1005,6 +1264,7 @@ private:
 		buf_.reset();
 		std::pair<bool, int> res = composer_.nextBatch(buf_);
 		buf_.init();
+		ahead_end_ = 0;
 		batch_id_ = (size_t)(buf_.rdid()/buf_.max_buf_);
 		return res;
 	}
@@ -1031,13 +1291,24 @@ private:
 		return composer_.parse(ra, rb, buf_.rdid());
 	}
 
+	/// What lookahead() found for a read in the buffer
+	enum {
+		AHEAD_SKIPPED = 0, // rdid below skip_; not parsed
+		AHEAD_FAILED,      // parse failed
+		AHEAD_OK           // parsed and finalized
+	};
+
 	PatternComposer& composer_; // pattern composer
 	PerThreadReadBuf buf_;    // read data buffer
 	bool last_batch_;         // true if this is final batch
 	size_t last_batch_size_;  // # reads read in previous batch
 	uint32_t skip_;           // skip reads with rdids less than this
 	uint32_t seed_;           // pseudo-random seed based on read content
+	bool seedQuals_;          // per-read seeds depend on qualities
+	bool seedName_;           // per-read seeds depend on read name
 	size_t batch_id_;	  // identify batches of reads for reordering
+	size_t ahead_end_;        // slots before this were handled by lookahead()
+	EList<uint8_t> ahead_;    // per-slot AHEAD_* status set by lookahead()
 };
 
 /**
@@ -1049,17 +1320,21 @@ public:
 		PatternComposer& composer,
 		uint32_t max_buf,
 		uint32_t skip,
-		uint32_t seed):
+		uint32_t seed,
+		bool seedQuals = true,
+		bool seedName = true):
 		composer_(composer),
 		max_buf_(max_buf),
 		skip_(skip),
-		seed_(seed) {}
+		seed_(seed),
+		seedQuals_(seedQuals),
+		seedName_(seedName) {}
 
 	/**
 	 * Create a new heap-allocated PatternSourcePerThreads.
 	 */
 	virtual PatternSourcePerThread* create() const {
-		return new PatternSourcePerThread(composer_, max_buf_, skip_, seed_);
+		return new PatternSourcePerThread(composer_, max_buf_, skip_, seed_, seedQuals_, seedName_);
 	}
 
 	/**
@@ -1069,7 +1344,7 @@ public:
 	virtual EList<PatternSourcePerThread*>* create(uint32_t n) const {
 		EList<PatternSourcePerThread*>* v = new EList<PatternSourcePerThread*>;
 		for(size_t i = 0; i < n; i++) {
-			v->push_back(new PatternSourcePerThread(composer_, max_buf_, skip_, seed_));
+			v->push_back(new PatternSourcePerThread(composer_, max_buf_, skip_, seed_, seedQuals_, seedName_));
 			assert(v->back() != NULL);
 		}
 		return v;
@@ -1105,6 +1380,8 @@ private:
 	uint32_t max_buf_;
 	uint32_t skip_;
 	uint32_t seed_;
+	bool seedQuals_; // per-read seeds depend on qualities
+	bool seedName_;  // per-read seeds depend on read name
 };
 
 #endif /*PAT_H_*/
@@ -5,10 +5,12 @@
 #ifndef POOL_H_
 #define POOL_H_
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 #include "bitset.h"
 #include "ds.h"
@@ -16,113 +18,144 @@
 #include "read.h"
 #include "search_globals.h"
 
+/**
+ * Usage statistics for one or more ChunkPools, gathered per read.
+ */
+struct ChunkPoolStats {
+
+	ChunkPoolStats() { reset(); }
+
+	void reset() {
+		reads = grownReads = peakBytes = slabAllocs = exhaustedReads = 0;
+	}
+
+	/**
+	 * Fold another set of statistics into this one.
+	 */
+	void merge(const ChunkPoolStats& o) {
+		reads += o.reads;
+		grownReads += o.grownReads;
+		peakBytes = std::max(peakBytes, o.peakBytes);
+		slabAllocs += o.slabAllocs;
+		exhaustedReads += o.exhaustedReads;
+	}
+
+	uint64_t reads;          /// reads that used the pool
+	uint64_t grownReads;     /// reads that needed more than the retained slabs
+	uint64_t peakBytes;      /// largest footprint of any single read
+	uint64_t slabAllocs;     /// slabs allocated on demand
+	uint64_t exhaustedReads; /// reads skipped because the hard cap was hit
+};
+
 /**
  * Very simple allocator for fixed-size chunks of memory.  Chunk size
- * is set at construction time.  Heap memory is only allocated at
- * construction and deallocated at destruction.
+ * is set at construction time.  Chunks are carved out of slabs that
+ * are allocated on demand; slabs up to 'totSz' bytes are retained
+ * across reads, and slabs beyond that are released by reset() after
+ * the outlier read that needed them.  A read is only abandoned if the
+ * pool would have to grow past 'maxSz' bytes (0 = no limit).
  */
 class ChunkPool {
 public:
 	/**
-	 * Initialize a new pool with an initial size of about 'bytes'
-	 * bytes.  Exit with an error message if we can't allocate it.
+	 * Initialize a new pool that retains about 'totSz' bytes and may
+	 * grow to 'maxSz' bytes.  No memory is allocated until the first
+	 * chunk is requested.
 	 */
-	ChunkPool(uint32_t chunkSz, uint32_t totSz, bool verbose_) :
-		verbose(verbose_), patid(0), pool_(NULL), cur_(0),
-		chunkSz_(chunkSz), totSz_(totSz), lim_(totSz/chunkSz),
-		bits_(lim_), exhaustCrash_(false),
+	ChunkPool(uint32_t chunkSz, uint32_t totSz, bool verbose_, uint64_t maxSz = 0) :
+		verbose(verbose_), patid(0), next_(0), inUse_(0), readPeak_(0),
+		chunkSz_(chunkSz), totSz_(totSz),
+		slabChunks_(std::max<uint32_t>(1, std::min<uint32_t>(totSz / chunkSz, 16))),
+		retainSlabs_(std::max<uint32_t>(1, (totSz / chunkSz) / slabChunks_)),
+		maxSlabs_(maxSz == 0 ? 0 : (size_t)std::max<uint64_t>(retainSlabs_, maxSz / ((uint64_t)chunkSz * slabChunks_))),
+		exhaustCrash_(false),
 		lastSkippedRead_(0xffffffff), readName_(NULL)
 	{
-		assert_gt(lim_, 0);
-		try {
-			if((pool_ = new int8_t[totSz_]) == NULL) {
-				throw std::bad_alloc();
-			}
-		} catch(std::bad_alloc& e) {
-			ThreadSafe _ts(&gLock);
-			std::cerr << "Error: Could not allocate ChunkPool of "
-			          << totSz << " bytes" << std::endl;
-			exhausted();
-			throw 1; // Exit if we haven't already
-		}
+		assert_gt(chunkSz_, 0);
+		assert_geq(totSz_, chunkSz_);
 	}
 
 	/**
-	 * Delete all the pools.
+	 * Delete all the slabs.
 	 */
 	~ChunkPool() {
-		if(pool_ != NULL) delete[] pool_;
+		for(size_t i = 0; i < slabs_.size(); i++) {
+			delete[] slabs_[i];
+		}
 	}
 
 	/**
-	 * Reset the pool, freeing all arrays that had been given out.
+	 * Reset the pool, freeing all chunks that had been given out and
+	 * releasing any slabs beyond the retained amount.
 	 */
 	void reset(BTString* name, uint32_t patid_) {
+		flushStats();
+		while(slabs_.size() > retainSlabs_) {
+			delete[] slabs_.back();
+			slabs_.pop_back();
+		}
 		patid = patid_;
 		readName_ = name;
-		cur_ = 0;
-		bits_.clear();
-		assert_eq(0, bits_.test(0));
+		next_ = 0;
+		inUse_ = 0;
+		readPeak_ = 0;
+		free_.clear();
 	}
 
 	/**
-	 * Return our current position.
+	 * Return the number of chunks currently handed out.
 	 */
 	uint32_t pos() {
-		return cur_;
+		return inUse_;
 	}
 
 	/**
-	 * Return our current position.
+	 * Return the number of chunks that can be handed out without
+	 * allocating another slab.
 	 */
 	uint32_t remaining() {
-		assert_geq(lim_, cur_);
-		return lim_ - cur_;
+		return (uint32_t)(free_.size() + slabs_.size() * slabChunks_ - next_);
 	}
 
 	/**
-	 * Allocate a single T from the pool.
+	 * Allocate a single chunk from the pool, growing it by a slab if
+	 * all of the current slabs are in use.  Returns NULL iff the pool
+	 * can't grow any further.
 	 */
 	void* alloc() {
-		assert_lt(cur_, lim_);
-		uint32_t cur = cur_;
-		while(bits_.test(cur)) {
-			cur++;
-			if(cur >= lim_) {
-				cur = 0;
-			}
-			if(cur == cur_) {
-				// Wrapped all the way around without finding a free
-				// chunk
+		int8_t *ptr;
+		if(!free_.empty()) {
+			ptr = free_.back();
+			free_.pop_back();
+		} else {
+			if(next_ == slabs_.size() * slabChunks_ && !grow()) {
 				return NULL;
 			}
+			ptr = slabs_[next_ / slabChunks_] + (next_ % slabChunks_) * chunkSz_;
+			next_++;
 		}
-		void * ptr = (void *)(&pool_[cur * chunkSz_]);
-		assert(!bits_.test(cur));
-		bits_.set(cur);
-		assert(bits_.test(cur));
+		inUse_++;
+		if(inUse_ > readPeak_) readPeak_ = inUse_;
 		if(verbose) {
 			stringstream ss;
-			ss << patid << ": Allocating chunk with offset: " << cur;
+			ss << patid << ": Allocating chunk " << (void*)ptr << " (" << inUse_ << " in use)";
 			glog.msg(ss.str());
 		}
-		cur_ = cur;
-		return ptr;
+		return (void*)ptr;
 	}
 
 	/**
-	 *
+	 * Return a chunk to the pool.
 	 */
 	void free(void *ptr) {
-		uint32_t off = (uint32_t)((int8_t*)ptr - pool_);
-		assert_eq(0, off % chunkSz_);
-		off /= chunkSz_;
+		assert_gt(inUse_, 0);
 		if(verbose) {
 			stringstream ss;
-			ss << patid << ": Freeing chunk with offset: " << cur_;
+			ss << patid << ": Freeing chunk " << ptr;
 			glog.msg(ss.str());
 		}
-		bits_.clear(off);
+		free_.push_back((int8_t*)ptr);
+		inUse_--;
 	}
 
 	/**
@@ -139,12 +172,21 @@ public:
 		return totSz_;
 	}
 
+	/**
+	 * Return statistics gathered so far, including the current read.
+	 */
+	const ChunkPoolStats& stats() {
+		flushStats();
+		return stats_;
+	}
+
 	/**
 	 * Utility function to call when memory has been exhausted.
 	 * Currently just prints a friendly message and quits.
 	 */
 	void exhausted() {
 		if(patid != lastSkippedRead_) {
+			stats_.exhaustedReads++;
 			if(!exhaustCrash_ && !quiet) std::cerr << "Warning: ";
 			if(!quiet) {
 				std::cerr << "Exhausted best-first chunk memory for read "
@@ -153,7 +195,7 @@ public:
 			}
 			if(exhaustCrash_) {
 				if(!quiet) {
-					std::cerr << "Please try specifying a larger --chunkmbs <int> (default is 32)" << std::endl;
+					std::cerr << "Please try specifying a larger --chunkmbs-max <int>" << std::endl;
 				}
 				throw 1;
 			}
@@ -166,12 +208,47 @@ public:
 
 protected:
 
-	int8_t*  pool_; /// the memory pools
-	uint32_t cur_;  /// index of next free element of pool_
+	/**
+	 * Add another slab of chunks.  Returns false if the pool is
+	 * already at its hard cap or the allocation fails.
+	 */
+	bool grow() {
+		if(maxSlabs_ > 0 && slabs_.size() >= maxSlabs_) {
+			return false;
+		}
+		int8_t *slab;
+		try {
+			slab = new int8_t[(size_t)chunkSz_ * slabChunks_];
+		} catch(std::bad_alloc& e) {
+			return false;
+		}
+		slabs_.push_back(slab);
+		stats_.slabAllocs++;
+		return true;
+	}
+
+	/**
+	 * Fold the current read's footprint into the statistics.
+	 */
+	void flushStats() {
+		if(readPeak_ == 0) return;
+		stats_.reads++;
+		if(slabs_.size() > retainSlabs_) stats_.grownReads++;
+		stats_.peakBytes = std::max<uint64_t>(stats_.peakBytes, (uint64_t)readPeak_ * chunkSz_);
+		readPeak_ = 0;
+	}
+
+	std::vector<int8_t*> slabs_; /// slabs of slabChunks_ chunks each
+	std::vector<int8_t*> free_;  /// chunks handed back by free()
+	size_t   next_;      /// next never-used chunk, counting across slabs_
+	uint32_t inUse_;     /// chunks currently handed out
+	uint32_t readPeak_;  /// most chunks in use at once for this read
 	const uint32_t chunkSz_;
 	const uint32_t totSz_;
-	uint32_t lim_;  /// # elements held in pool_
-	FixedBitset2 bits_;
+	const uint32_t slabChunks_;  /// chunks per slab
+	const size_t   retainSlabs_; /// slabs kept across reads
+	const size_t   maxSlabs_;    /// hard cap on slabs; 0 = none
+	ChunkPoolStats stats_;
 	bool exhaustCrash_; /// abort hard when memory's exhausted?
 	uint32_t lastSkippedRead_;
 	BTString* readName_;
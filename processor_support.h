@@ -60,6 +60,56 @@ public:
     return true;
     }
 
+    // AVX2 requires CPUID.07H:EBX.AVX2[bit 5] plus OS support for
+    // saving the YMM state (OSXSAVE and XCR0 bits 1 and 2).
+    bool AVX2enabled()
+    {
+#if defined(USING_GCC_COMPILER) && (defined(__x86_64__) || defined(__i386__))
+        regs_t regs;
+        if(!OSsupportsXState(0x6)) return false;
+        if(__get_cpuid_max(0, 0) < 7) return false;
+        __cpuid_count(7, 0, regs.EAX, regs.EBX, regs.ECX, regs.EDX);
+        return (regs.EBX & BIT(5)) != 0;
+#else
+        return false;
+#endif
+    }
+
+    // The AVX-512 occurrence-counting kernel needs AVX512F
+    // (CPUID.07H:EBX[bit 16]), AVX512BW (EBX[bit 30]) and
+    // AVX512_VPOPCNTDQ (ECX[bit 14]), plus OS support for the opmask
+    // and ZMM state (XCR0 bits 5, 6 and 7).
+    bool AVX512enabled()
+    {
+#if defined(USING_GCC_COMPILER) && (defined(__x86_64__) || defined(__i386__))
+        regs_t regs;
+        if(!OSsupportsXState(0xe6)) return false;
+        if(__get_cpuid_max(0, 0) < 7) return false;
+        __cpuid_count(7, 0, regs.EAX, regs.EBX, regs.ECX, regs.EDX);
+        return (regs.EBX & BIT(16)) && (regs.EBX & BIT(30)) && (regs.ECX & BIT(14));
+#else
+        return false;
+#endif
+    }
+
+private:
+
+    // True iff the OS has enabled XSAVE and all of the XCR0 state
+    // components in 'mask'.
+    bool OSsupportsXState(unsigned int mask)
+    {
+#if defined(USING_GCC_COMPILER) && (defined(__x86_64__) || defined(__i386__))
+        regs_t regs;
+        if(!__get_cpuid(0x1, &regs.EAX, &regs.EBX, &regs.ECX, &regs.EDX)) return false;
+        if(!(regs.ECX & BIT(27))) return false; // OSXSAVE
+        unsigned int xcr0Lo, xcr0Hi;
+        __asm__ __volatile__ ("xgetbv" : "=a"(xcr0Lo), "=d"(xcr0Hi) : "c"(0));
+        return (xcr0Lo & mask) == mask;
+#else
+        return false;
+#endif
+    }
+
 #endif // POPCNT_CAPABILITY
 };
 
@@ -18,12 +18,20 @@
  * A class that statefully processes a range by picking one row
  * randomly and then linearly scanning forward through the range,
  * reporting reference offsets as we go.
+ *
+ * Rows are resolved a batch at a time: rows found in the shared
+ * RangeCache are taken from there, and the rest are walked together
+ * by Ebwt::resolveRows().  Batches start at one row and double up to
+ * MAX_BATCH, so a read that only wants one or two alignments from a
+ * range doesn't pay for resolving all of it.
  */
 class RangeChaser {
 
 	typedef std::pair<TIndexOffU,TIndexOffU> UPair;
 	typedef EList<UPair> UPairVec;
 
+	enum { MAX_BATCH = 64 };
+
 public:
 	RangeChaser(uint32_t cacheThresh,
 	            RangeCache* cacheFw, RangeCache* cacheBw,
@@ -36,18 +44,25 @@ public:
 		bot_(OFF_MASK),
 		irow_(OFF_MASK),
 		row_(OFF_MASK),
+		left_(0),
+		batch_(1),
+		bufPos_(0),
 		off_(make_pair(OFF_MASK, 0)),
 		tlen_(0),
-		chaser_(metrics),
-		cached_(false),
+		cache_(NULL),
 		cacheFw_(cacheFw), cacheBw_(cacheBw),
 		metrics_(metrics)
 		{ }
 
-	~RangeChaser() { }
+	~RangeChaser() {
+		if(cacheFw_ != NULL) cacheFw_->flush(statsFw_);
+		if(cacheBw_ != NULL) cacheBw_->flush(statsBw_);
+	}
 
 	/**
-	 * Set the row to chase
+	 * Look for an offset starting at row_, moving on to subsequent
+	 * rows until one yields a valid reference offset or the range is
+	 * exhausted.
 	 */
 	void setRow(TIndexOffU row) {
 		// Must be within bounds of range
@@ -55,68 +70,32 @@ public:
 		assert_geq(row, top_);
 		row_ = row;
 		while(true) {
-			// First thing to try is the cache
-			if(cached_) {
-				assert(cacheEnt_.valid());
-				TIndexOffU cached = cacheEnt_.get(row_ - top_);
-				assert(cacheEnt_.valid());
-				if(cached != RANGE_NOT_SET) {
-					// Assert that it matches what we would have got...
-					ASSERT_ONLY(uint32_t sanity = RowChaser::toFlatRefOff(ebwt_, 1, row_));
-					assert_eq(sanity, cached);
-					// We have a cached result.  Cached result is in the
-					// form of an offset into the joined reference string,
-					// so now we have to convert it to a tidx/toff pair.
-					ebwt_->joinedToTextOff(qlen_, cached, off_.first, off_.second, tlen_);
-					// Note: tidx may be 0xffffffff, if alignment overlaps a
-					// reference boundary
-					if(off_.first != OFF_MASK) {
-						// Bingo, we found a valid result using the cache
-						assert(foundOff());
-						return;
-					}
-				} else {
-					// Wasn't in the cache; use the RowChaser
-				}
+			if(bufPos_ == bufRows_.size()) {
+				fill();
 			}
-			// Second thing to try is the chaser
-			chaser_.setRow(row_, qlen_, ebwt_);
-			assert(chaser_.prepped_ || chaser_.done);
-			// It might be done immediately...
-			if(chaser_.done) {
-				// We're done immediately
-				off_ = chaser_.off();
-				if(off_.first != OFF_MASK) {
-					// This is a valid result
-					if(cached_) {
-						// Install the result in the cache
-						assert(cacheEnt_.valid());
-						cacheEnt_.install(row_ - top_, chaser_.flatOff());
-						//if(ebwt_->fw()) assert(cacheFw_->repOk());
-						//else            assert(cacheBw_->repOk());
-					}
-					tlen_ = chaser_.tlen();
-					assert(foundOff());
-					return; // found result
-				}
-			} else {
-				// Pursue this row
-				break;
+			assert_lt(bufPos_, bufRows_.size());
+			assert_eq(row_, bufRows_[bufPos_]);
+			TIndexOffU flat = bufOffs_[bufPos_++];
+			assert_gt(left_, 0);
+			left_--;
+			// Result is in the form of an offset into the joined
+			// reference string, so now we have to convert it to a
+			// tidx/toff pair.
+			ebwt_->joinedToTextOff(qlen_, flat, off_.first, off_.second, tlen_);
+			// Note: tidx may be 0xffffffff, if alignment overlaps a
+			// reference boundary
+			if(off_.first != OFF_MASK) {
+				assert(foundOff());
+				return; // found result
 			}
 			// That row didn't have a valid result, move to the next
-			row_++;
-			if(row_ == bot_) {
-				// Wrap back to top_
-				row_ = top_;
-			}
-			if(row_ == irow_) {
+			if(!nextRow()) {
 				// Exhausted all possible rows
 				done = true;
 				assert_eq(OFF_MASK, off_.first);
 				return;
 			}
 		}
-		assert(chaser_.prepped_);
 	}
 
 	/**
@@ -141,76 +120,48 @@ public:
 			TIndexOffU spread = bot - top;
 			irow_ = top + (rand.nextU32() % spread); // initial row
 			done = false;
-			cached_ = false;
+			left_ = spread;
+			batch_ = 1;
+			bufRows_.clear();
+			bufOffs_.clear();
+			bufPos_ = 0;
 			reset();
-			if(cacheFw_ != NULL || cacheBw_ != NULL) {
-				if(spread > cacheThresh_) {
-					bool ret = false;
-					if(ebwt->fw() && cacheFw_ != NULL) {
-						ret = cacheFw_->lookup(top, bot, cacheEnt_);
-						if(ret) assert(cacheEnt_.ebwt()->fw());
-					} else if(!ebwt->fw() && cacheBw_ != NULL) {
-						ret = cacheBw_->lookup(top, bot, cacheEnt_);
-						if(ret) assert(!cacheEnt_.ebwt()->fw());
-					} else {
-						cacheEnt_.reset();
-					}
-					assert_eq(cacheEnt_.valid(), ret);
-					cached_ = ret;
+			// Only rows of ranges wider than the threshold (i.e. of
+			// repetitive alignments) go through the shared cache
+			cache_ = NULL;
+			if(spread > cacheThresh_) {
+				if(ebwt->fw()) {
+					cache_ = cacheFw_;
+					cacheStats_ = &statsFw_;
 				} else {
-					cacheEnt_.reset();
+					cache_ = cacheBw_;
+					cacheStats_ = &statsBw_;
 				}
 			}
 			setRow(irow_);
-			assert(chaser_.prepped_ || foundOff() || done);
+			assert(foundOff() || done);
 		}
 
 	/**
-	 * Advance the step-left process by one step.  Check if we're done.
+	 * Move on to the next row in the range and look for an offset
+	 * there.  Check if we're done.
 	 */
 	void advance() {
 		assert(!done);
-		assert(chaser_.prepped_ || chaser_.done);
 		reset();
-		if(chaser_.done) {
-			// chaser finished with this row
-			row_++;
-			if(row_ == bot_) {
-				row_ = top_;
-			}
-			if(row_ == irow_) {
-				// Exhausted all possible rows
-				done = true;
-				assert_eq(OFF_MASK, off_.first);
-				return;
-			}
-			setRow(row_);
-			assert(chaser_.prepped_ || foundOff() || done);
-		} else {
-			chaser_.advance();
-			assert(chaser_.prepped_ || chaser_.done);
-			if(chaser_.done) {
-				// We're done immediately
-				off_ = chaser_.off();
-				if(off_.first != OFF_MASK) {
-					if(cached_) {
-						// Install the result in the cache
-						assert(cacheEnt_.valid());
-						cacheEnt_.install(row_ - top_, chaser_.flatOff());
-						//if(ebwt_->fw()) assert(cacheFw_->repOk());
-						//else            assert(cacheBw_->repOk());
-					}
-					// Found a reference position
-					tlen_ = chaser_.tlen();
-					assert(foundOff());
-				}
-			}
+		if(!nextRow()) {
+			// Exhausted all possible rows
+			done = true;
+			assert_eq(OFF_MASK, off_.first);
+			return;
 		}
+		setRow(row_);
+		assert(foundOff() || done);
 	}
 
 	/**
 	 * Prepare for the next call to advance() by prefetching relevant
-	 * data.  In this case, 'chaser_' is doing this for us.
+	 * data.  Prefetching happens inside Ebwt::resolveRows().
 	 */
 	void prep() {
 		// nothing
@@ -250,6 +201,64 @@ public:
 
 protected:
 
+	/**
+	 * Advance row_, wrapping from bot_ back to top_.  Return false if
+	 * every row of the range has been visited.
+	 */
+	bool nextRow() {
+		if(left_ == 0) return false;
+		row_++;
+		if(row_ == bot_) {
+			// Wrap back to top_
+			row_ = top_;
+		}
+		assert_neq(row_, irow_);
+		return true;
+	}
+
+	/**
+	 * Resolve the next batch of rows, starting at row_, into bufOffs_.
+	 */
+	void fill() {
+		assert_gt(left_, 0);
+		TIndexOffU nb = min<TIndexOffU>(batch_, left_);
+		batch_ = min<TIndexOffU>(batch_ << 1, (TIndexOffU)MAX_BATCH);
+		bufRows_.resize(nb);
+		bufOffs_.resize(nb);
+		missIdx_.clear();
+		missRows_.clear();
+		TIndexOffU r = row_;
+		for(TIndexOffU i = 0; i < nb; i++) {
+			bufRows_[i] = r;
+			bufOffs_[i] = RANGE_NOT_SET;
+			if(cache_ != NULL) {
+				bufOffs_[i] = cache_->lookup(r, *cacheStats_);
+			}
+			if(bufOffs_[i] == RANGE_NOT_SET) {
+				missIdx_.push_back(i);
+				missRows_.push_back(r);
+			} else {
+				// Assert that it matches what we would have got...
+				assert_eq(RowChaser::toFlatRefOff(ebwt_, 1, r), bufOffs_[i]);
+			}
+			if(++r == bot_) r = top_;
+		}
+		if(!missRows_.empty()) {
+			missOffs_.resize(missRows_.size());
+			uint64_t steps = ebwt_->resolveRows(missRows_.ptr(), missRows_.size(), missOffs_.ptr());
+			if(metrics_ != NULL) metrics_->curBwtOps_ += steps;
+			for(size_t i = 0; i < missIdx_.size(); i++) {
+				bufOffs_[missIdx_[i]] = missOffs_[i];
+				TIndexOffU mr = missRows_[i], idx;
+				if(cache_ != NULL && mr != ebwt_->zOff() && !ebwt_->sampledRow(mr, idx)) {
+					// Row needed a walk; install the result in the cache
+					cache_->insert(mr, missOffs_[i], *cacheStats_);
+				}
+			}
+		}
+		bufPos_ = 0;
+	}
+
 	const Ebwt* ebwt_;    /// index to resolve row in
 	TIndexOffU qlen_;        /// length of read; needed to convert to ref. coordinates
 	uint32_t cacheThresh_; /// ranges wider than thresh use cacheing
@@ -257,13 +266,22 @@ protected:
 	TIndexOffU bot_;         /// range bottom
 	TIndexOffU irow_;        /// initial randomly-chosen row within range
 	TIndexOffU row_;         /// current row within range
+	TIndexOffU left_;        /// rows of the range not yet consumed
+	TIndexOffU batch_;       /// size of the next batch
+	EList<TIndexOffU> bufRows_;  /// rows of the current batch
+	EList<TIndexOffU> bufOffs_;  /// their joined-reference offsets
+	size_t bufPos_;          /// next element of bufRows_ to consume
+	EList<size_t> missIdx_;      /// batch elements that missed the cache
+	EList<TIndexOffU> missRows_; /// their rows...
+	EList<TIndexOffU> missOffs_; /// ...and resolved offsets
 	UPair off_;          /// calculated offset (OFF_MASK if not done)
 	TIndexOffU tlen_;        /// length of text hit
-	RowChaser chaser_;    /// stateful row chaser
-	RangeCacheEntry cacheEnt_; /// current cache entry
-	bool cached_;          /// cacheEnt is active for current range?
-	RangeCache* cacheFw_; /// cache for the forward index
-	RangeCache* cacheBw_; /// cache for the backward index
+	RangeCache* cache_;   /// cache for the current range, if any
+	RangeCache::Stats* cacheStats_; /// counts for cache_
+	RangeCache* cacheFw_; /// shared cache for the forward index
+	RangeCache* cacheBw_; /// shared cache for the backward index
+	RangeCache::Stats statsFw_; /// this chaser's counts for cacheFw_
+	RangeCache::Stats statsBw_; /// this chaser's counts for cacheBw_
 	AlignerMetrics *metrics_;
 };
 
@@ -943,11 +943,12 @@ public:
 	 * SideLocus information and prefetching cache lines from the
 	 * appropriate loci.
 	 */
+	template<int L>
 	void prep(const EbwtParams& ep, const uint8_t* ebwt) {
 		if(bot_ > top_+1) {
-			SideLocus::initFromTopBot(top_, bot_, ep, ebwt, ltop_, lbot_);
+			SideLocus::initFromTopBot<L>(top_, bot_, ep, ebwt, ltop_, lbot_);
 		} else if(bot_ > top_) {
-			ltop_.initFromRow(top_, ep, ebwt);
+			ltop_.initFromRow<L>(top_, ep, ebwt);
 			lbot_.invalidate();
 		}
 		prepped_ = true;
@@ -1145,23 +1146,38 @@ public:
  * A priority queue for Branch objects; makes it easy to process
  * branches in a best-first manner by prioritizing branches with lower
  * cumulative costs over branches with higher cumulative costs.
+ *
+ * Branch costs are small integers (2-bit stratum over a 14-bit
+ * quality-weighted hamming distance), and a Branch is never pushed with
+ * a cost lower than that of the current front, so the queue is a
+ * monotone bucket queue: one bucket per cost, per-stratum bitmaps of
+ * non-empty buckets, and a cursor that only advances until reset().
+ * Branches within a bucket are ordered by the CostCompare tie-breakers
+ * (extendable first, then deeper, then lower id).
+ *
+ * The front Branch is held outside of the buckets because the
+ * PathManager extends, curtails and retires it in place; popping it is
+ * O(1) and it is only compared again when a new Branch is pushed.
  */
 class BranchQueue {
 
 	typedef std::pair<int, int> TIntPair;
-	typedef std::priority_queue<Branch*, std::vector<Branch*>, CostCompare> TBranchQueue;
+	typedef std::vector<Branch*> TBucket;
 
 public:
 
 	BranchQueue(bool verbose, bool quiet) :
-		sz_(0), branchQ_(), patid_(0), verbose_(verbose), quiet_(quiet)
-	{ }
+		sz_(0), front_(NULL), curStratum_(0), curHam_(0),
+		patid_(0), verbose_(verbose), quiet_(quiet)
+	{
+		cnt_[0] = cnt_[1] = cnt_[2] = cnt_[3] = 0;
+	}
 
 	/**
 	 * Return the front (highest-priority) element of the queue.
 	 */
 	Branch *front() {
-		Branch *b = branchQ_.top();
+		Branch *b = top();
 		if(verbose_) {
 			stringstream ss;
 			ss << patid_ << ": Fronting " << b->id_ << ", " << b << ", " << b->cost_ << ", " << b->exhausted_ << ", " << b->curtailed_ << ", " << sz_ << "->" << (sz_-1);
@@ -1175,8 +1191,8 @@ public:
 	 * queue.
 	 */
 	Branch *pop() {
-		Branch *b = branchQ_.top(); // get it
-		branchQ_.pop(); // remove it
+		Branch *b = top(); // get it
+		front_ = NULL;     // remove it
 		if(verbose_) {
 			stringstream ss;
 			ss << patid_ << ": Popping " << b->id_ << ", " << b << ", " << b->cost_ << ", " << b->exhausted_ << ", " << b->curtailed_ << ", " << sz_ << "->" << (sz_-1);
@@ -1190,28 +1206,45 @@ public:
 	 * Insert a new Branch into the sorted priority queue.
 	 */
 	void push(Branch *b) {
-#ifndef NDEBUG
-		bool bIsBetter = empty() || !CostCompare()(b, branchQ_.top());
-#endif
 		if(verbose_) {
 			stringstream ss;
 			ss << patid_ << ": Pushing " << b->id_ << ", " << b << ", " << b->cost_ << ", " << b->exhausted_ << ", " << b->curtailed_ << ", " << sz_ << "->" << (sz_+1);
 			glog.msg(ss.str());
 		}
-		branchQ_.push(b);
-#ifndef NDEBUG
-		assert(bIsBetter  || branchQ_.top() != b || CostCompare::equal(branchQ_.top(), b));
-		assert(!bIsBetter || branchQ_.top() == b || CostCompare::equal(branchQ_.top(), b));
-#endif
+		if(sz_ > 0) {
+			Branch *f = top();
+			if(CostCompare()(f, b)) {
+				// b displaces the current front
+				bury(f);
+				front_ = b;
+			} else {
+				bury(b);
+			}
+		} else {
+			front_ = b;
+		}
 		sz_++;
 	}
 
 	/**
-	 * Empty the priority queue and reset the count.
+	 * Empty the priority queue and reset the count.  Bucket storage is
+	 * kept for the next read.
 	 */
 	void reset(uint32_t patid) {
 		patid_ = patid;
-		branchQ_ = TBranchQueue();
+		for(int s = 0; s < 4; s++) {
+			if(cnt_[s] == 0) continue;
+			for(size_t w = 0; w < occ_[s].size(); w++) {
+				while(occ_[s][w] != 0) {
+					size_t h = (w << 6) + ctz64(occ_[s][w]);
+					buckets_[s][h].clear();
+					occ_[s][w] &= occ_[s][w] - 1;
+				}
+			}
+			cnt_[s] = 0;
+		}
+		front_ = NULL;
+		curStratum_ = curHam_ = 0;
 		sz_ = 0;
 	}
 
@@ -1219,9 +1252,8 @@ public:
 	 * Return true iff the priority queue of branches is empty.
 	 */
 	bool empty() const {
-		bool ret = branchQ_.empty();
-		assert(ret || sz_ > 0);
-		assert(!ret || sz_ == 0);
+		bool ret = (sz_ == 0);
+		assert(ret || front_ != NULL || cnt_[0] + cnt_[1] + cnt_[2] + cnt_[3] > 0);
 		return ret;
 	}
 
@@ -1238,9 +1270,10 @@ public:
 	 */
 	bool repOk(std::set<Branch*>& bset) {
 		TIntPair pair = bestStratumAndHam(bset);
-		Branch *b = branchQ_.top();
+		Branch *b = top();
 		assert_eq(pair.first, (b->cost_ >> 14));
 		assert_eq(pair.second, (b->cost_ & ~0xc000));
+		assert_eq(bset.size(), sz_);
 		std::set<Branch*>::iterator it;
 		for(it = bset.begin(); it != bset.end(); it++) {
 			assert_gt((*it)->depth3_, 0);
@@ -1251,6 +1284,67 @@ public:
 
 protected:
 
+	static inline int ctz64(uint64_t x) {
+		assert_neq(0, x);
+		return __builtin_ctzll(x);
+	}
+
+	/**
+	 * Return the front Branch, first moving the best buried Branch
+	 * into the front slot if there isn't one.
+	 */
+	Branch *top() {
+		assert_gt(sz_, 0);
+		if(front_ != NULL) return front_;
+		// Advance the cursor to the lowest non-empty bucket
+		while(cnt_[curStratum_] == 0) {
+			curStratum_++;
+			curHam_ = 0;
+			assert_lt(curStratum_, 4);
+		}
+		std::vector<uint64_t>& occ = occ_[curStratum_];
+		size_t w = curHam_ >> 6;
+		uint64_t bits = occ[w] & (~0llu << (curHam_ & 63));
+		while(bits == 0) {
+			bits = occ[++w];
+		}
+		curHam_ = (uint32_t)((w << 6) + ctz64(bits));
+		TBucket& bk = buckets_[curStratum_][curHam_];
+		assert(!bk.empty());
+		std::pop_heap(bk.begin(), bk.end(), CostCompare());
+		front_ = bk.back();
+		bk.pop_back();
+		if(bk.empty()) {
+			occ[w] &= ~(1llu << (curHam_ & 63));
+		}
+		cnt_[curStratum_]--;
+		return front_;
+	}
+
+	/**
+	 * Put a Branch that isn't the front into the bucket for its cost.
+	 */
+	void bury(Branch *b) {
+		uint32_t s = b->cost_ >> 14;
+		uint32_t h = b->cost_ & ~0xc000;
+		assert_lt(s, 4);
+		// Costs never go below the cursor, but move it back if one does
+		if(s < curStratum_ || (s == curStratum_ && h < curHam_)) {
+			curStratum_ = s;
+			curHam_ = h;
+		}
+		if(h >= buckets_[s].size()) {
+			size_t nsz = max<size_t>(((h >> 6) + 1) << 6, buckets_[s].size() * 2);
+			buckets_[s].resize(nsz);
+			occ_[s].resize(nsz >> 6, 0);
+		}
+		TBucket& bk = buckets_[s][h];
+		bk.push_back(b);
+		std::push_heap(bk.begin(), bk.end(), CostCompare());
+		occ_[s][h >> 6] |= (1llu << (h & 63));
+		cnt_[s]++;
+	}
+
 #ifndef NDEBUG
 	/**
 	 * Return the stratum and quality-weight (sum of qualities of all
@@ -1276,7 +1370,12 @@ protected:
 #endif
 
 	uint32_t sz_;
-	TBranchQueue branchQ_; // priority queue of branches
+	Branch *front_;                        // front branch; not in a bucket
+	std::vector<TBucket> buckets_[4];      // per stratum, indexed by ham
+	std::vector<uint64_t> occ_[4];         // non-empty buckets per stratum
+	uint32_t cnt_[4];                      // buried branches per stratum
+	uint32_t curStratum_;                  // cursor: no buried branch
+	uint32_t curHam_;                      // costs less than this
 	uint32_t patid_;
 	bool verbose_;
 	bool quiet_;
@@ -1349,8 +1448,9 @@ public:
 			assert(b != newtop);
 		}
 #endif
-		// Update this PathManager's cost
-		minCost = branchQ_.front()->cost_;
+		// Update this PathManager's cost; an emptied queue keeps the
+		// cost of the last branch popped
+		minCost = branchQ_.empty() ? b->cost_ : branchQ_.front()->cost_;
 		assert(repOk());
 		return b;
 	}
@@ -1455,8 +1555,10 @@ public:
 
 	/**
 	 * If the frontmost branch is a curtailed branch, split off an
-	 * extendable branch and add it to the queue.
+	 * extendable branch and add it to the queue.  L is the LF
+	 * variant (see EBWT_LF).
 	 */
+	template<int L>
 	bool splitAndPrep(RandomSource& rand, uint32_t qlen,
 	                  uint32_t qualLim, int seedLen,
 	                  bool qualOrder,
@@ -1513,7 +1615,7 @@ public:
 			push(newbr);
 			assert(newbr == front());
 		}
-		prep(ep, ebwt);
+		prep<L>(ep, ebwt);
 		return true;
 	}
 
@@ -1545,9 +1647,10 @@ protected:
 	/**
 	 * Prep the next branch to be extended in advanceBranch().
 	 */
+	template<int L>
 	void prep(const EbwtParams& ep, const uint8_t* ebwt) {
 		if(!branchQ_.empty()) {
-			branchQ_.front()->prep(ep, ebwt);
+			branchQ_.front()->prep<L>(ep, ebwt);
 		}
 	}
 
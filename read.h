@@ -27,6 +27,7 @@
 #include "ds.h"
 #include "filebuf.h"
 #include "hit_set.h"
+#include "input_block.h"
 #include "sstring.h"
 #include "util.h"
 
@@ -52,6 +53,7 @@ struct Read {
 		patid = 0;
 		trimmed5 = trimmed3 = 0;
 		readOrigBuf.clear();
+		orig.clear();
 		patFw.clear();
 		patRc.clear();
 		qual.clear();
@@ -254,8 +256,40 @@ struct Read {
 	BTDnaString patRcRev;
 	BTString    qualRev;
 
+	/**
+	 * Return the exact input text that defined the read: the slice of
+	 * an input block the light parser left it, or else readOrigBuf.
+	 */
+	const char *origBuf() const {
+		return orig.blk != NULL ? orig.buf : readOrigBuf.buf();
+	}
+
+	size_t origLen() const {
+		return orig.blk != NULL ? orig.len : readOrigBuf.length();
+	}
+
+	bool origEmpty() const { return origLen() == 0; }
+
+	/**
+	 * Copy the slice, if any, into readOrigBuf so it can be added to.
+	 */
+	void origToBuf() {
+		if(orig.blk != NULL) {
+			readOrigBuf.install(orig.buf, orig.len);
+			orig.clear();
+		}
+	}
+
+	/**
+	 * Write the input text that defined the read to 'os'.
+	 */
+	void writeOrig(std::ostream& os) const {
+		os.write(origBuf(), origLen());
+	}
+
 	// For remembering the exact input text used to define a read
 	TBuf readOrigBuf;
+	InputSlice orig;    // or where it lies in an input block
 
 	BTString name;      // read name
 	TReadId  rdid;      // 0-based id based on pair's offset in read file(s)
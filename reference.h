@@ -6,6 +6,7 @@
 #include "btypes.h"
 #include "ds.h"
 #include "endian_swap.h"
+#include "hugepages.h"
 #include "mm.h"
 #include "ref_read.h"
 #include "sequence_io.h"
@@ -48,13 +49,15 @@ public:
 	                 bool useShmem,
 	                 bool mmSweep,
 	                 bool verbose,
-	                 bool startVerbose) :
+	                 bool startVerbose,
+	                 bool hugePages = false) :
 	buf_(NULL),
 	sanityBuf_(NULL),
 	loaded_(true),
 	sanity_(sanity),
 	useMm_(useMm),
 	useShmem_(useShmem),
+	hugePages_(hugePages),
 	verbose_(verbose)
 	{
 		string s3 = in + ".3." + gEbwt_ext;
@@ -94,6 +97,7 @@ public:
 				cerr << "Error: Could not memory-map the index file " << s4.c_str() << endl;
 				throw 1;
 			}
+			if(hugePages_) hugeAdvise(mmFile, sbuf.st_size);
 			if(mmSweep) {
 				TIndexOff sum = 0;
 				for(off_t i = 0; i < sbuf.st_size; i += 1024) {
@@ -248,7 +252,8 @@ public:
 			if(!useShmem_) {
 				// Allocate a buffer to hold the reference string
 				try {
-					buf_ = new uint8_t[cumsz >> 2];
+					buf_ = hugePages_ ? hugeAlloc(cumsz >> 2, true)
+					                  : new uint8_t[cumsz >> 2];
 					if(buf_ == NULL) throw std::bad_alloc();
 				} catch(std::bad_alloc& e) {
 					cerr << "Error: Ran out of memory allocating space for the bitpacked reference.  Please" << endl
@@ -258,7 +263,7 @@ public:
 			} else {
 				shmemLeader = ALLOC_SHARED_U8(
 					(s4 + "[ref]"), (cumsz >> 2), &buf_,
-					"ref", (verbose_ || startVerbose));
+					"ref", (verbose_ || startVerbose), hugePages_);
 			}
 			if(shmemLeader) {
 				// Open the bitpair-encoded reference file
@@ -288,6 +293,10 @@ public:
 				if(useShmem_) WAIT_SHARED(buf_, (cumsz >> 2));
 			}
 		}
+		if(hugePages_) {
+			cerr << "Reference " << s4 << ":" << endl
+			     << "  ref[] backed by " << pageBacking(buf_) << endl;
+		}
 
 		// Populate byteToU32_
 		bool big = currentlyBigEndian();
@@ -370,7 +379,10 @@ public:
 	}
 
 	~BitPairReference() {
-		if(buf_ != NULL && !useMm_ && !useShmem_) delete[] buf_;
+		if(buf_ != NULL && !useMm_ && !useShmem_) {
+			if(hugePages_) hugeFree(buf_);
+			else delete[] buf_;
+		}
 		if(sanityBuf_ != NULL) delete[] sanityBuf_;
 	}
 
@@ -637,6 +649,113 @@ public:
 		return (int)offset;
 	}
 
+	/**
+	 * Return the 32 characters starting at offset 'off' into the
+	 * unambiguous stretches of all the references, concatenated in
+	 * order; i.e., into the joined text the Ebwt was built from.  Two
+	 * bits per character, first character in the least significant
+	 * bits.  Characters past the end are unspecified.
+	 */
+	uint64_t getJoinedWord(TIndexOffU off) const {
+		assert_lt(off, bufSz_);
+		const TIndexOffU by = off >> 2;
+		const int shift = (int)(off & 3) << 1;
+		uint64_t w = 0;
+		if(by + 9 <= bufAllocSz_) {
+			for(int i = 0; i < 8; i++) {
+				w |= ((uint64_t)buf_[by + i] << (i << 3));
+			}
+			if(shift > 0) {
+				w = (w >> shift) | ((uint64_t)buf_[by + 8] << (64 - shift));
+			}
+		} else {
+			for(int i = 0; i < 9 && by + i < bufAllocSz_; i++) {
+				const uint64_t b = buf_[by + i];
+				const int s = (i << 3) - shift;
+				w |= (s >= 0 ? (s < 64 ? b << s : 0) : b >> -s);
+			}
+		}
+		return w;
+	}
+
+	/// Return the length of the joined text getJoinedWord() reads
+	TIndexOffU joinedLen() const {
+		return bufSz_;
+	}
+
+	/**
+	 * Load a stretch of the reference string as three bit planes:
+	 * bit 'pad'+i of 'lo' and 'hi' holds the low and high bit of
+	 * character i, and the same bit of 'ns' is set iff character i is
+	 * ambiguous (its 'lo' and 'hi' bits are then clear).  Bits outside
+	 * [pad, pad+count) are left as they were; the caller clears them.
+	 * Unambiguous stretches are copied 32 characters at a time.
+	 */
+	void getStretchPlanes(uint64_t *lo,
+	                      uint64_t *hi,
+	                      uint64_t *ns,
+	                      size_t pad,
+	                      size_t tidx,
+	                      size_t toff,
+	                      size_t count) const
+	{
+		uint64_t reci = refRecOffs_[tidx];   // first record for target reference sequence
+		uint64_t recf = refRecOffs_[tidx+1]; // last record (exclusive) for target seq
+		assert_gt(recf, reci);
+		uint64_t cur = pad;
+		uint64_t bufOff = refOffs_[tidx];
+		uint64_t off = 0;
+		uint64_t i = reci;
+		if(recf > reci + 16) {
+			// Binary search for the last record starting at or
+			// before toff, as getStretch() does
+			uint64_t left = reci, right = recf;
+			while(left < right-1) {
+				uint64_t mid = left + ((right - left) >> 1);
+				if(cumRefOff_[mid] <= toff) left = mid;
+				else                        right = mid;
+			}
+			off = cumRefOff_[left];
+			bufOff = cumUnambig_[left];
+			i = left;
+		}
+		// For all records pertaining to the target reference sequence...
+		for(; i < recf && count > 0; i++) {
+			assert_geq(toff, off);
+			off += recs_[i].off; // skip Ns at beginning of stretch
+			if(toff < off) {
+				size_t cpycnt = (size_t)min<uint64_t>(off - toff, count);
+				setPlaneBits(ns, cur, cpycnt);
+				cur += cpycnt;
+				toff += cpycnt;
+				count -= cpycnt;
+				if(count == 0) break;
+			}
+			assert_geq(toff, off);
+			if(toff < off + recs_[i].len) {
+				bufOff += toff - off; // move bufOff pointer forward
+			} else {
+				bufOff += recs_[i].len;
+			}
+			off += recs_[i].len;
+			while(toff < off && count > 0) {
+				const size_t n = (size_t)min<uint64_t>(min<uint64_t>(off - toff, count), 32);
+				assert_lt(bufOff, bufSz_);
+				const uint64_t w = getJoinedWord((TIndexOffU)bufOff);
+				const uint64_t mask = (n == 32) ? 0xffffffffllu : ((1llu << n) - 1);
+				orPlaneBits(lo, cur, n, evenBits(w) & mask);
+				orPlaneBits(hi, cur, n, evenBits(w >> 1) & mask);
+				cur += n;
+				toff += n;
+				bufOff += n;
+				count -= n;
+			}
+		}
+		// In any chars are left after scanning all the records,
+		// they must be ambiguous
+		if(count > 0) setPlaneBits(ns, cur, count);
+	}
+
 	/// Return the number of reference sequences.
 	TIndexOffU numRefs() const {
 		return nrefs_;
@@ -695,6 +814,35 @@ public:
 
 protected:
 
+	/// Gather the 32 even-numbered bits of w into the low 32 bits
+	static uint64_t evenBits(uint64_t w) {
+		w &= 0x5555555555555555llu;
+		w = (w | (w >> 1))  & 0x3333333333333333llu;
+		w = (w | (w >> 2))  & 0x0f0f0f0f0f0f0f0fllu;
+		w = (w | (w >> 4))  & 0x00ff00ff00ff00ffllu;
+		w = (w | (w >> 8))  & 0x0000ffff0000ffffllu;
+		w = (w | (w >> 16)) & 0x00000000ffffffffllu;
+		return w;
+	}
+
+	/// OR the n <= 32 low bits of v into bit plane p starting at bit i
+	static void orPlaneBits(uint64_t *p, uint64_t i, size_t n, uint64_t v) {
+		const int sh = (int)(i & 63);
+		p[i >> 6] |= (v << sh);
+		if(sh + n > 64) p[(i >> 6) + 1] |= (v >> (64 - sh));
+	}
+
+	/// Set bits [i, i+n) of bit plane p
+	static void setPlaneBits(uint64_t *p, uint64_t i, size_t n) {
+		while(n > 0) {
+			const int sh = (int)(i & 63);
+			const size_t m = min<size_t>(n, 64 - sh);
+			p[i >> 6] |= ((m == 64) ? ~0llu : (((1llu << m) - 1) << sh));
+			i += m;
+			n -= m;
+		}
+	}
+
 	uint32_t byteToU32_[256];
 
 	EList<RefRecord> recs_;       /// records describing unambiguous stretches
@@ -717,6 +865,7 @@ protected:
 	bool     sanity_;   /// do sanity checking
 	bool     useMm_;    /// load the reference as a memory-mapped file
 	bool     useShmem_; /// load the reference into shared memory
+	bool     hugePages_; /// back the reference with huge pages
 	bool     verbose_;
 };
 
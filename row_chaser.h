@@ -75,14 +75,15 @@ public:
 		row_ = row;
 		qlen_ = qlen;
 		ASSERT_ONLY(sideloc_.invalidate());
+		TIndexOffU idx;
 		if(row_ == ebwt_->_zOff) {
 			// We arrived at the extreme left-hand end of the reference
 			off_ = 0;
 			done = true;
 			return;
-		} else if((row_ & eh_->_offMask) == row_) {
+		} else if(ebwt_->sampledRow(row_, idx)) {
 			// We arrived at a marked row
-			off_ = ebwt_->_offs[row_ >> eh_->_offRate];
+			off_ = ebwt_->offAt(idx);
 			done = true;
 			return;
 		}
@@ -109,13 +110,14 @@ public:
 			assert_neq(newrow, row_);
 			// Update row_ field
 			row_ = newrow;
+			TIndexOffU idx;
 			if(row_ == ebwt_->_zOff) {
 				// We arrived at the extreme left-hand end of the reference
 				off_ = jumps_;
 				done = true;
-			} else if((row_ & eh_->_offMask) == row_) {
+			} else if(ebwt_->sampledRow(row_, idx)) {
 				// We arrived at a marked row
-				off_ = ebwt_->_offs[row_ >> eh_->_offRate] + jumps_;
+				off_ = ebwt_->offAt(idx) + jumps_;
 				done = true;
 			}
 			prep();
@@ -133,6 +135,7 @@ public:
 			assert(!sideloc_.valid());
 			assert_leq(row_, eh_->_len);
 			sideloc_.initFromRow(row_, *eh_, (const uint8_t*)ebwt_->_ebwt);
+			ebwt_->prefetchSampled(row_);
 			assert(sideloc_.valid());
 		}
 		prepped_ = true;
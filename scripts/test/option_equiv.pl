@@ -0,0 +1,376 @@
+#!/usr/bin/perl -w
+
+##
+# option_equiv.pl
+#
+# Check that options which only change how bowtie and bowtie-build go
+# about their work leave the alignments unchanged.  Each case runs
+# bowtie with and without the option and compares the output.
+#
+
+use strict;
+use warnings;
+use Compress::Raw::Zlib;
+use IO::Compress::Gzip qw(gzip $GzipError);
+
+my $bowtie = "./bowtie";
+if(system("$bowtie --version > /dev/null") != 0) {
+	$bowtie = `which bowtie`;
+	chomp($bowtie);
+	if(system("$bowtie --version > /dev/null") != 0) {
+		die "Could not find bowtie in current directory or in PATH\n";
+	}
+}
+
+my $bowtie_build = "./bowtie-build";
+if(system("$bowtie_build --version > /dev/null") != 0) {
+	$bowtie_build = `which bowtie-build`;
+	chomp($bowtie_build);
+	if(system("$bowtie_build --version > /dev/null") != 0) {
+		die "Could not find bowtie-build in current directory or in PATH\n";
+	}
+}
+
+my $idx   = "indexes/e_coli";
+my $reads = "reads/e_coli_10000snp.fq";
+my $ref   = "genomes/NC_008253.fna";
+
+##
+# Run bowtie with the given arguments and return its output lines,
+# less any SAM @PG line.
+#
+sub btrun {
+	my ($args) = @_;
+	my $cmd = "$bowtie $args";
+	print "$cmd\n";
+	my @lines = ();
+	open BTIE, "$cmd 2>/dev/null |" || die "Could not open pipe '$cmd |'\n";
+	while(<BTIE>) {
+		# The SAM @PG line holds the command line
+		next if /^\@PG\t/;
+		push @lines, $_;
+	}
+	close(BTIE);
+	$? == 0 || die "'$cmd' exited with status $?\n";
+	return @lines;
+}
+
+##
+# Die unless the two lists of output lines are identical.
+#
+sub same {
+	my ($desc, $a, $b) = @_;
+	my $n = scalar(@$a) > scalar(@$b) ? scalar(@$a) : scalar(@$b);
+	for(my $i = 0; $i < $n; $i++) {
+		my $la = defined($a->[$i]) ? $a->[$i] : "(none)\n";
+		my $lb = defined($b->[$i]) ? $b->[$i] : "(none)\n";
+		if($la ne $lb) {
+			die "FAILED: $desc; line ".($i+1)." differs:\n  $la  $lb";
+		}
+	}
+	scalar(@$a) > 0 || die "FAILED: $desc; no output\n";
+	print "PASSED: $desc\n";
+}
+
+##
+# Make sure $ref names a FASTA file of the E. coli genome.  If the
+# genome isn't in genomes/, take it from the E. coli index that comes
+# with bowtie.
+#
+sub getRef {
+	return if -f $ref;
+	$ref = "e_coli_equiv.fa";
+	my $bowtie_inspect = $bowtie_build;
+	$bowtie_inspect =~ s/bowtie-build$/bowtie-inspect/;
+	system("$bowtie_inspect $idx > $ref") && die "Could not extract $ref from $idx\n";
+}
+
+##
+# Build an index of the E. coli genome with the given bowtie-build
+# options.
+#
+sub build {
+	my ($name, $args) = @_;
+	getRef();
+	print STDERR "Making e_coli index $name ($args)\n";
+	system("$bowtie_build -q $args $ref $name > /dev/null") && die;
+}
+
+##
+# Alignment modes used to compare an index built with some
+# bowtie-build option against one built without it.
+#
+my @idxArgs = (
+	"",
+	"-v 2 -k 3",
+	"-v 1 -a",
+	"-n 3 --best -k 2"
+);
+
+my %built = ();
+
+##
+# Build index $name with bowtie-build options $bargs and check that
+# bowtie, given options $args, aligns with it just as it does with an
+# index built without them.
+#
+sub sameAsDefaultIdx {
+	my ($name, $bargs, $args) = @_;
+	for my $b (["e_coli_equiv", ""], [$name, $bargs]) {
+		next if $built{$b->[0]};
+		build(@$b);
+		$built{$b->[0]} = 1;
+	}
+	for my $a (@idxArgs) {
+		my @a = btrun("$a e_coli_equiv $reads");
+		my @b = btrun("$a $args $name $reads");
+		my $with = ($args ne "") ? " with $args" : "";
+		same("'$a' on $bargs index$with vs. default index", \@a, \@b);
+	}
+}
+
+##
+# Check that adding bowtie option $opt leaves the output of aligning
+# $in against the bundled E. coli index unchanged in each of the given
+# alignment modes.
+#
+sub sameWith {
+	my ($opt, $in, @modes) = @_;
+	for my $m (@modes) {
+		my @a = btrun("$m $idx $in");
+		my @b = btrun("$m $opt $idx $in");
+		same("'$m' on $in with $opt vs. without", \@a, \@b);
+	}
+}
+
+##
+# Write $in to $out compressed in BGZF format, i.e. as a series of
+# gzip members of at most 64 KB, each recording its size in a "BC"
+# extra field.
+#
+sub bgzf {
+	my ($in, $out) = @_;
+	open(IN, $in) || die "Could not open $in\n";
+	binmode(IN);
+	open(OUT, ">$out") || die "Could not open $out for writing\n";
+	binmode(OUT);
+	my $buf;
+	while(read(IN, $buf, 60000)) {
+		my ($d, $st) = Compress::Raw::Zlib::Deflate->new(
+			-WindowBits => -MAX_WBITS, -AppendOutput => 1);
+		$st == Z_OK || die "Could not start deflating\n";
+		my $cdata = "";
+		$d->deflate($buf, $cdata) == Z_OK || die "Could not deflate\n";
+		$d->flush($cdata) == Z_OK || die "Could not deflate\n";
+		my $bsize = 18 + length($cdata) + 8;
+		print OUT pack("CCCCVCCv", 31, 139, 8, 4, 0, 0, 255, 6);
+		print OUT "BC".pack("vv", 2, $bsize - 1);
+		print OUT $cdata.pack("VV", crc32($buf), length($buf));
+	}
+	# Empty end-of-file block
+	print OUT pack("C*", 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67,
+	               2, 0, 27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	close(IN);
+	close(OUT);
+}
+
+##
+# Strip the column that counts other alignments from a line of
+# default bowtie output, leaving just what identifies the alignment.
+#
+sub alnKey {
+	my ($l) = @_;
+	my @fs = split(/\t/, $l, -1);
+	splice(@fs, 6, 1);
+	return join("\t", @fs);
+}
+
+##
+# With --mms-bound, -v 2 prunes branches of the backtracking search
+# that can't finish within the mismatch budget.  That changes the
+# pseudo-random choices made along the way, so rather than comparing
+# against plain -v 2, check against the stateful aligner, which
+# doesn't prune: -a must find exactly the same alignments, and -v 2
+# must align the same reads, each to one of the alignments -a finds.
+#
+{
+	my @pruned = sort(btrun("-v 2 -a --mms-bound $idx $reads"));
+	my @ref    = sort(btrun("-v 2 -a --stateful $idx $reads"));
+	same("-v 2 -a --mms-bound vs. -v 2 -a --stateful", \@pruned, \@ref);
+	my %valid = map { alnKey($_) => 1 } @ref;
+	my %refReads = map { (split(/\t/))[0] => 1 } btrun("-v 2 --stateful $idx $reads");
+	my %reads = ();
+	for my $l (btrun("-v 2 --mms-bound $idx $reads")) {
+		defined($valid{alnKey($l)}) ||
+			die "FAILED: -v 2 --mms-bound reported an alignment -a didn't find:\n  $l";
+		$reads{(split(/\t/, $l))[0]} = 1;
+	}
+	my @a = sort(keys %reads);
+	my @b = sort(keys %refReads);
+	@a = map { "$_\n" } @a;
+	@b = map { "$_\n" } @b;
+	same("reads aligned by -v 2 --mms-bound vs. -v 2 --stateful", \@a, \@b);
+}
+
+##
+# --pigeonhole only answers reads with at most one alignment and leaves
+# the rest to -v backtracking, so output must be unchanged in every
+# reporting mode.
+#
+for my $v (2, 3) {
+	for my $args ("", "-k 3", "-a", "-m 1", "-m 2", "--best", "-M 1",
+	              "--best --strata -a", "-S -p 3 --reorder")
+	{
+		my @a = btrun("-v $v $args $idx $reads");
+		my @b = btrun("-v $v $args --pigeonhole $idx $reads");
+		same("-v $v $args vs. -v $v $args --pigeonhole", \@a, \@b);
+	}
+}
+
+# An index with one side per cache line (--line-sides)
+sameAsDefaultIdx("e_coli_equiv_ls", "--line-sides", "");
+
+# A sparse lookup table for initial 14-mers (--kftab)
+sameAsDefaultIdx("e_coli_equiv_kf", "--kftab 14", "");
+
+# A page-aligned index (--paged), read normally and used in place from
+# a mapping
+sameAsDefaultIdx("e_coli_equiv_pg", "--paged", "");
+sameAsDefaultIdx("e_coli_equiv_pg", "--paged", "--mm");
+
+# Suffix array sampled at reference offsets rather than rows
+# (--text-sample), with the sample read normally and bit-packed
+sameAsDefaultIdx("e_coli_equiv_ts", "--text-sample", "");
+sameAsDefaultIdx("e_coli_equiv_ts", "--text-sample", "--packed-offs");
+
+# Bit-packed suffix-array sample (--packed-offs)
+sameWith("--packed-offs", $reads, @idxArgs);
+
+# Aligning each distinct read once (--dedup).  Copies get the first
+# copy's alignments, so with every read followed by a copy of itself,
+# each read's alignments should appear twice in a row, just as the
+# read alone gets them.  --dedup stops pseudo-random choices depending
+# on read names, so those runs all use --dedup; -a, which makes no
+# choices, is checked against a run without it.
+{
+	my $dup = "e_coli_equiv_dup.fq";
+	open(IN, $reads) || die "Could not open $reads\n";
+	open(OUT, ">$dup") || die "Could not open $dup for writing\n";
+	while(my $l = <IN>) {
+		my $rec = $l.<IN>.<IN>.<IN>;
+		print OUT $rec.$rec;
+	}
+	close(IN);
+	close(OUT);
+	for my $m ("-v 2", "-v 2 -k 3", "-n 2 --best") {
+		my @a = ();
+		my @grp = ();
+		my $last = "";
+		for my $l (btrun("$m --dedup $idx $reads")) {
+			my $name = (split(/\t/, $l))[0];
+			if($name ne $last) {
+				push @a, @grp, @grp;
+				@grp = ();
+			}
+			push @grp, $l;
+			$last = $name;
+		}
+		push @a, @grp, @grp;
+		my @b = btrun("$m --dedup $idx $dup");
+		same("'$m --dedup' on copied reads vs. on reads alone", \@a, \@b);
+	}
+	my @a = sort(btrun("-v 2 -a $idx $dup"));
+	my @b = sort(btrun("-v 2 -a --dedup $idx $dup"));
+	same("'-v 2 -a' with --dedup vs. without", \@a, \@b);
+}
+
+# Best-first frame memory that starts small and grows in slabs up to
+# --chunkmbs-max.  With -l 20 -e 300 every read needs more than 1 MB.
+for my $opt ("--chunkmbs 1", "--chunkmbs 1 --chunkmbs-max 0") {
+	sameWith($opt, $reads, "-n 3 -l 20 -e 300 --best", "-v 3 -a");
+}
+
+# Decompressing gzipped reads on threads of their own
+# (--inflate-threads).  Ordinary gzip is decompressed by one thread;
+# BGZF blocks are decompressed in parallel.
+{
+	my $gz = "e_coli_equiv.fq.gz";
+	gzip($reads => $gz) || die "Could not write $gz: $GzipError\n";
+	my $bgz = "e_coli_equiv_bgzf.fq.gz";
+	bgzf($reads, $bgz);
+	for my $m ("-v 2", "-v 2 -S -p 3 --reorder") {
+		my @a = btrun("$m $idx $reads");
+		for my $in ($gz, $bgz) {
+			for my $opt ("", "--inflate-threads 1", "--inflate-threads 3") {
+				my @b = btrun("$m $opt $idx $in");
+				same("'$m' on $in with '$opt' vs. uncompressed reads", \@a, \@b);
+			}
+		}
+	}
+}
+
+# Parsing reads ahead on a thread of their own (--reader-thread)
+sameWith("--reader-thread", $reads,
+         "-v 2", "-v 2 -S -p 3 --reorder", "-n 2 --best -S -p 2 --reorder");
+
+# Parsing uncompressed read files straight out of a mapping
+# (--mm-reads).  The mapping is handed out 4 MB at a time, so also try
+# a file 6 times the size of the FASTQ reads, which has a record
+# running from one stretch into the next.
+{
+	my $big = "e_coli_equiv_big.fq";
+	open(IN, $reads) || die "Could not open $reads\n";
+	my $fq = join("", <IN>);
+	close(IN);
+	open(OUT, ">$big") || die "Could not open $big for writing\n";
+	print OUT $fq x 6;
+	close(OUT);
+	my $fa = $reads;
+	$fa =~ s/\.fq$/.fa/;
+	for my $in ($reads, "-f $fa", $big, "$reads,$big") {
+		sameWith("--mm-reads", $in, "-v 2", "-v 2 -S -p 3 --reorder");
+	}
+	sameWith("--mm-reads --reader-thread", $big, "-v 2 -S -p 3 --reorder");
+}
+
+# Sharing resolved offsets of repetitive ranges between threads and
+# reads (--cachesz).  The cache is only consulted in --best and -M
+# modes for ranges of more than 5 rows, so align 36-mers that occur at
+# least 6 times in the genome, 3 copies of each.
+{
+	getRef();
+	open(IN, $ref) || die "Could not open $ref\n";
+	my $seq = "";
+	while(my $l = <IN>) {
+		next if $l =~ /^>/;
+		chomp($l);
+		$seq .= $l;
+	}
+	close(IN);
+	my $tile = "e_coli_equiv_tile.fa";
+	open(OUT, ">$tile") || die "Could not open $tile for writing\n";
+	for(my $i = 0; $i + 36 <= length($seq); $i += 20) {
+		print OUT ">t$i\n".substr($seq, $i, 36)."\n";
+	}
+	close(OUT);
+	my %n = ();
+	$n{(split(/\t/, $_))[0]}++ for btrun("-f -v 0 -k 6 $idx $tile");
+	my $rep = "e_coli_equiv_rep.fa";
+	open(OUT, ">$rep") || die "Could not open $rep for writing\n";
+	for my $c (1..3) {
+		for my $t (sort keys %n) {
+			next if $n{$t} < 6;
+			my $i = substr($t, 1);
+			print OUT ">${t}_$c\n".substr($seq, $i, 36)."\n";
+		}
+	}
+	close(OUT);
+	for my $opt ("--cachesz 1", "--cachesz 64") {
+		sameWith($opt, "-f $rep",
+		         "--best -k 10", "-v 2 --best -a", "-M 1", "-v 1 -M 2",
+		         "-v 2 --best -a -S -p 3 --reorder", "-M 1 -S -p 3 --reorder");
+	}
+}
+
+unlink(glob("e_coli_equiv*"));
+print "ALL PASSED\n";
@@ -14,12 +14,15 @@
 		throw 1;
 	}
 
+	// Exact ranges for both strands were found by the interleaved
+	// search
+	int exi = exactBatchFor(*patsrc, ebwtFw, exb, !nofw, !norc);
 	if(!nofw) {
 		// First, try exact hits for the forward-oriented read
 		params.setFw(true);
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, s, s, s, s);
-		if(bt.backtrack()) {
+		if(bt.reportExactRange(exb.top(exi, true), exb.bot(exi, true))) {
 			DONEMASK_SET(patid);
 			continue;
 		}
@@ -31,7 +34,7 @@
 		// Next, try exact hits for the reverse-complement read
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, s, s, s, s);
-		if(bt.backtrack()) {
+		if(bt.reportExactRange(exb.top(exi, false), exb.bot(exi, false))) {
 			DONEMASK_SET(patid);
 			continue;
 		}
@@ -44,11 +47,16 @@
 	}
 	bt.setReportExacts(false);
 
+	// The 5' halves were already matched on the way to the exact
+	// ranges; start backtracking from there when we can
+	TIndexOffU htop = 0, hbot = 0;
 	if(!norc) {
 		// Next, try hits with one mismatch on the 3' end for the reverse-complement read
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, s5, s, s, s); // 1 mismatch allowed in 3' half
-		if(bt.backtrack()) {
+		bool done = exb.halfRange(exi, false, s5, htop, hbot) ?
+			bt.backtrackFromRange(s5, htop, hbot) : bt.backtrack();
+		if(done) {
 			DONEMASK_SET(patid);
 			continue;
 		}
@@ -59,7 +67,9 @@
 		// Next, try hits with one mismatch on the 3' end for the reverse-complement read
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, s5, s, s, s); // 1 mismatch allowed in 3' half
-		if(bt.backtrack()) {
+		bool done = exb.halfRange(exi, true, s5, htop, hbot) ?
+			bt.backtrackFromRange(s5, htop, hbot) : bt.backtrack();
+		if(done) {
 			DONEMASK_SET(patid);
 			continue;
 		}
@@ -18,13 +18,17 @@
 		cerr << "Error: Read (" << name << ") is less than 4 characters long" << endl;
 		throw 1;
 	}
+	// The interleaved search finds the forward pattern's exact range
+	// and, for both strands, the ranges of the halves that the
+	// forward-index backtracks below and in phase 3 keep unrevisitable
+	int exi = exactBatchFor(*patsrc, ebwtFw, exb, !nofw, !norc, true);
 	if(!nofw) {
 		// Do an exact-match search on the forward pattern, just in
 		// case we can pick it off early here
 		params.setFw(true);
 		btr1.setQuery(patsrc->bufa());
 		btr1.setOffs(0, 0, plen, plen, plen, plen);
-		if(btr1.backtrack()) {
+		if(btr1.reportExactRange(exb.top(exi, true), exb.bot(exi, true))) {
 			DONEMASK_SET(patid);
 			continue;
 		}
@@ -35,7 +39,10 @@
 		// Set up the revisitability of the halves
 		btr1.setQuery(patsrc->bufa());
 		btr1.setOffs(0, 0, s5, s5, two ? s : s5, s);
-		if(btr1.backtrack()) {
+		TIndexOffU htop = 0, hbot = 0;
+		bool done = exb.halfRange(exi, false, s5, htop, hbot) ?
+			btr1.backtrackFromRange(s5, htop, hbot) : btr1.backtrack();
+		if(done) {
 			DONEMASK_SET(patid);
 			continue;
 		}
@@ -16,7 +16,11 @@
 					s3,
 					two? s : s3,
 					s);
-		bool done = bt3.backtrack();
+		// Start from the 3' half's range if phase 1 found it
+		int exi = exactBatchFor(*patsrc, ebwtFw, exb, !nofw, !norc, true);
+		TIndexOffU htop = 0, hbot = 0;
+		bool done = exb.halfRange(exi, true, s3, htop, hbot) ?
+			bt3.backtrackFromRange(s3, htop, hbot) : bt3.backtrack();
 		if(done) continue;
 		// no more 1-mismatch hits are possible after this point
 		if(sink->finishedWithStratum(1)) {
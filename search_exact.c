@@ -6,6 +6,8 @@
  */
 {
 	uint32_t plen = (uint32_t)patsrc->bufa().patFw.length();
+	// Ranges for both strands were found by the interleaved search
+	int exi = exactBatchFor(*patsrc, ebwt, exb, !nofw, !norc);
 	if(!nofw) {
 		// Match against forward strand
 		params.setFw(true);
@@ -13,7 +15,7 @@
 		bt.setOffs(0, 0, plen, plen, plen, plen);
 		// If we matched on the forward strand, ignore the reverse-
 		// complement strand
-		if(bt.backtrack()) {
+		if(bt.reportExactRange(exb.top(exi, true), exb.bot(exi, true))) {
 			continue;
 		}
 	}
@@ -22,6 +24,6 @@
 		params.setFw(false);
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, plen, plen, plen, plen);
-		bt.backtrack();
+		bt.reportExactRange(exb.top(exi, false), exb.bot(exi, false));
 	}
 }
@@ -16,6 +16,8 @@ extern bool showSeed;
 extern bool quiet;
 extern bool gAllowMateContainment;
 extern bool noUnal;
+extern int  inflateThreads;
+extern bool mmReads;
 
 extern MUTEX_T gLock;
 
@@ -36,13 +36,16 @@ extern void waitSharedMem(void *mem, size_t len);
 
 /**
  * Tries to allocate a shared-memory chunk for a given file of a given size.
+ * If hugePages is set, the chunk is backed by huge pages if the system
+ * has enough of them reserved, and by regular pages otherwise.
  */
 template <typename T>
 bool allocSharedMem(std::string fname,
                     size_t len,
                     T ** dst,
                     const char *memName,
-                    bool verbose)
+                    bool verbose,
+                    bool hugePages = false)
 {
 	using namespace std;
 	int shmid = -1;
@@ -58,7 +61,17 @@ bool allocSharedMem(std::string fname,
 	T *ptr = NULL;
 	while(true) {
 		// Create the shrared-memory block
-		if((shmid = shmget(key, shmemLen, IPC_CREAT | 0666)) < 0) {
+		shmid = -1;
+#ifdef SHM_HUGETLB
+		if(hugePages) {
+			shmid = shmget(key, shmemLen, IPC_CREAT | SHM_HUGETLB | 0666);
+			if(shmid < 0 && verbose) {
+				cerr << "Could not get huge pages for shared area " << memName
+				     << " (errno " << errno << "); using regular pages" << endl;
+			}
+		}
+#endif
+		if(shmid < 0 && (shmid = shmget(key, shmemLen, IPC_CREAT | 0666)) < 0) {
 			if(errno == ENOMEM) {
 				cerr << "Out of memory allocating shared area " << memName << endl;
 			} else if(errno == EACCES) {